@@ -1,13 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "cmdline.h"
 #include "memory.h"
 #include "cache.h"
+#include "timing.h"
 
 
-/* This is the number of nodes to have in the graph. */
+/* This is the number of nodes to have in the graph, if -n doesn't say. */
 #define NUM_NODES 400
 
 /* This is a value between 0 and 100 indicating the percent of edges
@@ -24,57 +26,142 @@
  */
 #define SEED 54321098
 
+/* The tile size of the blocked variant, which is also the size at which the
+ * recursive variant stops dividing, if -t doesn't say.  Three 16x16 tiles
+ * of ints take 3KB, so they fit in most L1 caches.
+ */
+#define DEFAULT_TILE 16
+
+/* The ways of computing the shortest paths, selected with -a. */
+#define ALGORITHM_NAIVE 0
+#define ALGORITHM_BLOCKED 1
+#define ALGORITHM_RECURSIVE 2
+#define NUM_ALGORITHMS 3
+
+static const char *algorithm_names[NUM_ALGORITHMS] = {
+    "naive", "blocked", "recursive"
+};
+
 
 typedef struct {
     int num_nodes;
 
+    /* The tile size of the blocked and recursive variants. */
+    int tile;
+
+    /* The simulated memory holding the weight matrix followed by the path
+     * matrix, or NULL if the matrices are the native arrays below.
+     */
     membase_t *p_mem;
+
+    int *weights;
+    int *paths;
 } shortest_path_info;
 
 
-int get_weight(shortest_path_info *info, int row, int col) {
+/* Local functions used by the shortest-paths test. */
+
+void generate_graph(shortest_path_info *info);
+void update_tile(shortest_path_info *info, int i0, int j0, int k0, int size);
+void compute_naive(shortest_path_info *info);
+void compute_blocked(shortest_path_info *info);
+void compute_recursive(shortest_path_info *info, int i0, int j0, int k0,
+                       int size);
+void compute_shortest_paths(shortest_path_info *info, int algorithm);
+void init_native_info(shortest_path_info *info, int num_nodes, int tile);
+void free_native_info(shortest_path_info *info);
+int check_results(shortest_path_info *info, shortest_path_info *expected);
+void time_native_runs(int num_nodes, int tile);
+
+
+static inline int get_weight(shortest_path_info *info, int row, int col) {
+    if (info->p_mem == NULL)
+        return info->weights[row * info->num_nodes + col];
     return read_int(info->p_mem, row * info->num_nodes + col);
 }
 
 
-void set_weight(shortest_path_info *info, int row, int col, int weight) {
-    write_int(info->p_mem, row * info->num_nodes + col, weight);
+static inline void set_weight(shortest_path_info *info, int row, int col,
+                              int weight) {
+    if (info->p_mem == NULL)
+        info->weights[row * info->num_nodes + col] = weight;
+    else
+        write_int(info->p_mem, row * info->num_nodes + col, weight);
 }
 
 
-int get_path(shortest_path_info *info, int row, int col) {
+static inline int get_path(shortest_path_info *info, int row, int col) {
     int nodes = info->num_nodes;
+
+    if (info->p_mem == NULL)
+        return info->paths[row * nodes + col];
     return read_int(info->p_mem, nodes * nodes + row * nodes + col);
 }
 
 
-void set_path(shortest_path_info *info, int row, int col, int node) {
+static inline void set_path(shortest_path_info *info, int row, int col,
+                            int node) {
     int nodes = info->num_nodes;
-    write_int(info->p_mem, nodes * nodes + row * nodes + col, node);
+
+    if (info->p_mem == NULL)
+        info->paths[row * nodes + col] = node;
+    else
+        write_int(info->p_mem, nodes * nodes + row * nodes + col, node);
+}
+
+
+/* Considers the path from node i to node j through node k, which is the
+ * step that every variant is made of.
+ */
+static inline void relax(shortest_path_info *info, int i, int j, int k) {
+    int weight_ikj = get_weight(info, i, k) + get_weight(info, k, j);
+    int weight_ij = get_weight(info, i, j);
+
+    if (weight_ikj < weight_ij) {
+        set_weight(info, i, j, weight_ikj);
+        set_path(info, i, j, k);
+    }
 }
 
 
-void compute_shortest_paths(shortest_path_info *info) {
+/* Generates the same random graph every time for the same SEED. */
+void generate_graph(shortest_path_info *info) {
+    int i, j;
+
+    srand(SEED);
+
+    for (i = 0; i < info->num_nodes; i++) {
+        for (j = 0; j < info->num_nodes; j++) {
+            if (i != j) {
+                if (rand() % 100 < CONNECTED_PCT)
+                    set_weight(info, i, j, 1 + rand() % 10);
+                else
+                    set_weight(info, i, j, INFINITY);
+            }
+            else {
+                set_weight(info, i, j, 0);
+            }
+        }
+    }
+}
+
+
+/* The naive triple loop, which sweeps both whole matrices for every k.  On
+ * native arrays, that is one tile covering the whole matrices.
+ */
+void compute_naive(shortest_path_info *info) {
     int nodes = info->num_nodes;
     int i, j, k;
 
-    printf(" * Clearing the path-reconstruction state.\n");
-    for (i = 0; i < nodes; i++)
-        for (j = 0; j < nodes; j++)
-            set_path(info, i, j, -1);
+    if (info->p_mem == NULL) {
+        update_tile(info, 0, 0, 0, nodes);
+        return;
+    }
 
-    printf(" * Computing the all-points shortest path results.\n");
     for (k = 0; k < nodes; k++) {
         for (i = 0; i < nodes; i++) {
-            for (j = 0; j < nodes; j++) {
-                int weight_ikj = get_weight(info, i, k) + get_weight(info, k, j);
-                int weight_ij = get_weight(info, i, j);
-
-                if (weight_ikj < weight_ij) {
-                    set_weight(info, i, j, weight_ikj);
-                    set_path(info, i, j, k);
-                }
-            }
+            for (j = 0; j < nodes; j++)
+                relax(info, i, j, k);
         }
         printf(".");
         fflush(stdout);
@@ -83,44 +170,361 @@ void compute_shortest_paths(shortest_path_info *info) {
 }
 
 
+/* Relaxes the paths from rows i0 to i0 + size - 1 to columns j0 to
+ * j0 + size - 1 through nodes k0 to k0 + size - 1, in the same order as the
+ * naive loop, stopping at the edge of the matrices.  Native arrays are
+ * accessed directly, so that native timings measure the loop order rather
+ * than the accessors.
+ */
+void update_tile(shortest_path_info *info, int i0, int j0, int k0, int size) {
+    int nodes = info->num_nodes;
+    int i_end = i0 + size < nodes ? i0 + size : nodes;
+    int j_end = j0 + size < nodes ? j0 + size : nodes;
+    int k_end = k0 + size < nodes ? k0 + size : nodes;
+    int i, j, k;
 
-int main(int argc, const char **argv) {
-    membase_t *p_mem;
+    if (info->p_mem == NULL) {
+        for (k = k0; k < k_end; k++) {
+            const int *row_k = info->weights + k * nodes;
+
+            for (i = i0; i < i_end; i++) {
+                int *row_i = info->weights + i * nodes;
+                int *paths_i = info->paths + i * nodes;
+                int weight_ik = row_i[k];
+
+                /* row_i[k] can't change within the loop, since the weight
+                 * from k to itself is 0.
+                 */
+                for (j = j0; j < j_end; j++) {
+                    int weight_ikj = weight_ik + row_k[j];
+                    if (weight_ikj < row_i[j]) {
+                        row_i[j] = weight_ikj;
+                        paths_i[j] = k;
+                    }
+                }
+            }
+        }
+        return;
+    }
 
-    shortest_path_info info;
-    int i, j;
+    for (k = k0; k < k_end; k++) {
+        for (i = i0; i < i_end; i++) {
+            for (j = j0; j < j_end; j++)
+                relax(info, i, j, k);
+        }
+    }
+}
 
-    /* Set up the simulated memory. */
-    p_mem = make_cached_memory(argc, argv,
-                               2 * NUM_NODES * NUM_NODES * sizeof(int));
 
-    /* Generate a random graph. */
+/* The blocked variant (Venkataraman et al., 2003).  For each band of tile
+ * nodes k, it first updates the tile on the diagonal, which only depends on
+ * itself; then the other tiles in the band's row and column, which depend
+ * on themselves and the diagonal tile; then every other tile, which depends
+ * on the tiles in its row and column of the band.  Each step only touches
+ * three tiles, so they stay in the cache while the band is applied to them.
+ */
+void compute_blocked(shortest_path_info *info) {
+    int nodes = info->num_nodes, tile = info->tile;
+    int kb, ib, jb;
 
-    printf("Generating a random graph containing %d nodes.\n", NUM_NODES);
+    for (kb = 0; kb < nodes; kb += tile) {
+        update_tile(info, kb, kb, kb, tile);
 
-    srand(SEED);
+        for (jb = 0; jb < nodes; jb += tile) {
+            if (jb != kb) {
+                update_tile(info, kb, jb, kb, tile);
+                update_tile(info, jb, kb, kb, tile);
+            }
+        }
 
-    info.num_nodes = NUM_NODES;
-    info.p_mem = p_mem;
+        for (ib = 0; ib < nodes; ib += tile) {
+            if (ib == kb)
+                continue;
+            for (jb = 0; jb < nodes; jb += tile) {
+                if (jb != kb)
+                    update_tile(info, ib, jb, kb, tile);
+            }
+        }
 
-    for (i = 0; i < info.num_nodes; i++) {
-        for (j = 0; j < info.num_nodes; j++) {
-            if (i != j) {
-                if (rand() % 100 < CONNECTED_PCT)
-                    set_weight(&info, i, j, 1 + rand() % 10);
-                else
-                    set_weight(&info, i, j, INFINITY);
+        if (info->p_mem != NULL) {
+            printf(".");
+            fflush(stdout);
+        }
+    }
+    if (info->p_mem != NULL)
+        printf("\n");
+}
+
+
+/* The cache-oblivious recursive variant (Park, Penner and Prasanna, 2004).
+ * It relaxes the paths from the size rows starting at i0 to the size
+ * columns starting at j0 through the size nodes starting at k0, by halving
+ * all three ranges and recursing on the eight combinations in an order that
+ * respects their dependencies.  Quadrants that fall wholly outside the
+ * matrices are skipped.  Whatever the cache size, some level of the
+ * recursion works on blocks that fit in it.
+ */
+void compute_recursive(shortest_path_info *info, int i0, int j0, int k0,
+                       int size) {
+    int nodes = info->num_nodes;
+    int h = size / 2;
+
+    if (i0 >= nodes || j0 >= nodes || k0 >= nodes)
+        return;
+
+    if (size <= info->tile) {
+        update_tile(info, i0, j0, k0, size);
+        return;
+    }
+
+    compute_recursive(info, i0, j0, k0, h);
+    compute_recursive(info, i0, j0 + h, k0, h);
+    compute_recursive(info, i0 + h, j0, k0, h);
+    compute_recursive(info, i0 + h, j0 + h, k0, h);
+
+    compute_recursive(info, i0 + h, j0 + h, k0 + h, h);
+    compute_recursive(info, i0 + h, j0, k0 + h, h);
+    compute_recursive(info, i0, j0 + h, k0 + h, h);
+    compute_recursive(info, i0, j0, k0 + h, h);
+}
+
+
+/* Clears the path matrix, and then computes the shortest paths with the
+ * specified variant.  Every variant produces the same weights.
+ */
+void compute_shortest_paths(shortest_path_info *info, int algorithm) {
+    int nodes = info->num_nodes;
+    int i, j, size;
+
+    if (info->p_mem != NULL)
+        printf(" * Clearing the path-reconstruction state.\n");
+    for (i = 0; i < nodes; i++)
+        for (j = 0; j < nodes; j++)
+            set_path(info, i, j, -1);
+
+    if (info->p_mem != NULL) {
+        printf(" * Computing the all-points shortest path results (%s).\n",
+               algorithm_names[algorithm]);
+    }
+
+    switch (algorithm) {
+    case ALGORITHM_BLOCKED:
+        compute_blocked(info);
+        break;
+
+    case ALGORITHM_RECURSIVE:
+        /* The top level covers the matrices with a power-of-2 multiple of
+         * the tile size.
+         */
+        for (size = info->tile; size < nodes; size *= 2);
+        compute_recursive(info, 0, 0, 0, size);
+        break;
+
+    default:
+        compute_naive(info);
+    }
+}
+
+
+/* Initializes info to use native arrays for a graph of num_nodes nodes. */
+void init_native_info(shortest_path_info *info, int num_nodes, int tile) {
+    info->num_nodes = num_nodes;
+    info->tile = tile;
+    info->p_mem = NULL;
+    info->weights = malloc(num_nodes * num_nodes * sizeof(int));
+    info->paths = malloc(num_nodes * num_nodes * sizeof(int));
+    if (info->weights == NULL || info->paths == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+}
+
+
+void free_native_info(shortest_path_info *info) {
+    free(info->weights);
+    free(info->paths);
+}
+
+
+/* Compares the weights in info against native arrays holding the expected
+ * weights, and checks that every path in info is consistent with them:  a
+ * path from i to j through k must be exactly as long as the path from i to
+ * k plus the path from k to j.  (The variants can pick different nodes k
+ * when several paths are equally short.)  Returns the number of entries
+ * that are wrong.
+ */
+int check_results(shortest_path_info *info, shortest_path_info *expected) {
+    int nodes = info->num_nodes;
+    int i, j, k, count = 0;
+
+    for (i = 0; i < nodes; i++) {
+        for (j = 0; j < nodes; j++) {
+            int weight = get_weight(info, i, j);
+
+            int wrong = (weight != get_weight(expected, i, j));
+
+            /* A path through k must be as short as the expected one. */
+            k = get_path(info, i, j);
+            if (k != -1) {
+                wrong |= (k < 0 || k >= nodes || weight !=
+                    get_weight(expected, i, k) + get_weight(expected, k, j));
             }
-            else {
-                set_weight(&info, i, j, 0);
+            if (wrong) {
+                if (count == 0) {
+                    printf("ERROR:  results don't match at row %d, column "
+                           "%d.\n", i, j);
+                }
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+/* Runs every variant on native arrays, without simulating any caches, and
+ * reports the best of NATIVE_TRIALS times for each, and its speedup over
+ * the naive variant.  Every variant's results are checked against the
+ * naive variant's weights.
+ */
+void time_native_runs(int num_nodes, int tile) {
+    shortest_path_info expected, info;
+    double times[NUM_ALGORITHMS];
+    int algorithm, trial;
+
+    init_native_info(&expected, num_nodes, tile);
+    init_native_info(&info, num_nodes, tile);
+
+    printf("Timing each variant natively on a graph of %d nodes, best of "
+           "%d trials, with %dx%d tiles.\n\n", num_nodes, NATIVE_TRIALS,
+           tile, tile);
+
+    for (algorithm = 0; algorithm < NUM_ALGORITHMS; algorithm++) {
+        times[algorithm] = 0;
+
+        for (trial = 0; trial < NATIVE_TRIALS; trial++) {
+            double start, elapsed;
+
+            generate_graph(&info);
+            start = now_seconds();
+            compute_shortest_paths(&info, algorithm);
+            elapsed = now_seconds() - start;
+
+            if (times[algorithm] == 0 || elapsed < times[algorithm])
+                times[algorithm] = elapsed;
+        }
+
+        if (algorithm == ALGORITHM_NAIVE) {
+            memcpy(expected.weights, info.weights,
+                   num_nodes * num_nodes * sizeof(int));
+        }
+        if (check_results(&info, &expected) != 0) {
+            printf("The %s variant's results are wrong, aborting.\n",
+                   algorithm_names[algorithm]);
+            abort();
+        }
+
+        printf("    %-10s  %8.3f s  %6.2fx\n", algorithm_names[algorithm],
+               times[algorithm], times[ALGORITHM_NAIVE] / times[algorithm]);
+    }
+
+    free_native_info(&info);
+    free_native_info(&expected);
+}
+
+
+/* Prints the program usage. */
+void apsptest_usage(const char *progname) {
+    printf("usage: %s [-a naive|blocked|recursive] [-t tile] [-n nodes] "
+           "[-native]\n\t\t[cache-spec ...]\n\n", progname);
+    printf("\tComputes the shortest paths between every pair of nodes of a\n");
+    printf("\trandom graph (default %d nodes) with the Floyd-Warshall\n",
+           NUM_NODES);
+    printf("\talgorithm, through the specified caches.  -a selects the naive\n");
+    printf("\ttriple loop (the default), the blocked variant with tiles of\n");
+    printf("\ttile x tile entries (default %d), or the recursive variant,\n",
+           DEFAULT_TILE);
+    printf("\twhich divides down to that size.  -native times every variant\n");
+    printf("\ton native arrays instead, without simulating any caches.\n\n");
+    usage(progname);
+}
+
+
+int main(int argc, const char **argv) {
+    const char *progname = argv[0];
+    membase_t *p_mem;
+    shortest_path_info info, expected;
+    int num_nodes = NUM_NODES, tile = DEFAULT_TILE;
+    int algorithm = ALGORITHM_NAIVE, native = 0;
+    uint32_t matrix_size;
+    int i;
+
+    i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-native") == 0) {
+            native = 1;
+            i++;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            apsptest_usage(progname);
+            exit(1);
+        }
+
+        if (strcmp(argv[i], "-a") == 0) {
+            for (algorithm = 0; algorithm < NUM_ALGORITHMS; algorithm++) {
+                if (strcmp(argv[i + 1], algorithm_names[algorithm]) == 0)
+                    break;
             }
         }
+        else if (strcmp(argv[i], "-t") == 0) {
+            tile = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-n") == 0) {
+            num_nodes = atoi(argv[i + 1]);
+        }
+        else {
+            algorithm = NUM_ALGORITHMS;
+        }
+
+        if (algorithm == NUM_ALGORITHMS || tile <= 0 || num_nodes <= 0) {
+            apsptest_usage(progname);
+            exit(1);
+        }
+        i += 2;
     }
 
+    if (native) {
+        time_native_runs(num_nodes, tile);
+        return 0;
+    }
+
+    /* Set up the simulated memory.  make_cached_memory() expects the
+     * program name followed by the cache specifications.
+     */
+    matrix_size = num_nodes * num_nodes * sizeof(int);
+    argv[i - 1] = progname;
+    p_mem = make_cached_memory(argc - i + 1, argv + i - 1, 2 * matrix_size);
+
+    /* Caches that classify their misses report each matrix separately. */
+    add_miss_region(p_mem, "weights", 0, matrix_size);
+    add_miss_region(p_mem, "paths", matrix_size, matrix_size);
+
+    /* Generate a random graph. */
+
+    printf("Generating a random graph containing %d nodes.\n", num_nodes);
+
+    info.num_nodes = num_nodes;
+    info.tile = tile;
+    info.p_mem = p_mem;
+    generate_graph(&info);
+
     /* Compute the all-points shortest path of the graph. */
 
     printf("Computing the all-points-shortest-paths of the graph.\n");
-    compute_shortest_paths(&info);
+    compute_shortest_paths(&info, algorithm);
 
     /* Print out the results of the all-points-shortest-paths computation. */
 
@@ -128,6 +532,18 @@ int main(int argc, const char **argv) {
     p_mem->print_stats(p_mem);
     printf("\n");
 
+    /* Check the results against a native run of the naive variant, now that
+     * the statistics are printed, since the checking reads the memory too.
+     */
+    printf("Checking the results against a native naive run.\n");
+    init_native_info(&expected, num_nodes, tile);
+    generate_graph(&expected);
+    compute_shortest_paths(&expected, ALGORITHM_NAIVE);
+    if (check_results(&info, &expected) != 0) {
+        printf("Some results didn't match, aborting.\n");
+        abort();
+    }
+    free_native_info(&expected);
+
     return 0;
 }
-
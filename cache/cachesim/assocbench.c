@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "membase.h"
+#include "memory.h"
+#include "cache.h"
+#include "timing.h"
+
+
+/* This program measures how fast the simulator runs as the associativity of
+ * the simulated cache grows.  Every cache it builds has the same capacity
+ * and block size, with the lines divided into fewer, larger sets each time,
+ * up to a fully associative cache.  The same accesses are replayed through
+ * each one, and the best of several trials is reported in simulated
+ * accesses per second, along with the miss rate.
+ *
+ * There are two workloads.  In the first, most accesses fall in a hot region
+ * half the size of the cache, so nearly every access is a hit and the time
+ * goes into looking up tags.  In the second, the hot region is four times
+ * the size of the cache, so about a fifth of the accesses miss, and choosing
+ * victims costs as much as the lookups.
+ */
+
+
+/* The size of the simulated memory. */
+#define MEM_SIZE (16 * 1024 * 1024)
+
+/* The percentage of accesses that go to the hot region. */
+#define HOT_PERCENT 90
+
+/* The block size and total size of every simulated cache. */
+#define BLOCK_SIZE 64
+#define CACHE_SIZE (64 * 1024)
+
+#define NUM_ACCESSES 4000000
+#define NUM_TRIALS 3
+
+/* Set to time(NULL) to generate new addresses each time, or a constant to
+ * generate the same addresses each time.
+ */
+#define SEED 54321098
+
+
+/* The associativities measured; the last is fully associative. */
+static const int lines_per_set[] = {
+    1, 2, 4, 8, 16, 32, 64, 128, 256, CACHE_SIZE / BLOCK_SIZE
+};
+
+#define NUM_CONFIGS (sizeof(lines_per_set) / sizeof(lines_per_set[0]))
+
+/* The size of the hot region in each workload. */
+static const int hot_sizes[] = { CACHE_SIZE / 2, CACHE_SIZE * 4 };
+
+#define NUM_WORKLOADS (sizeof(hot_sizes) / sizeof(hot_sizes[0]))
+
+
+/* Fills in the word addresses of a workload, up front so that generating
+ * them isn't timed.
+ */
+void make_addresses(addr_t *addresses, int hot_size) {
+    int i;
+
+    srand48(SEED);
+    for (i = 0; i < NUM_ACCESSES; i++) {
+        if (lrand48() % 100 < HOT_PERCENT)
+            addresses[i] = lrand48() % hot_size;
+        else
+            addresses[i] = lrand48() % MEM_SIZE;
+        addresses[i] &= ~3;
+    }
+}
+
+
+/* Replays the accesses through a cache with the specified number of lines
+ * per set, and returns the best time of NUM_TRIALS trials.  The miss rate
+ * is stored in *miss_rate.
+ */
+double time_config(const addr_t *addresses, memory_t *p_memory,
+                   int lines_per_set, double *miss_rate) {
+    int num_sets = CACHE_SIZE / BLOCK_SIZE / lines_per_set;
+    unsigned char buf[4];
+    double best = 0;
+    cache_t cache;
+    int i, trial;
+
+    for (trial = 0; trial < NUM_TRIALS; trial++) {
+        double start, elapsed;
+
+        init_cache(&cache, BLOCK_SIZE, num_sets, lines_per_set,
+                   (membase_t *) p_memory);
+
+        start = now_seconds();
+        for (i = 0; i < NUM_ACCESSES; i++)
+            read_block((membase_t *) &cache, addresses[i], buf, 4);
+        elapsed = now_seconds() - start;
+
+        if (best == 0 || elapsed < best)
+            best = elapsed;
+        *miss_rate = 100.0 * cache.num_misses /
+                     (cache.num_hits + cache.num_misses);
+
+        cache.free((membase_t *) &cache);
+    }
+
+    return best;
+}
+
+
+int main(int argc, const char **argv) {
+    addr_t *addresses[NUM_WORKLOADS];
+    double times[NUM_WORKLOADS][NUM_CONFIGS];
+    double miss_rates[NUM_WORKLOADS][NUM_CONFIGS];
+    memory_t memory;
+    int config, w;
+
+    init_memory(&memory, MEM_SIZE);
+
+    for (w = 0; w < NUM_WORKLOADS; w++) {
+        addresses[w] = malloc(NUM_ACCESSES * sizeof(addr_t));
+        if (addresses[w] == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+        make_addresses(addresses[w], hot_sizes[w]);
+
+        for (config = 0; config < NUM_CONFIGS; config++) {
+            times[w][config] = time_config(addresses[w], &memory,
+                lines_per_set[config], &miss_rates[w][config]);
+        }
+        free(addresses[w]);
+    }
+
+    printf("%d accesses through a %d-byte cache with %d-byte blocks, "
+           "best of %d trials.\n", NUM_ACCESSES, CACHE_SIZE, BLOCK_SIZE,
+           NUM_TRIALS);
+    printf("%d%% of the accesses are to a hot region of the size shown.\n\n",
+           HOT_PERCENT);
+
+    printf("%8s  %8s", "", "");
+    for (w = 0; w < NUM_WORKLOADS; w++)
+        printf("  %8d-byte hot region", hot_sizes[w]);
+    printf("\n%8s  %8s", "E", "S");
+    for (w = 0; w < NUM_WORKLOADS; w++)
+        printf("  %9s  %14s", "miss-rate", "accesses/sec");
+    printf("\n");
+
+    for (config = 0; config < NUM_CONFIGS; config++) {
+        printf("%8d  %8d", lines_per_set[config],
+               CACHE_SIZE / BLOCK_SIZE / lines_per_set[config]);
+        for (w = 0; w < NUM_WORKLOADS; w++) {
+            printf("  %8.2f%%  %14.0f", miss_rates[w][config],
+                   NUM_ACCESSES / times[w][config]);
+        }
+        printf("\n");
+    }
+
+    memory.free((membase_t *) &memory);
+
+    return 0;
+}
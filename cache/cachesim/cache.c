@@ -2,19 +2,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include <limits.h>
 
 #include "cache.h"
+#include "memory.h"
+#include "policy.h"
+#include "prefetch.h"
+#include "coherence.h"
+#include "classify.h"
 
 
 /* Set this to a nonzero value and rebuild to see debug output. */
 #define DEBUG_CACHE 0
 
+/* The number of blocks evicted by prefetches that are remembered, for
+ * counting the misses that prefetches cause.
+ */
+#define PREFETCH_VICTIMS 4096
+
+/* The number of blocks invalidated by other cores that are remembered, for
+ * counting coherence misses.
+ */
+#define COHERENCE_VICTIMS 4096
 
-/* Set this to 0 to activate your custom replacement policy, which is
- * hopefully smarter and better than a random replacement policy!
+/* The number of blocks invalidated by an inclusive cache behind this one
+ * that are remembered, for counting the misses that inclusion causes.
+ */
+#define INCLUSION_VICTIMS 4096
+
+/* The number of accesses to a cache that a miss can overlap with, standing
+ * in for the reach of an out-of-order processor's reorder buffer:  with
+ * memory-level parallelism, a miss within this many accesses of the first
+ * miss of a cluster joins the cluster, as long as it is no more than mlp
+ * misses long, and only the part of its penalty that outlasts the
+ * cluster's longest penalty is charged.
  */
-#define RANDOM_REPLACEMENT_POLICY 0
+#define MLP_WINDOW 64
+
+/* The seed of each cache's random-number generator. */
+#define CACHE_RANDOM_SEED 2463534242U
 
 
 /* Local functions used by the cache implementation, roughly in order of
@@ -23,12 +48,20 @@
 
 unsigned char cache_read_byte(membase_t *mb, addr_t address);
 void cache_write_byte(membase_t *mb, addr_t address, unsigned char value);
+void cache_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                      uint32_t size);
+void cache_write_block(membase_t *mb, addr_t address,
+                       const unsigned char *buf, uint32_t size);
 void cache_free(membase_t *mb);
+membase_t * cache_next_level(membase_t *mb);
+uint64_t cache_cycles(membase_t *mb);
 
 void cache_print_stats(membase_t *mb);
 void cache_reset_stats(membase_t *mb);
 
-cacheline_t *resolve_cache_access(cache_t *p_cache, addr_t address);
+cacheline_t *resolve_cache_access(cache_t *p_cache, addr_t address,
+                                  uint32_t num_bytes, int is_write,
+                                  int allocate);
 
 void decompose_address(cache_t *p_cache, addr_t address,
     addr_t *tag, addr_t *set, addr_t *offset);
@@ -40,13 +73,42 @@ addr_t get_block_start_from_line_info(cache_t *p_cache,
 
 cacheline_t * find_line_in_set(cacheset_t *p_set, addr_t tag);
 
-cacheline_t * choose_victim(cacheset_t *p_set);
-cacheline_t * evict_cache_line(cache_t *p_cache, cacheset_t *p_set);
-
-void load_cache_line(cache_t *p_cache, cacheline_t *p_line, addr_t address,
-                     addr_t tag);
-void write_back_cache_line(cache_t *p_cache, cacheline_t *p_line, 
-                           addr_t set_no);
+cacheline_t * evict_cache_line(cache_t *p_cache, cacheset_t *p_set,
+                               addr_t tag, int for_prefetch);
+
+int take_prefetched_block(cache_t *p_cache, cacheset_t *p_set,
+                          cacheline_t *p_line, addr_t address, addr_t tag);
+void count_polluting_miss(cache_t *p_cache, addr_t address);
+void charge_miss_penalty(cache_t *p_cache, uint64_t penalty);
+int count_coherence_miss(cache_t *p_cache, addr_t address);
+void count_inclusion_miss(cache_t *p_cache, addr_t address);
+
+void load_cache_line(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line,
+                     addr_t address, addr_t tag, int for_write);
+void write_back_cache_line(cache_t *p_cache, cacheset_t *p_set,
+                           cacheline_t *p_line);
+void retire_block(cache_t *p_cache, addr_t block_start,
+                  const unsigned char *data, int dirty);
+
+uint64_t back_invalidate(cache_t *p_cache, addr_t start, uint32_t size,
+                         unsigned char *data, char *p_dirty);
+void exclusive_read(cache_t *p_cache, addr_t address, unsigned char *buf,
+                    uint32_t size);
+void fill_victim_block(cache_t *p_cache, addr_t block_start,
+                       const unsigned char *data, int dirty);
+uint64_t count_distinct_blocks(cache_t *p_cache, cache_t *p_lower);
+
+victim_entry_t * find_victim_entry(cache_t *p_cache, addr_t block_start);
+int fill_victim_cache(cache_t *p_cache, addr_t block_start,
+                      const unsigned char *data, int dirty,
+                      addr_t *p_displaced, int *p_displaced_dirty);
+
+void send_write(cache_t *p_cache, addr_t address, const unsigned char *buf,
+                uint32_t size);
+void write_next_level(cache_t *p_cache, addr_t address,
+                      const unsigned char *buf, uint32_t size);
+void drain_write_buffer_entry(cache_t *p_cache, writebuf_entry_t *p_entry);
+void drain_write_buffer_block(cache_t *p_cache, addr_t block_start);
 
 
 /* Initializes the members of the cache_t struct to be a cache with the
@@ -56,8 +118,9 @@ void write_back_cache_line(cache_t *p_cache, cacheline_t *p_line,
  */
 void init_cache(cache_t *p_cache, uint32_t block_size, uint32_t num_sets,
                 uint32_t lines_per_set, membase_t *next_mem) {
+    cache_t *p_next;
     addr_t set_no;
-    unsigned int line_no;
+    unsigned int line_no, tags_per_set;
 
     assert(p_cache != NULL);
     assert(next_mem != NULL);
@@ -73,9 +136,13 @@ void init_cache(cache_t *p_cache, uint32_t block_size, uint32_t num_sets,
     /* Set up the functions this cache exposes. */
     p_cache->read_byte = cache_read_byte;
     p_cache->write_byte = cache_write_byte;
+    p_cache->read_block = cache_read_block;
+    p_cache->write_block = cache_write_block;
     p_cache->print_stats = cache_print_stats;
     p_cache->reset_stats = cache_reset_stats;
     p_cache->free = cache_free;
+    p_cache->next_level = cache_next_level;
+    p_cache->cycles = cache_cycles;
 
     /* These are various parameters for the cache. */
     
@@ -86,6 +153,21 @@ void init_cache(cache_t *p_cache, uint32_t block_size, uint32_t num_sets,
     p_cache->sets_addr_bits = log_2(num_sets);
     p_cache->block_offset_bits = log_2(block_size);
 
+    /* Every line starts out invalid, along with the padding after each
+     * set's tags.
+     */
+    tags_per_set = (lines_per_set + TAG_GROUP - 1) & ~(TAG_GROUP - 1);
+    p_cache->tag_data = malloc(num_sets * tags_per_set * sizeof(uint32_t));
+    p_cache->block_data = malloc((size_t) num_sets * lines_per_set *
+                                 block_size);
+    if (p_cache->cache_sets == NULL || p_cache->tag_data == NULL ||
+        p_cache->block_data == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    memset(p_cache->tag_data, 0xFF,
+           num_sets * tags_per_set * sizeof(uint32_t));
+
     /* The remaining code initializes each cache set and the lines in
      * each set.
      */
@@ -97,14 +179,323 @@ void init_cache(cache_t *p_cache, uint32_t block_size, uint32_t num_sets,
         p_set->set_no = set_no;
         p_set->num_lines = lines_per_set;
         p_set->cache_lines = malloc(lines_per_set * sizeof(cacheline_t));
+        p_set->tags = p_cache->tag_data + set_no * tags_per_set;
+        if (p_set->cache_lines == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
 
         for (line_no = 0; line_no < lines_per_set; line_no++) {
             cacheline_t *p_line = p_set->cache_lines + line_no;
             bzero(p_line, sizeof(cacheline_t));
 
             p_line->line_no = line_no;
-            p_line->block = malloc(block_size);
+            p_line->block = p_cache->block_data +
+                ((size_t) set_no * lines_per_set + line_no) * block_size;
+        }
+    }
+
+    p_cache->rand_state = CACHE_RANDOM_SEED;
+    set_replacement_policy(p_cache, &lru_policy);
+
+    p_cache->write_allocate = 1;
+
+    /* This cache is in front of the next cache behind it, even if a TLB or a
+     * stack-distance analysis is in between, which that cache's inclusion
+     * policy needs to know.
+     */
+    p_next = next_cache(next_mem);
+    if (p_next != NULL) {
+        p_next->upper_caches = realloc(p_next->upper_caches,
+            (p_next->num_upper_caches + 1) * sizeof(cache_t *));
+        if (p_next->upper_caches == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+        p_next->upper_caches[p_next->num_upper_caches++] = p_cache;
+    }
+}
+
+
+/* Returns mb as a cache, if it is one, or NULL if it is some other kind of
+ * memory.  Caches are recognized by their read_block function.
+ */
+cache_t * as_cache(membase_t *mb) {
+    return mb->read_block == cache_read_block ? (cache_t *) mb : NULL;
+}
+
+
+/* Returns the first cache from mb down, passing through the other levels
+ * on the way, or NULL if there is none before the memory at the bottom.
+ */
+cache_t * next_cache(membase_t *mb) {
+    for (; mb != NULL; mb = next_level(mb)) {
+        cache_t *p_cache = as_cache(mb);
+
+        if (p_cache != NULL)
+            return p_cache;
+    }
+
+    return NULL;
+}
+
+
+/* Returns the next number from the cache's xorshift32 generator. */
+uint32_t cache_random(cache_t *p_cache) {
+    uint32_t x = p_cache->rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    p_cache->rand_state = x;
+    return x;
+}
+
+
+/* Changes the replacement policy of a cache, replacing the old policy's
+ * per-set and per-line state with the new policy's.
+ */
+void set_replacement_policy(cache_t *p_cache,
+                            const replacement_policy_t *policy) {
+    addr_t set_no;
+    int line_no;
+
+    for (set_no = 0; set_no < p_cache->num_sets; set_no++) {
+        cacheset_t *p_set = p_cache->cache_sets + set_no;
+
+        if (p_cache->policy != NULL && p_cache->policy->free_set != NULL)
+            p_cache->policy->free_set(p_cache, p_set);
+        p_set->policy_state = NULL;
+
+        for (line_no = 0; line_no < p_set->num_lines; line_no++) {
+            p_set->cache_lines[line_no].recent = 0;
+            p_set->cache_lines[line_no].policy_bits = 0;
         }
+
+        if (policy->init_set != NULL)
+            policy->init_set(p_cache, p_set);
+    }
+
+    p_cache->policy = policy;
+    p_cache->policy_counter = 0;
+}
+
+
+/* Changes how a cache handles writes, replacing any write buffer it had
+ * before with an empty one of the specified size.
+ */
+void set_write_policy(cache_t *p_cache, int write_through, int write_allocate,
+                      uint32_t write_buffer_size) {
+    uint32_t i;
+
+    for (i = 0; i < p_cache->write_buffer_size; i++) {
+        drain_write_buffer_entry(p_cache, p_cache->write_buffer + i);
+        free(p_cache->write_buffer[i].data);
+        free(p_cache->write_buffer[i].written);
+    }
+    free(p_cache->write_buffer);
+    p_cache->write_buffer = NULL;
+
+    p_cache->write_through = write_through;
+    p_cache->write_allocate = write_allocate;
+    p_cache->write_buffer_size = write_buffer_size;
+
+    if (write_buffer_size > 0) {
+        p_cache->write_buffer = calloc(write_buffer_size,
+                                       sizeof(writebuf_entry_t));
+        if (p_cache->write_buffer == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        for (i = 0; i < write_buffer_size; i++) {
+            writebuf_entry_t *p_entry = p_cache->write_buffer + i;
+            p_entry->data = malloc(p_cache->block_size);
+            p_entry->written = malloc(p_cache->block_size);
+            if (p_entry->data == NULL || p_entry->written == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+    }
+}
+
+
+/* Gives a cache a prefetcher, replacing any prefetcher it had before. */
+void set_prefetcher(cache_t *p_cache, const prefetcher_t *prefetcher,
+                    uint32_t degree, uint32_t mem_size) {
+    if (p_cache->prefetcher != NULL && p_cache->prefetcher->free != NULL)
+        p_cache->prefetcher->free(p_cache);
+
+    p_cache->prefetcher = prefetcher;
+    p_cache->prefetch_state = NULL;
+    p_cache->prefetch_degree = degree;
+    p_cache->prefetch_limit = mem_size;
+
+    if (p_cache->prefetch_victims == NULL) {
+        p_cache->prefetch_victims = calloc(PREFETCH_VICTIMS, sizeof(uint32_t));
+        if (p_cache->prefetch_victims == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+
+    if (prefetcher->init != NULL)
+        prefetcher->init(p_cache);
+}
+
+
+/* Starts classifying a cache's misses, with a shadow cache of the same
+ * block size and number of lines.
+ */
+void set_miss_classification(cache_t *p_cache) {
+    if (p_cache->classifier != NULL)
+        return;
+
+    p_cache->classifier = malloc(sizeof(miss_classifier_t));
+    if (p_cache->classifier == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    init_miss_classifier(p_cache->classifier, p_cache->block_size,
+        p_cache->num_sets * p_cache->cache_sets[0].num_lines);
+}
+
+
+/* The names of the inclusion policies. */
+const char *inclusion_names[] = {
+    "non-inclusive", "inclusive", "exclusive"
+};
+
+
+/* Changes the inclusion policy of a cache. */
+void set_inclusion_policy(cache_t *p_cache, int inclusion) {
+    assert(inclusion >= INCLUSION_NINE && inclusion <= INCLUSION_EXCLUSIVE);
+
+    p_cache->inclusion = inclusion;
+    p_cache->report_inclusion = 1;
+}
+
+
+/* Checks that a cache can be in front of the caches behind it, given their
+ * inclusion policies:  its blocks must be no larger than those of any
+ * inclusive cache behind it, so that back-invalidation covers them, and
+ * the same size as those of an exclusive cache directly behind it, which
+ * hands whole blocks back and forth with it.  A prefetcher that keeps its
+ * own copies of blocks would hold blocks that neither policy knows about.
+ * Prints an error and returns -1 if the cache can't be used, or returns 0.
+ */
+int check_inclusion(cache_t *p_cache) {
+    cache_t *p_next = next_cache(p_cache->next_memory);
+    cache_t *p_lower;
+
+    if (p_next == NULL)
+        return 0;
+
+    if (p_next->inclusion == INCLUSION_EXCLUSIVE &&
+        p_next->block_size != p_cache->block_size) {
+        printf("ERROR:  a cache in front of an exclusive cache must have "
+               "the same block size.\n");
+        return -1;
+    }
+
+    for (p_lower = p_next; p_lower != NULL;
+         p_lower = next_cache(p_lower->next_memory)) {
+        if (p_lower->inclusion == INCLUSION_NINE)
+            continue;
+
+        if (p_lower->inclusion == INCLUSION_INCLUSIVE &&
+            p_lower->block_size < p_cache->block_size) {
+            printf("ERROR:  a cache in front of an inclusive cache can't "
+                   "have larger blocks.\n");
+            return -1;
+        }
+
+        if (p_cache->prefetcher != NULL &&
+            p_cache->prefetcher->take_block != NULL) {
+            printf("ERROR:  a cache in front of an %s cache can't use the "
+                   "%s prefetcher.\n", inclusion_names[p_lower->inclusion],
+                   p_cache->prefetcher->name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Gives a cache an empty victim cache, replacing any it had before.  The
+ * old victim cache's dirty blocks are written back first.
+ */
+void set_victim_cache(cache_t *p_cache, uint32_t num_entries) {
+    uint32_t i;
+
+    for (i = 0; i < p_cache->victim_cache_size; i++) {
+        victim_entry_t *p_entry = p_cache->victim_cache + i;
+
+        if (p_entry->valid) {
+            p_entry->valid = 0;
+            retire_block(p_cache, p_entry->block_start, p_entry->data,
+                         p_entry->dirty);
+        }
+        free(p_entry->data);
+    }
+    free(p_cache->victim_cache);
+    free(p_cache->victim_swap);
+    p_cache->victim_cache = NULL;
+    p_cache->victim_swap = NULL;
+    p_cache->victim_cache_size = num_entries;
+
+    if (num_entries > 0) {
+        p_cache->victim_cache = calloc(num_entries, sizeof(victim_entry_t));
+        p_cache->victim_swap = malloc(p_cache->block_size);
+        if (p_cache->victim_cache == NULL || p_cache->victim_swap == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        for (i = 0; i < num_entries; i++) {
+            p_cache->victim_cache[i].data = malloc(p_cache->block_size);
+            if (p_cache->victim_cache[i].data == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+    }
+}
+
+
+/* Sets the timing parameters of a cache. */
+void set_cache_latency(cache_t *p_cache, uint32_t hit_latency, uint32_t mlp) {
+    p_cache->hit_latency = hit_latency;
+    p_cache->mlp = mlp;
+    p_cache->timed = 1;
+}
+
+
+/* Walks down from mb to the memory at the bottom of the hierarchy, and sets
+ * its latency.  The caches on the way start keeping time too.
+ */
+void set_memory_latency(membase_t *mb, uint32_t latency) {
+    for (; next_level(mb) != NULL; mb = next_level(mb)) {
+        cache_t *p_cache = as_cache(mb);
+
+        if (p_cache != NULL)
+            p_cache->timed = 1;
+    }
+
+    ((memory_t *) mb)->latency = latency;
+}
+
+
+/* Adds a region to each cache from mb down that classifies its misses. */
+void add_miss_region(membase_t *mb, const char *name, addr_t start,
+                     uint32_t size) {
+    for (; mb != NULL; mb = next_level(mb)) {
+        cache_t *p_cache = as_cache(mb);
+
+        if (p_cache != NULL && p_cache->classifier != NULL)
+            add_region(p_cache->classifier, name, start, size);
     }
 }
 
@@ -114,12 +505,13 @@ unsigned char cache_read_byte(membase_t *mb, addr_t address) {
     cache_t *p_cache = (cache_t *) mb;
     cacheline_t *p_line;
     addr_t block_offset;
+    unsigned char value;
     
 #if DEBUG_CACHE
     printf("Resolving cache read to address %u\n", address);
 #endif
     
-    p_line = resolve_cache_access(p_cache, address);
+    p_line = resolve_cache_access(p_cache, address, 1, 0, 1);
     block_offset = get_offset_in_block(p_cache, address);
     
 #if DEBUG_CACHE
@@ -128,25 +520,121 @@ unsigned char cache_read_byte(membase_t *mb, addr_t address) {
     
     /* Return the byte read by the requester. */
     p_cache->num_reads++;
+    value = p_line->block[block_offset];
 
-    /* Update the most recent access time for this cache line */
-    p_line->recent = clock_tick();    
-    
-    return p_line->block[block_offset];
+    if (p_cache->prefetcher != NULL) {
+        p_cache->prefetcher->access(p_cache, address,
+                                    p_cache->prefetch_trigger);
+    }
+
+    return value;
 }
 
 
-/* This function implements writing bytes of memory through the cache. */
+/* This function implements writing bytes of memory through the cache.  A
+ * single byte is written just as a run of one byte would be.
+ */
 void cache_write_byte(membase_t *mb, addr_t address, unsigned char value) {
+    cache_write_block(mb, address, &value, 1);
+}
+
+
+/* This function implements reading a run of bytes through the cache.  The
+ * run is split at cache-line boundaries, and each piece is copied out of its
+ * cache line in one go.
+ */
+void cache_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                      uint32_t size) {
     cache_t *p_cache = (cache_t *) mb;
-    cacheline_t *p_line = resolve_cache_access(p_cache, address);
-    addr_t block_offset = get_offset_in_block(p_cache, address);
-    
-    /* Write the byte specified by the requester. */
-    p_cache->num_writes++;
-    p_line->block[block_offset] = value;
-    p_line->dirty = 1;
-    p_line->recent = clock_tick();
+
+    /* The caches in front of an exclusive cache take blocks out of it. */
+    if (p_cache->inclusion == INCLUSION_EXCLUSIVE &&
+        p_cache->num_upper_caches > 0) {
+        exclusive_read(p_cache, address, buf, size);
+        return;
+    }
+
+    while (size > 0) {
+        addr_t block_offset = get_offset_in_block(p_cache, address);
+        uint32_t num_bytes = p_cache->block_size - block_offset;
+        cacheline_t *p_line;
+
+        if (num_bytes > size)
+            num_bytes = size;
+
+        p_line = resolve_cache_access(p_cache, address, num_bytes, 0, 1);
+
+        p_cache->num_reads += num_bytes;
+        copy_bytes(buf, p_line->block + block_offset, num_bytes);
+
+        if (p_cache->prefetcher != NULL) {
+            p_cache->prefetcher->access(p_cache, address,
+                                        p_cache->prefetch_trigger);
+        }
+
+        address += num_bytes;
+        buf += num_bytes;
+        size -= num_bytes;
+    }
+}
+
+
+/* This function implements writing a run of bytes through the cache.  Like
+ * cache_read_block(), it handles one cache line at a time.  Each piece is
+ * also sent on to the next level if the cache is write-through, or if it
+ * missed in a cache without write-allocate.  An exclusive cache with caches
+ * in front of it never allocates lines for writes, which come from those
+ * caches; the blocks they evict come in through fill_victim_block().
+ */
+void cache_write_block(membase_t *mb, addr_t address,
+                       const unsigned char *buf, uint32_t size) {
+    cache_t *p_cache = (cache_t *) mb;
+    int allocate = p_cache->write_allocate;
+
+    if (p_cache->inclusion == INCLUSION_EXCLUSIVE &&
+        p_cache->num_upper_caches > 0)
+        allocate = 0;
+
+    while (size > 0) {
+        addr_t block_offset = get_offset_in_block(p_cache, address);
+        uint32_t num_bytes = p_cache->block_size - block_offset;
+        cacheline_t *p_line;
+
+        if (num_bytes > size)
+            num_bytes = size;
+
+        p_line = resolve_cache_access(p_cache, address, num_bytes, 1,
+                                      allocate);
+
+        p_cache->num_writes += num_bytes;
+        if (p_line == NULL) {
+            /* Write around the cache. */
+            p_cache->num_write_arounds++;
+            send_write(p_cache, address, buf, num_bytes);
+        }
+        else if (p_cache->write_through) {
+            if (p_cache->bus != NULL)
+                coherence_write(p_cache, p_line, address - block_offset);
+            copy_bytes(p_line->block + block_offset, buf, num_bytes);
+            p_cache->num_write_throughs++;
+            send_write(p_cache, address, buf, num_bytes);
+        }
+        else {
+            if (p_cache->bus != NULL)
+                coherence_write(p_cache, p_line, address - block_offset);
+            copy_bytes(p_line->block + block_offset, buf, num_bytes);
+            p_line->dirty = 1;
+        }
+
+        if (p_cache->prefetcher != NULL) {
+            p_cache->prefetcher->access(p_cache, address,
+                                        p_cache->prefetch_trigger);
+        }
+
+        address += num_bytes;
+        buf += num_bytes;
+        size -= num_bytes;
+    }
 }
 
 
@@ -155,7 +643,14 @@ void cache_write_byte(membase_t *mb, addr_t address, unsigned char value) {
  */
 void cache_print_stats(membase_t *mb) {
     cache_t *p_cache = (cache_t *) mb;
-    
+
+    cache_print_level_stats(p_cache);
+    p_cache->next_memory->print_stats(p_cache->next_memory);
+}
+
+
+/* This function prints the statistics for the cache itself. */
+void cache_print_level_stats(cache_t *p_cache) {
     double miss_rate = (double) p_cache->num_misses;
     miss_rate /= (double) (p_cache->num_hits + p_cache->num_misses);
     miss_rate *= 100;
@@ -164,9 +659,99 @@ void cache_print_stats(membase_t *mb) {
            "\n", p_cache->num_reads, p_cache->num_writes,
            p_cache->num_hits, p_cache->num_misses);
     printf("   miss-rate=%.2f%% %s replacement policy\n", miss_rate,
-           (RANDOM_REPLACEMENT_POLICY ? "random" : "LRU"));
-    
-    p_cache->next_memory->print_stats(p_cache->next_memory);
+           p_cache->policy->name);
+    printf("   %s, %s:  write-backs=%lu write-throughs=%lu "
+           "write-arounds=%lu\n",
+           p_cache->write_through ? "write-through" : "write-back",
+           p_cache->write_allocate ? "write-allocate" : "no-write-allocate",
+           p_cache->num_write_backs, p_cache->num_write_throughs,
+           p_cache->num_write_arounds);
+    if (p_cache->write_buffer != NULL) {
+        printf("   write buffer of %u entries:  combined-writes=%lu\n",
+               p_cache->write_buffer_size, p_cache->num_combined_writes);
+    }
+    printf("   next-level writes=%lu (%lu bytes)\n", p_cache->num_next_writes,
+           p_cache->num_next_write_bytes);
+
+    if (p_cache->prefetcher != NULL) {
+        uint64_t useful = p_cache->num_useful_prefetches;
+        double accuracy = 0, coverage = 0, pollution = 0;
+
+        /* Accuracy is the fraction of prefetches that were used, coverage is
+         * the fraction of misses that prefetching removed, and pollution is
+         * the fraction of the remaining misses caused by prefetches.
+         */
+        if (p_cache->num_prefetches > 0)
+            accuracy = 100.0 * useful / p_cache->num_prefetches;
+        if (useful + p_cache->num_misses > 0)
+            coverage = 100.0 * useful / (useful + p_cache->num_misses);
+        if (p_cache->num_misses > 0) {
+            pollution = 100.0 * p_cache->num_polluting_misses /
+                        p_cache->num_misses;
+        }
+
+        printf("   %s prefetcher, degree %u:  prefetches=%lu useful=%lu "
+               "unused=%lu\n", p_cache->prefetcher->name,
+               p_cache->prefetch_degree, p_cache->num_prefetches, useful,
+               p_cache->num_unused_prefetches);
+        printf("   accuracy=%.2f%% coverage=%.2f%% polluting-misses=%lu "
+               "(%.2f%% of misses)\n", accuracy, coverage,
+               p_cache->num_polluting_misses, pollution);
+    }
+
+    if (p_cache->bus != NULL) {
+        printf("   coherent (core %d, level %d):  invalidations=%lu "
+               "coherence-misses=%lu\n", p_cache->core,
+               p_cache->core_level + 1, p_cache->num_invalidations,
+               p_cache->num_coherence_misses);
+    }
+
+    if (p_cache->victim_cache != NULL) {
+        printf("   victim cache of %u entries:  hits=%lu\n",
+               p_cache->victim_cache_size, p_cache->num_victim_hits);
+    }
+
+    if (p_cache->report_inclusion) {
+        uint64_t here = count_distinct_blocks(p_cache, NULL), above = 0;
+        int i;
+
+        /* The effective capacity is what the cache and the caches directly
+         * in front of it hold between them, counting each block once.
+         */
+        for (i = 0; i < p_cache->num_upper_caches; i++) {
+            cache_t *p_upper = p_cache->upper_caches[i];
+            above += count_distinct_blocks(p_upper, p_cache) *
+                     p_upper->block_size;
+        }
+        here *= p_cache->block_size;
+
+        printf("   %s:  back-invalidations=%lu victim-fills=%lu\n",
+               inclusion_names[p_cache->inclusion],
+               p_cache->num_back_invalidations, p_cache->num_victim_fills);
+        printf("   effective capacity=%lu bytes (%lu here, %lu only in "
+               "front)\n", here + above, here, above);
+    }
+
+    if (p_cache->inclusion_victims != NULL) {
+        printf("   back-invalidated lines=%lu inclusion-misses=%lu\n",
+               p_cache->num_inclusion_invalidations,
+               p_cache->num_inclusion_misses);
+    }
+
+    if (p_cache->classifier != NULL)
+        print_miss_classes(p_cache->classifier);
+
+    if (p_cache->timed && p_cache->num_accesses > 0) {
+        double amat = (double) p_cache->num_cycles / p_cache->num_accesses;
+
+        printf("   hit-latency=%u:  accesses=%lu cycles=%lu AMAT=%.2f "
+               "cycles\n", p_cache->hit_latency, p_cache->num_accesses,
+               p_cache->num_cycles, amat);
+        if (p_cache->mlp > 1) {
+            printf("   memory-level parallelism %u:  overlapped-misses=%lu\n",
+                   p_cache->mlp, p_cache->num_overlapped_misses);
+        }
+    }
 }
 
 
@@ -180,6 +765,29 @@ void cache_reset_stats(membase_t *mb) {
     p_cache->num_writes = 0;
     p_cache->num_hits = 0;
     p_cache->num_misses = 0;
+    p_cache->num_prefetches = 0;
+    p_cache->num_useful_prefetches = 0;
+    p_cache->num_unused_prefetches = 0;
+    p_cache->num_polluting_misses = 0;
+    p_cache->num_write_backs = 0;
+    p_cache->num_write_throughs = 0;
+    p_cache->num_write_arounds = 0;
+    p_cache->num_combined_writes = 0;
+    p_cache->num_next_writes = 0;
+    p_cache->num_next_write_bytes = 0;
+    p_cache->num_invalidations = 0;
+    p_cache->num_coherence_misses = 0;
+    p_cache->num_accesses = 0;
+    p_cache->num_cycles = 0;
+    p_cache->cluster_misses = 0;
+    p_cache->num_overlapped_misses = 0;
+    p_cache->num_back_invalidations = 0;
+    p_cache->num_victim_fills = 0;
+    p_cache->num_inclusion_invalidations = 0;
+    p_cache->num_inclusion_misses = 0;
+    p_cache->num_victim_hits = 0;
+    if (p_cache->classifier != NULL)
+        reset_miss_classifier(p_cache->classifier);
     
     p_cache->next_memory->reset_stats(p_cache->next_memory);
 }
@@ -194,18 +802,57 @@ void cache_free(membase_t *mb) {
     
     for (i_set = 0; i_set < p_cache->num_sets; i_set++) {
         cacheset_t *p_set = p_cache->cache_sets + i_set;
-        for (i_line = 0; i_line < p_set->num_lines; i_line++) {
-            cacheline_t *p_line = p_set->cache_lines + i_line;
-            free(p_line->block);
-        }
         free(p_set->cache_lines);
+
+        if (p_cache->policy->free_set != NULL)
+            p_cache->policy->free_set(p_cache, p_set);
     }
     free(p_cache->cache_sets);
+    free(p_cache->tag_data);
+    free(p_cache->block_data);
+
+    if (p_cache->prefetcher != NULL && p_cache->prefetcher->free != NULL)
+        p_cache->prefetcher->free(p_cache);
+    free(p_cache->prefetch_victims);
+    free(p_cache->coherence_victims);
+    free(p_cache->inclusion_victims);
+    free(p_cache->upper_caches);
+
+    if (p_cache->classifier != NULL) {
+        free_miss_classifier(p_cache->classifier);
+        free(p_cache->classifier);
+    }
+
+    for (i_line = 0; i_line < p_cache->write_buffer_size; i_line++) {
+        free(p_cache->write_buffer[i_line].data);
+        free(p_cache->write_buffer[i_line].written);
+    }
+    free(p_cache->write_buffer);
+
+    for (i_line = 0; i_line < p_cache->victim_cache_size; i_line++)
+        free(p_cache->victim_cache[i_line].data);
+    free(p_cache->victim_cache);
+    free(p_cache->victim_swap);
+}
+
+
+/* Returns the level behind the cache. */
+membase_t * cache_next_level(membase_t *mb) {
+    return ((cache_t *) mb)->next_memory;
+}
+
+
+/* Returns the cycles taken so far by the cache's accesses, which include
+ * the penalties of its misses.
+ */
+uint64_t cache_cycles(membase_t *mb) {
+    return ((cache_t *) mb)->num_cycles;
 }
 
 
-/* This method flushes lines out of the cache so that all modified data in the
- * cache is properly reflected in the next level of the simulated memory.
+/* This method flushes lines out of the cache and its victim cache, and then
+ * drains the write buffer, so that all modified data in the cache is
+ * properly reflected in the next level of the simulated memory.
  */
 int flush_cache(cache_t *p_cache) {
     addr_t i_set, i_line;
@@ -216,12 +863,25 @@ int flush_cache(cache_t *p_cache) {
         cacheset_t *p_set = p_cache->cache_sets + i_set;
         for (i_line = 0; i_line < p_set->num_lines; i_line++) {
             cacheline_t *p_line = p_set->cache_lines + i_line;
-            if (p_line->valid && p_line->dirty) {
-                write_back_cache_line(p_cache, p_line, i_set);
+            if (line_is_valid(p_set, p_line) && p_line->dirty) {
+                write_back_cache_line(p_cache, p_set, p_line);
                 flushed++;
             }
         }
     }
+
+    for (i_line = 0; i_line < p_cache->victim_cache_size; i_line++) {
+        victim_entry_t *p_entry = p_cache->victim_cache + i_line;
+        if (p_entry->valid && p_entry->dirty) {
+            p_cache->num_write_backs++;
+            send_write(p_cache, p_entry->block_start, p_entry->data,
+                       p_cache->block_size);
+            flushed++;
+        }
+    }
+
+    for (i_line = 0; i_line < p_cache->write_buffer_size; i_line++)
+        drain_write_buffer_entry(p_cache, p_cache->write_buffer + i_line);
     
     return flushed;
 }
@@ -232,15 +892,35 @@ int flush_cache(cache_t *p_cache) {
  */
 
 
-/* This function is used by both the read-byte and write-byte functions to
- * ensure that the cache contains a cache-line for the specified address.
- * This way, the read or write can be performed against the cache-line.  If
- * the cache doesn't contain a line for the specified address, the
- * corresponding block will be loaded from the next level of the memory.  An
- * eviction will also occur if the cache doesn't currently have room for the
- * new line.
+/* This function is used by all of the read and write functions to ensure
+ * that the cache contains a cache-line for the specified address.  This way,
+ * the read or write can be performed against the cache-line.  If the cache
+ * doesn't contain a line for the specified address, the corresponding block
+ * will be loaded from the next level of the memory.  An eviction will also
+ * occur if the cache doesn't currently have room for the new line.
+ *
+ * The access covers num_bytes bytes of the line.  Only the first of them can
+ * miss, so the hit and miss counts are the same as if each byte had been
+ * accessed separately.  The replacement policy sees the access once.
+ *
+ * If allocate is 0, a miss doesn't load the block; the function returns
+ * NULL instead, and every byte of the access counts as a miss.  is_write is
+ * nonzero if the access is a write, so that a coherent cache can load the
+ * block for writing.  A block found in the victim cache is swapped back
+ * into the cache either way, and the access counts as a hit.
+ *
+ * Every access takes the cache's hit latency, and a miss that loads the
+ * block also takes the cycles that the load took at the levels below (see
+ * charge_miss_penalty()).  Writes that go around the cache and prefetched
+ * blocks are assumed to cost no more than a hit.
+ *
+ * The function also records in prefetch_trigger whether the access should
+ * trigger the prefetcher.  The caller runs the prefetcher once it is done
+ * with the line, since a prefetch may evict it.
  */
-cacheline_t *resolve_cache_access(cache_t *p_cache, addr_t address) {
+cacheline_t *resolve_cache_access(cache_t *p_cache, addr_t address,
+                                  uint32_t num_bytes, int is_write,
+                                  int allocate) {
     addr_t tag, set_no, block_offset;
     cacheset_t *p_set;
     cacheline_t *p_line;
@@ -257,28 +937,289 @@ cacheline_t *resolve_cache_access(cache_t *p_cache, addr_t address) {
     /* Get the cache set that should contain the address. */
     p_set = p_cache->cache_sets + set_no;
     p_line = find_line_in_set(p_set, tag);
+    p_cache->prefetch_trigger = 0;
+
+    p_cache->num_accesses++;
+    p_cache->num_cycles += p_cache->hit_latency;
+
+    if (p_line == NULL && p_cache->victim_cache != NULL) {
+        victim_entry_t *p_entry = find_victim_entry(p_cache,
+            get_block_start_from_address(p_cache, address));
+
+        if (p_entry != NULL) {
+            int dirty = p_entry->dirty;
+
+            /* Free the entry before evicting, so that the evicted block
+             * takes its place, and nothing has to be retired.
+             */
+            copy_bytes(p_cache->victim_swap, p_entry->data,
+                       p_cache->block_size);
+            p_entry->valid = 0;
+
+            p_line = evict_cache_line(p_cache, p_set, tag, 0);
+            copy_bytes(p_line->block, p_cache->victim_swap,
+                       p_cache->block_size);
+            p_set->tags[p_line->line_no] = tag;
+            p_line->dirty = dirty;
+            p_cache->policy->line_filled(p_cache, p_set, p_line);
+
+            p_cache->num_hits += num_bytes;
+            p_cache->num_victim_hits++;
+            if (p_cache->classifier != NULL) {
+                classify_access(p_cache->classifier, address, num_bytes,
+                                0, 0);
+            }
+            return p_line;
+        }
+    }
     
+    if (p_line == NULL && !allocate) {
+        p_cache->num_misses += num_bytes;
+        p_cache->prefetch_trigger = 1;
+        if (p_cache->classifier != NULL) {
+            classify_access(p_cache->classifier, address, num_bytes,
+                            num_bytes, 0);
+        }
+        return NULL;
+    }
+
     if (p_line == NULL) {
+        int coherence = 0;
+        uint64_t start_cycles;
+
+        p_line = evict_cache_line(p_cache, p_set, tag, 0);
+
+        if (p_cache->prefetcher != NULL &&
+            take_prefetched_block(p_cache, p_set, p_line, address, tag)) {
+            /* The prefetcher had the block waiting, so this is a hit. */
+            p_cache->num_hits += num_bytes;
+            if (p_cache->classifier != NULL) {
+                classify_access(p_cache->classifier, address, num_bytes,
+                                0, 0);
+            }
+            return p_line;
+        }
+
         /* CACHE MISS.  :-( */
         p_cache->num_misses++;
+        p_cache->prefetch_trigger = 1;
         
 #if DEBUG_CACHE
         printf(" * Cache miss.\n");
 #endif
+
+        if (p_cache->prefetcher != NULL)
+            count_polluting_miss(p_cache, address);
+        if (p_cache->coherence_victims != NULL)
+            coherence = count_coherence_miss(p_cache, address);
+        if (p_cache->inclusion_victims != NULL)
+            count_inclusion_miss(p_cache, address);
+        if (p_cache->classifier != NULL) {
+            classify_access(p_cache->classifier, address, num_bytes, 1,
+                            coherence);
+        }
         
         /* Resolve the cache miss. */
-        p_line = evict_cache_line(p_cache, p_set);
-        load_cache_line(p_cache, p_line, address, tag);
+        if (p_cache->timed) {
+            start_cycles = level_cycles(p_cache->next_memory);
+            load_cache_line(p_cache, p_set, p_line, address, tag, is_write);
+            charge_miss_penalty(p_cache,
+                level_cycles(p_cache->next_memory) - start_cycles);
+        }
+        else {
+            load_cache_line(p_cache, p_set, p_line, address, tag, is_write);
+        }
+        p_cache->policy->line_filled(p_cache, p_set, p_line);
+
+        /* The rest of the bytes hit the line that was just loaded. */
+        p_cache->num_hits += num_bytes - 1;
     }
     else {
         /* CACHE HIT!  :-) */
-        p_cache->num_hits++;
+        p_cache->num_hits += num_bytes;
+        p_cache->policy->line_hit(p_cache, p_set, p_line);
+        if (p_cache->classifier != NULL)
+            classify_access(p_cache->classifier, address, num_bytes, 0, 0);
+
+        if (p_line->prefetched) {
+            p_line->prefetched = 0;
+            p_cache->num_useful_prefetches++;
+            p_cache->prefetch_trigger = 1;
+        }
     }
     
     return p_line;
 }
 
 
+/* This function loads the block containing the specified address into the
+ * cache for the prefetcher, unless the block is already in the cache or its
+ * victim cache, or lies past the end of the memory.  The line is marked as
+ * prefetched until it is first accessed, so that the prefetch can be
+ * counted as useful or not.
+ */
+void prefetch_block(cache_t *p_cache, addr_t address) {
+    addr_t tag, set_no, block_offset;
+    cacheset_t *p_set;
+    cacheline_t *p_line;
+
+    address = get_block_start_from_address(p_cache, address);
+    if (address >= p_cache->prefetch_limit ||
+        p_cache->prefetch_limit - address < p_cache->block_size)
+        return;
+
+    decompose_address(p_cache, address, &tag, &set_no, &block_offset);
+    p_set = p_cache->cache_sets + set_no;
+    if (find_line_in_set(p_set, tag) != NULL)
+        return;
+
+    if (p_cache->victim_cache != NULL &&
+        find_victim_entry(p_cache, address) != NULL)
+        return;
+
+    p_line = evict_cache_line(p_cache, p_set, tag, 1);
+    load_cache_line(p_cache, p_set, p_line, address, tag, 0);
+    p_cache->policy->line_filled(p_cache, p_set, p_line);
+
+    p_line->prefetched = 1;
+    p_cache->num_prefetches++;
+}
+
+
+/* This function charges a cache's access for the penalty of a miss, the
+ * cycles that loading the block took at the levels below.  Without
+ * memory-level parallelism the whole penalty is charged.  With it, the
+ * miss may join the current cluster of misses (see MLP_WINDOW), which it
+ * is assumed to be independent of, so that it overlaps them.
+ */
+void charge_miss_penalty(cache_t *p_cache, uint64_t penalty) {
+    if (p_cache->mlp > 1 && p_cache->cluster_misses > 0 &&
+        p_cache->cluster_misses < p_cache->mlp &&
+        p_cache->num_accesses - p_cache->cluster_start < MLP_WINDOW) {
+        p_cache->cluster_misses++;
+        p_cache->num_overlapped_misses++;
+        if (penalty > p_cache->cluster_penalty) {
+            p_cache->num_cycles += penalty - p_cache->cluster_penalty;
+            p_cache->cluster_penalty = penalty;
+        }
+        return;
+    }
+
+    p_cache->cluster_start = p_cache->num_accesses;
+    p_cache->cluster_misses = 1;
+    p_cache->cluster_penalty = penalty;
+    p_cache->num_cycles += penalty;
+}
+
+
+/* This function asks the prefetcher for the block containing the specified
+ * address, on a miss.  If the prefetcher has it, the block is placed in the
+ * specified (empty) line and the function returns 1; otherwise it returns 0.
+ */
+int take_prefetched_block(cache_t *p_cache, cacheset_t *p_set,
+                          cacheline_t *p_line, addr_t address, addr_t tag) {
+    addr_t block_start = get_block_start_from_address(p_cache, address);
+
+    /* Buffered writes to the block must reach the next level first, so
+     * that the prefetcher drops any copy it made before them.
+     */
+    if (p_cache->write_buffer != NULL)
+        drain_write_buffer_block(p_cache, block_start);
+
+    if (p_cache->prefetcher->take_block == NULL ||
+        !p_cache->prefetcher->take_block(p_cache, block_start,
+                                         p_line->block))
+        return 0;
+
+    p_set->tags[p_line->line_no] = tag;
+    p_line->dirty = 0;
+    p_cache->policy->line_filled(p_cache, p_set, p_line);
+
+    p_cache->num_useful_prefetches++;
+    return 1;
+}
+
+
+/* This function checks whether a miss is on a block that a prefetch
+ * evicted, and counts it as a polluting miss if so.
+ */
+void count_polluting_miss(cache_t *p_cache, addr_t address) {
+    uint32_t block = address >> p_cache->block_offset_bits;
+    uint32_t *p_victim = p_cache->prefetch_victims + block % PREFETCH_VICTIMS;
+
+    if (*p_victim == block + 1) {
+        p_cache->num_polluting_misses++;
+        *p_victim = 0;
+    }
+}
+
+
+/* This function checks whether a miss is on a block that another core's
+ * write invalidated, and counts it as a coherence miss if so.  Returns
+ * nonzero if it was one.
+ */
+int count_coherence_miss(cache_t *p_cache, addr_t address) {
+    uint32_t block = address >> p_cache->block_offset_bits;
+    uint32_t *p_victim = p_cache->coherence_victims +
+                         block % COHERENCE_VICTIMS;
+
+    if (*p_victim == block + 1) {
+        p_cache->num_coherence_misses++;
+        *p_victim = 0;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* This function checks whether a miss is on a block that an inclusive cache
+ * behind this one invalidated, and counts it as an inclusion miss if so.
+ */
+void count_inclusion_miss(cache_t *p_cache, addr_t address) {
+    uint32_t block = address >> p_cache->block_offset_bits;
+    uint32_t *p_victim = p_cache->inclusion_victims +
+                         block % INCLUSION_VICTIMS;
+
+    if (*p_victim == block + 1) {
+        p_cache->num_inclusion_misses++;
+        *p_victim = 0;
+    }
+}
+
+
+/* This function invalidates a line for a coherence protocol.  The line is
+ * dropped without being written back, and the block is remembered, so that
+ * a later miss on it can be counted as a coherence miss.
+ */
+void invalidate_cache_line(cache_t *p_cache, cacheset_t *p_set,
+                           cacheline_t *p_line) {
+    uint32_t block;
+
+    if (p_cache->coherence_victims == NULL) {
+        p_cache->coherence_victims = calloc(COHERENCE_VICTIMS,
+                                            sizeof(uint32_t));
+        if (p_cache->coherence_victims == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+
+    block = get_block_start_from_line_info(p_cache, line_tag(p_set, p_line),
+        p_set->set_no) >> p_cache->block_offset_bits;
+    p_cache->coherence_victims[block % COHERENCE_VICTIMS] = block + 1;
+
+    if (p_line->prefetched) {
+        p_cache->num_unused_prefetches++;
+        p_line->prefetched = 0;
+    }
+
+    p_set->tags[p_line->line_no] = INVALID_TAG;
+    p_line->dirty = 0;
+    p_line->state = LINE_INVALID;
+    p_cache->num_invalidations++;
+}
+
+
 /* This function takes a cache and an address being accessed through the
  * cache, and returns the offset within the block that the access occurs at.
  *
@@ -310,11 +1251,6 @@ addr_t get_offset_in_block(cache_t *p_cache, addr_t address) {
 void decompose_address(cache_t *p_cache, addr_t address,
     addr_t *tag, addr_t *set, addr_t *offset) {
 
-    assert(p_cache != NULL);
-    assert(tag != NULL);
-    assert(set != NULL);
-    assert(offset != NULL);
-
     /* Each time we do right shift of address by number of bits in
      * block_offset and set_address, and then do the same trick in
      * get_offset_in_block function.
@@ -362,80 +1298,71 @@ addr_t get_block_start_from_line_info(cache_t *p_cache,
  * returns NULL.
  */
 cacheline_t * find_line_in_set(cacheset_t *p_set, addr_t tag) {
-    cacheline_t *found_line = NULL;
+    int i;
 
 #if DEBUG_CACHE
     printf(" * Finding line with tag %u in cache set:\n", tag);
 #endif
 
-    cacheline_t *cache_lines = p_set->cache_lines;
-    for (int i = 0; i < p_set->num_lines; i++) {
-        /* search in each cache line */     
-        if (tag == cache_lines[i].tag && cache_lines[i].valid) {
-            found_line = &(cache_lines[i]);
-            break;
-        }
-    }  
-    return found_line;
+    i = find_tag_in_set(p_set, tag);
+    return i < 0 ? NULL : p_set->cache_lines + i;
 }
 
 
-/* This function chooses a victim cache-line to evict, when a new cache line
- * must be loaded into the cache.  Note that this function is slightly mis-
- * named; if it selects a cache line that is currently invalid, nothing will
- * actually be evicted; the line will simply be used to store the new block
- * of data.
+/* This function handles the case when space must be made in the current
+ * cache set for the block with the specified tag.  A victim is selected by
+ * the cache's replacement policy, and if it is dirty, this function also
+ * ensures that the cache line is written back to the next level of the
+ * memory.  At completion, the function returns a pointer to the newly
+ * emptied and invalidated cache line that can be used to load a new block
+ * from the next level of memory.  for_prefetch is nonzero if the new block
+ * is being prefetched, so that a later miss on the victim can be blamed on
+ * the prefetch.
+ *
+ * An inclusive cache first invalidates the victim's copies in the caches in
+ * front of it, taking their newer data.  The victim then goes to the victim
+ * cache if there is one, or to an exclusive next level whether or not it is
+ * dirty.  A block that the victim cache displaces is retired last, once the
+ * line is invalid, since retiring it can reach back into this cache.
  */
-cacheline_t * choose_victim(cacheset_t *p_set) {
-    cacheline_t *victim = NULL;
-    
-#if RANDOM_REPLACEMENT_POLICY
-    int i_victim;
-    /* Randomly choose a victim line to evict. */
-    i_victim = rand() % p_set->num_lines;
-    victim = p_set->cache_lines + i_victim;
-#else
-    /* Least Recently Used replacement policy */
-    cacheline_t *p_line = p_set->cache_lines;
-    uint64_t accessed_time = ULONG_MAX;
-    for (int i = 0; i < p_set->num_lines; i++) {
-        if (!p_line[i].valid) {
-            /* if a line is invalid, just return it since it's empty. */
-            victim = &(p_line[i]);
-            break;
-        }
-        if (p_line[i].recent < accessed_time) {
-            /* update and find the line with the smallest access-time value */
-            victim = &(p_line[i]);
-            accessed_time = p_line[i].recent;
-        }
-    }
-    return victim;
-#endif
-    
+cacheline_t * evict_cache_line(cache_t *p_cache, cacheset_t *p_set,
+                               addr_t tag, int for_prefetch) {
+    cacheline_t *victim = p_cache->policy->choose_victim(p_cache, p_set, tag);
+    int valid = line_is_valid(p_set, victim);
+    int displaced = 0, displaced_dirty = 0;
+    addr_t block_start = 0, displaced_start = 0;
+    cache_t *p_next;
+
 #if DEBUG_CACHE
-    if (victim->valid) {
+    if (valid) {
         printf(" * Chose victim line to evict:  tag %u, set %u\n",
-               victim->tag, p_set->set_no);
+               line_tag(p_set, victim), p_set->set_no);
     }
 #endif
 
-    return victim;
-}
+    if (valid) {
+        block_start = get_block_start_from_line_info(p_cache,
+            line_tag(p_set, victim), p_set->set_no);
+    }
 
+    if (valid && p_cache->inclusion == INCLUSION_INCLUSIVE &&
+        p_cache->num_upper_caches > 0) {
+        p_cache->num_back_invalidations += back_invalidate(p_cache,
+            block_start, p_cache->block_size, victim->block, &victim->dirty);
+    }
 
-/* This function handles the case when space must be made in the current
- * cache set.  A victim is selected using the choose_victim() helper, and if
- * it is dirty, this function also ensures that the cache line is written
- * back to the next level of the memory.  At completion, the function returns
- * a pointer to the newly emptied and invalidated cache line that can be used
- * to load a new block from the next level of memory.
- */
-cacheline_t * evict_cache_line(cache_t *p_cache, cacheset_t *p_set) {
-    /* Randomly choose a victim line to evict. */
-    cacheline_t *victim = choose_victim(p_set);
+    p_next = next_cache(p_cache->next_memory);
 
-    if (victim->valid && victim->dirty) {
+    if (valid && p_cache->victim_cache != NULL) {
+        displaced = fill_victim_cache(p_cache, block_start, victim->block,
+                                      victim->dirty, &displaced_start,
+                                      &displaced_dirty);
+    }
+    else if (valid && p_next != NULL &&
+             p_next->inclusion == INCLUSION_EXCLUSIVE) {
+        retire_block(p_cache, block_start, victim->block, victim->dirty);
+    }
+    else if (valid && victim->dirty) {
         /* The line being evicted is dirty, so we need to
          * write it back to the next level.
          */
@@ -444,12 +1371,30 @@ cacheline_t * evict_cache_line(cache_t *p_cache, cacheset_t *p_set) {
         printf(" * Victim cache line is dirty; writing back.\n");
 #endif
 
-        write_back_cache_line(p_cache, victim, p_set->set_no);
+        write_back_cache_line(p_cache, p_set, victim);
     }
 
-    victim->valid = 0;
+    if (p_cache->prefetcher != NULL && valid) {
+        if (victim->prefetched) {
+            /* The victim was prefetched, but never used. */
+            p_cache->num_unused_prefetches++;
+            victim->prefetched = 0;
+        }
+        else if (for_prefetch) {
+            /* Remember the victim, in case it is missed on later. */
+            addr_t block = block_start >> p_cache->block_offset_bits;
+            p_cache->prefetch_victims[block % PREFETCH_VICTIMS] = block + 1;
+        }
+    }
+
+    p_set->tags[victim->line_no] = INVALID_TAG;
     victim->dirty = 0;
-    victim->tag = 0;
+    victim->state = LINE_INVALID;
+
+    if (displaced) {
+        retire_block(p_cache, displaced_start, p_cache->victim_swap,
+                     displaced_dirty);
+    }
 
     return victim;
 }
@@ -458,24 +1403,37 @@ cacheline_t * evict_cache_line(cache_t *p_cache, cacheset_t *p_set) {
 /* This function loads a block of data from the next level of the memory into
  * the specified cache-line of this cache.  The tag could be computed from
  * the address, but it is passed in as an argument since it was already
- * computed earlier on.
+ * computed earlier on.  A coherent cache gets the block through its
+ * coherence bus instead, which needs to know if the block is to be written.
+ * A block taken out of an exclusive next level stays dirty if it was dirty
+ * there.
  */
-void load_cache_line(cache_t *p_cache, cacheline_t *p_line, addr_t address,
-                     addr_t tag) {
+void load_cache_line(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line,
+                     addr_t address, addr_t tag, int for_write) {
     membase_t *next_mem = p_cache->next_memory;
+    cache_t *p_next;
     addr_t start_addr;
-    int offset;
 
     /* Determine the start of the block that holds the specified address. */
     start_addr = get_block_start_from_address(p_cache, address);
 
-    /* Read each byte of the new line from the next level. */
-    for (offset = 0; offset < p_cache->block_size; offset++)
-        p_line->block[offset] = read_byte(next_mem, start_addr + offset);
+    /* Buffered writes to the block must reach the next level first. */
+    if (p_cache->write_buffer != NULL)
+        drain_write_buffer_block(p_cache, start_addr);
+
+    /* Read the new line from the next level in a single access. */
+    if (p_cache->bus != NULL)
+        coherence_fill(p_cache, p_line, start_addr, for_write);
+    else
+        read_block(next_mem, start_addr, p_line->block, p_cache->block_size);
 
-    p_line->valid = 1;
+    assert(tag != INVALID_TAG);
+    p_set->tags[p_line->line_no] = tag;
     p_line->dirty = 0;
-    p_line->tag = tag;
+
+    p_next = next_cache(next_mem);
+    if (p_next != NULL && p_next->inclusion == INCLUSION_EXCLUSIVE)
+        p_line->dirty = p_next->handoff_dirty;
 }
 
 
@@ -484,35 +1442,488 @@ void load_cache_line(cache_t *p_cache, cacheline_t *p_line, addr_t address,
  * compute the starting address of the block, since the address itself is not
  * stored in the cache line.
  */
-void write_back_cache_line(cache_t *p_cache, cacheline_t *p_line,
-                           addr_t set_no) {
+void write_back_cache_line(cache_t *p_cache, cacheset_t *p_set,
+                           cacheline_t *p_line) {
     /* The line being evicted is dirty, so we need to
      * write it back to the next level.
      */
-    membase_t *next_mem = p_cache->next_memory;
     addr_t start_addr;
-    int offset;
 
-    assert(p_line->valid);
+    assert(line_is_valid(p_set, p_line));
     assert(p_line->dirty);
 
 #if DEBUG_CACHE
-    printf(" * Tag of cache line being written back is %u\n", p_line->tag);
-    printf(" * Set of cache line being written back is %u\n", set_no);
+    printf(" * Tag of cache line being written back is %u\n",
+           line_tag(p_set, p_line));
+    printf(" * Set of cache line being written back is %u\n", p_set->set_no);
 #endif
 
     /* Reconstruct the address where the block is stored, so we can
      * write it back to the next level.
      */
-    start_addr = get_block_start_from_line_info(p_cache, p_line->tag, set_no);
+    start_addr = get_block_start_from_line_info(p_cache,
+                                                line_tag(p_set, p_line),
+                                                p_set->set_no);
 
 #if DEBUG_CACHE
     printf(" * Start address of cache line being written back is %u\n",
            start_addr);
 #endif
 
-    /* Write each byte of the victim line out to the next level. */
-    for (offset = 0; offset < p_cache->block_size; offset++)
-        write_byte(next_mem, start_addr + offset, p_line->block[offset]);
+    /* Write the victim line out to the next level in a single access. */
+    p_cache->num_write_backs++;
+    if (p_cache->bus != NULL)
+        coherence_write_back(p_cache);
+    send_write(p_cache, start_addr, p_line->block, p_cache->block_size);
+}
+
+
+/* This function sends a block that is leaving the cache to the next level:
+ * into an exclusive next level whether it is dirty or not, or otherwise as
+ * a write-back, if it is dirty.  The block may be a line being evicted or
+ * a block displaced from the victim cache.  A block put into an exclusive
+ * next level counts as a next-level write, since it costs as much traffic
+ * as one, clean or not.
+ */
+void retire_block(cache_t *p_cache, addr_t block_start,
+                  const unsigned char *data, int dirty) {
+    cache_t *p_next = next_cache(p_cache->next_memory);
+
+    if (dirty)
+        p_cache->num_write_backs++;
+
+    if (p_next != NULL && p_next->inclusion == INCLUSION_EXCLUSIVE) {
+        /* Buffered writes to the block are older than the block. */
+        if (p_cache->write_buffer != NULL)
+            drain_write_buffer_block(p_cache, block_start);
+        fill_victim_block(p_next, block_start, data, dirty);
+        p_cache->num_next_writes++;
+        p_cache->num_next_write_bytes += p_cache->block_size;
+    }
+    else if (dirty) {
+        if (p_cache->bus != NULL)
+            coherence_write_back(p_cache);
+        send_write(p_cache, block_start, data, p_cache->block_size);
+    }
+}
+
+
+/*---------------------------------------------------------------------------
+ * INCLUSION AND VICTIM CACHE FUNCTIONS
+ */
+
+
+/* This function invalidates every copy of the size bytes at start in the
+ * caches in front of p_cache, and in the caches in front of those, for an
+ * inclusive cache that is evicting them.  The copies' newer data is copied
+ * into data, which holds the bytes being evicted, and *p_dirty is set if
+ * any of it was dirty.  Within each cache, the write buffer is older than
+ * the victim cache and the lines, and the caches further in front are
+ * newer still, so they are copied in that order.  Returns the number of
+ * lines and victim-cache entries invalidated.
+ */
+uint64_t back_invalidate(cache_t *p_cache, addr_t start, uint32_t size,
+                         unsigned char *data, char *p_dirty) {
+    uint64_t count = 0;
+    addr_t address;
+    uint32_t i, j;
+    int u;
+
+    for (u = 0; u < p_cache->num_upper_caches; u++) {
+        cache_t *p_upper = p_cache->upper_caches[u];
+        uint32_t block_size = p_upper->block_size;
+
+        assert(block_size <= size);
+
+        for (address = start; address - start < size;
+             address += block_size) {
+            unsigned char *block = data + (address - start);
+            victim_entry_t *p_entry;
+            addr_t tag, set_no, offset;
+            cacheset_t *p_set;
+            cacheline_t *p_line;
+            int invalidated = 0;
+
+            for (i = 0; i < p_upper->write_buffer_size; i++) {
+                writebuf_entry_t *p_buf = p_upper->write_buffer + i;
+
+                if (!p_buf->valid || p_buf->block_start != address)
+                    continue;
+
+                for (j = 0; j < block_size; j++) {
+                    if (p_buf->written[j])
+                        block[j] = p_buf->data[j];
+                }
+                p_buf->valid = 0;
+                *p_dirty = 1;
+            }
+
+            p_entry = find_victim_entry(p_upper, address);
+            if (p_entry != NULL) {
+                if (p_entry->dirty) {
+                    copy_bytes(block, p_entry->data, block_size);
+                    *p_dirty = 1;
+                }
+                p_entry->valid = 0;
+                invalidated = 1;
+            }
+
+            decompose_address(p_upper, address, &tag, &set_no, &offset);
+            p_set = p_upper->cache_sets + set_no;
+            p_line = find_line_in_set(p_set, tag);
+            if (p_line != NULL) {
+                if (p_line->dirty) {
+                    copy_bytes(block, p_line->block, block_size);
+                    *p_dirty = 1;
+                }
+                if (p_line->prefetched) {
+                    p_upper->num_unused_prefetches++;
+                    p_line->prefetched = 0;
+                }
+                p_set->tags[p_line->line_no] = INVALID_TAG;
+                p_line->dirty = 0;
+                p_line->state = LINE_INVALID;
+                invalidated = 1;
+            }
+
+            if (invalidated) {
+                uint32_t block_no = address >> p_upper->block_offset_bits;
+
+                if (p_upper->inclusion_victims == NULL) {
+                    p_upper->inclusion_victims = calloc(INCLUSION_VICTIMS,
+                                                        sizeof(uint32_t));
+                    if (p_upper->inclusion_victims == NULL) {
+                        printf("Not enough memory.\n");
+                        exit(0);
+                    }
+                }
+                p_upper->inclusion_victims[block_no % INCLUSION_VICTIMS] =
+                    block_no + 1;
+                p_upper->num_inclusion_invalidations++;
+                count++;
+            }
+
+            if (p_upper->num_upper_caches > 0) {
+                count += back_invalidate(p_upper, address, block_size, block,
+                                         p_dirty);
+            }
+        }
+    }
+
+    return count;
+}
+
+
+/* This function implements reads from an exclusive cache by the caches in
+ * front of it, which read whole blocks.  A block that hits is handed over
+ * and invalidated here, with handoff_dirty telling the reader whether it
+ * was dirty.  A block that misses is read from the next level without
+ * being allocated here, since the reader will hold it.  The lookup is of
+ * one byte, as a miss that allocates would be, and the rest of the bytes
+ * count as hits.
+ */
+void exclusive_read(cache_t *p_cache, addr_t address, unsigned char *buf,
+                    uint32_t size) {
+    addr_t tag, set_no, block_offset;
+    cacheline_t *p_line;
+
+    decompose_address(p_cache, address, &tag, &set_no, &block_offset);
+    assert(block_offset + size <= p_cache->block_size);
+
+    p_line = resolve_cache_access(p_cache, address, 1, 0, 0);
+    p_cache->num_reads += size;
+    p_cache->num_hits += size - 1;
+
+    if (p_line != NULL) {
+        cacheset_t *p_set = p_cache->cache_sets + set_no;
+
+        copy_bytes(buf, p_line->block + block_offset, size);
+        p_cache->handoff_dirty = p_line->dirty;
+
+        p_set->tags[p_line->line_no] = INVALID_TAG;
+        p_line->dirty = 0;
+        p_line->state = LINE_INVALID;
+    }
+    else {
+        uint64_t start_cycles = 0;
+
+        if (p_cache->write_buffer != NULL) {
+            drain_write_buffer_block(p_cache,
+                                     get_block_start_from_address(p_cache,
+                                                                  address));
+        }
+
+        if (p_cache->timed)
+            start_cycles = level_cycles(p_cache->next_memory);
+        read_block(p_cache->next_memory, address, buf, size);
+        if (p_cache->timed) {
+            charge_miss_penalty(p_cache,
+                level_cycles(p_cache->next_memory) - start_cycles);
+        }
+        p_cache->handoff_dirty = 0;
+    }
+
+    if (p_cache->prefetcher != NULL) {
+        p_cache->prefetcher->access(p_cache, address,
+                                    p_cache->prefetch_trigger);
+    }
+}
+
+
+/* This function puts a block evicted by a cache in front of an exclusive
+ * cache into the exclusive cache.  It normally takes a line of its own,
+ * but if the cache prefetched the block while the cache in front held it,
+ * the copy here is brought up to date instead.  A write-through cache
+ * writes a dirty block straight on to the next level.
+ */
+void fill_victim_block(cache_t *p_cache, addr_t block_start,
+                       const unsigned char *data, int dirty) {
+    addr_t tag, set_no, block_offset;
+    cacheset_t *p_set;
+    cacheline_t *p_line;
+
+    decompose_address(p_cache, block_start, &tag, &set_no, &block_offset);
+    p_set = p_cache->cache_sets + set_no;
+    p_line = find_line_in_set(p_set, tag);
+    p_cache->num_victim_fills++;
+
+    if (p_line == NULL) {
+        p_line = evict_cache_line(p_cache, p_set, tag, 0);
+        p_set->tags[p_line->line_no] = tag;
+        p_line->dirty = 0;
+        p_cache->policy->line_filled(p_cache, p_set, p_line);
+    }
+
+    copy_bytes(p_line->block, data, p_cache->block_size);
+    if (dirty && p_cache->write_through) {
+        p_cache->num_write_throughs++;
+        send_write(p_cache, block_start, data, p_cache->block_size);
+    }
+    else if (dirty) {
+        p_line->dirty = 1;
+    }
+}
+
+
+/* Returns 1 if the cache or its victim cache holds the block containing the
+ * specified address, or 0 if not.
+ */
+int holds_block(cache_t *p_cache, addr_t address) {
+    addr_t tag, set_no, block_offset;
+
+    decompose_address(p_cache, address, &tag, &set_no, &block_offset);
+    if (find_line_in_set(p_cache->cache_sets + set_no, tag) != NULL)
+        return 1;
+
+    return find_victim_entry(p_cache, address - block_offset) != NULL;
+}
+
+
+/* Returns the number of blocks that the cache and its victim cache hold,
+ * not counting those that p_lower also holds, if p_lower isn't NULL.
+ */
+uint64_t count_distinct_blocks(cache_t *p_cache, cache_t *p_lower) {
+    uint64_t count = 0;
+    addr_t set_no;
+    uint32_t i;
+    int line_no;
+
+    for (set_no = 0; set_no < p_cache->num_sets; set_no++) {
+        cacheset_t *p_set = p_cache->cache_sets + set_no;
+
+        for (line_no = 0; line_no < p_set->num_lines; line_no++) {
+            cacheline_t *p_line = p_set->cache_lines + line_no;
+
+            if (line_is_valid(p_set, p_line) &&
+                (p_lower == NULL ||
+                 !holds_block(p_lower, get_block_start_from_line_info(
+                     p_cache, line_tag(p_set, p_line), set_no))))
+                count++;
+        }
+    }
+
+    for (i = 0; i < p_cache->victim_cache_size; i++) {
+        victim_entry_t *p_entry = p_cache->victim_cache + i;
+
+        if (p_entry->valid &&
+            (p_lower == NULL || !holds_block(p_lower, p_entry->block_start)))
+            count++;
+    }
+
+    return count;
+}
+
+
+/* Returns the victim-cache entry holding the block that starts at
+ * block_start, or NULL if the victim cache doesn't hold it.
+ */
+victim_entry_t * find_victim_entry(cache_t *p_cache, addr_t block_start) {
+    uint32_t i;
+
+    for (i = 0; i < p_cache->victim_cache_size; i++) {
+        victim_entry_t *p_entry = p_cache->victim_cache + i;
+
+        if (p_entry->valid && p_entry->block_start == block_start)
+            return p_entry;
+    }
+
+    return NULL;
+}
+
+
+/* This function puts a block evicted from the cache into the victim cache,
+ * in a free entry or in place of the least recently filled one.  If that
+ * displaces a block, the block is copied to victim_swap, its start and
+ * dirty bit are stored in *p_displaced and *p_displaced_dirty, and the
+ * function returns 1; the caller must then retire the block.  Otherwise
+ * it returns 0.
+ */
+int fill_victim_cache(cache_t *p_cache, addr_t block_start,
+                      const unsigned char *data, int dirty,
+                      addr_t *p_displaced, int *p_displaced_dirty) {
+    victim_entry_t *p_entry = NULL;
+    int displaced = 0;
+    uint32_t i;
+
+    for (i = 0; i < p_cache->victim_cache_size; i++) {
+        victim_entry_t *p = p_cache->victim_cache + i;
+
+        if (p_entry == NULL || !p->valid ||
+            (p_entry->valid && p->recent < p_entry->recent))
+            p_entry = p;
+        if (!p->valid)
+            break;
+    }
+
+    if (p_entry->valid) {
+        copy_bytes(p_cache->victim_swap, p_entry->data, p_cache->block_size);
+        *p_displaced = p_entry->block_start;
+        *p_displaced_dirty = p_entry->dirty;
+        displaced = 1;
+    }
+
+    p_entry->valid = 1;
+    p_entry->dirty = dirty;
+    p_entry->block_start = block_start;
+    p_entry->recent = ++p_cache->victim_clock;
+    copy_bytes(p_entry->data, data, p_cache->block_size);
+
+    return displaced;
+}
+
+
+/*---------------------------------------------------------------------------
+ * WRITE BUFFER FUNCTIONS
+ */
+
+
+/* This function sends a write of size bytes, all within one block, towards
+ * the next level of the memory.  If the cache has a write buffer, the write
+ * is combined with any other buffered writes to the same block, and the
+ * oldest entry is drained to make room if the buffer is full; otherwise the
+ * write goes straight to the next level.
+ */
+void send_write(cache_t *p_cache, addr_t address, const unsigned char *buf,
+                uint32_t size) {
+    addr_t block_start = get_block_start_from_address(p_cache, address);
+    addr_t block_offset = address - block_start;
+    writebuf_entry_t *p_entry = NULL, *oldest = NULL;
+    uint32_t i;
+
+    if (p_cache->write_buffer == NULL) {
+        write_next_level(p_cache, address, buf, size);
+        return;
+    }
+
+    for (i = 0; i < p_cache->write_buffer_size; i++) {
+        writebuf_entry_t *p = p_cache->write_buffer + i;
+
+        if (p->valid && p->block_start == block_start) {
+            p_entry = p;
+            p_cache->num_combined_writes++;
+            break;
+        }
+
+        if (oldest == NULL || !p->valid ||
+            (oldest->valid && p->filled < oldest->filled))
+            oldest = p;
+    }
+
+    if (p_entry == NULL) {
+        p_entry = oldest;
+        drain_write_buffer_entry(p_cache, p_entry);
+
+        p_entry->valid = 1;
+        p_entry->block_start = block_start;
+        p_entry->filled = ++p_cache->write_buffer_clock;
+        memset(p_entry->written, 0, p_cache->block_size);
+    }
+
+    memcpy(p_entry->data + block_offset, buf, size);
+    memset(p_entry->written + block_offset, 1, size);
+}
+
+
+/* This function writes bytes to the next level of the memory, counting the
+ * write traffic, and lets the prefetcher know that the block has changed.
+ */
+void write_next_level(cache_t *p_cache, addr_t address,
+                      const unsigned char *buf, uint32_t size) {
+    write_block(p_cache->next_memory, address, buf, size);
+
+    p_cache->num_next_writes++;
+    p_cache->num_next_write_bytes += size;
+
+    if (p_cache->prefetcher != NULL &&
+        p_cache->prefetcher->block_written != NULL) {
+        p_cache->prefetcher->block_written(p_cache,
+            get_block_start_from_address(p_cache, address));
+    }
+}
+
+
+/* This function writes the contents of a write-buffer entry to the next
+ * level of the memory, and frees the entry.  Each run of written bytes
+ * becomes one write; a fully written block is a single write.
+ */
+void drain_write_buffer_entry(cache_t *p_cache, writebuf_entry_t *p_entry) {
+    uint32_t start = 0, end;
+
+    if (!p_entry->valid)
+        return;
+
+    while (start < p_cache->block_size) {
+        if (!p_entry->written[start]) {
+            start++;
+            continue;
+        }
+
+        end = start;
+        while (end < p_cache->block_size && p_entry->written[end])
+            end++;
+
+        write_next_level(p_cache, p_entry->block_start + start,
+                         p_entry->data + start, end - start);
+        start = end;
+    }
+
+    p_entry->valid = 0;
+}
+
+
+/* This function drains the write-buffer entry for the block starting at
+ * block_start, if there is one.  It is used before the block is read from
+ * the next level, so that the read sees the buffered writes.
+ */
+void drain_write_buffer_block(cache_t *p_cache, addr_t block_start) {
+    uint32_t i;
+
+    for (i = 0; i < p_cache->write_buffer_size; i++) {
+        writebuf_entry_t *p_entry = p_cache->write_buffer + i;
+        if (p_entry->valid && p_entry->block_start == block_start) {
+            drain_write_buffer_entry(p_cache, p_entry);
+            break;
+        }
+    }
 }
 
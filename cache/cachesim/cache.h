@@ -2,34 +2,126 @@
 #define CACHE_H
 
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "membase.h"
 
 
-/* This struct represents to a cache line within a cache set. */
+struct replacement_policy_t;
+struct prefetcher_t;
+struct coherence_bus_t;
+struct miss_classifier_t;
+
+
+/* The tag recorded for invalid lines.  Simulated memories are smaller than
+ * 2^31 bytes, so no block can have this tag.
+ */
+#define INVALID_TAG 0xFFFFFFFFU
+
+/* Each cache set's tag array is padded with invalid entries to a multiple
+ * of this many, so that lookups can compare this many tags at once.
+ */
+#define TAG_GROUP 4
+
+
+/* This struct represents to a cache line within a cache set.  A line's tag,
+ * and whether it is valid, are kept in the set's tags array rather than in
+ * the line, so that looking up a tag doesn't touch the lines at all; use
+ * line_is_valid() and line_tag() to get at them.
+ */
 typedef struct cacheline_t {
-    /* The index of the cache line.  This is mainly for informational and
-     * debugging purposes; it is not used in the normal operation of the
-     * cache.
+    /* The index of the cache line within its set, which is also its index
+     * in the set's tags array.
      */
     uint32_t line_no;
 
-    /* This value will be 0 if the line is invalid, 1 if it is valid. */
-    char valid;
-
     /* This value will be 0 if the line is clean, 1 if it is dirty. */
     char dirty;
 
-    /* This is the tag for the cache line, taken from the address. */
-    uint32_t tag;
+    /* This value will be 1 if the line was filled by the prefetcher and
+     * hasn't been accessed since, 0 otherwise.
+     */
+    char prefetched;
+
+    /* The line's coherence state (see coherence.h), if the cache is attached
+     * to a coherence bus.
+     */
+    char state;
+
+    /* Per-line state kept by the replacement policy, such as an access
+     * count or a re-reference prediction.
+     */
+    uint32_t policy_bits;
     
-    /* This is the start of the block of data itself. */
+    /* This is the start of the block of data itself, within the cache's
+     * block_data.
+     */
     unsigned char *block;
 
-    /* This is the most recent time that this cache line is accessed. */
+    /* This is a time from cache_clock_tick() kept by the replacement
+     * policy; for LRU, it is the most recent time that this cache line is
+     * accessed.
+     */
     uint64_t recent;
 } cacheline_t;
 
 
+/* This struct represents an entry in a cache's write buffer.  Each entry
+ * collects the writes to one block, so that several writes to the block
+ * reach the next level of the memory together.
+ */
+typedef struct writebuf_entry_t {
+    /* This value will be 1 if the entry holds writes, 0 if it is free. */
+    char valid;
+
+    /* The start address of the block the writes are to. */
+    addr_t block_start;
+
+    /* The bytes written, and for each byte of the block, 1 if it has been
+     * written and 0 if not.
+     */
+    unsigned char *data;
+    unsigned char *written;
+
+    /* When the entry was filled, so that the oldest entry drains first. */
+    uint64_t filled;
+} writebuf_entry_t;
+
+
+/* This struct represents an entry in a cache's victim cache, a small fully
+ * associative cache of the blocks most recently evicted from the cache.
+ */
+typedef struct victim_entry_t {
+    /* This value will be 1 if the entry holds a block, 0 if it is free. */
+    char valid;
+
+    /* This value will be 1 if the block is dirty, 0 if it is clean. */
+    char dirty;
+
+    /* The start address of the block, and the block's data. */
+    addr_t block_start;
+    unsigned char *data;
+
+    /* When the entry was last filled, for LRU replacement. */
+    uint64_t recent;
+} victim_entry_t;
+
+
+/* The inclusion policies a cache can have towards the caches directly in
+ * front of it (those whose next level it is).  A non-inclusive,
+ * non-exclusive cache doesn't care what they hold.  An inclusive cache
+ * holds every block that they hold, and when it evicts a block, it
+ * invalidates their copies (back-invalidation).  An exclusive cache holds
+ * none of their blocks:  a block they read moves up out of it, and the
+ * blocks they evict, clean or dirty, move down into it.
+ */
+#define INCLUSION_NINE 0
+#define INCLUSION_INCLUSIVE 1
+#define INCLUSION_EXCLUSIVE 2
+
+
 /* This struct represents a cache set within the cache. */
 typedef struct cacheset_t {
     /* The number of the cache set.  This allows us to construct addresses
@@ -46,6 +138,15 @@ typedef struct cacheset_t {
 
     /* The cache lines in this cache set. */
     cacheline_t *cache_lines;
+
+    /* The tag of each line in the set, or INVALID_TAG if the line is
+     * invalid, followed by INVALID_TAG padding up to a multiple of
+     * TAG_GROUP entries.  Points into the cache's tag_data.
+     */
+    uint32_t *tags;
+
+    /* Per-set state allocated by the replacement policy, if it needs any. */
+    void *policy_state;
 } cacheset_t;
 
 
@@ -66,6 +167,14 @@ typedef struct cache_t {
     
     /* The function to write a byte to the cache. */
     void (*write_byte)(membase_t *mb, addr_t address, unsigned char value);
+
+    /* The function to read size bytes starting at address into buf. */
+    void (*read_block)(membase_t *mb, addr_t address,
+                       unsigned char *buf, uint32_t size);
+
+    /* The function to write size bytes from buf starting at address. */
+    void (*write_block)(membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size);
  
     /* The function to print the cache's access statistics. */
     void (*print_stats)(struct membase_t *mb);
@@ -78,6 +187,16 @@ typedef struct cache_t {
      */
     void (*free)(membase_t *mb);
 
+    /* The function to return the level behind this one, or NULL for the
+     * memory at the bottom of the hierarchy.
+     */
+    membase_t * (*next_level)(membase_t *mb);
+
+    /* The function to return the cycles that the accesses to this level
+     * have taken so far, counting the levels behind it.
+     */
+    uint64_t (*cycles)(membase_t *mb);
+
 
     /* This is the block size for the cache line, and is required to be a
      * power of 2.
@@ -105,6 +224,12 @@ typedef struct cache_t {
     /* The array of cache sets themselves. */
     cacheset_t *cache_sets;
 
+    /* The storage for every set's tags array, and for the data of every
+     * cache line, each allocated in one piece.
+     */
+    uint32_t *tag_data;
+    unsigned char *block_data;
+
     /* The memory that this is a cache of. */
     membase_t *next_memory;
 
@@ -114,14 +239,349 @@ typedef struct cache_t {
     /* The number of cache misses. */
     uint64_t num_misses;
 
+    /* The replacement policy used to choose lines to evict. */
+    const struct replacement_policy_t *policy;
+
+    /* A counter for policies that do something every so many fills. */
+    uint32_t policy_counter;
+
+    /* The cache's clock, advanced by cache_clock_tick(), and the state of
+     * its random-number generator.  Each cache keeps its own, so that
+     * separate simulations can run at the same time in different threads.
+     */
+    uint64_t clock;
+    uint32_t rand_state;
+
+    /* The prefetcher, or NULL if the cache only loads lines on demand, along
+     * with its state and the number of blocks it fetches ahead.
+     */
+    const struct prefetcher_t *prefetcher;
+    void *prefetch_state;
+    uint32_t prefetch_degree;
+
+    /* The size of the memory; blocks past it are never prefetched. */
+    uint32_t prefetch_limit;
+
+    /* Set by each access:  nonzero if the access missed, or was the first
+     * access to a prefetched line, either of which may trigger prefetches.
+     */
+    int prefetch_trigger;
+
+    /* The number of blocks prefetched, the number of those that were used,
+     * and the number that were evicted or discarded without being used.
+     */
+    uint64_t num_prefetches;
+    uint64_t num_useful_prefetches;
+    uint64_t num_unused_prefetches;
+
+    /* The number of misses on blocks that a prefetch had evicted. */
+    uint64_t num_polluting_misses;
+
+    /* The blocks most recently evicted by prefetches, stored as block
+     * number plus 1 and hashed by block number.
+     */
+    uint32_t *prefetch_victims;
+
+    /* This value will be 1 if every write is also sent to the next level
+     * of the memory, or 0 if writes only reach it when dirty lines are
+     * written back.
+     */
+    int write_through;
+
+    /* This value will be 1 if a write miss loads the block into the cache,
+     * or 0 if the write goes around the cache to the next level instead.
+     */
+    int write_allocate;
+
+    /* The write buffer between this cache and the next level, or NULL if
+     * writes go to the next level directly.
+     */
+    writebuf_entry_t *write_buffer;
+    uint32_t write_buffer_size;
+    uint64_t write_buffer_clock;
+
+    /* The number of dirty lines written back, and the number of writes
+     * sent to the next level by write-through and by write-around.
+     */
+    uint64_t num_write_backs;
+    uint64_t num_write_throughs;
+    uint64_t num_write_arounds;
+
+    /* The number of writes merged into a write-buffer entry that already
+     * held writes to the same block.
+     */
+    uint64_t num_combined_writes;
+
+    /* The write traffic that actually reached the next level:  the number
+     * of write accesses, and the number of bytes they wrote.
+     */
+    uint64_t num_next_writes;
+    uint64_t num_next_write_bytes;
+
+    /* The coherence bus that the cache is attached to, or NULL if it isn't
+     * kept coherent with other caches; and if it is, the core it belongs to
+     * and its level among that core's caches, starting from 0.
+     */
+    struct coherence_bus_t *bus;
+    int core;
+    int core_level;
+
+    /* The number of lines invalidated by other cores' writes, and the
+     * number of misses on blocks that had been invalidated that way.
+     */
+    uint64_t num_invalidations;
+    uint64_t num_coherence_misses;
+
+    /* The blocks most recently invalidated by other cores, stored like
+     * prefetch_victims.
+     */
+    uint32_t *coherence_victims;
+
+    /* The classifier of the cache's misses, or NULL if they aren't being
+     * classified.
+     */
+    struct miss_classifier_t *classifier;
+
+    /* The timing model:  nonzero if the cache keeps time at all, the
+     * cycles an access to the cache takes when it hits, and the most
+     * misses that may be outstanding at once, where 0 or 1 means that
+     * every miss stalls for its whole penalty.
+     */
+    int timed;
+    uint32_t hit_latency;
+    uint32_t mlp;
+
+    /* The number of accesses to the cache (each a run of bytes within one
+     * line), and the cycles they took, including the time that misses
+     * spent at the levels below.
+     */
+    uint64_t num_accesses;
+    uint64_t num_cycles;
+
+    /* The current cluster of overlapping misses:  the access that started
+     * it, the number of misses in it, and the longest penalty among them.
+     * Also the number of misses whose penalty overlapped an earlier miss.
+     */
+    uint64_t cluster_start;
+    uint32_t cluster_misses;
+    uint64_t cluster_penalty;
+    uint64_t num_overlapped_misses;
+
+    /* The caches directly in front of this one, which are recorded by
+     * init_cache(), for the inclusion policies.
+     */
+    struct cache_t **upper_caches;
+    int num_upper_caches;
+
+    /* The cache's inclusion policy towards the caches in front of it, and
+     * nonzero if it was chosen with set_inclusion_policy(), which makes
+     * the statistics report it.
+     */
+    int inclusion;
+    int report_inclusion;
+
+    /* Set by each read that an exclusive cache hands a block up with:  1 if
+     * the block was dirty, so that the reader's copy is dirty too.
+     */
+    int handoff_dirty;
+
+    /* The number of lines this cache invalidated in the caches in front of
+     * it when it evicted blocks, and the number of blocks that the caches
+     * in front of an exclusive cache evicted into it.
+     */
+    uint64_t num_back_invalidations;
+    uint64_t num_victim_fills;
+
+    /* The number of lines invalidated by the cache behind this one when it
+     * evicted blocks, and the number of misses on blocks that had been
+     * invalidated that way, with the blocks remembered like
+     * prefetch_victims.
+     */
+    uint64_t num_inclusion_invalidations;
+    uint64_t num_inclusion_misses;
+    uint32_t *inclusion_victims;
+
+    /* The victim cache, or NULL if the cache has none, with its number of
+     * entries, its clock, a block-sized buffer for swapping a block with
+     * it, and the number of misses that it served.
+     */
+    victim_entry_t *victim_cache;
+    uint32_t victim_cache_size;
+    uint64_t victim_clock;
+    unsigned char *victim_swap;
+    uint64_t num_victim_hits;
+
 } cache_t;
 
 
+/* This function emulates a hardware clock for the cache, e.g. for tagging
+ * cache lines in order to implement an LRU replacement policy.  Every call
+ * advances the cache's clock by one tick, and then returns the new value.
+ */
+static inline uint64_t cache_clock_tick(cache_t *p_cache) {
+    return ++p_cache->clock;
+}
+
+/* Returns a pseudo-random number from the cache's own generator. */
+uint32_t cache_random(cache_t *p_cache);
+
+
+/* Returns nonzero if the specified line of the set holds a block. */
+static inline int line_is_valid(const cacheset_t *p_set,
+                                const cacheline_t *p_line) {
+    return p_set->tags[p_line->line_no] != INVALID_TAG;
+}
+
+/* Returns the tag of the block in the specified (valid) line of the set. */
+static inline addr_t line_tag(const cacheset_t *p_set,
+                              const cacheline_t *p_line) {
+    return p_set->tags[p_line->line_no];
+}
+
+/* Returns the index of the first line in the set whose tag is the specified
+ * tag, or -1 if there is none.  Passing INVALID_TAG finds an invalid line.
+ * The tags are compared TAG_GROUP at a time; the padding after the last line
+ * is always INVALID_TAG, so it can only match a search for an invalid line,
+ * and such a match is ignored.
+ */
+static inline int find_tag_in_set(const cacheset_t *p_set, addr_t tag) {
+    int i;
+
+#ifdef __SSE2__
+    __m128i key = _mm_set1_epi32((int) tag);
+
+    for (i = 0; i < p_set->num_lines; i += TAG_GROUP) {
+        __m128i tags = _mm_loadu_si128((const __m128i *) (p_set->tags + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpeq_epi32(tags, key)));
+
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return i < p_set->num_lines ? i : -1;
+        }
+    }
+#else
+    for (i = 0; i < p_set->num_lines; i++) {
+        if (p_set->tags[i] == tag)
+            return i;
+    }
+#endif
+
+    return -1;
+}
+
+
 void init_cache(cache_t *p_cache, uint32_t block_size, uint32_t num_sets,
     uint32_t lines_per_set, membase_t *next_mem);
 
 int flush_cache(cache_t *p_cache);
 
+/* Changes the replacement policy of a cache.  This should be done before the
+ * cache is used; caches start out with the LRU policy.
+ */
+void set_replacement_policy(cache_t *p_cache,
+                            const struct replacement_policy_t *policy);
+
+/* Changes how a cache handles writes:  write-through or write-back, with or
+ * without write-allocate, and with a write-combining buffer of the
+ * specified number of entries, or none if it is 0.  This should also be done
+ * before the cache is used; caches start out write-back and write-allocate,
+ * with no write buffer.
+ */
+void set_write_policy(cache_t *p_cache, int write_through, int write_allocate,
+                      uint32_t write_buffer_size);
+
+/* Gives a cache a prefetcher that fetches degree blocks ahead.  mem_size is
+ * the size of the memory, which prefetches must stay within.  This should
+ * also be done before the cache is used.
+ */
+void set_prefetcher(cache_t *p_cache, const struct prefetcher_t *prefetcher,
+                    uint32_t degree, uint32_t mem_size);
+
+/* Starts classifying the cache's misses as compulsory, capacity, conflict or
+ * coherence misses (see classify.h), which its statistics then report.
+ * This should also be done before the cache is used.
+ */
+void set_miss_classification(cache_t *p_cache);
+
+/* Changes the inclusion policy of a cache towards the caches in front of
+ * it, to one of the INCLUSION_ constants.  The caches in front of an
+ * inclusive cache must have blocks no larger than its own, and those in
+ * front of an exclusive cache must have blocks of the same size, and no
+ * prefetcher that keeps its own copies of blocks.  This should be done
+ * before the cache is used.
+ */
+void set_inclusion_policy(cache_t *p_cache, int inclusion);
+
+/* Gives a cache a victim cache of the specified number of entries, which
+ * the cache's evicted blocks go to before they go to the next level.  This
+ * should also be done before the cache is used.
+ */
+void set_victim_cache(cache_t *p_cache, uint32_t num_entries);
+
+/* Checks that a cache can be in front of the caches behind it, given their
+ * inclusion policies.  Prints an error and returns -1 if it can't be, or
+ * returns 0.  This should be done once the cache's prefetcher is set.
+ */
+int check_inclusion(cache_t *p_cache);
+
+/* The names of the inclusion policies, indexed by the INCLUSION_
+ * constants.
+ */
+extern const char *inclusion_names[];
+
+/* Gives a cache a hit latency, in cycles, and lets up to mlp of its misses
+ * overlap (see MLP_WINDOW in cache.c), or none if mlp is 0 or 1.  Caches
+ * start out without timing, so that their misses don't pay for measuring
+ * the levels below; a cache keeps time once this has been called, or once
+ * set_memory_latency() has passed through it.
+ */
+void set_cache_latency(cache_t *p_cache, uint32_t hit_latency, uint32_t mlp);
+
+/* Sets the latency, in cycles, of the memory at the bottom of the hierarchy
+ * that starts at mb, going down through the caches and the levels that
+ * pass accesses through, and makes the caches on the way keep time.
+ */
+void set_memory_latency(membase_t *mb, uint32_t latency);
+
+/* Names a range of addresses, such as one data structure, so that the
+ * accesses and misses that fall in it are reported separately.  The region
+ * is added to every cache from mb down that classifies its misses, as far
+ * as the memory at the bottom.
+ */
+void add_miss_region(membase_t *mb, const char *name, addr_t start,
+                     uint32_t size);
+
+/* Returns the memory as a cache, or NULL if it isn't a cache. */
+cache_t * as_cache(membase_t *mb);
+
+/* Returns the first cache from mb down, passing through the levels that
+ * aren't caches, or NULL if there is no cache before the memory.
+ */
+cache_t * next_cache(membase_t *mb);
+
+/* Returns 1 if the cache or its victim cache holds the block containing the
+ * specified address, or 0 if not.
+ */
+int holds_block(cache_t *p_cache, addr_t address);
+
+/* Invalidates a valid line on behalf of a coherence protocol, without
+ * writing it back.  A later miss on the block counts as a coherence miss.
+ */
+void invalidate_cache_line(cache_t *p_cache, cacheset_t *p_set,
+                           cacheline_t *p_line);
+
+/* Prints the statistics of the cache alone, without going on to the next
+ * level of the memory as print_stats() does.
+ */
+void cache_print_level_stats(cache_t *p_cache);
+
+/* Loads the block containing the specified address into the cache, if it
+ * isn't already there, on behalf of the prefetcher.  The access isn't
+ * counted as a hit or a miss.
+ */
+void prefetch_block(cache_t *p_cache, addr_t address);
+
 
 #endif /* CACHE_H */
 
@@ -1,8 +1,172 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "cmdline.h"
 #include "membase.h"
 #include "memory.h"
 #include "cache.h"
+#include "trace.h"
 
 
+/* Accesses are replayed through this buffer; larger accesses are split into
+ * pieces of this size.
+ */
+#define REPLAY_BUFFER_SIZE 4096
 
+/* The most regions that can be named on the command line. */
+#define MAX_REGIONS 64
+
+
+/* This program replays a memory-access trace (see trace.h) through a cached
+ * memory built from the same cache specifications the test programs take.
+ * The trace is streamed, so it can be any length, and can be piped in from
+ * lackey2trace.  Traces only record addresses, so writes store zeros (and
+ * since the memory starts out zeroed, reads only ever see zeros too).
+ */
+
+
+/* Prints the program usage. */
+void cachesim_usage(const char *progname) {
+    printf("usage: %s [-m mem-size] [-r name:start:size ...] trace-file "
+           "[cache-spec ...]\n\n", progname);
+    printf("\tReplays the trace in trace-file (\"-\" for standard input)\n");
+    printf("\tthrough the specified caches.  The memory size comes from the\n");
+    printf("\ttrace's header, unless -m is given; traces written to a pipe\n");
+    printf("\thave no memory size, so -m is required for them.  Each -r\n");
+    printf("\tnames a region of addresses, whose misses are reported\n");
+    printf("\tseparately by caches with the 3c option.\n\n");
+    usage(progname);
+}
+
+
+int main(int argc, const char **argv) {
+    static unsigned char buffer[REPLAY_BUFFER_SIZE];
+
+    const char *progname = argv[0];
+    const char *trace_path;
+    const char *region_names[MAX_REGIONS];
+    uint32_t region_starts[MAX_REGIONS], region_sizes[MAX_REGIONS];
+    int num_regions = 0;
+    uint32_t mem_size = 0;
+    uint64_t num_reads = 0, num_writes = 0;
+    trace_access access;
+    trace_file tf;
+    membase_t *p_mem;
+    int i, j, result;
+
+    i = 1;
+    while (i + 1 < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-m") == 0) {
+            mem_size = strtoul(argv[i + 1], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-r") == 0) {
+            const char *colon = strchr(argv[i + 1], ':');
+            char *start_end = NULL, *size_end = NULL;
+
+            if (num_regions == MAX_REGIONS) {
+                printf("ERROR:  at most %d regions can be named.\n",
+                       MAX_REGIONS);
+                exit(1);
+            }
+
+            if (colon != NULL && colon != argv[i + 1]) {
+                region_starts[num_regions] = strtoul(colon + 1, &start_end, 0);
+                if (start_end != colon + 1 && *start_end == ':') {
+                    region_sizes[num_regions] = strtoul(start_end + 1,
+                                                        &size_end, 0);
+                }
+            }
+            if (size_end == NULL || size_end == start_end + 1 ||
+                *size_end != '\0') {
+                printf("ERROR:  region \"%s\" isn't formatted as "
+                       "name:start:size.\n", argv[i + 1]);
+                exit(1);
+            }
+
+            region_names[num_regions] = strndup(argv[i + 1],
+                                                colon - argv[i + 1]);
+            num_regions++;
+        }
+        else {
+            break;
+        }
+        i += 2;
+    }
+
+    if (i >= argc) {
+        cachesim_usage(progname);
+        exit(1);
+    }
+    trace_path = argv[i++];
+
+    if (trace_open(&tf, trace_path) != 0)
+        exit(1);
+
+    if (mem_size == 0)
+        mem_size = tf.header.mem_size;
+
+    mem_size = (mem_size + MEM_SIZE_ALIGN - 1) & ~(MEM_SIZE_ALIGN - 1);
+    if (mem_size == 0 || mem_size > INT32_MAX) {
+        printf("ERROR:  the trace doesn't specify a usable memory size; "
+               "use -m.\n");
+        exit(1);
+    }
+
+    /* make_cached_memory() expects the program name followed by the cache
+     * specifications, so put the name just before them.
+     */
+    argv[i - 1] = progname;
+    p_mem = make_cached_memory(argc - i + 1, argv + i - 1, mem_size);
+    for (j = 0; j < num_regions; j++) {
+        add_miss_region(p_mem, region_names[j], region_starts[j],
+                        region_sizes[j]);
+    }
+
+    printf("Replaying trace %s.\n", trace_path);
+
+    while ((result = trace_read(&tf, &access)) == 1) {
+        addr_t address = access.address;
+        uint32_t size = access.size;
+
+        if (size > mem_size || address > mem_size - size) {
+            printf("ERROR:  access of %u bytes at address %u is outside "
+                   "the %u-byte memory.\n", size, address, mem_size);
+            exit(1);
+        }
+
+        while (size > 0) {
+            uint32_t piece = size;
+            if (piece > REPLAY_BUFFER_SIZE)
+                piece = REPLAY_BUFFER_SIZE;
+
+            if (access.is_write)
+                write_block(p_mem, address, buffer, piece);
+            else
+                read_block(p_mem, address, buffer, piece);
+
+            address += piece;
+            size -= piece;
+        }
+
+        if (access.is_write)
+            num_writes++;
+        else
+            num_reads++;
+    }
+
+    if (result < 0) {
+        printf("ERROR:  trace %s is truncated or corrupt.\n", trace_path);
+        exit(1);
+    }
+    trace_close(&tf);
+
+    printf("Replayed %lu accesses:  %lu reads, %lu writes.\n",
+           num_reads + num_writes, num_reads, num_writes);
+
+    printf("\nMemory-Access Statistics:\n\n");
+    p_mem->print_stats(p_mem);
+    printf("\n");
+
+    return 0;
+}
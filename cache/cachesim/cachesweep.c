@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "cmdline.h"
+#include "membase.h"
+#include "cache.h"
+#include "trace.h"
+#include "timing.h"
+
+
+/* Accesses are replayed through this buffer; larger accesses are split into
+ * pieces of this size.
+ */
+#define REPLAY_BUFFER_SIZE 4096
+
+/* The initial capacity of the array the trace is decoded into. */
+#define INITIAL_TRACE_CAPACITY 65536
+
+
+/* This program replays one memory-access trace (see trace.h) through many
+ * cache hierarchies, on a pool of threads, and prints a table of their miss
+ * rates.  The trace is decoded into memory once and shared by every thread;
+ * each hierarchy is built, replayed and freed by whichever thread takes it.
+ * Caches keep all of their state in their own structs, so hierarchies on
+ * different threads never touch the same data.
+ */
+
+
+/* The default sweep, used when no hierarchies are given:  every single-level
+ * cache with these block sizes, set counts and associativities.
+ */
+static const int default_block_sizes[] = { 16, 32, 64, 128 };
+static const int default_set_counts[] = { 64, 256, 1024 };
+static const int default_lines_per_set[] = { 1, 2, 4, 8 };
+
+#define NUM_ELEMENTS(a) (sizeof(a) / sizeof((a)[0]))
+
+
+/* One hierarchy in the sweep, and the results of replaying the trace
+ * through it.
+ */
+typedef struct sweep_job {
+    /* The hierarchy as given, and its comma-separated specifications. */
+    const char *hierarchy;
+    int num_specs;
+    const char **specs;
+
+    /* The miss rate of each level, as a percentage, or -1 for levels that
+     * aren't caches.
+     */
+    double *miss_rates;
+
+    /* The bytes read from and written to the memory. */
+    uint64_t mem_reads;
+    uint64_t mem_writes;
+} sweep_job;
+
+
+/* The state shared by the worker threads. */
+typedef struct sweep_state {
+    const trace_access *accesses;
+    uint64_t num_accesses;
+    uint32_t mem_size;
+
+    sweep_job *jobs;
+    int num_jobs;
+
+    /* The index of the next job to hand out, protected by lock. */
+    int next_job;
+    pthread_mutex_t lock;
+} sweep_state;
+
+
+/* Local functions used by the sweep driver. */
+
+void * sweep_worker(void *arg);
+void run_job(sweep_state *state, sweep_job *job, unsigned char *buffer);
+void split_hierarchy(sweep_job *job, const char *hierarchy);
+trace_access * load_trace(const char *trace_path, uint64_t *num_accesses,
+                          uint32_t *mem_size);
+
+
+/* Prints the program usage. */
+void cachesweep_usage(const char *progname) {
+    printf("usage: %s [-m mem-size] [-j threads] trace-file "
+           "[hierarchy ...]\n\n", progname);
+    printf("\tReplays the trace in trace-file (\"-\" for standard input)\n");
+    printf("\tthrough each hierarchy, using the specified number of\n");
+    printf("\tthreads (default, one per online processor).  A hierarchy\n");
+    printf("\tis a list of cache specifications separated by commas,\n");
+    printf("\tnearest the program first, such as 32:64:4,64:1024:8.  If\n");
+    printf("\tno hierarchies are given, every single cache with B in 16,\n");
+    printf("\t32, 64, 128, S in 64, 256, 1024 and E in 1, 2, 4, 8 is\n");
+    printf("\tsimulated.  The memory size comes from the trace's header\n");
+    printf("\tunless -m is given.\n\n");
+    usage(progname);
+}
+
+
+/* Takes jobs from the shared state until there are none left. */
+void * sweep_worker(void *arg) {
+    sweep_state *state = arg;
+    unsigned char *buffer;
+    int i;
+
+    buffer = malloc(REPLAY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    while (1) {
+        pthread_mutex_lock(&state->lock);
+        i = state->next_job++;
+        pthread_mutex_unlock(&state->lock);
+
+        if (i >= state->num_jobs)
+            break;
+
+        run_job(state, state->jobs + i, buffer);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+
+/* Builds a job's hierarchy, replays the trace through it, records the
+ * results and frees the hierarchy.  The trace has already been checked
+ * against the memory size.
+ */
+void run_job(sweep_state *state, sweep_job *job, unsigned char *buffer) {
+    membase_t **levels;
+    membase_t *p_mem;
+    uint64_t i;
+    int level;
+
+    levels = build_memory_levels(job->num_specs, job->specs, "cachesweep",
+                                 state->mem_size, 0);
+    p_mem = levels[0];
+
+    for (i = 0; i < state->num_accesses; i++) {
+        addr_t address = state->accesses[i].address;
+        uint32_t size = state->accesses[i].size;
+        int is_write = state->accesses[i].is_write;
+
+        while (size > 0) {
+            uint32_t piece = size;
+            if (piece > REPLAY_BUFFER_SIZE)
+                piece = REPLAY_BUFFER_SIZE;
+
+            if (is_write)
+                write_block(p_mem, address, buffer, piece);
+            else
+                read_block(p_mem, address, buffer, piece);
+
+            address += piece;
+            size -= piece;
+        }
+    }
+
+    for (level = 0; level < job->num_specs; level++) {
+        cache_t *p_cache = as_cache(levels[level]);
+        uint64_t accesses;
+
+        job->miss_rates[level] = -1;
+        if (p_cache == NULL)
+            continue;
+
+        accesses = p_cache->num_hits + p_cache->num_misses;
+        job->miss_rates[level] = accesses == 0 ? 0 :
+            100.0 * p_cache->num_misses / accesses;
+    }
+
+    job->mem_reads = levels[job->num_specs]->num_reads;
+    job->mem_writes = levels[job->num_specs]->num_writes;
+
+    free_memory_levels(levels, job->num_specs);
+}
+
+
+/* Splits a comma-separated hierarchy into the job's specifications. */
+void split_hierarchy(sweep_job *job, const char *hierarchy) {
+    char *copy, *spec;
+    const char **specs;
+    int i;
+
+    job->hierarchy = hierarchy;
+    job->num_specs = 1;
+    for (i = 0; hierarchy[i] != '\0'; i++) {
+        if (hierarchy[i] == ',')
+            job->num_specs++;
+    }
+
+    copy = strdup(hierarchy);
+    specs = malloc(job->num_specs * sizeof(const char *));
+    if (copy == NULL || specs == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    spec = copy;
+    for (i = 0; i < job->num_specs; i++) {
+        char *comma = strchr(spec, ',');
+        specs[i] = spec;
+        if (comma != NULL) {
+            *comma = '\0';
+            spec = comma + 1;
+        }
+    }
+
+    /* A "host" specification stands for all of the host's caches. */
+    job->specs = expand_host_specs(&job->num_specs, specs, 0);
+    free(specs);
+
+    job->miss_rates = malloc(job->num_specs * sizeof(double));
+    if (job->miss_rates == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+}
+
+
+/* Decodes a whole trace into an array, checking that every access fits in
+ * the memory.  If *mem_size is 0, it is taken from the trace's header.
+ * Exits on any error.
+ */
+trace_access * load_trace(const char *trace_path, uint64_t *num_accesses,
+                          uint32_t *mem_size) {
+    trace_access *accesses;
+    uint64_t capacity, count = 0;
+    trace_file tf;
+    int result;
+
+    if (trace_open(&tf, trace_path) != 0)
+        exit(1);
+
+    if (*mem_size == 0)
+        *mem_size = tf.header.mem_size;
+
+    *mem_size = (*mem_size + MEM_SIZE_ALIGN - 1) & ~(MEM_SIZE_ALIGN - 1);
+    if (*mem_size == 0 || *mem_size > INT32_MAX) {
+        printf("ERROR:  the trace doesn't specify a usable memory size; "
+               "use -m.\n");
+        exit(1);
+    }
+
+    capacity = tf.header.num_records;
+    if (capacity == 0)
+        capacity = INITIAL_TRACE_CAPACITY;
+    accesses = malloc(capacity * sizeof(trace_access));
+
+    while (1) {
+        if (count == capacity) {
+            capacity *= 2;
+            accesses = realloc(accesses, capacity * sizeof(trace_access));
+        }
+        if (accesses == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        result = trace_read(&tf, accesses + count);
+        if (result != 1)
+            break;
+
+        if (accesses[count].size > *mem_size ||
+            accesses[count].address > *mem_size - accesses[count].size) {
+            printf("ERROR:  access of %u bytes at address %u is outside "
+                   "the %u-byte memory.\n", accesses[count].size,
+                   accesses[count].address, *mem_size);
+            exit(1);
+        }
+        count++;
+    }
+
+    if (result < 0) {
+        printf("ERROR:  trace %s is truncated or corrupt.\n", trace_path);
+        exit(1);
+    }
+    trace_close(&tf);
+
+    *num_accesses = count;
+    return accesses;
+}
+
+
+int main(int argc, const char **argv) {
+    const char *progname = argv[0];
+    const char *trace_path;
+    uint32_t mem_size = 0;
+    int num_threads = 0;
+    sweep_state state;
+    pthread_t *threads;
+    double start, load_time, sweep_time;
+    int i, j, max_levels;
+
+    i = 1;
+    while (i + 1 < argc && argv[i][0] == '-' && argv[i][1] != '\0') {
+        if (strcmp(argv[i], "-m") == 0) {
+            mem_size = strtoul(argv[i + 1], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-j") == 0) {
+            num_threads = atoi(argv[i + 1]);
+            if (num_threads <= 0) {
+                printf("ERROR:  -j needs a positive number of threads.\n");
+                exit(1);
+            }
+        }
+        else {
+            break;
+        }
+        i += 2;
+    }
+
+    if (i >= argc) {
+        cachesweep_usage(progname);
+        exit(1);
+    }
+    trace_path = argv[i++];
+
+    if (num_threads == 0) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_threads <= 0)
+            num_threads = 1;
+    }
+
+    /* Set up the jobs, either from the arguments or the default sweep. */
+    if (i < argc) {
+        state.num_jobs = argc - i;
+        state.jobs = calloc(state.num_jobs, sizeof(sweep_job));
+        if (state.jobs == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+        for (j = 0; j < state.num_jobs; j++)
+            split_hierarchy(state.jobs + j, argv[i + j]);
+    }
+    else {
+        int b, s, e;
+
+        state.num_jobs = NUM_ELEMENTS(default_block_sizes) *
+                         NUM_ELEMENTS(default_set_counts) *
+                         NUM_ELEMENTS(default_lines_per_set);
+        state.jobs = calloc(state.num_jobs, sizeof(sweep_job));
+        if (state.jobs == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        j = 0;
+        for (b = 0; b < NUM_ELEMENTS(default_block_sizes); b++) {
+            for (s = 0; s < NUM_ELEMENTS(default_set_counts); s++) {
+                for (e = 0; e < NUM_ELEMENTS(default_lines_per_set); e++) {
+                    char *spec = malloc(32);
+                    if (spec == NULL) {
+                        printf("Not enough memory.\n");
+                        exit(0);
+                    }
+                    sprintf(spec, "%d:%d:%d", default_block_sizes[b],
+                            default_set_counts[s], default_lines_per_set[e]);
+                    split_hierarchy(state.jobs + j++, spec);
+                }
+            }
+        }
+    }
+
+    start = now_seconds();
+    state.accesses = load_trace(trace_path, &state.num_accesses, &mem_size);
+    state.mem_size = mem_size;
+    load_time = now_seconds() - start;
+
+    /* Build each hierarchy once here, so that a bad specification is
+     * reported before any thread starts.
+     */
+    max_levels = 0;
+    for (j = 0; j < state.num_jobs; j++) {
+        sweep_job *job = state.jobs + j;
+        free_memory_levels(build_memory_levels(job->num_specs, job->specs,
+                                               progname, mem_size, 0),
+                           job->num_specs);
+        if (job->num_specs > max_levels)
+            max_levels = job->num_specs;
+    }
+
+    if (num_threads > state.num_jobs)
+        num_threads = state.num_jobs;
+
+    printf("Replaying %lu accesses from %s through %d hierarchies "
+           "on %d thread%s.\n", state.num_accesses, trace_path,
+           state.num_jobs, num_threads, num_threads == 1 ? "" : "s");
+
+    state.next_job = 0;
+    pthread_mutex_init(&state.lock, NULL);
+
+    threads = malloc(num_threads * sizeof(pthread_t));
+    if (threads == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    start = now_seconds();
+    for (j = 0; j < num_threads; j++) {
+        if (pthread_create(threads + j, NULL, sweep_worker, &state) != 0) {
+            printf("ERROR:  couldn't start thread %d.\n", j);
+            exit(1);
+        }
+    }
+    for (j = 0; j < num_threads; j++)
+        pthread_join(threads[j], NULL);
+    sweep_time = now_seconds() - start;
+
+    pthread_mutex_destroy(&state.lock);
+    free(threads);
+
+    printf("\n%-32s", "Hierarchy");
+    for (j = 0; j < max_levels; j++)
+        printf("  L%d miss%%", j + 1);
+    printf("  %14s  %14s\n", "memory reads", "memory writes");
+
+    for (j = 0; j < state.num_jobs; j++) {
+        sweep_job *job = state.jobs + j;
+        int level;
+
+        printf("%-32s", job->hierarchy);
+        for (level = 0; level < max_levels; level++) {
+            if (level >= job->num_specs)
+                printf("  %8s", "");
+            else if (job->miss_rates[level] < 0)
+                printf("  %8s", "-");
+            else
+                printf("  %8.3f", job->miss_rates[level]);
+        }
+        printf("  %14lu  %14lu\n", job->mem_reads, job->mem_writes);
+    }
+
+    printf("\nDecoded the trace in %.2f seconds; swept it in %.2f seconds.\n",
+           load_time, sweep_time);
+
+    return 0;
+}
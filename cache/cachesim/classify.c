@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classify.h"
+
+
+/* The index that marks the end of the shadow's LRU list. */
+#define NO_LINE 0xFFFFFFFFU
+
+/* The smallest number of blocks the where array grows to. */
+#define MIN_BLOCKS 1024
+
+
+/* Local functions used by the miss classifier. */
+
+void grow_where(miss_classifier_t *mc, uint32_t block);
+int shadow_access(miss_classifier_t *mc, uint32_t block);
+miss_region_t * find_region(miss_classifier_t *mc, addr_t address);
+uint64_t region_misses(const miss_region_t *p_region);
+int compare_regions(const void *a, const void *b);
+void print_region(const miss_region_t *p_region, uint64_t total_misses);
+
+
+void init_miss_classifier(miss_classifier_t *mc, uint32_t block_size,
+                          uint32_t num_lines) {
+    bzero(mc, sizeof(miss_classifier_t));
+
+    mc->block_offset_bits = log_2(block_size);
+    mc->num_lines = num_lines;
+    mc->line_block = malloc(num_lines * sizeof(uint32_t));
+    mc->prev = malloc(num_lines * sizeof(uint32_t));
+    mc->next = malloc(num_lines * sizeof(uint32_t));
+    if (mc->line_block == NULL || mc->prev == NULL || mc->next == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    mc->mru = NO_LINE;
+    mc->lru = NO_LINE;
+    mc->other.name = (char *) "other addresses";
+}
+
+
+void free_miss_classifier(miss_classifier_t *mc) {
+    int i;
+
+    free(mc->where);
+    free(mc->line_block);
+    free(mc->prev);
+    free(mc->next);
+
+    for (i = 0; i < mc->num_regions; i++)
+        free(mc->regions[i].name);
+    free(mc->regions);
+}
+
+
+void reset_miss_classifier(miss_classifier_t *mc) {
+    int i;
+
+    memset(mc->num_misses, 0, sizeof(mc->num_misses));
+    for (i = 0; i < mc->num_regions; i++) {
+        mc->regions[i].num_accesses = 0;
+        memset(mc->regions[i].num_misses, 0,
+               sizeof(mc->regions[i].num_misses));
+    }
+    mc->other.num_accesses = 0;
+    memset(mc->other.num_misses, 0, sizeof(mc->other.num_misses));
+}
+
+
+void add_region(miss_classifier_t *mc, const char *name, addr_t start,
+                uint32_t size) {
+    miss_region_t *p_region;
+
+    mc->regions = realloc(mc->regions,
+                          (mc->num_regions + 1) * sizeof(miss_region_t));
+    if (mc->regions == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    p_region = mc->regions + mc->num_regions;
+    bzero(p_region, sizeof(miss_region_t));
+    p_region->name = strdup(name);
+    if (p_region->name == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    p_region->start = start;
+    p_region->size = size;
+
+    mc->num_regions++;
+}
+
+
+/*---------------------------------------------------------------------------
+ * CLASSIFICATION
+ */
+
+
+/* Grows the where array so that it covers the specified block.  The new
+ * entries are zeroed, since those blocks haven't been accessed.
+ */
+void grow_where(miss_classifier_t *mc, uint32_t block) {
+    uint64_t num_blocks = mc->num_blocks > 0 ? mc->num_blocks : MIN_BLOCKS;
+
+    while (num_blocks <= block)
+        num_blocks *= 2;
+
+    mc->where = realloc(mc->where, num_blocks * sizeof(uint32_t));
+    if (mc->where == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    memset(mc->where + mc->num_blocks, 0,
+           (num_blocks - mc->num_blocks) * sizeof(uint32_t));
+    mc->num_blocks = num_blocks;
+}
+
+
+/* Accesses a block in the shadow cache, making it the most recently used,
+ * and returns the class that a miss on the block would fall in.
+ */
+int shadow_access(miss_classifier_t *mc, uint32_t block) {
+    uint32_t line, where;
+
+    if (block >= mc->num_blocks)
+        grow_where(mc, block);
+
+    where = mc->where[block];
+    if (where >= 2) {
+        /* A shadow hit; move the line to the front if it isn't there. */
+        line = where - 2;
+        if (line == mc->mru)
+            return MISS_CONFLICT;
+
+        mc->next[mc->prev[line]] = mc->next[line];
+        if (mc->next[line] != NO_LINE)
+            mc->prev[mc->next[line]] = mc->prev[line];
+        else
+            mc->lru = mc->prev[line];
+    }
+    else if (mc->num_used < mc->num_lines) {
+        line = mc->num_used++;
+        mc->line_block[line] = block;
+    }
+    else {
+        /* A shadow miss; replace the least recently used line. */
+        line = mc->lru;
+        mc->where[mc->line_block[line]] = 1;
+        mc->line_block[line] = block;
+
+        mc->lru = mc->prev[line];
+        if (mc->lru != NO_LINE)
+            mc->next[mc->lru] = NO_LINE;
+        else
+            mc->mru = NO_LINE;
+    }
+
+    mc->prev[line] = NO_LINE;
+    mc->next[line] = mc->mru;
+    if (mc->mru != NO_LINE)
+        mc->prev[mc->mru] = line;
+    mc->mru = line;
+    mc->where[block] = line + 2;
+
+    /* The line is also the least recently used if the list was empty,
+     * either before the first line was used or after a one-line shadow
+     * cache unlinked its only line.
+     */
+    if (mc->lru == NO_LINE)
+        mc->lru = line;
+
+    if (where == 0)
+        return MISS_COMPULSORY;
+    return where == 1 ? MISS_CAPACITY : MISS_CONFLICT;
+}
+
+
+/* Returns the first region that contains the address, or the catch-all
+ * region if none does.
+ */
+miss_region_t * find_region(miss_classifier_t *mc, addr_t address) {
+    int i;
+
+    for (i = 0; i < mc->num_regions; i++) {
+        miss_region_t *p_region = mc->regions + i;
+        if (address - p_region->start < p_region->size)
+            return p_region;
+    }
+
+    return &mc->other;
+}
+
+
+int classify_access(miss_classifier_t *mc, addr_t address,
+                    uint32_t num_bytes, uint32_t num_misses, int coherence) {
+    int miss_class = shadow_access(mc, address >> mc->block_offset_bits);
+    miss_region_t *p_region;
+
+    if (coherence)
+        miss_class = MISS_COHERENCE;
+    mc->num_misses[miss_class] += num_misses;
+
+    if (mc->num_regions > 0) {
+        p_region = find_region(mc, address);
+        p_region->num_accesses += num_bytes;
+        p_region->num_misses[miss_class] += num_misses;
+    }
+
+    return miss_class;
+}
+
+
+/*---------------------------------------------------------------------------
+ * REPORTING
+ */
+
+
+/* Returns the total misses of a region. */
+uint64_t region_misses(const miss_region_t *p_region) {
+    uint64_t total = 0;
+    int i;
+
+    for (i = 0; i < NUM_MISS_CLASSES; i++)
+        total += p_region->num_misses[i];
+    return total;
+}
+
+
+/* Orders pointers to regions by decreasing misses, for qsort(). */
+int compare_regions(const void *a, const void *b) {
+    uint64_t misses_a = region_misses(*(const miss_region_t * const *) a);
+    uint64_t misses_b = region_misses(*(const miss_region_t * const *) b);
+
+    if (misses_a != misses_b)
+        return misses_a > misses_b ? -1 : 1;
+    return 0;
+}
+
+
+/* Prints the accesses and misses of one region. */
+void print_region(const miss_region_t *p_region, uint64_t total_misses) {
+    uint64_t misses = region_misses(p_region);
+    double share = 0, miss_rate = 0;
+
+    if (total_misses > 0)
+        share = 100.0 * misses / total_misses;
+    if (p_region->num_accesses > 0)
+        miss_rate = 100.0 * misses / p_region->num_accesses;
+
+    printf("     %s", p_region->name);
+    if (p_region->size > 0) {
+        printf(" [%u, %u)", p_region->start,
+               p_region->start + p_region->size);
+    }
+    printf(":  accesses=%lu misses=%lu (%.2f%% of misses) "
+           "miss-rate=%.2f%%\n", p_region->num_accesses, misses, share,
+           miss_rate);
+    printf("       compulsory=%lu capacity=%lu conflict=%lu",
+           p_region->num_misses[MISS_COMPULSORY],
+           p_region->num_misses[MISS_CAPACITY],
+           p_region->num_misses[MISS_CONFLICT]);
+    if (p_region->num_misses[MISS_COHERENCE] > 0)
+        printf(" coherence=%lu", p_region->num_misses[MISS_COHERENCE]);
+    printf("\n");
+}
+
+
+void print_miss_classes(miss_classifier_t *mc) {
+    const miss_region_t **sorted;
+    uint64_t total = 0;
+    int i, num_sorted = 0;
+
+    for (i = 0; i < NUM_MISS_CLASSES; i++)
+        total += mc->num_misses[i];
+
+    printf("   misses by class:  compulsory=%lu capacity=%lu conflict=%lu",
+           mc->num_misses[MISS_COMPULSORY], mc->num_misses[MISS_CAPACITY],
+           mc->num_misses[MISS_CONFLICT]);
+    if (mc->num_misses[MISS_COHERENCE] > 0)
+        printf(" coherence=%lu", mc->num_misses[MISS_COHERENCE]);
+    printf("\n");
+
+    if (mc->num_regions == 0)
+        return;
+
+    sorted = malloc((mc->num_regions + 1) * sizeof(miss_region_t *));
+    if (sorted == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    for (i = 0; i < mc->num_regions; i++)
+        sorted[num_sorted++] = mc->regions + i;
+    if (mc->other.num_accesses > 0)
+        sorted[num_sorted++] = &mc->other;
+    qsort(sorted, num_sorted, sizeof(miss_region_t *), compare_regions);
+
+    printf("   misses by region, most first:\n");
+    for (i = 0; i < num_sorted; i++)
+        print_region(sorted[i], total);
+
+    free(sorted);
+}
@@ -0,0 +1,111 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+
+#include "membase.h"
+
+
+/* The classes a miss can fall in.  A compulsory miss is the first access to
+ * a block; a capacity miss would also miss in a fully associative LRU cache
+ * with the same number of lines; a conflict miss would hit in that cache,
+ * so it is due to the mapping of blocks to sets (or to the replacement
+ * policy); and a coherence miss is on a block that another core's write
+ * invalidated.
+ */
+#define MISS_COMPULSORY 0
+#define MISS_CAPACITY 1
+#define MISS_CONFLICT 2
+#define MISS_COHERENCE 3
+#define NUM_MISS_CLASSES 4
+
+
+/* A named range of addresses, such as one data structure, and the accesses
+ * and misses that fell in it.  Like the cache's own hit and miss counts,
+ * accesses are counted per byte, so the region's miss rate is comparable to
+ * the cache's.
+ */
+typedef struct miss_region_t {
+    char *name;
+    addr_t start;
+    uint32_t size;
+
+    uint64_t num_accesses;
+    uint64_t num_misses[NUM_MISS_CLASSES];
+} miss_region_t;
+
+
+/* This struct holds the state for classifying the misses of one cache.  It
+ * runs a shadow of the cache:  a fully associative LRU cache with the same
+ * block size and number of lines, which sees the same accesses (but not the
+ * prefetches).  Each block of memory records whether it has been accessed
+ * and, if it is in the shadow, which line holds it.
+ */
+typedef struct miss_classifier_t {
+    uint32_t block_offset_bits;
+
+    /* For each block of memory:  0 if it has never been accessed, 1 if it
+     * has been accessed but isn't in the shadow, or 2 plus the shadow line
+     * it is in.  The array grows as higher blocks are accessed.
+     */
+    uint32_t *where;
+    uint32_t num_blocks;
+
+    /* The shadow's lines, each holding a block number, linked in LRU order
+     * from most recently used (mru) to least (lru).  Lines are filled in
+     * order until num_used reaches num_lines.
+     */
+    uint32_t num_lines;
+    uint32_t num_used;
+    uint32_t *line_block;
+    uint32_t *prev;
+    uint32_t *next;
+    uint32_t mru;
+    uint32_t lru;
+
+    /* The misses of each class, counted like the cache's misses. */
+    uint64_t num_misses[NUM_MISS_CLASSES];
+
+    /* The regions that misses are attributed to, and the accesses that fell
+     * in none of them.
+     */
+    miss_region_t *regions;
+    int num_regions;
+    miss_region_t other;
+} miss_classifier_t;
+
+
+/* Initializes a classifier for a cache with the specified block size and
+ * total number of lines.
+ */
+void init_miss_classifier(miss_classifier_t *mc, uint32_t block_size,
+                          uint32_t num_lines);
+
+/* Releases the memory used by a classifier. */
+void free_miss_classifier(miss_classifier_t *mc);
+
+/* Zeroes the counts of a classifier and its regions.  The shadow keeps its
+ * contents, just as the cache does.
+ */
+void reset_miss_classifier(miss_classifier_t *mc);
+
+/* Adds a region to attribute accesses and misses to.  The name is copied.
+ * An access is attributed to the first region added that contains it.
+ */
+void add_region(miss_classifier_t *mc, const char *name, addr_t start,
+                uint32_t size);
+
+/* Records an access of num_bytes bytes within one block, of which
+ * num_misses missed in the cache (all of them, if the cache didn't load the
+ * block, or else at most 1).  coherence is nonzero if the miss was a
+ * coherence miss.  Returns the class of the miss, if there was one.
+ */
+int classify_access(miss_classifier_t *mc, addr_t address,
+                    uint32_t num_bytes, uint32_t num_misses, int coherence);
+
+/* Prints the misses of each class, out of the cache's total, and the
+ * regions in decreasing order of misses.
+ */
+void print_miss_classes(miss_classifier_t *mc);
+
+
+#endif /* CLASSIFY_H */
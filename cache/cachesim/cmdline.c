@@ -1,13 +1,79 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cmdline.h"
 #include "memory.h"
 #include "cache.h"
+#include "policy.h"
+#include "prefetch.h"
+#include "stackdist.h"
+#include "tlb.h"
+
+#ifdef HAVE_CPUINFO
+#include "cpuid.h"
+#endif
+
+
+/* The number of sets a stack-distance analysis goes up to, if the
+ * specification doesn't say.
+ */
+#define DEFAULT_STACK_MAX_SETS 1024
+
+/* The longest option name accepted in a cache specification. */
+#define MAX_OPTION_LENGTH 32
+
+/* The number of write-buffer entries, if the specification doesn't say. */
+#define DEFAULT_WRITE_BUFFER_SIZE 8
+
+/* The number of victim-cache entries, if the specification doesn't say. */
+#define DEFAULT_VICTIM_CACHE_SIZE 8
+
+/* The most cache levels that the host specification stands for, and the
+ * longest B:S:E specification generated for one of them.
+ */
+#define MAX_HOST_LEVELS 8
+#define MAX_HOST_SPEC_LENGTH 40
+
+
+/* The settings in a TLB specification. */
+typedef struct tlb_options {
+    uint32_t page_size;
+    uint32_t entries[MAX_TLB_LEVELS];
+    uint32_t ways[MAX_TLB_LEVELS];
+    int num_levels;
+    uint32_t walk_level_cycles;
+} tlb_options;
+
+
+/* The settings that the options after B:S:E in a cache specification can
+ * change.
+ */
+typedef struct cache_options {
+    const replacement_policy_t *policy;
+
+    const prefetcher_t *prefetcher;
+    int prefetch_degree;
+
+    int write_through;
+    int write_allocate;
+    int write_buffer_size;
+
+    int classify_misses;
+
+    int hit_latency;
+    int memory_latency;
+    int mlp;
+
+    int inclusion;
+    int victim_cache_size;
+} cache_options;
 
 
 /* Prints the program usage. */
 void usage(const char *progname) {
+    int i;
+
     printf("usage: %s [cache-spec ...]\n\n", progname);
     printf("\tAll arguments are cache specifications in the form B:S:E, where\n");
     printf("\tB, S and E are all positive integers with the following meanings:\n");
@@ -15,48 +81,464 @@ void usage(const char *progname) {
     printf("\t\tS = the number of cache-sets in the cache (must be a power of 2)\n");
     printf("\t\tE = the number of cache-lines in each cache-set (may be 1 or more)\n");
     printf("\n");
+    printf("\tB:S:E may be followed by options, each introduced by a colon.  An\n");
+    printf("\toption can name the cache's replacement policy, which is one of\n");
+    printf("\t");
+    for (i = 0; replacement_policies[i] != NULL; i++) {
+        printf("%s%s", i > 0 ? ", " : "", replacement_policies[i]->spec_name);
+    }
+    printf(" (default %s).\n", lru_policy.spec_name);
+    printf("\tplru needs E to be a power of 2.  An option can also add a\n");
+    printf("\tprefetcher, written name or name=degree, where name is one of\n");
+    printf("\t");
+    for (i = 0; prefetchers[i] != NULL; i++) {
+        printf("%s%s (degree %u)", i > 0 ? ", " : "", prefetchers[i]->spec_name,
+               prefetchers[i]->default_degree);
+    }
+    printf(".\n");
+    printf("\tThe options wb and wt make the cache write-back (the default) or\n");
+    printf("\twrite-through, and wa and nwa make it write-allocate (the default)\n");
+    printf("\tor not.  wbuf or wbuf=N adds a write-combining buffer of N entries\n");
+    printf("\t(default %d) between the cache and the next level.  3c\n",
+           DEFAULT_WRITE_BUFFER_SIZE);
+    printf("\tclassifies the cache's misses as compulsory, capacity or conflict\n");
+    printf("\tmisses, and by the regions of memory the program names.\n");
+    printf("\tlat=N gives the cache a hit latency of N cycles, and mem=N gives\n");
+    printf("\tthe memory below all the caches a latency of N cycles; each cache\n");
+    printf("\tthen reports its average memory access time (AMAT).  mlp=N lets\n");
+    printf("\tup to N of the cache's misses overlap, if they are close together.\n");
+    printf("\tFor example, 64:64:8:plru:stride=4 or 32:256:1:wt:nwa:wbuf:3c, or\n");
+    printf("\t64:64:8:lat=4 64:1024:8:lat=14:mem=200:mlp=4.\n");
+    printf("\tincl makes the cache inclusive of the caches in front of it,\n");
+    printf("\tinvalidating their copies of the blocks it evicts, and excl makes\n");
+    printf("\tit exclusive, holding only the blocks they evict; nine keeps the\n");
+    printf("\tdefault, neither, but reports it too.  The caches in front of an\n");
+    printf("\texclusive cache must have its block size.  victim or victim=N adds\n");
+    printf("\ta fully associative victim cache of N blocks (default %d) for the\n",
+           DEFAULT_VICTIM_CACHE_SIZE);
+    printf("\tblocks the cache evicts.  For example, 64:64:8:victim=16\n");
+    printf("\t64:1024:8:excl.\n");
+    printf("\n");
+    printf("\tA specification of the form stack:B or stack:B:S instead adds a\n");
+    printf("\tstack-distance analysis at that point, which reports the LRU miss\n");
+    printf("\trate of every cache with block size B, 1, 2, 4, ..., S sets\n");
+    printf("\t(default %d), and any number of lines per set, in one run.\n",
+           DEFAULT_STACK_MAX_SETS);
+    printf("\n");
+    printf("\tA specification of the form tlb:P:E:W or tlb:P:E:W:E2:W2 adds a\n");
+    printf("\tTLB for pages of P bytes (a power of 2, which may end in k, m or\n");
+    printf("\tg), with a first level of E entries in W ways, and optionally a\n");
+    printf("\tsecond level of E2 entries in W2 ways.  It may be followed by the\n");
+    printf("\toption walk=N, the cycles each of the page walk's tables cost\n");
+    printf("\t(default %d).  For example, tlb:4k:64:4:1536:12 or tlb:2m:32:4.\n",
+           DEFAULT_PAGE_WALK_CYCLES);
+    printf("\n");
+    printf("\tThe specification host stands for the data and unified caches of\n");
+    printf("\tthe CPU running the simulation, from L1 down, as read with CPUID,\n");
+    printf("\tso that simulated miss rates can be compared with measured ones.\n");
+    printf("\tA cache whose number of sets isn't a power of 2 is simulated with\n");
+    printf("\tthe next power of 2 below it, and more ways to keep its size.  For\n");
+    printf("\texample, tlb:4k:64:4:1536:12 host.\n");
+    printf("\n");
     printf("\tThe actual memory size will be fixed by the program itself, as it\n");
     printf("\tdepends on the specific tests being run against the cache simulator.\n");
 }
 
 
-/* Initializes a set of caches and a memory, using the cache configuration
- * specified from command-line arguments.
- *
- * TODO:  This function doesn't provide any way to clean up the allocated
- *        memory!  Return a pointer to a struct that referenes everything
- *        else, so it can all be deallocated!
+/* Parses one of the options that may follow B:S:E in a cache specification,
+ * and stores the setting it changes in opts.  Options are a name, optionally
+ * followed by = and a positive number.  Returns 0 on success, or -1 if the
+ * option isn't valid.
  */
-membase_t * make_cached_memory(int argc, const char **argv,
-                               uint32_t mem_size) {
+int parse_cache_option(const char *option, cache_options *opts) {
+    char name[MAX_OPTION_LENGTH];
+    const char *equals;
+    const replacement_policy_t *policy;
+    const prefetcher_t *prefetcher;
+    size_t len;
+    int ct, end = 0, value = 0;
+
+    equals = strchr(option, '=');
+    len = equals != NULL ? equals - option : strlen(option);
+    if (len >= MAX_OPTION_LENGTH)
+        return -1;
+
+    memcpy(name, option, len);
+    name[len] = '\0';
+
+    if (equals != NULL) {
+        ct = sscanf(equals + 1, "%d%n", &value, &end);
+        if (ct != 1 || equals[1 + end] != '\0' || value <= 0)
+            return -1;
+    }
+
+    if (strcmp(name, "wbuf") == 0) {
+        opts->write_buffer_size = equals != NULL ?
+                                  value : DEFAULT_WRITE_BUFFER_SIZE;
+        return 0;
+    }
+
+    if (strcmp(name, "victim") == 0) {
+        opts->victim_cache_size = equals != NULL ?
+                                  value : DEFAULT_VICTIM_CACHE_SIZE;
+        return 0;
+    }
+
+    /* The timing options need a value. */
+    if (strcmp(name, "lat") == 0 && equals != NULL) {
+        opts->hit_latency = value;
+        return 0;
+    }
+
+    if (strcmp(name, "mem") == 0 && equals != NULL) {
+        opts->memory_latency = value;
+        return 0;
+    }
+
+    if (strcmp(name, "mlp") == 0 && equals != NULL) {
+        opts->mlp = value;
+        return 0;
+    }
+
+    prefetcher = find_prefetcher(name);
+    if (prefetcher != NULL) {
+        opts->prefetcher = prefetcher;
+        opts->prefetch_degree = equals != NULL ?
+                                value : prefetcher->default_degree;
+        return 0;
+    }
+
+    /* The remaining options don't take a value. */
+    if (equals != NULL)
+        return -1;
+
+    if (strcmp(name, "wb") == 0 || strcmp(name, "wt") == 0) {
+        opts->write_through = strcmp(name, "wt") == 0;
+        return 0;
+    }
+
+    if (strcmp(name, "wa") == 0 || strcmp(name, "nwa") == 0) {
+        opts->write_allocate = strcmp(name, "wa") == 0;
+        return 0;
+    }
+
+    if (strcmp(name, "3c") == 0) {
+        opts->classify_misses = 1;
+        return 0;
+    }
+
+    if (strcmp(name, "nine") == 0 || strcmp(name, "incl") == 0 ||
+        strcmp(name, "excl") == 0) {
+        opts->inclusion = strcmp(name, "incl") == 0 ? INCLUSION_INCLUSIVE :
+                          strcmp(name, "excl") == 0 ? INCLUSION_EXCLUSIVE :
+                          INCLUSION_NINE;
+        return 0;
+    }
+
+    policy = find_replacement_policy(name);
+    if (policy != NULL) {
+        opts->policy = policy;
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/* Parses a number in a TLB specification, which may end in k, m or g to
+ * multiply it by 2^10, 2^20 or 2^30, and stores it in value.  Returns the
+ * number of characters parsed, or 0 if there isn't a positive number that
+ * fits in 32 bits.
+ */
+int parse_tlb_number(const char *str, uint32_t *value, int allow_suffix) {
+    unsigned long long n = 0;
+    int len = 0;
+
+    while (str[len] >= '0' && str[len] <= '9' && n <= UINT32_MAX) {
+        n = n * 10 + (str[len] - '0');
+        len++;
+    }
+    if (len == 0)
+        return 0;
+
+    if (allow_suffix && str[len] != '\0' && strchr("kKmMgG", str[len])) {
+        switch (str[len]) {
+        case 'k': case 'K': n <<= 10; break;
+        case 'm': case 'M': n <<= 20; break;
+        default:            n <<= 30; break;
+        }
+        len++;
+    }
+
+    if (n == 0 || n > UINT32_MAX)
+        return 0;
+    *value = n;
+    return len;
+}
+
+
+/* Parses a TLB specification, without the leading "tlb:", into opts.
+ * Returns 0 on success, or -1 if it isn't valid.
+ */
+int parse_tlb_spec(const char *spec, tlb_options *opts) {
+    uint32_t numbers[1 + 2 * MAX_TLB_LEVELS];
+    int num_numbers = 0, len, i;
+
+    opts->num_levels = 0;
+    opts->walk_level_cycles = DEFAULT_PAGE_WALK_CYCLES;
+
+    while (1) {
+        if (strncmp(spec, "walk=", 5) == 0) {
+            len = parse_tlb_number(spec + 5, &opts->walk_level_cycles, 0);
+            if (len == 0)
+                return -1;
+            spec += 5 + len;
+        }
+        else {
+            if (num_numbers == 1 + 2 * MAX_TLB_LEVELS)
+                return -1;
+            len = parse_tlb_number(spec, &numbers[num_numbers],
+                                   num_numbers == 0);
+            if (len == 0)
+                return -1;
+            spec += len;
+            num_numbers++;
+        }
+
+        if (*spec == '\0')
+            break;
+        if (*spec != ':')
+            return -1;
+        spec++;
+    }
+
+    /* The page size, and then an entries and ways pair for each level. */
+    if (num_numbers < 3 || num_numbers % 2 == 0 ||
+        !is_power_of_2(numbers[0]))
+        return -1;
+
+    opts->page_size = numbers[0];
+    for (i = 1; i < num_numbers; i += 2) {
+        uint32_t entries = numbers[i], ways = numbers[i + 1];
+
+        if (entries % ways != 0 || !is_power_of_2(entries / ways))
+            return -1;
+
+        opts->entries[opts->num_levels] = entries;
+        opts->ways[opts->num_levels] = ways;
+        opts->num_levels++;
+    }
+
+    return 0;
+}
+
+
+/* Stores a B:S:E specification for each of the host CPU's data and unified
+ * caches in specs, from L1 down, and returns the number of them, or 0 if
+ * the host's caches can't be read.  If verbose is nonzero, each cache is
+ * printed along with its specification.
+ */
+int get_host_specs(char specs[][MAX_HOST_SPEC_LENGTH], int verbose) {
+#ifdef HAVE_CPUINFO
+    cache_info caches[MAX_CACHES];
+    int num_caches, num_specs = 0, i;
+
+    num_caches = get_caches(caches, MAX_CACHES);
+    for (i = 0; i < num_caches && num_specs < MAX_HOST_LEVELS; i++) {
+        cache_info *p_info = caches + i;
+        uint32_t num_sets = p_info->sets;
+        uint32_t ways = p_info->partitions * p_info->ways;
+
+        if (p_info->type != CACHE_TYPE_DATA &&
+            p_info->type != CACHE_TYPE_UNIFIED)
+            continue;
+
+        if (!is_power_of_2(p_info->line_size))
+            return 0;
+
+        /* Each partition of a set holds its own ways.  Keep the size,
+         * rounding the ways to the nearest whole number.
+         */
+        if (!is_power_of_2(num_sets)) {
+            while (!is_power_of_2(num_sets))
+                num_sets &= num_sets - 1;
+            ways = (2 * ways * (uint64_t) p_info->sets / num_sets + 1) / 2;
+        }
+
+        snprintf(specs[num_specs], MAX_HOST_SPEC_LENGTH, "%u:%u:%u",
+                 p_info->line_size, num_sets, ways);
+
+        if (verbose) {
+            printf(" * Host L%u %s:  %u bytes in %u sets of %u ways, "
+                   "simulated as %s.\n", p_info->level,
+                   get_cache_type_name(p_info->type), p_info->size,
+                   p_info->sets, p_info->ways, specs[num_specs]);
+        }
+        num_specs++;
+    }
+
+    return num_specs;
+#else
+    return 0;
+#endif
+}
+
+
+/* Returns a copy of the specifications in specs, with each "host"
+ * specification replaced by the specifications of the host's caches, and
+ * updates num_specs to the number in the copy.  The host's specifications
+ * are stored in the same allocation as the copy, so the caller owns all of
+ * it, and frees it with a single call to free().  If the host's caches can't
+ * be read, this prints an error and exits.
+ */
+const char ** expand_host_specs(int *num_specs, const char **specs,
+                                int verbose) {
+    char (*host_specs)[MAX_HOST_SPEC_LENGTH];
+    int num_host_specs = -1;
+    const char **expanded;
+    int max_expanded = *num_specs * MAX_HOST_LEVELS + 1;
+    int num_expanded = 0, i, j;
+
+    expanded = malloc(max_expanded * sizeof(const char *) +
+                      MAX_HOST_LEVELS * MAX_HOST_SPEC_LENGTH);
+    if (expanded == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    host_specs = (char (*)[MAX_HOST_SPEC_LENGTH]) (expanded + max_expanded);
+
+    for (i = 0; i < *num_specs; i++) {
+        if (strcmp(specs[i], "host") != 0) {
+            expanded[num_expanded++] = specs[i];
+            continue;
+        }
+
+        /* The host's caches are only read once per call. */
+        if (num_host_specs < 0)
+            num_host_specs = get_host_specs(host_specs, verbose);
+        if (num_host_specs == 0) {
+            printf("ERROR:  argument %d:  the host's caches can't be read "
+                   "on this platform.\n", i + 1);
+            exit(1);
+        }
+
+        for (j = 0; j < num_host_specs; j++)
+            expanded[num_expanded++] = host_specs[j];
+    }
+
+    *num_specs = num_expanded;
+    return expanded;
+}
+
+
+/* Builds the cache levels in front of levels[num_specs], one per
+ * specification in specs, with specs[0] nearest the program, and stores
+ * them in levels[0] to levels[num_specs - 1].  mem_size is the size of the
+ * memory at the bottom of the hierarchy.  A specification that isn't valid
+ * prints an error and the usage of progname, and exits.  If verbose is
+ * zero, nothing else is printed, so several threads can build hierarchies
+ * at once.
+ */
+void build_cache_levels(int num_specs, const char **specs,
+                        const char *progname, membase_t **levels,
+                        uint32_t mem_size, int verbose) {
     int i;
-    const char *progname;
-    membase_t **p_mems;
-    memory_t *p_memory;
     cache_t *p_cache;
-    
-    progname = argv[0];
-    argc--;
-    argv++;
-    
-    p_mems = malloc((argc + 1) * sizeof(membase_t *));
+    stackdist_t *p_sd;
 
-    printf("Constructing memory for simulation (in reverse order):\n");
-    
-    printf(" * Building memory of size %u bytes\n", mem_size);
-    p_memory = malloc(sizeof(memory_t));
-    init_memory(p_memory, mem_size);
-    p_mems[argc] = (membase_t *) p_memory;
-    
-    for (i = argc - 1; i >= 0; i--) {
+    for (i = num_specs - 1; i >= 0; i--) {
         int block_size, num_sets, lines_per_set;
-        int ct = sscanf(argv[i], "%d:%d:%d",
-                        &block_size, &num_sets, &lines_per_set);
-        if (ct != 3) {
+        int ct, len = 0;
+        cache_options opts = { &lru_policy, NULL, 0, 0, 1, 0, 0, 0, 0, 0,
+                               -1, 0 };
+
+        if (strncmp(specs[i], "tlb:", 4) == 0) {
+            tlb_options tlb_opts;
+            tlb_t *p_tlb;
+            int level;
+
+            if (parse_tlb_spec(specs[i] + 4, &tlb_opts) != 0) {
+                printf("ERROR:  argument %d isn't a valid TLB "
+                       "specification.\n", i + 1);
+                usage(progname);
+                exit(1);
+            }
+
+            if (verbose) {
+                printf(" * Building TLB for pages of %u bytes, with",
+                       tlb_opts.page_size);
+                for (level = 0; level < tlb_opts.num_levels; level++) {
+                    printf("%s %u entries in %u ways",
+                           level > 0 ? " and" : "", tlb_opts.entries[level],
+                           tlb_opts.ways[level]);
+                }
+                printf(".\n");
+            }
+
+            p_tlb = malloc(sizeof(tlb_t));
+            init_tlb(p_tlb, tlb_opts.page_size, levels[i + 1]);
+            for (level = 0; level < tlb_opts.num_levels; level++) {
+                add_tlb_level(p_tlb, tlb_opts.entries[level],
+                              tlb_opts.ways[level]);
+            }
+            set_page_walk_cost(p_tlb, tlb_opts.walk_level_cycles);
+
+            levels[i] = (membase_t *) p_tlb;
+            continue;
+        }
+
+        if (strncmp(specs[i], "stack:", 6) == 0) {
+            num_sets = DEFAULT_STACK_MAX_SETS;
+            ct = sscanf(specs[i] + 6, "%d:%d", &block_size, &num_sets);
+            if (ct < 1 || block_size <= 0 || !is_power_of_2(block_size) ||
+                num_sets <= 0 || !is_power_of_2(num_sets)) {
+                printf("ERROR:  argument %d isn't correctly formatted.\n",
+                       i + 1);
+                usage(progname);
+                exit(1);
+            }
+
+            if (verbose) {
+                printf(" * Building stack-distance analysis with a block-size "
+                       "of %d bytes,\n   for 1 to %d cache-sets.\n",
+                       block_size, num_sets);
+            }
+
+            p_sd = malloc(sizeof(stackdist_t));
+            init_stackdist(p_sd, block_size, num_sets, mem_size,
+                           levels[i + 1]);
+
+            levels[i] = (membase_t *) p_sd;
+            continue;
+        }
+
+        ct = sscanf(specs[i], "%d:%d:%d%n",
+                    &block_size, &num_sets, &lines_per_set, &len);
+        if (ct != 3 || (specs[i][len] != '\0' && specs[i][len] != ':')) {
             printf("ERROR:  argument %d isn't correctly formatted.\n", i + 1);
             usage(progname);
             exit(1);
         }
+
+        while (specs[i][len] == ':') {
+            char option[MAX_OPTION_LENGTH];
+            const char *start = specs[i] + len + 1;
+            size_t option_len = strcspn(start, ":");
+
+            len += 1 + option_len;
+            if (option_len < MAX_OPTION_LENGTH) {
+                memcpy(option, start, option_len);
+                option[option_len] = '\0';
+            }
+
+            if (option_len >= MAX_OPTION_LENGTH ||
+                parse_cache_option(option, &opts) != 0) {
+                printf("ERROR:  argument %d:  unknown option \"%.*s\".\n",
+                       i + 1, (int) option_len, start);
+                usage(progname);
+                exit(1);
+            }
+        }
         
         if (block_size <= 0 || !is_power_of_2(block_size)) {
             printf("ERROR:  argument %d:  block size must be a positive "
@@ -80,18 +562,139 @@ membase_t * make_cached_memory(int argc, const char **argv,
             exit(1);
         }
 
-        printf(" * Building cache with a block-size of %d bytes, %d cache-sets,\n"
-               "   and %d cache-lines per set.  Total cache size is %d bytes.\n",
-               block_size, num_sets, lines_per_set,
-               block_size * num_sets * lines_per_set);
+        if (opts.policy->needs_power_of_2_lines &&
+            !is_power_of_2(lines_per_set)) {
+            printf("ERROR:  argument %d:  the %s policy needs a power-of-2 "
+                   "number of cache-lines per set, got %d.\n", i + 1,
+                   opts.policy->spec_name, lines_per_set);
+            usage(progname);
+            exit(1);
+        }
+
+        if (verbose) {
+            printf(" * Building cache with a block-size of %d bytes, %d "
+                   "cache-sets,\n   and %d cache-lines per set.  Total cache "
+                   "size is %d bytes.\n", block_size, num_sets, lines_per_set,
+                   block_size * num_sets * lines_per_set);
+            if (opts.prefetcher != NULL) {
+                printf("   Prefetching with a %s prefetcher of degree %d.\n",
+                       opts.prefetcher->name, opts.prefetch_degree);
+            }
+            if (opts.classify_misses)
+                printf("   Classifying the cache's misses.\n");
+            if (opts.hit_latency > 0 || opts.memory_latency > 0) {
+                printf("   Hit latency of %d cycles", opts.hit_latency);
+                if (opts.memory_latency > 0) {
+                    printf(", memory latency of %d cycles",
+                           opts.memory_latency);
+                }
+                if (opts.mlp > 1)
+                    printf(", up to %d overlapping misses", opts.mlp);
+                printf(".\n");
+            }
+            if (opts.inclusion >= 0) {
+                printf("   The cache is %s of the caches in front of it.\n",
+                       inclusion_names[opts.inclusion]);
+            }
+            if (opts.victim_cache_size > 0) {
+                printf("   Victim cache of %d blocks.\n",
+                       opts.victim_cache_size);
+            }
+        }
 
         p_cache = malloc(sizeof(cache_t));
-        init_cache(p_cache, block_size, num_sets, lines_per_set, p_mems[i + 1]);
+        init_cache(p_cache, block_size, num_sets, lines_per_set, levels[i + 1]);
+        set_replacement_policy(p_cache, opts.policy);
+        set_write_policy(p_cache, opts.write_through, opts.write_allocate,
+                         opts.write_buffer_size);
+        if (opts.prefetcher != NULL) {
+            set_prefetcher(p_cache, opts.prefetcher, opts.prefetch_degree,
+                           mem_size);
+        }
+        if (opts.classify_misses)
+            set_miss_classification(p_cache);
+        if (opts.hit_latency > 0 || opts.mlp > 0)
+            set_cache_latency(p_cache, opts.hit_latency, opts.mlp);
+        if (opts.memory_latency > 0)
+            set_memory_latency((membase_t *) p_cache, opts.memory_latency);
+        if (opts.inclusion >= 0)
+            set_inclusion_policy(p_cache, opts.inclusion);
+        if (opts.victim_cache_size > 0)
+            set_victim_cache(p_cache, opts.victim_cache_size);
 
-        p_mems[i] = (membase_t *) p_cache;
+        if (check_inclusion(p_cache) != 0) {
+            printf("ERROR:  argument %d can't be in front of the next "
+                   "level.\n", i + 1);
+            usage(progname);
+            exit(1);
+        }
+
+        levels[i] = (membase_t *) p_cache;
     }
-    printf("\n");
+}
+
+
+/* Builds a memory of mem_size bytes and the cache levels in front of it, one
+ * per specification in specs, with specs[0] nearest the program.  Returns an
+ * array of num_specs + 1 levels, with specs[0]'s level first and the memory
+ * last; free_memory_levels() releases them all.  Invalid specifications and
+ * verbose are handled as by build_cache_levels().
+ */
+membase_t ** build_memory_levels(int num_specs, const char **specs,
+                                 const char *progname, uint32_t mem_size,
+                                 int verbose) {
+    membase_t **p_mems;
+    memory_t *p_memory;
     
+    p_mems = malloc((num_specs + 1) * sizeof(membase_t *));
+    p_memory = malloc(sizeof(memory_t));
+    if (p_mems == NULL || p_memory == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    if (verbose) {
+        printf("Constructing memory for simulation (in reverse order):\n");
+        printf(" * Building memory of size %u bytes\n", mem_size);
+    }
+    init_memory(p_memory, mem_size);
+    p_mems[num_specs] = (membase_t *) p_memory;
+
+    build_cache_levels(num_specs, specs, progname, p_mems, mem_size, verbose);
+    if (verbose)
+        printf("\n");
+    
+    return p_mems;
+}
+
+
+/* Releases the levels returned by build_memory_levels(), and the array. */
+void free_memory_levels(membase_t **levels, int num_specs) {
+    int i;
+
+    for (i = 0; i <= num_specs; i++) {
+        levels[i]->free(levels[i]);
+        free(levels[i]);
+    }
+    free(levels);
+}
+
+
+/* Initializes a set of caches and a memory, using the cache configuration
+ * specified from command-line arguments, where "host" stands for the host's
+ * caches, and returns the level nearest the program.  The levels are never
+ * freed; programs that need to free them should call build_memory_levels()
+ * instead.
+ */
+membase_t * make_cached_memory(int argc, const char **argv,
+                               uint32_t mem_size) {
+    membase_t **p_mems;
+    const char **specs;
+    int num_specs = argc - 1;
+
+    specs = expand_host_specs(&num_specs, argv + 1, 1);
+    p_mems = build_memory_levels(num_specs, specs, argv[0], mem_size, 1);
+    free(specs);
     return p_mems[0];
 }
 
@@ -3,3 +3,13 @@
 void usage(const char *progname);
 membase_t * make_cached_memory(int argc, const char **argv, uint32_t mem_size);
 
+const char ** expand_host_specs(int *num_specs, const char **specs,
+                                int verbose);
+
+void build_cache_levels(int num_specs, const char **specs,
+                        const char *progname, membase_t **levels,
+                        uint32_t mem_size, int verbose);
+membase_t ** build_memory_levels(int num_specs, const char **specs,
+                                 const char *progname, uint32_t mem_size,
+                                 int verbose);
+void free_memory_levels(membase_t **levels, int num_specs);
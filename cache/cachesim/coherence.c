@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coherence.h"
+#include "prefetch.h"
+
+
+/* The results of snooping a core, or all of the other cores. */
+#define SNOOP_HELD 1
+#define SNOOP_SUPPLIED 2
+
+
+/* Local functions used by the coherence bus. */
+
+cacheline_t * find_block(cache_t *p_cache, addr_t block_start,
+                         cacheset_t **pp_set);
+int core_state(coherence_bus_t *bus, int core, addr_t block_start,
+               cache_t *except, cache_t **p_holder_cache,
+               cacheline_t **p_holder);
+int snoop_core(coherence_bus_t *bus, int core, addr_t block_start,
+               int exclusive, int flush, unsigned char *dest);
+int snoop_others(coherence_bus_t *bus, int requester, addr_t block_start,
+                 int exclusive, int flush, unsigned char *dest);
+
+
+/*---------------------------------------------------------------------------
+ * SETUP AND STATISTICS
+ */
+
+
+void init_coherence_bus(coherence_bus_t *bus, int protocol, int num_cores,
+                        membase_t *shared) {
+    bus->protocol = protocol;
+    bus->shared = shared;
+    bus->num_cores = num_cores;
+    bus->cores = calloc(num_cores, sizeof(coherence_core_t));
+    if (bus->cores == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+}
+
+
+int attach_core(coherence_bus_t *bus, int core, cache_t **levels,
+                int num_levels) {
+    coherence_core_t *p_core = bus->cores + core;
+    uint32_t block_size = levels[0]->block_size;
+    int i;
+
+    /* Every core's caches must have the same block size as the first. */
+    if (core > 0 && bus->cores[0].num_levels > 0)
+        block_size = bus->cores[0].levels[0]->block_size;
+
+    for (i = 0; i < num_levels; i++) {
+        cache_t *p_cache = levels[i];
+        membase_t *next = i + 1 < num_levels ?
+                          (membase_t *) levels[i + 1] : bus->shared;
+
+        if (p_cache->block_size != block_size) {
+            printf("ERROR:  coherent caches must all have the same block "
+                   "size.\n");
+            return -1;
+        }
+
+        if (p_cache->write_through || !p_cache->write_allocate ||
+            p_cache->write_buffer != NULL) {
+            printf("ERROR:  coherent caches must be write-back and "
+                   "write-allocate, without a write buffer.\n");
+            return -1;
+        }
+
+        if (p_cache->prefetcher != NULL &&
+            p_cache->prefetcher->take_block != NULL) {
+            printf("ERROR:  coherent caches can't use the %s prefetcher.\n",
+                   p_cache->prefetcher->name);
+            return -1;
+        }
+
+        if (p_cache->victim_cache != NULL ||
+            p_cache->inclusion != INCLUSION_NINE) {
+            printf("ERROR:  coherent caches can't have victim caches or "
+                   "inclusion policies.\n");
+            return -1;
+        }
+
+        if (p_cache->next_memory != next) {
+            printf("ERROR:  core %d's caches aren't in front of the shared "
+                   "memory.\n", core);
+            return -1;
+        }
+    }
+
+    /* The shared memory's back-invalidations and hand-offs would bypass
+     * the coherence protocol.
+     */
+    if (as_cache(bus->shared) != NULL &&
+        ((cache_t *) bus->shared)->inclusion != INCLUSION_NINE) {
+        printf("ERROR:  a cache shared by coherent caches can't be inclusive "
+               "or exclusive.\n");
+        return -1;
+    }
+
+    p_core->levels = malloc(num_levels * sizeof(cache_t *));
+    if (p_core->levels == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    memcpy(p_core->levels, levels, num_levels * sizeof(cache_t *));
+    p_core->num_levels = num_levels;
+
+    for (i = 0; i < num_levels; i++) {
+        levels[i]->bus = bus;
+        levels[i]->core = core;
+        levels[i]->core_level = i;
+    }
+
+    return 0;
+}
+
+
+void free_coherence_bus(coherence_bus_t *bus) {
+    int i;
+
+    for (i = 0; i < bus->num_cores; i++)
+        free(bus->cores[i].levels);
+    free(bus->cores);
+}
+
+
+const char * protocol_name(int protocol) {
+    return protocol == PROTOCOL_MOESI ? "MOESI" : "MESI";
+}
+
+
+void print_core_stats(coherence_bus_t *bus, int core) {
+    coherence_core_t *p_core = bus->cores + core;
+    uint64_t total;
+
+    total = p_core->num_bus_reads + p_core->num_bus_read_exclusives +
+            p_core->num_bus_upgrades + p_core->num_flushes +
+            p_core->num_write_backs;
+
+    printf(" * Core %d bus transactions=%lu:  reads=%lu read-exclusives=%lu "
+           "upgrades=%lu\n", core, total, p_core->num_bus_reads,
+           p_core->num_bus_read_exclusives, p_core->num_bus_upgrades);
+    printf("   flushes=%lu write-backs=%lu", p_core->num_flushes,
+           p_core->num_write_backs);
+    if (bus->protocol == PROTOCOL_MOESI)
+        printf(" supplies=%lu", p_core->num_supplies);
+    printf(" invalidations-received=%lu\n", p_core->num_invalidations);
+}
+
+
+/*---------------------------------------------------------------------------
+ * PROTOCOL
+ */
+
+
+/* Returns the line of a cache that holds the block starting at block_start,
+ * or NULL if no line does.  The line's set is stored in *pp_set.
+ */
+cacheline_t * find_block(cache_t *p_cache, addr_t block_start,
+                         cacheset_t **pp_set) {
+    addr_t block = block_start >> p_cache->block_offset_bits;
+    int i;
+
+    *pp_set = p_cache->cache_sets + (block & (p_cache->num_sets - 1));
+    i = find_tag_in_set(*pp_set, block >> p_cache->sets_addr_bits);
+    return i < 0 ? NULL : (*pp_set)->cache_lines + i;
+}
+
+
+/* Returns the highest state that any cache of a core, apart from except,
+ * holds a block in, or LINE_INVALID if none holds it.  If the block is
+ * held, the cache nearest the core that holds it, which has the newest
+ * copy, and its line are stored in *p_holder_cache and *p_holder;
+ * otherwise they are set to NULL.
+ */
+int core_state(coherence_bus_t *bus, int core, addr_t block_start,
+               cache_t *except, cache_t **p_holder_cache,
+               cacheline_t **p_holder) {
+    coherence_core_t *p_core = bus->cores + core;
+    int i, state = LINE_INVALID;
+
+    *p_holder_cache = NULL;
+    *p_holder = NULL;
+
+    for (i = 0; i < p_core->num_levels; i++) {
+        cacheset_t *p_set;
+        cacheline_t *p_line;
+
+        if (p_core->levels[i] == except)
+            continue;
+
+        p_line = find_block(p_core->levels[i], block_start, &p_set);
+        if (p_line == NULL)
+            continue;
+
+        if (*p_holder == NULL) {
+            *p_holder_cache = p_core->levels[i];
+            *p_holder = p_line;
+        }
+        if (p_line->state > state)
+            state = p_line->state;
+    }
+
+    return state;
+}
+
+
+/* Snoops every cache of a core for the block starting at block_start, on
+ * behalf of another core.  If exclusive is nonzero, the other core wants to
+ * write the block, so every copy is invalidated; otherwise every copy
+ * becomes shared.  If the core has modified the block, the newest copy is
+ * either copied into dest (if dest isn't NULL, and the protocol is MOESI),
+ * or written to the shared memory (if flush is nonzero).  Returns
+ * SNOOP_HELD if the core held the block, plus SNOOP_SUPPLIED if it copied
+ * the block into dest.
+ */
+int snoop_core(coherence_bus_t *bus, int core, addr_t block_start,
+               int exclusive, int flush, unsigned char *dest) {
+    coherence_core_t *p_core = bus->cores + core;
+    cacheline_t *newest = NULL;
+    uint32_t block_size = p_core->levels[0]->block_size;
+    int i, lowest = 0, dirty = 0, result;
+
+    for (i = 0; i < p_core->num_levels; i++) {
+        cacheset_t *p_set;
+        cacheline_t *p_line = find_block(p_core->levels[i], block_start,
+                                         &p_set);
+        if (p_line == NULL)
+            continue;
+
+        if (newest == NULL)
+            newest = p_line;
+        if (p_line->state == LINE_MODIFIED || p_line->state == LINE_OWNED)
+            dirty = 1;
+        lowest = i;
+    }
+
+    if (newest == NULL)
+        return 0;
+
+    result = SNOOP_HELD;
+    if (dirty && dest != NULL && bus->protocol == PROTOCOL_MOESI) {
+        memcpy(dest, newest->block, block_size);
+        p_core->num_supplies++;
+        result |= SNOOP_SUPPLIED;
+    }
+    else if (dirty && flush) {
+        write_block(bus->shared, block_start, newest->block, block_size);
+        p_core->num_flushes++;
+        dirty = 0;
+    }
+
+    for (i = 0; i < p_core->num_levels; i++) {
+        cacheset_t *p_set;
+        cacheline_t *p_line = find_block(p_core->levels[i], block_start,
+                                         &p_set);
+        if (p_line == NULL)
+            continue;
+
+        if (exclusive) {
+            invalidate_cache_line(p_core->levels[i], p_set, p_line);
+            continue;
+        }
+
+        /* The copies further from the core may be older, so bring them all
+         * up to date.  With MOESI, the lowest copy keeps the block dirty.
+         */
+        if (p_line != newest)
+            memcpy(p_line->block, newest->block, block_size);
+
+        if (dirty && i == lowest) {
+            p_line->state = LINE_OWNED;
+            p_line->dirty = 1;
+        }
+        else {
+            p_line->state = LINE_SHARED;
+            p_line->dirty = 0;
+        }
+    }
+
+    if (exclusive)
+        p_core->num_invalidations++;
+
+    return result;
+}
+
+
+/* Snoops every core but the requester, as snoop_core() does, and returns the
+ * combined results.  Only one core can supply the block.
+ */
+int snoop_others(coherence_bus_t *bus, int requester, addr_t block_start,
+                 int exclusive, int flush, unsigned char *dest) {
+    int core, result = 0;
+
+    for (core = 0; core < bus->num_cores; core++) {
+        if (core == requester)
+            continue;
+
+        result |= snoop_core(bus, core, block_start, exclusive, flush,
+                             (result & SNOOP_SUPPLIED) ? NULL : dest);
+    }
+
+    return result;
+}
+
+
+/* Loads a block into an empty line of a coherent cache.  If another cache of
+ * the same core holds the block, no bus transaction is needed, unless the
+ * block is to be written and the core doesn't own it.  Otherwise the cache
+ * reads the block over the bus, snooping the other cores.
+ *
+ * The data comes from the next level, as it would without coherence, unless
+ * another core supplies it, or a cache nearer the core holds a newer copy.
+ * Levels below this one that miss on the way are filled in the same state,
+ * but clean, without another bus transaction.
+ */
+void coherence_fill(cache_t *p_cache, cacheline_t *p_line, addr_t block_start,
+                    int for_write) {
+    coherence_bus_t *bus = p_cache->bus;
+    coherence_core_t *p_core = bus->cores + p_cache->core;
+    cache_t *holder_cache;
+    cacheline_t *holder;
+    addr_t saved_block;
+    int held, state, saved_state, result = 0;
+
+    if (p_core->pending_block == block_start + 1) {
+        state = p_core->pending_state;
+        if (state == LINE_MODIFIED)
+            state = LINE_EXCLUSIVE;
+
+        read_block(p_cache->next_memory, block_start, p_line->block,
+                   p_cache->block_size);
+        p_line->state = state;
+        return;
+    }
+
+    held = core_state(bus, p_cache->core, block_start, p_cache,
+                      &holder_cache, &holder);
+
+    if (!for_write) {
+        if (held != LINE_INVALID) {
+            state = held >= LINE_EXCLUSIVE ? LINE_EXCLUSIVE : LINE_SHARED;
+        }
+        else {
+            p_core->num_bus_reads++;
+            result = snoop_others(bus, p_cache->core, block_start, 0, 1,
+                                  p_line->block);
+            state = (result & SNOOP_HELD) ? LINE_SHARED : LINE_EXCLUSIVE;
+        }
+    }
+    else {
+        state = LINE_MODIFIED;
+        if (held == LINE_INVALID) {
+            p_core->num_bus_read_exclusives++;
+            result = snoop_others(bus, p_cache->core, block_start, 1, 1,
+                                  p_line->block);
+        }
+        else if (held < LINE_EXCLUSIVE) {
+            p_core->num_bus_upgrades++;
+            snoop_others(bus, p_cache->core, block_start, 1, 0, NULL);
+        }
+    }
+
+    if (holder != NULL && holder_cache->core_level < p_cache->core_level) {
+        /* The levels below may only have an older copy. */
+        memcpy(p_line->block, holder->block, p_cache->block_size);
+    }
+    else if (!(result & SNOOP_SUPPLIED)) {
+        saved_block = p_core->pending_block;
+        saved_state = p_core->pending_state;
+        p_core->pending_block = block_start + 1;
+        p_core->pending_state = state;
+
+        read_block(p_cache->next_memory, block_start, p_line->block,
+                   p_cache->block_size);
+
+        p_core->pending_block = saved_block;
+        p_core->pending_state = saved_state;
+    }
+
+    p_line->state = state;
+}
+
+
+/* Gains ownership of a block before a line of a coherent cache is written.
+ * No bus transaction is needed if the core already owns the block.
+ */
+void coherence_write(cache_t *p_cache, cacheline_t *p_line,
+                     addr_t block_start) {
+    coherence_bus_t *bus = p_cache->bus;
+    cache_t *holder_cache;
+    cacheline_t *holder;
+
+    if (p_line->state >= LINE_EXCLUSIVE) {
+        p_line->state = LINE_MODIFIED;
+        return;
+    }
+
+    if (core_state(bus, p_cache->core, block_start, p_cache,
+                   &holder_cache, &holder) < LINE_EXCLUSIVE) {
+        bus->cores[p_cache->core].num_bus_upgrades++;
+        snoop_others(bus, p_cache->core, block_start, 1, 0, NULL);
+    }
+
+    p_line->state = LINE_MODIFIED;
+}
+
+
+/* Counts a write-back as a bus transaction if it goes to the shared memory,
+ * rather than to another cache of the same core.
+ */
+void coherence_write_back(cache_t *p_cache) {
+    coherence_core_t *p_core = p_cache->bus->cores + p_cache->core;
+
+    if (p_cache->core_level == p_core->num_levels - 1)
+        p_core->num_write_backs++;
+}
@@ -0,0 +1,126 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+
+#include "cache.h"
+
+
+/* The protocols a coherence bus can use. */
+#define PROTOCOL_MESI 0
+#define PROTOCOL_MOESI 1
+
+/* The states of a line in a coherent cache, kept in its state member.  The
+ * values are ordered so that a larger state grants more rights to the
+ * block, apart from OWNED, which grants the same rights as SHARED.
+ */
+#define LINE_INVALID 0
+#define LINE_SHARED 1
+#define LINE_OWNED 2
+#define LINE_EXCLUSIVE 3
+#define LINE_MODIFIED 4
+
+
+/* The private caches of one core, and the bus traffic the core causes. */
+typedef struct coherence_core_t {
+    /* The core's private caches, nearest the core first.  The last one's
+     * next level is the bus's shared memory.
+     */
+    cache_t **levels;
+    int num_levels;
+
+    /* While the core is loading a block, so that the levels below the one
+     * that missed can be filled without another bus transaction:  the
+     * block's start address plus 1 (or 0 if none), and the state that the
+     * block is being loaded in.
+     */
+    addr_t pending_block;
+    int pending_state;
+
+    /* The bus transactions the core has made:  reads, reads for ownership,
+     * upgrades of shared lines to modified, dirty blocks flushed to the
+     * shared memory because another core asked for them, and write-backs of
+     * evicted dirty blocks.
+     */
+    uint64_t num_bus_reads;
+    uint64_t num_bus_read_exclusives;
+    uint64_t num_bus_upgrades;
+    uint64_t num_flushes;
+    uint64_t num_write_backs;
+
+    /* The number of blocks the core supplied directly to another core, which
+     * only happens with MOESI.
+     */
+    uint64_t num_supplies;
+
+    /* The number of times another core's write invalidated a block that
+     * this core held, in any number of its caches.
+     */
+    uint64_t num_invalidations;
+} coherence_core_t;
+
+
+/* This struct represents a snooping bus that keeps the private caches of
+ * several cores coherent, with the MESI or MOESI protocol.  Every private
+ * cache of every core is snooped, so the caches of a core don't have to be
+ * inclusive of each other.  Within a core, the copy of a block nearest the
+ * core is always the newest one.
+ *
+ * The private caches must all have the same block size, and must be
+ * write-back and write-allocate, without write buffers; prefetchers that
+ * keep blocks outside the cache, such as stream buffers, aren't supported.
+ */
+typedef struct coherence_bus_t {
+    int protocol;
+
+    /* The memory that all of the cores share, below their private caches. */
+    membase_t *shared;
+
+    coherence_core_t *cores;
+    int num_cores;
+} coherence_bus_t;
+
+
+/* Initializes a bus for the specified number of cores, sharing the specified
+ * memory.  Each core's caches must then be attached with attach_core().
+ */
+void init_coherence_bus(coherence_bus_t *bus, int protocol, int num_cores,
+                        membase_t *shared);
+
+/* Attaches a core's private caches to the bus, nearest the core first.  The
+ * last cache's next level must be the bus's shared memory.  Returns 0 on
+ * success, or -1 (after printing why) if the caches can't be kept coherent.
+ */
+int attach_core(coherence_bus_t *bus, int core, cache_t **levels,
+                int num_levels);
+
+/* Releases the memory used by the bus, but not the caches or the shared
+ * memory.
+ */
+void free_coherence_bus(coherence_bus_t *bus);
+
+/* Prints the bus traffic of a core. */
+void print_core_stats(coherence_bus_t *bus, int core);
+
+/* Returns the name of the protocol a bus uses. */
+const char * protocol_name(int protocol);
+
+
+/* Called by a coherent cache to load the block starting at block_start into
+ * an empty line, in place of reading it from the next level.  Makes any bus
+ * transaction needed, and sets the line's state.  for_write is nonzero if
+ * the block is being loaded to be written.
+ */
+void coherence_fill(cache_t *p_cache, cacheline_t *p_line, addr_t block_start,
+                    int for_write);
+
+/* Called by a coherent cache before it writes to a valid line, to gain
+ * ownership of the block if the line doesn't already have it.
+ */
+void coherence_write(cache_t *p_cache, cacheline_t *p_line,
+                     addr_t block_start);
+
+/* Called by a coherent cache when it writes back a dirty line. */
+void coherence_write_back(cache_t *p_cache);
+
+
+#endif /* COHERENCE_H */
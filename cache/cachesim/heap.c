@@ -1,8 +1,14 @@
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "heap.h"
 
 
+const char *heap_layout_names[NUM_HEAP_LAYOUTS] = {
+    "binary", "4-ary", "8-ary", "b-heap"
+};
+
+
 /*
  * These are declarations of local functions that are used internally by the
  * heap data structure, but are not visible outside this module.
@@ -12,6 +18,34 @@ void sift_down(float_heap *p_heap, int index);
 void sift_up(float_heap *p_heap, int index);
 void swap_values(float_heap *p_heap, int i, int j);
 
+void dary_sift_down(float_heap *p_heap, float value);
+void dary_sift_up(float_heap *p_heap, int index, float value);
+
+uint32_t bheap_root_depth(uint32_t page_bits, int max_values);
+uint32_t bheap_position(uint32_t page_bits, uint32_t root_depth,
+                        uint32_t index);
+uint32_t bheap_left_child(float_heap *p_heap, uint32_t pos);
+uint32_t bheap_parent(float_heap *p_heap, uint32_t pos);
+void bheap_sift_down(float_heap *p_heap, float value);
+void bheap_sift_up(float_heap *p_heap, uint32_t index, float value);
+
+
+/* Reads the value at a position of the heap's storage. */
+static inline float heap_read(float_heap *p_heap, uint32_t pos) {
+    if (p_heap->memory == NULL)
+        return p_heap->values[pos];
+    return read_float(p_heap->memory, pos);
+}
+
+
+/* Writes the value at a position of the heap's storage. */
+static inline void heap_write(float_heap *p_heap, uint32_t pos, float value) {
+    if (p_heap->memory == NULL)
+        p_heap->values[pos] = value;
+    else
+        write_float(p_heap->memory, pos, value);
+}
+
 /*
  * For heaps stored in an array, left child and right child of a particular
  * index are calculated using these functions.  The "index" value is
@@ -26,15 +60,96 @@ void swap_values(float_heap *p_heap, int i, int j);
 #define PARENT(index) (((index) - 1) / 2)
 
 
-/* Initialize a heap data structure. */
+/* Initialize a binary heap data structure. */
 void init_heap(float_heap *p_heap, membase_t *memory, int max_values) {
+    init_heap_layout(p_heap, memory, max_values, HEAP_BINARY, 0);
+}
+
+
+/* Initialize a heap data structure with the specified layout. */
+void init_heap_layout(float_heap *p_heap, membase_t *memory, int max_values,
+                      int layout, uint32_t page_size) {
+    uint32_t size;
+
     assert(p_heap != NULL);
-    assert(memory != NULL);
+    assert(layout >= 0 && layout < NUM_HEAP_LAYOUTS);
 
     p_heap->memory = memory;
+    p_heap->values = NULL;
 
     p_heap->num_values = 0;
     p_heap->max_values = max_values;
+
+    p_heap->layout = layout;
+    p_heap->arity = (layout == HEAP_4_ARY ? 4 :
+                     layout == HEAP_8_ARY ? 8 : 2);
+
+    p_heap->page_values = 0;
+    p_heap->page_bits = 0;
+    p_heap->root_depth = 0;
+    if (layout == HEAP_B_HEAP) {
+        assert(page_size >= 4 * sizeof(float));
+        assert((page_size & (page_size - 1)) == 0);
+        p_heap->page_values = page_size / sizeof(float);
+        p_heap->page_bits = log_2(p_heap->page_values);
+        p_heap->root_depth = bheap_root_depth(p_heap->page_bits, max_values);
+    }
+
+    if (memory == NULL) {
+        /* Align the native array like the simulated memory, whose address
+         * 0 starts every cache line and page.
+         */
+        size = heap_memory_size(layout, max_values, page_size);
+        if (posix_memalign((void **) &p_heap->values,
+                           page_size > 64 ? page_size : 64, size) != 0) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+}
+
+
+/* Releases the native array of a heap, if it has one. */
+void free_heap(float_heap *p_heap) {
+    free(p_heap->values);
+    p_heap->values = NULL;
+}
+
+
+/* Returns the number of bytes of memory a heap uses. */
+uint32_t heap_memory_size(int layout, int max_values, uint32_t page_size) {
+    uint32_t page_bits, root_depth, index, pos, last_pos;
+
+    switch (layout) {
+    case HEAP_4_ARY:
+        return (max_values + 3) * sizeof(float);
+
+    case HEAP_8_ARY:
+        return (max_values + 7) * sizeof(float);
+
+    case HEAP_B_HEAP:
+        /* Pages are numbered level by level, left to right, so the last
+         * page holds either the last value or the rightmost value of some
+         * full level of the tree, whose indexes are 0, 2, 6, 14, ...
+         */
+        page_bits = log_2(page_size / sizeof(float));
+        root_depth = bheap_root_depth(page_bits, max_values);
+        last_pos = 0;
+        for (index = 0; index < (uint32_t) max_values; index = 2 * index + 2) {
+            pos = bheap_position(page_bits, root_depth, index);
+            if (pos > last_pos)
+                last_pos = pos;
+        }
+        if (max_values > 0) {
+            pos = bheap_position(page_bits, root_depth, max_values - 1);
+            if (pos > last_pos)
+                last_pos = pos;
+        }
+        return ((last_pos >> page_bits) + 1) * page_size;
+
+    default:
+        return max_values * sizeof(float);
+    }
 }
 
 
@@ -47,8 +162,37 @@ float get_first_value(float_heap *p_heap) {
     /* There needs to be at least one value left in the heap! */
     assert(p_heap->num_values > 0);
 
+    if (p_heap->layout != HEAP_BINARY) {
+        /* The other layouts sift the last value down from the root without
+         * storing it there first.
+         */
+        int offset = p_heap->arity - 1;
+        float last;
+
+        if (p_heap->layout == HEAP_B_HEAP)
+            offset = (1 << p_heap->root_depth) - 2;
+        result = heap_read(p_heap, offset);
+
+        p_heap->num_values--;
+        if (p_heap->num_values != 0) {
+            if (p_heap->layout == HEAP_B_HEAP) {
+                last = heap_read(p_heap,
+                                 bheap_position(p_heap->page_bits,
+                                                p_heap->root_depth,
+                                                p_heap->num_values));
+                bheap_sift_down(p_heap, last);
+            }
+            else {
+                last = heap_read(p_heap, p_heap->num_values + offset);
+                dary_sift_down(p_heap, last);
+            }
+        }
+
+        return result;
+    }
+
     /* Smallest value is at the root - index 0. */
-    result = read_float(p_heap->memory, 0);
+    result = heap_read(p_heap, 0);
 
     /* Decrease the count of how many values are in the heap.  NOTE that if
      * there was more than one value in the heap, the last value is still at
@@ -59,8 +203,8 @@ float get_first_value(float_heap *p_heap) {
     p_heap->num_values--;
     if (p_heap->num_values != 0) {
         /* Move the last value in the heap to the root. */
-        float f = read_float(p_heap->memory, p_heap->num_values);
-        write_float(p_heap->memory, 0, f);
+        float f = heap_read(p_heap, p_heap->num_values);
+        heap_write(p_heap, 0, f);
 
         /* Sift down the new value to position it properly in the heap. */
         sift_down(p_heap, 0);
@@ -80,10 +224,19 @@ void add_value(float_heap *p_heap, float newval) {
     /* There needs to be room for one more element in the heap... */
     assert(p_heap->num_values < p_heap->max_values);
 
+    if (p_heap->layout == HEAP_B_HEAP) {
+        bheap_sift_up(p_heap, p_heap->num_values++, newval);
+        return;
+    }
+    if (p_heap->layout != HEAP_BINARY) {
+        dary_sift_up(p_heap, p_heap->num_values++, newval);
+        return;
+    }
+
     /* Add the new value to the end of the heap, then sift up. */
 
     index = p_heap->num_values;
-    write_float(p_heap->memory, index, newval);
+    heap_write(p_heap, index, newval);
     p_heap->num_values++;
 
     /* If the new value isn't at the root, sift up. */
@@ -119,7 +272,7 @@ void sift_down(float_heap *p_heap, int index) {
 
     int left_child = LEFT_CHILD(index);
     int right_child = RIGHT_CHILD(index);
-    float index_val = read_float(p_heap->memory, index);
+    float index_val = heap_read(p_heap, index);
 
     if (left_child >= p_heap->num_values) {
         /* If the left child's index is past the end of the heap
@@ -131,7 +284,7 @@ void sift_down(float_heap *p_heap, int index) {
     if (right_child >= p_heap->num_values) {
         /* Only have a left child. */
 
-        if (read_float(p_heap->memory, left_child) < index_val) {
+        if (heap_read(p_heap, left_child) < index_val) {
             /* Left child value is smaller.  Swap this value and the
              * left child value.
              */
@@ -146,8 +299,8 @@ void sift_down(float_heap *p_heap, int index) {
     else {
         /* This value has a left and right child. */
 
-        float left_val = read_float(p_heap->memory, left_child);
-        float right_val = read_float(p_heap->memory, right_child);
+        float left_val = heap_read(p_heap, left_child);
+        float right_val = heap_read(p_heap, right_child);
         int swap_child;
 
         if (left_val < index_val || right_val < index_val) {
@@ -190,8 +343,8 @@ void sift_up(float_heap *p_heap, int index) {
     /* If the specified value is smaller than its parent value then
      * we have to swap the value and its parent.
      */
-    if (read_float(p_heap->memory, index) <
-        read_float(p_heap->memory, parent_index)) {
+    if (heap_read(p_heap, index) <
+        heap_read(p_heap, parent_index)) {
         /* Swap the value with its parent value. */
         swap_values(p_heap, index, parent_index);
 
@@ -214,10 +367,228 @@ void swap_values(float_heap *p_heap, int i, int j) {
     assert(j >= 0 && j < p_heap->num_values);
     assert(i != j);
 
-    i_val = read_float(p_heap->memory, i);
-    j_val = read_float(p_heap->memory, j);
+    i_val = heap_read(p_heap, i);
+    j_val = heap_read(p_heap, j);
+
+    heap_write(p_heap, i, j_val);
+    heap_write(p_heap, j, i_val);
+}
+
+
+/*
+ * The d-ary layouts store the value with index i at position i + arity - 1,
+ * so that the children of index i, at indexes arity * i + 1 to
+ * arity * (i + 1), start at position arity * (i + 1), a multiple of the
+ * size of a group of children.  Both sifts move a hole through the heap
+ * instead of swapping values, and store the sifted value once at the end.
+ */
+void dary_sift_down(float_heap *p_heap, float value) {
+    int arity = p_heap->arity;
+    int offset = arity - 1;
+    int index = 0;
+
+    while (1) {
+        int first_child = arity * index + 1;
+        int end_child = first_child + arity;
+        int child, min_child;
+        float min_val;
+
+        if (first_child >= p_heap->num_values)
+            break;
+        if (end_child > p_heap->num_values)
+            end_child = p_heap->num_values;
+
+        /* Find the smallest child. */
+        min_child = first_child;
+        min_val = heap_read(p_heap, first_child + offset);
+        for (child = first_child + 1; child < end_child; child++) {
+            float child_val = heap_read(p_heap, child + offset);
+            if (child_val < min_val) {
+                min_child = child;
+                min_val = child_val;
+            }
+        }
+
+        if (!(min_val < value))
+            break;
+
+        heap_write(p_heap, index + offset, min_val);
+        index = min_child;
+    }
+
+    heap_write(p_heap, index + offset, value);
+}
+
 
-    write_float(p_heap->memory, i, j_val);
-    write_float(p_heap->memory, j, i_val);
+void dary_sift_up(float_heap *p_heap, int index, float value) {
+    int arity = p_heap->arity;
+    int offset = arity - 1;
+
+    while (index > 0) {
+        int parent_index = (index - 1) / arity;
+        float parent_val = heap_read(p_heap, parent_index + offset);
+
+        if (!(value < parent_val))
+            break;
+
+        heap_write(p_heap, index + offset, parent_val);
+        index = parent_index;
+    }
+
+    heap_write(p_heap, index + offset, value);
 }
 
+
+/*
+ * The B-heap layout stores the binary tree in pages of page_values values.
+ * Each page holds a pair of sibling subtrees, page_bits - 1 levels deep,
+ * in the usual array order:  numbering the two roots 2 and 3, node m's
+ * children are 2m and 2m+1, and node m is at slot m - 2 of the page.  That
+ * leaves the last two slots of each page empty.  The children of the
+ * subtrees' leaves are the roots of the next pages, which are numbered
+ * like the nodes of a (page_values / 2)-ary heap.  Siblings are always
+ * next to each other, so comparing them touches one cache line.
+ *
+ * The pages at the bottom of the heap would hold only a few levels if the
+ * tree's levels were split into pages from the top, wasting most of each
+ * page.  Instead the tree's root is the leftmost node at root_depth in
+ * page 0, chosen so that the bottom level of the full heap is the bottom
+ * level of its pages.  Only the leftmost pages of each level are used,
+ * and the rest are never touched.
+ */
+
+
+/* Returns the depth in page 0 of the root of a B-heap holding max_values
+ * values.
+ */
+uint32_t bheap_root_depth(uint32_t page_bits, int max_values) {
+    uint32_t levels = page_bits - 1;
+    uint32_t tree_levels = 1;
+
+    while (max_values >> tree_levels > 0)
+        tree_levels++;
+
+    /* Page 0 holds whatever levels are left over by the full pages. */
+    if (tree_levels % levels == 0)
+        return 1;
+    return levels - tree_levels % levels + 1;
+}
+
+
+/* Returns the position of the value with the specified index in the
+ * B-heap layout.
+ */
+uint32_t bheap_position(uint32_t page_bits, uint32_t root_depth,
+                        uint32_t index) {
+    uint32_t levels = page_bits - 1;
+    uint32_t half = 1 << levels;
+    uint32_t n = index + 1, depth = 0, m, page = 0;
+
+    while ((n >> depth) > 1)
+        depth++;
+
+    /* Number the node as though the root were at root_depth, replacing the
+     * leading 1 of n with the root's number, 1 << root_depth.
+     */
+    m = n + (((1 << root_depth) - 1) << depth);
+    depth += root_depth;
+
+    /* Descend through the pages, renumbering the node within each one. */
+    while (depth > levels) {
+        uint32_t shift = depth - levels;
+
+        page = page * half + 1 + ((m >> shift) - half);
+        m = (m & ((1 << shift) - 1)) | (1 << shift);
+        depth = shift;
+    }
+
+    return (page << page_bits) + m - 2;
+}
+
+
+/* Returns the position of the left child of the value at the specified
+ * position in the B-heap layout.  The right child follows it.
+ */
+uint32_t bheap_left_child(float_heap *p_heap, uint32_t pos) {
+    uint32_t slot = pos & (p_heap->page_values - 1);
+    uint32_t half = p_heap->page_values / 2;
+
+    if (slot + 2 < half)
+        return pos + slot + 2;
+
+    /* A leaf of its page; the children start the next page. */
+    return ((pos >> p_heap->page_bits) * half + 1 + slot + 2 - half)
+        << p_heap->page_bits;
+}
+
+
+/* Returns the position of the parent of the value at the specified
+ * position in the B-heap layout, which mustn't be the root.
+ */
+uint32_t bheap_parent(float_heap *p_heap, uint32_t pos) {
+    uint32_t slot = pos & (p_heap->page_values - 1);
+    uint32_t half = p_heap->page_values / 2;
+    uint32_t page;
+
+    if (slot >= 2)
+        return pos - slot + slot / 2 - 1;
+
+    /* A root of its page; the parent is a leaf of the page above. */
+    page = (pos >> p_heap->page_bits) - 1;
+    return ((page / half) << p_heap->page_bits) + half + page % half - 2;
+}
+
+
+void bheap_sift_down(float_heap *p_heap, float value) {
+    uint32_t num_values = p_heap->num_values;
+    uint32_t index = 0, pos = (1 << p_heap->root_depth) - 2;
+
+    while (1) {
+        uint32_t child = 2 * index + 1, child_pos;
+        float child_val, right_val;
+
+        if (child >= num_values)
+            break;
+
+        /* Pick the smaller child. */
+        child_pos = bheap_left_child(p_heap, pos);
+        child_val = heap_read(p_heap, child_pos);
+        if (child + 1 < num_values) {
+            right_val = heap_read(p_heap, child_pos + 1);
+            if (right_val < child_val) {
+                child++;
+                child_pos++;
+                child_val = right_val;
+            }
+        }
+
+        if (!(child_val < value))
+            break;
+
+        heap_write(p_heap, pos, child_val);
+        index = child;
+        pos = child_pos;
+    }
+
+    heap_write(p_heap, pos, value);
+}
+
+
+void bheap_sift_up(float_heap *p_heap, uint32_t index, float value) {
+    uint32_t pos = bheap_position(p_heap->page_bits, p_heap->root_depth,
+                                  index);
+
+    while (index > 0) {
+        uint32_t parent_pos = bheap_parent(p_heap, pos);
+        float parent_val = heap_read(p_heap, parent_pos);
+
+        if (!(value < parent_val))
+            break;
+
+        heap_write(p_heap, pos, parent_val);
+        index = (index - 1) / 2;
+        pos = parent_pos;
+    }
+
+    heap_write(p_heap, pos, value);
+}
@@ -5,6 +5,29 @@
 #include "membase.h"
 
 
+/* The layouts a heap can store its values in.  The binary layout is the
+ * classic array, where the children of index i are at 2i+1 and 2i+2.  The
+ * d-ary layouts give each node 4 or 8 children, stored next to each other
+ * and aligned so that they share one cache line, which makes the heap
+ * shallower and means that sift-down touches one line per level.  The
+ * B-heap layout (Kamp, 2010) keeps the binary tree, but stores it in pages
+ * of page_values values, each holding a pair of sibling subtrees several
+ * levels deep, so that a path from the root to a leaf touches only a few
+ * pages.
+ */
+#define HEAP_BINARY 0
+#define HEAP_4_ARY 1
+#define HEAP_8_ARY 2
+#define HEAP_B_HEAP 3
+#define NUM_HEAP_LAYOUTS 4
+
+/* The names of the layouts, indexed by the constants above. */
+extern const char *heap_layout_names[NUM_HEAP_LAYOUTS];
+
+/* The default size of a B-heap page, in bytes. */
+#define DEFAULT_HEAP_PAGE_SIZE 4096
+
+
 /* A simple heap data structure, for storing floats. */
 typedef struct {
     /* Number of values currently in the heap. */
@@ -13,14 +36,49 @@ typedef struct {
     /* The maximum number of values to be stored in the heap. */
     int max_values;
 
-    /* The values in the heap. */
+    /* How the values are laid out; one of the HEAP_ constants above. */
+    int layout;
+
+    /* The number of children of each node in the d-ary layouts. */
+    int arity;
+
+    /* The number of values in each page of the B-heap layout, which is a
+     * power of 2, and its log.
+     */
+    uint32_t page_values;
+    uint32_t page_bits;
+
+    /* The depth of the root within the first page of the B-heap layout. */
+    uint32_t root_depth;
+
+    /* The values in the heap, or NULL if the heap is stored in the native
+     * values array instead.
+     */
     membase_t *memory;
+    float *values;
 } float_heap;
 
 
-/* Initialize a heap data structure. */
+/* Initialize a binary heap data structure. */
 void init_heap(float_heap *p_heap, membase_t *memory, int max_values);
 
+/* Initialize a heap data structure with the specified layout.  page_size is
+ * the size of a B-heap page in bytes, which must be a power of 2 holding at
+ * least 4 values; the other layouts ignore it.  If memory is NULL, the
+ * values are stored in a native array instead, which free_heap() releases.
+ */
+void init_heap_layout(float_heap *p_heap, membase_t *memory, int max_values,
+                      int layout, uint32_t page_size);
+
+/* Releases the native array of a heap, if it has one. */
+void free_heap(float_heap *p_heap);
+
+/* Returns the number of bytes of memory a heap with the specified layout
+ * and maximum number of values uses, counting the slots that the layout
+ * leaves empty.
+ */
+uint32_t heap_memory_size(int layout, int max_values, uint32_t page_size);
+
 /* Returns the first (i.e. smallest) value in the heap. */
 float get_first_value(float_heap *p_heap);
 
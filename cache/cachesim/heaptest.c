@@ -1,11 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "cmdline.h"
 #include "heap.h"
 #include "memory.h"
 #include "cache.h"
+#include "timing.h"
 
 
 #define NUM_ELEMS 1000000
@@ -17,6 +19,14 @@
 #define SEED 54321098
 
 
+/* Local functions used by the heap test. */
+
+void generate_inputs(float *inputs, int num_elems);
+int check_heap(float_heap *p_heap, const float *sorted, int num_elems);
+void time_native_runs(int num_elems, uint32_t page_size);
+void heaptest_usage(const char *progname);
+
+
 /* This function is used by the C standard-library function qsort(), so that
  * we can check the output of our heap-sort algorithm.
  */
@@ -33,52 +43,202 @@ int compare_float_ptrs(const void *v1, const void *v2) {
 }
 
 
+/* Generates the same random floats every time for the same SEED. */
+void generate_inputs(float *inputs, int num_elems) {
+    int i;
+
+    srand48(SEED);
+    for (i = 0; i < num_elems; i++)
+        inputs[i] = (float) drand48();
+}
+
+
+/* Empties the heap, checking that its values come out in the same order as
+ * the sorted inputs.  Returns nonzero if any didn't.
+ */
+int check_heap(float_heap *p_heap, const float *sorted, int num_elems) {
+    int i, error = 0;
+
+    for (i = 0; i < num_elems; i++) {
+        float val = get_first_value(p_heap);
+        if (val != sorted[i]) {
+            printf("ERROR:  heap and sorted array don't match at "
+                   "index %d!  heap = %f, val = %f\n", i, val, sorted[i]);
+            error = 1;
+        }
+    }
+
+    return error;
+}
+
+
+/* Sorts the inputs with a heap of each layout in a native array, without
+ * simulating any caches, and reports the best of NATIVE_TRIALS rates for
+ * each, in heap operations (adds and removes) per second, and its speedup
+ * over the binary layout.
+ */
+void time_native_runs(int num_elems, uint32_t page_size) {
+    float *inputs, *sorted;
+    double rates[NUM_HEAP_LAYOUTS];
+    float_heap heap;
+    int layout, trial, i;
+
+    inputs = malloc(num_elems * sizeof(float));
+    sorted = malloc(num_elems * sizeof(float));
+    if (inputs == NULL || sorted == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    generate_inputs(inputs, num_elems);
+    memcpy(sorted, inputs, num_elems * sizeof(float));
+    qsort(sorted, num_elems, sizeof(float), compare_float_ptrs);
+
+    printf("Timing each layout natively on %d random floats, best of %d "
+           "trials.\n", num_elems, NATIVE_TRIALS);
+    printf("B-heap pages are %u bytes.\n\n", page_size);
+
+    for (layout = 0; layout < NUM_HEAP_LAYOUTS; layout++) {
+        rates[layout] = 0;
+
+        for (trial = 0; trial < NATIVE_TRIALS; trial++) {
+            double start, elapsed;
+            int error;
+
+            init_heap_layout(&heap, NULL, num_elems, layout, page_size);
+
+            start = now_seconds();
+            for (i = 0; i < num_elems; i++)
+                add_value(&heap, inputs[i]);
+            error = check_heap(&heap, sorted, num_elems);
+            elapsed = now_seconds() - start;
+
+            free_heap(&heap);
+
+            if (error) {
+                printf("The %s layout's results are wrong, aborting.\n",
+                       heap_layout_names[layout]);
+                abort();
+            }
+
+            if (2.0 * num_elems / elapsed > rates[layout])
+                rates[layout] = 2.0 * num_elems / elapsed;
+        }
+
+        printf("    %-8s  %8.2f M ops/s  %6.2fx\n", heap_layout_names[layout],
+               rates[layout] / 1e6, rates[layout] / rates[HEAP_BINARY]);
+    }
+
+    free(inputs);
+    free(sorted);
+}
+
+
+/* Prints the program usage. */
+void heaptest_usage(const char *progname) {
+    printf("usage: %s [-l binary|4-ary|8-ary|b-heap] [-p page-size] "
+           "[-n count] [-native]\n\t\t[cache-spec ...]\n\n", progname);
+    printf("\tSorts random floats (default %d) with a heap through the\n",
+           NUM_ELEMS);
+    printf("\tspecified caches.  -l selects how the heap is laid out:  a\n");
+    printf("\tbinary heap (the default), a 4-ary or 8-ary heap, or a B-heap\n");
+    printf("\twith pages of page-size bytes (default %d).  -native times\n",
+           DEFAULT_HEAP_PAGE_SIZE);
+    printf("\tevery layout on native arrays instead, without simulating any\n");
+    printf("\tcaches.\n\n");
+    usage(progname);
+}
+
+
 int main(int argc, const char **argv) {
+    const char *progname = argv[0];
     float *inputs;
-    int i, error;
+    int num_elems = NUM_ELEMS, layout = HEAP_BINARY, native = 0;
+    uint32_t page_size = DEFAULT_HEAP_PAGE_SIZE, mem_size;
+    int i;
 
     membase_t *p_mem;
 
     float_heap heap;
 
-    /* Set up the simulated memory. */
-    p_mem = make_cached_memory(argc, argv, NUM_ELEMS * sizeof(int));
-    
-    /* Generate random floats to sort. */
+    i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-native") == 0) {
+            native = 1;
+            i++;
+            continue;
+        }
 
-    printf("Generating %d random floats to sort.\n", NUM_ELEMS);
+        if (i + 1 >= argc) {
+            heaptest_usage(progname);
+            exit(1);
+        }
 
-    inputs = malloc(NUM_ELEMS * sizeof(float));
+        if (strcmp(argv[i], "-l") == 0) {
+            for (layout = 0; layout < NUM_HEAP_LAYOUTS; layout++) {
+                if (strcmp(argv[i + 1], heap_layout_names[layout]) == 0)
+                    break;
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0) {
+            page_size = strtoul(argv[i + 1], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-n") == 0) {
+            num_elems = atoi(argv[i + 1]);
+        }
+        else {
+            layout = NUM_HEAP_LAYOUTS;
+        }
 
-    srand48(SEED);
-    for (i = 0; i < NUM_ELEMS; i++)
-        inputs[i] = (float) drand48();
+        if (layout == NUM_HEAP_LAYOUTS || num_elems <= 0 ||
+            page_size < 4 * sizeof(float) ||
+            (page_size & (page_size - 1)) != 0) {
+            heaptest_usage(progname);
+            exit(1);
+        }
+        i += 2;
+    }
+
+    if (native) {
+        time_native_runs(num_elems, page_size);
+        return 0;
+    }
+
+    /* Set up the simulated memory.  make_cached_memory() expects the
+     * program name followed by the cache specifications.
+     */
+    mem_size = heap_memory_size(layout, num_elems, page_size);
+    mem_size = (mem_size + MEM_SIZE_ALIGN - 1) & ~(MEM_SIZE_ALIGN - 1);
+    argv[i - 1] = progname;
+    p_mem = make_cached_memory(argc - i + 1, argv + i - 1, mem_size);
+
+    /* Generate random floats to sort. */
+
+    printf("Generating %d random floats to sort.\n", num_elems);
+
+    inputs = malloc(num_elems * sizeof(float));
+    if (inputs == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    generate_inputs(inputs, num_elems);
 
     /* Use the heap to sort the sequence of floats. */
 
-    printf("Sorting numbers using the heap.\n");
+    printf("Sorting numbers using the heap (%s layout).\n",
+           heap_layout_names[layout]);
 
-    init_heap(&heap, p_mem, NUM_ELEMS);
-    for (i = 0; i < NUM_ELEMS; i++)
+    init_heap_layout(&heap, p_mem, num_elems, layout, page_size);
+    for (i = 0; i < num_elems; i++)
         add_value(&heap, inputs[i]);
 
     /* Sort the inputs so that we can check the heap's results. */
 
     printf("Checking the results against the sorted inputs.\n");
 
-    qsort(inputs, NUM_ELEMS, sizeof(float), compare_float_ptrs);
-
-    error = 0;
-    for (i = 0; i < NUM_ELEMS; i++) {
-        float val = get_first_value(&heap);
-        if (val != inputs[i]) {
-            printf("ERROR:  heap and sorted array don't match at "
-                   "index %d!  heap = %f, val = %f\n", i, val, inputs[i]);
-            error = 1;
-        }
-    }
+    qsort(inputs, num_elems, sizeof(float), compare_float_ptrs);
 
-    if (error) {
+    if (check_heap(&heap, inputs, num_elems)) {
         printf("Some values didn't match, aborting.\n");
         abort();
     }
@@ -91,4 +251,3 @@ int main(int argc, const char **argv) {
 
     return 0;
 }
-
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+
+/* This program converts the memory trace printed by Valgrind's lackey tool,
+ * e.g.
+ *
+ *     valgrind --tool=lackey --trace-mem=yes --log-file=prog.lackey prog
+ *     ./lackey2trace prog.lackey prog.trace
+ *     ./cachesim prog.trace 32:256:1
+ *
+ * into a trace for cachesim.  Lackey reports 64-bit virtual addresses spread
+ * all over the address space, but the simulated memory is a small array, so
+ * addresses are remapped the way an operating system would:  each virtual
+ * page is assigned the next free "physical" page the first time it is
+ * touched.  Offsets within a page are kept, so the cache sets that accesses
+ * map to are unchanged for caches of up to one page per way.
+ */
+
+
+/* The size of the pages that addresses are remapped in. */
+#ifndef LACKEY_PAGE_SIZE
+#define LACKEY_PAGE_SIZE 4096
+#endif
+
+/* The initial number of slots in the page table; it doubles as it fills. */
+#define INITIAL_PAGE_SLOTS 1024
+
+
+/* One slot of the page table, which maps virtual page numbers to physical
+ * page numbers.  Slots are stored with vpage + 1, so that 0 means empty.
+ */
+typedef struct page_slot {
+    uint64_t vpage_plus_1;
+    uint32_t ppage;
+} page_slot;
+
+
+page_slot *page_table;
+uint32_t page_slots;
+uint32_t num_pages;
+
+
+/* Prints the program usage. */
+void usage(const char *progname) {
+    printf("usage: %s [-i] lackey-output trace-file\n\n", progname);
+    printf("\tConverts the output of valgrind --tool=lackey --trace-mem=yes\n");
+    printf("\tinto a trace for cachesim.  Either file may be \"-\" for\n");
+    printf("\tstandard input or output.  With -i, instruction fetches are\n");
+    printf("\tincluded as reads; otherwise only data accesses are kept.\n");
+}
+
+
+/* Returns the slot for the specified virtual page; if the page isn't mapped
+ * yet, the slot returned is empty.
+ */
+page_slot * find_page_slot(uint64_t vpage) {
+    uint32_t i = (uint32_t) ((vpage * 0x9E3779B97F4A7C15ULL) >> 32);
+
+    while (1) {
+        page_slot *slot = page_table + (i & (page_slots - 1));
+        if (slot->vpage_plus_1 == 0 || slot->vpage_plus_1 == vpage + 1)
+            return slot;
+        i++;
+    }
+}
+
+
+/* Maps a virtual page to a physical page, assigning a new physical page the
+ * first time the virtual page is seen.
+ */
+uint32_t map_page(uint64_t vpage) {
+    page_slot *slot;
+
+    /* Keep the table at most half full, so probe sequences stay short. */
+    if (2 * (num_pages + 1) > page_slots) {
+        page_slot *old_table = page_table;
+        uint32_t old_slots = page_slots, i;
+
+        page_slots = page_slots ? 2 * page_slots : INITIAL_PAGE_SLOTS;
+        page_table = calloc(page_slots, sizeof(page_slot));
+        if (page_table == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        for (i = 0; i < old_slots; i++) {
+            if (old_table[i].vpage_plus_1 != 0)
+                *find_page_slot(old_table[i].vpage_plus_1 - 1) = old_table[i];
+        }
+        free(old_table);
+    }
+
+    slot = find_page_slot(vpage);
+    if (slot->vpage_plus_1 == 0) {
+        if ((uint64_t) (num_pages + 1) * LACKEY_PAGE_SIZE > INT32_MAX) {
+            fprintf(stderr, "The traced program touches too much memory "
+                    "to simulate.\n");
+            exit(1);
+        }
+
+        slot->vpage_plus_1 = vpage + 1;
+        slot->ppage = num_pages++;
+    }
+
+    return slot->ppage;
+}
+
+
+/* Writes an access to the trace, remapping its address and splitting it
+ * where it crosses a page boundary.
+ */
+void convert_access(trace_file *tf, uint64_t address, uint32_t size,
+                    int is_write) {
+    trace_access access;
+
+    while (size > 0) {
+        uint32_t offset = address % LACKEY_PAGE_SIZE;
+        uint32_t piece = LACKEY_PAGE_SIZE - offset;
+        if (piece > size)
+            piece = size;
+
+        access.address =
+            map_page(address / LACKEY_PAGE_SIZE) * LACKEY_PAGE_SIZE + offset;
+        access.size = piece;
+        access.is_write = is_write;
+
+        if (trace_write(tf, &access) != 0) {
+            perror("trace_write");
+            exit(1);
+        }
+
+        address += piece;
+        size -= piece;
+    }
+}
+
+
+int main(int argc, const char **argv) {
+    const char *progname = argv[0];
+    int instructions = 0;
+    char line[256];
+    trace_file tf;
+    FILE *in;
+
+    if (argc > 1 && strcmp(argv[1], "-i") == 0) {
+        instructions = 1;
+        argc--;
+        argv++;
+    }
+
+    if (argc != 3) {
+        usage(progname);
+        exit(1);
+    }
+
+    if (strcmp(argv[1], "-") == 0) {
+        in = stdin;
+    }
+    else {
+        in = fopen(argv[1], "r");
+        if (in == NULL) {
+            perror(argv[1]);
+            exit(1);
+        }
+    }
+
+    if (trace_create(&tf, argv[2]) != 0)
+        exit(1);
+
+    /* Lackey prints lines like "I  0401c4d6,3", " L 1ffefffd40,8",
+     * " S 1ffefffd38,8" and " M 0421d4a0,4", mixed in with Valgrind's own
+     * "==pid==" messages, which are skipped along with anything else that
+     * doesn't parse.
+     */
+    while (fgets(line, sizeof(line), in) != NULL) {
+        unsigned long long address;
+        unsigned int size;
+        char kind;
+
+        if (sscanf(line, " %c %llx,%u", &kind, &address, &size) != 3 ||
+            size == 0)
+            continue;
+
+        switch (kind) {
+        case 'I':
+            if (instructions)
+                convert_access(&tf, address, size, 0);
+            break;
+
+        case 'L':
+            convert_access(&tf, address, size, 0);
+            break;
+
+        case 'S':
+            convert_access(&tf, address, size, 1);
+            break;
+
+        case 'M':
+            /* A modify is a load followed by a store to the same data. */
+            convert_access(&tf, address, size, 0);
+            convert_access(&tf, address, size, 1);
+            break;
+        }
+    }
+
+    if (in != stdin)
+        fclose(in);
+
+    tf.header.mem_size = num_pages * LACKEY_PAGE_SIZE;
+    if (trace_close(&tf) != 0) {
+        perror(argv[2]);
+        exit(1);
+    }
+
+    fprintf(stderr, "Wrote %lu accesses touching %u pages (%u bytes).\n",
+            tf.num_records, num_pages, num_pages * LACKEY_PAGE_SIZE);
+    free(page_table);
+
+    return 0;
+}
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmdline.h"
+#include "membase.h"
+#include "cache.h"
+#include "coherence.h"
+#include "trace.h"
+
+
+/* Accesses are replayed through this buffer; larger accesses are split into
+ * pieces of this size.
+ */
+#define REPLAY_BUFFER_SIZE 4096
+
+/* This program simulates several cores, each with its own private caches,
+ * sharing the caches below them and the memory.  The private caches are
+ * kept coherent by a snooping bus (see coherence.h).  Each core replays its
+ * own trace (see trace.h); the cores take turns, each replaying a quantum of
+ * accesses from its trace before the next core goes, until every trace is
+ * done.
+ *
+ * For each core it reports the statistics of its private caches, including
+ * the invalidations they received and the coherence misses those caused,
+ * and the bus transactions the core made.
+ */
+
+
+/* A simulated core, and the trace it replays. */
+typedef struct mc_core {
+    const char *trace_path;
+    trace_file tf;
+    int done;
+
+    /* The core's private caches, nearest the core first, followed by the
+     * nearest shared level.
+     */
+    membase_t **levels;
+
+    uint64_t num_reads;
+    uint64_t num_writes;
+} mc_core;
+
+
+/* Local functions used by the multi-core simulator. */
+
+const char ** split_specs(const char *list, int *num_specs);
+int replay_quantum(mc_core *p_core, int quantum, uint32_t mem_size,
+                   unsigned char *buffer);
+
+
+/* Prints the program usage. */
+void mcsim_usage(const char *progname) {
+    printf("usage: %s [-m mem-size] [-q quantum] [-p mesi|moesi] "
+           "private-caches\n\t\tshared-caches trace-file ...\n\n", progname);
+    printf("\tSimulates one core per trace-file, each replaying its trace\n");
+    printf("\tthrough its own private caches.  private-caches is a list of\n");
+    printf("\tcache specifications separated by commas, nearest the core\n");
+    printf("\tfirst, such as 32:64:4,64:512:8; every core gets caches\n");
+    printf("\tbuilt from it, kept coherent with the MESI protocol (or\n");
+    printf("\tMOESI, with -p moesi).  shared-caches is a list of the same\n");
+    printf("\tkind, for the caches all of the cores share, or \"none\".\n");
+    printf("\tIn either list, \"host\" stands for all of the host's data\n");
+    printf("\tand unified caches, so \"host none\" gives every core its\n");
+    printf("\town copy of each of them.\n");
+    printf("\tThe cores take turns, replaying quantum accesses each\n");
+    printf("\t(default 1).  The memory size is the largest of the traces'\n");
+    printf("\tsizes, unless -m is given.\n\n");
+    usage(progname);
+}
+
+
+/* Splits a comma-separated list of cache specifications. */
+const char ** split_specs(const char *list, int *num_specs) {
+    const char **specs;
+    char *copy, *spec;
+    int i;
+
+    *num_specs = 1;
+    for (i = 0; list[i] != '\0'; i++) {
+        if (list[i] == ',')
+            (*num_specs)++;
+    }
+
+    copy = strdup(list);
+    specs = malloc(*num_specs * sizeof(const char *));
+    if (copy == NULL || specs == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    spec = copy;
+    for (i = 0; i < *num_specs; i++) {
+        char *comma = strchr(spec, ',');
+        specs[i] = spec;
+        if (comma != NULL) {
+            *comma = '\0';
+            spec = comma + 1;
+        }
+    }
+
+    return specs;
+}
+
+
+/* Replays up to quantum accesses from a core's trace through its caches.
+ * Returns 0 once the trace is done, and 1 otherwise.
+ */
+int replay_quantum(mc_core *p_core, int quantum, uint32_t mem_size,
+                   unsigned char *buffer) {
+    membase_t *p_mem = p_core->levels[0];
+    trace_access access;
+    int n, result = 1;
+
+    for (n = 0; n < quantum; n++) {
+        addr_t address;
+        uint32_t size;
+
+        result = trace_read(&p_core->tf, &access);
+        if (result != 1)
+            break;
+
+        address = access.address;
+        size = access.size;
+        if (size > mem_size || address > mem_size - size) {
+            printf("ERROR:  access of %u bytes at address %u in trace %s is "
+                   "outside the %u-byte memory.\n", size, address,
+                   p_core->trace_path, mem_size);
+            exit(1);
+        }
+
+        while (size > 0) {
+            uint32_t piece = size;
+            if (piece > REPLAY_BUFFER_SIZE)
+                piece = REPLAY_BUFFER_SIZE;
+
+            if (access.is_write)
+                write_block(p_mem, address, buffer, piece);
+            else
+                read_block(p_mem, address, buffer, piece);
+
+            address += piece;
+            size -= piece;
+        }
+
+        if (access.is_write)
+            p_core->num_writes++;
+        else
+            p_core->num_reads++;
+    }
+
+    if (result < 0) {
+        printf("ERROR:  trace %s is truncated or corrupt.\n",
+               p_core->trace_path);
+        exit(1);
+    }
+
+    return result == 1;
+}
+
+
+int main(int argc, const char **argv) {
+    static unsigned char buffer[REPLAY_BUFFER_SIZE];
+
+    const char *progname = argv[0];
+    const char **specs, **private_specs, **shared_specs = NULL;
+    int num_private, num_shared = 0, num_cores, num_active;
+    int protocol = PROTOCOL_MESI, quantum = 1;
+    uint32_t mem_size = 0;
+    membase_t **shared;
+    coherence_bus_t bus;
+    mc_core *cores;
+    int i, c;
+
+    i = 1;
+    while (i + 1 < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-m") == 0) {
+            mem_size = strtoul(argv[i + 1], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            quantum = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-p") == 0) {
+            if (strcmp(argv[i + 1], "mesi") == 0) {
+                protocol = PROTOCOL_MESI;
+            }
+            else if (strcmp(argv[i + 1], "moesi") == 0) {
+                protocol = PROTOCOL_MOESI;
+            }
+            else {
+                mcsim_usage(progname);
+                exit(1);
+            }
+        }
+        else {
+            break;
+        }
+        i += 2;
+    }
+
+    if (argc - i < 3 || quantum <= 0) {
+        mcsim_usage(progname);
+        exit(1);
+    }
+
+    /* The expanded lists point into the split ones' strings, which are
+     * kept for as long as the program runs.
+     */
+    specs = split_specs(argv[i], &num_private);
+    private_specs = expand_host_specs(&num_private, specs, 1);
+    free(specs);
+    if (strcmp(argv[i + 1], "none") != 0) {
+        specs = split_specs(argv[i + 1], &num_shared);
+        shared_specs = expand_host_specs(&num_shared, specs, 1);
+        free(specs);
+    }
+    i += 2;
+
+    num_cores = argc - i;
+    cores = calloc(num_cores, sizeof(mc_core));
+    if (cores == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    for (c = 0; c < num_cores; c++) {
+        cores[c].trace_path = argv[i + c];
+        if (trace_open(&cores[c].tf, cores[c].trace_path) != 0)
+            exit(1);
+    }
+
+    if (mem_size == 0) {
+        for (c = 0; c < num_cores; c++) {
+            if (cores[c].tf.header.mem_size > mem_size)
+                mem_size = cores[c].tf.header.mem_size;
+        }
+    }
+
+    mem_size = (mem_size + MEM_SIZE_ALIGN - 1) & ~(MEM_SIZE_ALIGN - 1);
+    if (mem_size == 0 || mem_size > INT32_MAX) {
+        printf("ERROR:  the traces don't specify a usable memory size; "
+               "use -m.\n");
+        exit(1);
+    }
+
+    shared = build_memory_levels(num_shared, shared_specs, progname,
+                                 mem_size, 1);
+
+    printf("Constructing private caches for each of %d cores, kept coherent "
+           "with %s\n(in reverse order):\n", num_cores,
+           protocol_name(protocol));
+    init_coherence_bus(&bus, protocol, num_cores, shared[0]);
+
+    for (c = 0; c < num_cores; c++) {
+        cache_t **caches;
+        int j;
+
+        cores[c].levels = malloc((num_private + 1) * sizeof(membase_t *));
+        caches = malloc(num_private * sizeof(cache_t *));
+        if (cores[c].levels == NULL || caches == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        cores[c].levels[num_private] = shared[0];
+        build_cache_levels(num_private, private_specs, progname,
+                           cores[c].levels, mem_size, c == 0);
+
+        /* Only caches can be kept coherent, so the private levels can't be
+         * TLBs or stack-distance analyses.
+         */
+        for (j = 0; j < num_private; j++) {
+            caches[j] = as_cache(cores[c].levels[j]);
+            if (caches[j] == NULL) {
+                printf("ERROR:  private level %d (%s) isn't a cache.\n",
+                       j + 1, private_specs[j]);
+                exit(1);
+            }
+        }
+        if (attach_core(&bus, c, caches, num_private) != 0)
+            exit(1);
+        free(caches);
+    }
+    printf("\n");
+
+    num_active = num_cores;
+    while (num_active > 0) {
+        for (c = 0; c < num_cores; c++) {
+            if (cores[c].done)
+                continue;
+
+            if (!replay_quantum(cores + c, quantum, mem_size, buffer)) {
+                cores[c].done = 1;
+                num_active--;
+            }
+        }
+    }
+
+    for (c = 0; c < num_cores; c++) {
+        int j;
+
+        printf("Core %d replayed %s:  %lu accesses, %lu reads, %lu writes.\n",
+               c, cores[c].trace_path,
+               cores[c].num_reads + cores[c].num_writes, cores[c].num_reads,
+               cores[c].num_writes);
+        for (j = 0; j < num_private; j++)
+            cache_print_level_stats(as_cache(cores[c].levels[j]));
+        print_core_stats(&bus, c);
+        printf("\n");
+
+        trace_close(&cores[c].tf);
+    }
+
+    printf("Shared Memory-Access Statistics:\n\n");
+    shared[0]->print_stats(shared[0]);
+    printf("\n");
+
+    for (c = 0; c < num_cores; c++) {
+        int j;
+
+        for (j = 0; j < num_private; j++) {
+            cores[c].levels[j]->free(cores[c].levels[j]);
+            free(cores[c].levels[j]);
+        }
+        free(cores[c].levels);
+    }
+    free(cores);
+    free_coherence_bus(&bus);
+    free_memory_levels(shared, num_shared);
+    free(private_specs);
+    free(shared_specs);
+
+    return 0;
+}
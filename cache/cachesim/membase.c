@@ -37,6 +37,40 @@ void write_byte(membase_t *mb, addr_t address, unsigned char value) {
 }
 
 
+/* Returns the level behind a level of the memory, or NULL for the memory at
+ * the bottom of the hierarchy.
+ */
+membase_t * next_level(membase_t *mb) {
+    return mb->next_level(mb);
+}
+
+
+/* Returns the cycles taken so far by the accesses to a level of the
+ * memory.
+ */
+uint64_t level_cycles(membase_t *mb) {
+    return mb->cycles(mb);
+}
+
+
+/* Reads size bytes starting at a specific memory address in the simulated
+ * memory into buf.
+ */
+void read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                uint32_t size) {
+    mb->read_block(mb, address, buf, size);
+}
+
+
+/* Writes size bytes from buf to the simulated memory, starting at a specific
+ * memory address.
+ */
+void write_block(membase_t *mb, addr_t address, const unsigned char *buf,
+                 uint32_t size) {
+    mb->write_block(mb, address, buf, size);
+}
+
+
 /* This struct is used by read_float and write_float so that it can use the
  * read_int and write_int implementations.
  */
@@ -51,11 +85,9 @@ typedef union {
  * is stored in little-endian format, as IA32 normally does.
  */
 int32_t read_int(membase_t *mb, uint32_t index) {
-    addr_t addr = index * 4;
-    return read_byte(mb, addr) |
-           read_byte(mb, addr + 1) <<  8 |
-           read_byte(mb, addr + 2) << 16 |
-           read_byte(mb, addr + 3) << 24;
+    unsigned char bytes[4];
+    read_block(mb, index * 4, bytes, 4);
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | bytes[3] << 24;
 }
 
 
@@ -64,11 +96,12 @@ int32_t read_int(membase_t *mb, uint32_t index) {
  * is stored in little-endian format, as IA32 normally does.
  */
 void write_int(membase_t *mb, uint32_t index, int32_t value) {
-    addr_t addr = index * 4;
-    write_byte(mb, addr, value & 0xFF);
-    write_byte(mb, addr + 1, (value >>  8) & 0xFF);
-    write_byte(mb, addr + 2, (value >> 16) & 0xFF);
-    write_byte(mb, addr + 3, (value >> 24) & 0xFF);
+    unsigned char bytes[4];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >>  8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+    write_block(mb, index * 4, bytes, 4);
 }
 
 
@@ -92,16 +125,3 @@ void write_float(membase_t *mb, uint32_t index, float value) {
     v.fval = value;
     write_int(mb, index, v.ival);
 }
-
-
-/* This function can be used to emulate a hardware clock e.g. for tagging cache
- * lines in order to implement an LRU replacement policy when evicting cache
- * lines.  Every call to the function advances the clock by one tick, and then
- * returns the new value of the clock.
- */
-uint64_t clock_tick() {
-    static uint64_t clock = 0;
-
-    return ++clock;
-}
-
@@ -3,6 +3,7 @@
 
 
 #include <stdint.h>
+#include <string.h>
 
 
 /* This typedef specifies the type we use for "addresses" in the memory
@@ -11,6 +12,12 @@
 typedef uint32_t addr_t;
 
 
+/* Simulated memories are rounded up to a multiple of this size, so that cache
+ * lines filled near the end of the data don't run off the end of the memory.
+ */
+#define MEM_SIZE_ALIGN 4096
+
+
 /* This struct defines the basic operations that must be present in all of our
  * "memory" types.  The memory_t and cache_t types both have *exactly* the
  * same initial set of members, so that a pointer to a cache_t or memory_t
@@ -30,6 +37,14 @@ typedef struct membase_t {
     /* The function to write a byte to the memory. */
     void (*write_byte)(struct membase_t *mb, addr_t address, unsigned char value);
 
+    /* The function to read size bytes starting at address into buf. */
+    void (*read_block)(struct membase_t *mb, addr_t address,
+                       unsigned char *buf, uint32_t size);
+
+    /* The function to write size bytes from buf starting at address. */
+    void (*write_block)(struct membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size);
+
     /* The function to print the memory's access statistics. */
     void (*print_stats)(struct membase_t *mb);
 
@@ -41,9 +56,34 @@ typedef struct membase_t {
      */
     void (*free)(struct membase_t *mb);
 
+    /* The function to return the level behind this one, or NULL for the
+     * memory at the bottom of the hierarchy.
+     */
+    struct membase_t * (*next_level)(struct membase_t *mb);
+
+    /* The function to return the cycles that the accesses to this level
+     * have taken so far, counting the levels behind it.
+     */
+    uint64_t (*cycles)(struct membase_t *mb);
+
 } membase_t;
 
 
+/* Copies n bytes of simulated data, for the block operations.  Nearly every
+ * access is a single byte or a single int, and those sizes are copied inline,
+ * since a call to memcpy() would cost more than the rest of a cache hit.
+ */
+static inline void copy_bytes(unsigned char *dst, const unsigned char *src,
+                              uint32_t n) {
+    if (n == 1)
+        *dst = *src;
+    else if (n == 4)
+        memcpy(dst, src, 4);
+    else
+        memcpy(dst, src, n);
+}
+
+
 /* Returns nonzero if the input is a power of 2, or zero otherwise. */
 uint32_t is_power_of_2(uint32_t n);
 
@@ -56,6 +96,29 @@ uint32_t log_2(uint32_t n);
 unsigned char read_byte(membase_t *mb, addr_t address);
 void write_byte(membase_t *mb, addr_t address, unsigned char value);
 
+/* Returns the level behind mb, or NULL if mb is the memory at the bottom of
+ * the hierarchy.  Walking down with this passes through every kind of level,
+ * so code that looks for the caches behind a level doesn't need to know
+ * about the others.
+ */
+membase_t * next_level(membase_t *mb);
+
+/* Returns the cycles that the accesses to a level of the memory have taken
+ * so far, counting the levels below it.  A level without a timing model
+ * passes the question on to the level below.
+ */
+uint64_t level_cycles(membase_t *mb);
+
+
+/* These functions access a run of bytes with a single operation on the
+ * memory.  The access statistics are counted per byte, exactly as if each
+ * byte had been accessed with read_byte() or write_byte().
+ */
+void read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                uint32_t size);
+void write_block(membase_t *mb, addr_t address, const unsigned char *buf,
+                 uint32_t size);
+
 
 /*
  * These functions expose the memory as an array of signed integers or floats,
@@ -71,11 +134,4 @@ float read_float(membase_t *mb, uint32_t index);
 void write_float(membase_t *mb, uint32_t index, float value);
 
 
-/* This function can be used to emulate a hardware clock e.g. for tagging cache
- * lines in order to implement an LRU replacement policy when evicting cache
- * lines.
- */
-uint64_t clock_tick();
-
-
 #endif /* MEMBASE_H */
@@ -14,9 +14,15 @@
 
 unsigned char memory_read_byte(membase_t *mb, addr_t address);
 void memory_write_byte(membase_t *mb, addr_t address, unsigned char value);
+void memory_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                       uint32_t size);
+void memory_write_block(membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size);
 void memory_print_stats(membase_t *mb);
 void memory_reset_stats(membase_t *mb);
 void memory_free(membase_t *mb);
+membase_t * memory_next_level(membase_t *mb);
+uint64_t memory_cycles(membase_t *mb);
 
 
 /* Initializes the members of the memory_t struct to be a memory of the
@@ -34,9 +40,13 @@ void init_memory(memory_t *p_memory, int32_t mem_size) {
     /* Set up the pointers for interacting with the memory. */
     p_memory->read_byte = memory_read_byte;
     p_memory->write_byte = memory_write_byte;
+    p_memory->read_block = memory_read_block;
+    p_memory->write_block = memory_write_block;
     p_memory->print_stats = memory_print_stats;
     p_memory->reset_stats = memory_reset_stats;
     p_memory->free = memory_free;
+    p_memory->next_level = memory_next_level;
+    p_memory->cycles = memory_cycles;
 }
 
 
@@ -54,6 +64,7 @@ unsigned char memory_read_byte(membase_t *mb, addr_t address) {
 #endif
 
     p_memory->num_reads++;
+    p_memory->num_accesses++;
     return p_memory->mem[address];
 }
 
@@ -72,16 +83,64 @@ void memory_write_byte(membase_t *mb, addr_t address, unsigned char value) {
 #endif
 
     p_memory->num_writes++;
+    p_memory->num_accesses++;
     p_memory->mem[address] = value;
 }
 
 
+/* This function implements block reads against the memory.  Each byte counts
+ * as one read, so the statistics are the same as for reading the bytes one
+ * at a time.
+ */
+void memory_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                       uint32_t size) {
+    memory_t *p_memory = (memory_t *) mb;
+
+    assert(address < p_memory->mem_size &&
+           size <= p_memory->mem_size - address);
+
+#if DEBUG_MEMORY
+    printf("Reading memory[%u..%u]\n", address, address + size - 1);
+#endif
+
+    p_memory->num_reads += size;
+    p_memory->num_accesses++;
+    copy_bytes(buf, p_memory->mem + address, size);
+}
+
+
+/* This function implements block writes against the memory.  Each byte
+ * counts as one write, so the statistics are the same as for writing the
+ * bytes one at a time.
+ */
+void memory_write_block(membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size) {
+    memory_t *p_memory = (memory_t *) mb;
+
+    assert(address < p_memory->mem_size &&
+           size <= p_memory->mem_size - address);
+
+#if DEBUG_MEMORY
+    printf("Writing memory[%u..%u]\n", address, address + size - 1);
+#endif
+
+    p_memory->num_writes += size;
+    p_memory->num_accesses++;
+    copy_bytes(p_memory->mem + address, buf, size);
+}
+
+
 /* This function prints out the statistics for accesses against the memory. */
 void memory_print_stats(membase_t *mb) {
     memory_t *p_memory = (memory_t *) mb;
 
     printf(" * Memory reads=%ld writes=%ld\n",
         p_memory->num_reads, p_memory->num_writes);
+    if (p_memory->latency > 0) {
+        printf("   latency=%u cycles:  accesses=%lu cycles=%lu\n",
+               p_memory->latency, p_memory->num_accesses,
+               p_memory->num_accesses * p_memory->latency);
+    }
 }
 
 
@@ -91,6 +150,7 @@ void memory_reset_stats(membase_t *mb) {
 
     p_memory->num_reads = 0;
     p_memory->num_writes = 0;
+    p_memory->num_accesses = 0;
 }
 
 
@@ -100,3 +160,20 @@ void memory_free(membase_t *mb) {
     free(p_memory->mem);
 }
 
+
+/* The memory is the bottom of the hierarchy, so there is no level behind
+ * it.
+ */
+membase_t * memory_next_level(membase_t *mb) {
+    return NULL;
+}
+
+
+/* Returns the cycles taken by the memory's accesses so far, which is the
+ * number of accesses times the latency.
+ */
+uint64_t memory_cycles(membase_t *mb) {
+    memory_t *p_memory = (memory_t *) mb;
+
+    return p_memory->num_accesses * p_memory->latency;
+}
@@ -25,6 +25,14 @@ typedef struct memory_t {
     /* The function to write a byte to the memory. */
     void (*write_byte)(membase_t *mb, addr_t address, unsigned char value);
 
+    /* The function to read size bytes starting at address into buf. */
+    void (*read_block)(membase_t *mb, addr_t address,
+                       unsigned char *buf, uint32_t size);
+
+    /* The function to write size bytes from buf starting at address. */
+    void (*write_block)(membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size);
+
     /* The function to print the memory's access statistics. */
     void (*print_stats)(struct membase_t *mb);
 
@@ -36,12 +44,28 @@ typedef struct memory_t {
      */
     void (*free)(membase_t *mb);
 
+    /* The function to return the level behind this one, or NULL for the
+     * memory at the bottom of the hierarchy.
+     */
+    membase_t * (*next_level)(membase_t *mb);
+
+    /* The function to return the cycles that the accesses to this level
+     * have taken so far, counting the levels behind it.
+     */
+    uint64_t (*cycles)(membase_t *mb);
+
     /* The size of the memory. */
     int32_t mem_size;
 
     /* The malloc'd region of memory. */
     unsigned char *mem;
 
+    /* The cycles each access to the memory takes, or 0 for no timing, and
+     * the number of accesses, each a byte or a block.
+     */
+    uint32_t latency;
+    uint64_t num_accesses;
+
 } memory_t;
 
 
@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "policy.h"
+
+
+/* The largest re-reference prediction value of the RRIP policies, which use
+ * 2 bits per line.  Lines are filled with RRIP_LONG (SRRIP) or RRIP_DISTANT
+ * (most BRRIP fills), and hits set the value to 0.
+ */
+#define RRIP_DISTANT 3
+#define RRIP_LONG 2
+
+/* BRRIP fills one in this many lines with RRIP_LONG instead of
+ * RRIP_DISTANT.  A counter is used instead of random numbers, so that the
+ * policy's behavior is easy to follow.
+ */
+#define BRRIP_LONG_INTERVAL 32
+
+/* The values of policy_bits that mark which of ARC's lists a line is in. */
+#define ARC_T1 1
+#define ARC_T2 2
+
+
+/* Local functions used by the policy implementations. */
+
+cacheline_t * find_invalid_line(cacheset_t *p_set);
+cacheline_t * find_oldest_line(cacheset_t *p_set, uint32_t policy_bits);
+
+
+/*---------------------------------------------------------------------------
+ * HELPER FUNCTIONS
+ */
+
+
+/* Returns the first invalid line in the set, or NULL if every line is valid.
+ * Most policies fill invalid lines before evicting anything.
+ */
+cacheline_t * find_invalid_line(cacheset_t *p_set) {
+    int i = find_tag_in_set(p_set, INVALID_TAG);
+
+    return i < 0 ? NULL : p_set->cache_lines + i;
+}
+
+
+/* Returns the valid line with the smallest recent value among the lines
+ * whose policy_bits are the specified value, or NULL if there is none.
+ */
+cacheline_t * find_oldest_line(cacheset_t *p_set, uint32_t policy_bits) {
+    cacheline_t *oldest = NULL;
+    int i;
+
+    for (i = 0; i < p_set->num_lines; i++) {
+        cacheline_t *p_line = p_set->cache_lines + i;
+        if (line_is_valid(p_set, p_line) &&
+            p_line->policy_bits == policy_bits &&
+            (oldest == NULL || p_line->recent < oldest->recent))
+            oldest = p_line;
+    }
+    return oldest;
+}
+
+
+/*---------------------------------------------------------------------------
+ * LRU:  evicts the line that was accessed least recently, using the time of
+ * each line's last access.
+ */
+
+
+cacheline_t * lru_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                addr_t tag) {
+    int i = find_tag_in_set(p_set, INVALID_TAG);
+    int victim = 0;
+    uint64_t oldest;
+
+    if (i >= 0)
+        return p_set->cache_lines + i;
+
+    /* This is on every miss's path.  Which line is oldest is unpredictable,
+     * so the loop is written for the compiler to use conditional moves
+     * rather than branches.
+     */
+    oldest = p_set->cache_lines[0].recent;
+    for (i = 1; i < p_set->num_lines; i++) {
+        uint64_t recent = p_set->cache_lines[i].recent;
+        int older = recent < oldest;
+
+        oldest = older ? recent : oldest;
+        victim = older ? i : victim;
+    }
+    return p_set->cache_lines + victim;
+}
+
+
+void lru_touch(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    p_line->recent = cache_clock_tick(p_cache);
+}
+
+
+const replacement_policy_t lru_policy = {
+    "lru", "LRU", 0, NULL, NULL,
+    lru_choose_victim, lru_touch, lru_touch
+};
+
+
+/*---------------------------------------------------------------------------
+ * Random:  evicts a randomly chosen line.  Like the original simulator, it
+ * doesn't look for invalid lines first.  The numbers come from the cache's
+ * own generator rather than rand(), so they don't depend on what else the
+ * program (or another thread) is doing.
+ */
+
+
+cacheline_t * random_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                   addr_t tag) {
+    return p_set->cache_lines + cache_random(p_cache) % p_set->num_lines;
+}
+
+
+void no_touch(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    /* The policy doesn't track accesses. */
+}
+
+
+const replacement_policy_t random_policy = {
+    "random", "random", 0, NULL, NULL,
+    random_choose_victim, no_touch, no_touch
+};
+
+
+/*---------------------------------------------------------------------------
+ * FIFO:  evicts the line that was filled longest ago, no matter how
+ * recently it was accessed.
+ */
+
+
+void fifo_line_filled(cache_t *p_cache, cacheset_t *p_set,
+                      cacheline_t *p_line) {
+    p_line->recent = cache_clock_tick(p_cache);
+}
+
+
+const replacement_policy_t fifo_policy = {
+    "fifo", "FIFO", 0, NULL, NULL,
+    lru_choose_victim, fifo_line_filled, no_touch
+};
+
+
+/*---------------------------------------------------------------------------
+ * LFU:  evicts the line with the fewest accesses since it was filled,
+ * breaking ties by evicting the least recently used line.
+ */
+
+
+cacheline_t * lfu_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                addr_t tag) {
+    cacheline_t *victim = find_invalid_line(p_set);
+    int i;
+
+    if (victim != NULL)
+        return victim;
+
+    victim = p_set->cache_lines;
+    for (i = 1; i < p_set->num_lines; i++) {
+        cacheline_t *p_line = p_set->cache_lines + i;
+        if (p_line->policy_bits < victim->policy_bits ||
+            (p_line->policy_bits == victim->policy_bits &&
+             p_line->recent < victim->recent))
+            victim = p_line;
+    }
+    return victim;
+}
+
+
+void lfu_line_filled(cache_t *p_cache, cacheset_t *p_set,
+                     cacheline_t *p_line) {
+    p_line->policy_bits = 1;
+    p_line->recent = cache_clock_tick(p_cache);
+}
+
+
+void lfu_line_hit(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    if (p_line->policy_bits != UINT32_MAX)
+        p_line->policy_bits++;
+    p_line->recent = cache_clock_tick(p_cache);
+}
+
+
+const replacement_policy_t lfu_policy = {
+    "lfu", "LFU", 0, NULL, NULL,
+    lfu_choose_victim, lfu_line_filled, lfu_line_hit
+};
+
+
+/*---------------------------------------------------------------------------
+ * Tree-PLRU:  approximates LRU with a binary tree of bits over the lines of
+ * each set.  Each bit points toward the half of its subtree that was used
+ * less recently; the victim is found by following the bits from the root,
+ * and an access flips the bits on its path to point away from it.  The tree
+ * is stored heap-style, with the children of node i at 2i + 1 and 2i + 2.
+ */
+
+
+void plru_init_set(cache_t *p_cache, cacheset_t *p_set) {
+    if (p_set->num_lines > 1) {
+        p_set->policy_state = calloc(p_set->num_lines - 1, 1);
+        if (p_set->policy_state == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+}
+
+
+void free_policy_state(cache_t *p_cache, cacheset_t *p_set) {
+    free(p_set->policy_state);
+    p_set->policy_state = NULL;
+}
+
+
+cacheline_t * plru_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                 addr_t tag) {
+    cacheline_t *victim = find_invalid_line(p_set);
+    unsigned char *bits = p_set->policy_state;
+    int node = 0, first = 0, n = p_set->num_lines;
+
+    if (victim != NULL)
+        return victim;
+
+    while (n > 1) {
+        n /= 2;
+        if (bits[node]) {
+            first += n;
+            node = 2 * node + 2;
+        }
+        else {
+            node = 2 * node + 1;
+        }
+    }
+    return p_set->cache_lines + first;
+}
+
+
+void plru_touch(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    unsigned char *bits = p_set->policy_state;
+    int line = p_line - p_set->cache_lines;
+    int node = 0, first = 0, n = p_set->num_lines;
+
+    while (n > 1) {
+        n /= 2;
+        if (line < first + n) {
+            bits[node] = 1;
+            node = 2 * node + 1;
+        }
+        else {
+            bits[node] = 0;
+            first += n;
+            node = 2 * node + 2;
+        }
+    }
+}
+
+
+const replacement_policy_t plru_policy = {
+    "plru", "tree-PLRU", 1, plru_init_set, free_policy_state,
+    plru_choose_victim, plru_touch, plru_touch
+};
+
+
+/*---------------------------------------------------------------------------
+ * Bit-PLRU:  approximates LRU with one "recently used" bit per line.  An
+ * access sets the line's bit, clearing all of the others if every bit would
+ * be set; the victim is the first line whose bit is clear.
+ */
+
+
+cacheline_t * bitplru_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                    addr_t tag) {
+    cacheline_t *victim = find_invalid_line(p_set);
+    int i;
+
+    if (victim != NULL)
+        return victim;
+
+    for (i = 0; i < p_set->num_lines; i++) {
+        if (!p_set->cache_lines[i].policy_bits)
+            return p_set->cache_lines + i;
+    }
+
+    /* Only possible with one line per set. */
+    return p_set->cache_lines;
+}
+
+
+void bitplru_touch(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    int i;
+
+    p_line->policy_bits = 1;
+
+    for (i = 0; i < p_set->num_lines; i++) {
+        if (!p_set->cache_lines[i].policy_bits)
+            return;
+    }
+
+    for (i = 0; i < p_set->num_lines; i++)
+        p_set->cache_lines[i].policy_bits = 0;
+    p_line->policy_bits = 1;
+}
+
+
+const replacement_policy_t bitplru_policy = {
+    "bitplru", "bit-PLRU", 0, NULL, NULL,
+    bitplru_choose_victim, bitplru_touch, bitplru_touch
+};
+
+
+/*---------------------------------------------------------------------------
+ * SRRIP and BRRIP (Jaleel et al., 2010):  each line has a re-reference
+ * prediction value in policy_bits.  The victim is a line predicted to be
+ * re-referenced in the distant future; if there isn't one, every line's
+ * prediction is aged until there is.  SRRIP fills lines with a "long"
+ * prediction, so that lines that are never reused leave before lines that
+ * are; BRRIP fills most lines with a "distant" prediction, which resists
+ * thrashing when the working set is larger than the cache.
+ */
+
+
+cacheline_t * rrip_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                 addr_t tag) {
+    cacheline_t *victim = find_invalid_line(p_set);
+    int i;
+
+    if (victim != NULL)
+        return victim;
+
+    while (1) {
+        for (i = 0; i < p_set->num_lines; i++) {
+            if (p_set->cache_lines[i].policy_bits >= RRIP_DISTANT)
+                return p_set->cache_lines + i;
+        }
+
+        for (i = 0; i < p_set->num_lines; i++)
+            p_set->cache_lines[i].policy_bits++;
+    }
+}
+
+
+void srrip_line_filled(cache_t *p_cache, cacheset_t *p_set,
+                       cacheline_t *p_line) {
+    p_line->policy_bits = RRIP_LONG;
+}
+
+
+void brrip_line_filled(cache_t *p_cache, cacheset_t *p_set,
+                       cacheline_t *p_line) {
+    p_cache->policy_counter = (p_cache->policy_counter + 1) %
+                              BRRIP_LONG_INTERVAL;
+    if (p_cache->policy_counter == 0)
+        p_line->policy_bits = RRIP_LONG;
+    else
+        p_line->policy_bits = RRIP_DISTANT;
+}
+
+
+void rrip_line_hit(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    p_line->policy_bits = 0;
+}
+
+
+const replacement_policy_t srrip_policy = {
+    "srrip", "SRRIP", 0, NULL, NULL,
+    rrip_choose_victim, srrip_line_filled, rrip_line_hit
+};
+
+
+const replacement_policy_t brrip_policy = {
+    "brrip", "BRRIP", 0, NULL, NULL,
+    rrip_choose_victim, brrip_line_filled, rrip_line_hit
+};
+
+
+/*---------------------------------------------------------------------------
+ * ARC (Megiddo and Modha, 2003), applied to each set separately:  the
+ * resident lines are split between T1, which holds blocks seen once
+ * recently, and T2, which holds blocks seen at least twice.  The tags of
+ * blocks recently evicted from each are remembered in the "ghost" lists B1
+ * and B2.  A miss that hits in a ghost list shows that the corresponding
+ * list is too short, and moves the target size of T1 toward it; evictions
+ * then come from whichever of T1 and T2 is over its share.  Within T1 and
+ * T2, lines are ordered by their recent times.
+ */
+
+
+/* The per-set state of the ARC policy. */
+typedef struct arc_state {
+    /* The target number of lines in T1. */
+    int target;
+
+    /* The ghost lists, holding tags from least to most recently evicted. */
+    addr_t *b1;
+    addr_t *b2;
+    int b1_length;
+    int b2_length;
+
+    /* Nonzero if the line being filled belongs in T2, because its block
+     * was found in a ghost list.
+     */
+    int fill_into_t2;
+} arc_state;
+
+
+void arc_init_set(cache_t *p_cache, cacheset_t *p_set) {
+    arc_state *state = calloc(1, sizeof(arc_state));
+    if (state != NULL) {
+        state->b1 = malloc(p_set->num_lines * sizeof(addr_t));
+        state->b2 = malloc(p_set->num_lines * sizeof(addr_t));
+    }
+    if (state == NULL || state->b1 == NULL || state->b2 == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    p_set->policy_state = state;
+}
+
+
+void arc_free_set(cache_t *p_cache, cacheset_t *p_set) {
+    arc_state *state = p_set->policy_state;
+    if (state != NULL) {
+        free(state->b1);
+        free(state->b2);
+        free(state);
+    }
+    p_set->policy_state = NULL;
+}
+
+
+/* Returns the index of a tag in a ghost list, or -1 if it isn't there. */
+int arc_find_ghost(const addr_t *list, int length, addr_t tag) {
+    int i;
+    for (i = 0; i < length; i++) {
+        if (list[i] == tag)
+            return i;
+    }
+    return -1;
+}
+
+
+/* Removes the entry at the specified index from a ghost list. */
+void arc_remove_ghost(addr_t *list, int *length, int index) {
+    memmove(list + index, list + index + 1,
+            (*length - index - 1) * sizeof(addr_t));
+    (*length)--;
+}
+
+
+/* Adds a tag to the most recent end of a ghost list of at most max_length
+ * entries, dropping the least recent entry if the list is full.
+ */
+void arc_add_ghost(addr_t *list, int *length, int max_length, addr_t tag) {
+    if (*length == max_length)
+        arc_remove_ghost(list, length, 0);
+    list[(*length)++] = tag;
+}
+
+
+/* Counts the resident lines in T1 or T2. */
+int arc_list_size(cacheset_t *p_set, uint32_t list) {
+    int i, size = 0;
+    for (i = 0; i < p_set->num_lines; i++) {
+        if (p_set->tags[i] != INVALID_TAG &&
+            p_set->cache_lines[i].policy_bits == list)
+            size++;
+    }
+    return size;
+}
+
+
+/* ARC's REPLACE operation:  evicts the least recent line of T1 if T1 is over
+ * its target size, or else the least recent line of T2, and remembers the
+ * evicted tag in the matching ghost list.
+ */
+cacheline_t * arc_replace(cacheset_t *p_set, arc_state *state,
+                          int in_b2) {
+    int t1_size = arc_list_size(p_set, ARC_T1);
+    cacheline_t *victim;
+
+    if (t1_size >= 1 &&
+        ((in_b2 && t1_size == state->target) || t1_size > state->target)) {
+        victim = find_oldest_line(p_set, ARC_T1);
+        arc_add_ghost(state->b1, &state->b1_length, p_set->num_lines,
+                      line_tag(p_set, victim));
+    }
+    else {
+        victim = find_oldest_line(p_set, ARC_T2);
+        if (victim == NULL)
+            victim = find_oldest_line(p_set, ARC_T1);
+        arc_add_ghost(state->b2, &state->b2_length, p_set->num_lines,
+                      line_tag(p_set, victim));
+    }
+    return victim;
+}
+
+
+cacheline_t * arc_choose_victim(cache_t *p_cache, cacheset_t *p_set,
+                                addr_t tag) {
+    arc_state *state = p_set->policy_state;
+    int c = p_set->num_lines;
+    int i_b1 = arc_find_ghost(state->b1, state->b1_length, tag);
+    int i_b2 = arc_find_ghost(state->b2, state->b2_length, tag);
+    cacheline_t *invalid = find_invalid_line(p_set);
+    int t1_size, total;
+
+    if (i_b1 >= 0) {
+        /* B1 is a ghost hit:  T1 should have been larger. */
+        int delta = state->b1_length >= state->b2_length ?
+                    1 : state->b2_length / state->b1_length;
+        state->target = state->target + delta < c ? state->target + delta : c;
+        arc_remove_ghost(state->b1, &state->b1_length, i_b1);
+        state->fill_into_t2 = 1;
+        return invalid != NULL ? invalid : arc_replace(p_set, state, 0);
+    }
+
+    if (i_b2 >= 0) {
+        /* B2 is a ghost hit:  T2 should have been larger. */
+        int delta = state->b2_length >= state->b1_length ?
+                    1 : state->b1_length / state->b2_length;
+        state->target = state->target > delta ? state->target - delta : 0;
+        arc_remove_ghost(state->b2, &state->b2_length, i_b2);
+        state->fill_into_t2 = 1;
+        return invalid != NULL ? invalid : arc_replace(p_set, state, 1);
+    }
+
+    /* A block that isn't remembered at all goes into T1. */
+    state->fill_into_t2 = 0;
+    t1_size = arc_list_size(p_set, ARC_T1);
+    total = t1_size + arc_list_size(p_set, ARC_T2) +
+            state->b1_length + state->b2_length;
+
+    if (t1_size + state->b1_length >= c) {
+        if (t1_size < c) {
+            arc_remove_ghost(state->b1, &state->b1_length, 0);
+            return invalid != NULL ? invalid : arc_replace(p_set, state, 0);
+        }
+
+        /* T1 fills the whole set; its oldest line is dropped outright. */
+        return find_oldest_line(p_set, ARC_T1);
+    }
+
+    if (total >= c) {
+        if (total >= 2 * c)
+            arc_remove_ghost(state->b2, &state->b2_length, 0);
+        if (invalid == NULL)
+            return arc_replace(p_set, state, 0);
+    }
+
+    return invalid;
+}
+
+
+void arc_line_filled(cache_t *p_cache, cacheset_t *p_set,
+                     cacheline_t *p_line) {
+    arc_state *state = p_set->policy_state;
+
+    p_line->policy_bits = state->fill_into_t2 ? ARC_T2 : ARC_T1;
+    p_line->recent = cache_clock_tick(p_cache);
+}
+
+
+void arc_line_hit(cache_t *p_cache, cacheset_t *p_set, cacheline_t *p_line) {
+    p_line->policy_bits = ARC_T2;
+    p_line->recent = cache_clock_tick(p_cache);
+}
+
+
+const replacement_policy_t arc_policy = {
+    "arc", "ARC", 0, arc_init_set, arc_free_set,
+    arc_choose_victim, arc_line_filled, arc_line_hit
+};
+
+
+/*---------------------------------------------------------------------------
+ * POLICY LOOKUP
+ */
+
+
+const replacement_policy_t *replacement_policies[] = {
+    &lru_policy, &random_policy, &fifo_policy, &lfu_policy, &plru_policy,
+    &bitplru_policy, &srrip_policy, &brrip_policy, &arc_policy, NULL
+};
+
+
+/* Returns the policy with the specified spec_name, or NULL if there isn't
+ * one.
+ */
+const replacement_policy_t * find_replacement_policy(const char *spec_name) {
+    int i;
+
+    for (i = 0; replacement_policies[i] != NULL; i++) {
+        if (strcmp(replacement_policies[i]->spec_name, spec_name) == 0)
+            return replacement_policies[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+
+#include "cache.h"
+
+
+/* This struct defines a cache replacement policy.  Like membase_t, it is a
+ * set of function pointers; each cache points to the policy it uses, and
+ * calls through it whenever a line is hit, filled or must be replaced.
+ * Policies keep their state in the recent and policy_bits members of each
+ * cache line, and in the policy_state member of each cache set.
+ */
+typedef struct replacement_policy_t {
+    /* The name used to select the policy in a cache specification. */
+    const char *spec_name;
+
+    /* The name printed in the cache statistics. */
+    const char *name;
+
+    /* Nonzero if the policy only works with a power-of-2 number of lines
+     * per set.
+     */
+    int needs_power_of_2_lines;
+
+    /* Sets up and releases any per-set state.  Either may be NULL. */
+    void (*init_set)(cache_t *p_cache, cacheset_t *p_set);
+    void (*free_set)(cache_t *p_cache, cacheset_t *p_set);
+
+    /* Chooses the line to evict from a set, to make room for the block
+     * with the specified tag.  Policies should choose an invalid line if
+     * there is one, although the random policy doesn't.
+     */
+    cacheline_t * (*choose_victim)(cache_t *p_cache, cacheset_t *p_set,
+                                   addr_t tag);
+
+    /* Called after a line has been loaded with a new block, and after each
+     * hit on a line, respectively.
+     */
+    void (*line_filled)(cache_t *p_cache, cacheset_t *p_set,
+                        cacheline_t *p_line);
+    void (*line_hit)(cache_t *p_cache, cacheset_t *p_set,
+                     cacheline_t *p_line);
+} replacement_policy_t;
+
+
+/* The policy caches use unless another one is chosen. */
+extern const replacement_policy_t lru_policy;
+
+/* All of the available policies, ending with NULL. */
+extern const replacement_policy_t *replacement_policies[];
+
+
+/* Returns the policy with the specified spec_name, or NULL if there isn't
+ * one.
+ */
+const replacement_policy_t * find_replacement_policy(const char *spec_name);
+
+
+#endif /* POLICY_H */
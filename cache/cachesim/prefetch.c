@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+
+/* The stride prefetcher tracks this many streams of accesses at once. */
+#define STRIDE_STREAMS 16
+
+/* An access to a new block joins the stream whose last block is nearest,
+ * if it is within this many blocks; otherwise it starts a new stream.
+ */
+#define STRIDE_WINDOW 128
+
+/* A stride must be seen this many times in a row before the stride
+ * prefetcher issues prefetches along it.
+ */
+#define STRIDE_CONFIDENCE 2
+
+/* The number of stream buffers; their depth is the prefetch degree. */
+#define STREAM_BUFFERS 4
+
+
+/*---------------------------------------------------------------------------
+ * Next-line:  tagged next-line prefetching.  A miss, or the first access to
+ * a prefetched line, fetches the next degree blocks, so a sequential scan
+ * stays ahead of itself after its first miss.
+ */
+
+
+void nextline_access(cache_t *p_cache, addr_t address, int trigger) {
+    addr_t block_start = address & ~(p_cache->block_size - 1);
+    uint32_t i;
+
+    if (!trigger)
+        return;
+
+    for (i = 1; i <= p_cache->prefetch_degree; i++)
+        prefetch_block(p_cache, block_start + i * p_cache->block_size);
+}
+
+
+const prefetcher_t nextline_prefetcher = {
+    "next", "next-line", 1, NULL, NULL,
+    nextline_access, NULL, NULL
+};
+
+
+/*---------------------------------------------------------------------------
+ * Stride:  finds constant strides in the block addresses accessed, without
+ * knowing which instructions made the accesses.  Each access to a new block
+ * is assigned to the stream that it continues, or else (unless it repeats a
+ * stream's last block) to the nearest stream that is still being trained;
+ * once a stream has repeated the same stride STRIDE_CONFIDENCE times, its
+ * next degree blocks are prefetched.  Keeping several streams lets
+ * interleaved walks, such as a row and a column of a matrix, each be
+ * recognized.
+ */
+
+
+typedef struct stride_stream {
+    /* The last block number accessed by the stream, plus 1, or 0 if the
+     * stream is unused.
+     */
+    uint32_t last_block;
+
+    /* The current stride in blocks, and the number of times in a row it
+     * has been seen.
+     */
+    int32_t stride;
+    uint32_t confidence;
+
+    /* When the stream was last accessed, for choosing one to replace. */
+    uint64_t last_used;
+} stride_stream;
+
+
+typedef struct stride_state {
+    stride_stream streams[STRIDE_STREAMS];
+
+    /* The block number of the previous access, plus 1. */
+    uint32_t last_block;
+
+    uint64_t clock;
+} stride_state;
+
+
+void stride_init(cache_t *p_cache) {
+    p_cache->prefetch_state = calloc(1, sizeof(stride_state));
+    if (p_cache->prefetch_state == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+}
+
+
+void free_prefetch_state(cache_t *p_cache) {
+    free(p_cache->prefetch_state);
+    p_cache->prefetch_state = NULL;
+}
+
+
+void stride_access(cache_t *p_cache, addr_t address, int trigger) {
+    stride_state *state = p_cache->prefetch_state;
+    uint32_t block = (address >> p_cache->block_offset_bits) + 1;
+    stride_stream *stream = NULL, *nearest = NULL, *oldest = NULL;
+    stride_stream *repeated = NULL;
+    int32_t nearest_distance = STRIDE_WINDOW + 1;
+    uint32_t i;
+
+    /* Most accesses are to the same block as the one before. */
+    if (block == state->last_block)
+        return;
+    state->last_block = block;
+    state->clock++;
+
+    for (i = 0; i < STRIDE_STREAMS; i++) {
+        stride_stream *s = state->streams + i;
+        int32_t distance;
+
+        /* Unused streams have a last_used of 0, so they go first. */
+        if (oldest == NULL || s->last_used < oldest->last_used)
+            oldest = s;
+
+        if (s->last_block == 0)
+            continue;
+
+        if (s->last_block == block) {
+            repeated = s;
+            continue;
+        }
+
+        distance = (int32_t) (block - s->last_block);
+        if (s->stride != 0 && distance == s->stride) {
+            stream = s;
+            break;
+        }
+
+        /* Streams that have found their stride aren't retrained, so that an
+         * unrelated access near one can't break it.
+         */
+        if (distance < 0)
+            distance = -distance;
+        if (s->confidence < STRIDE_CONFIDENCE && distance < nearest_distance) {
+            nearest = s;
+            nearest_distance = distance;
+        }
+    }
+
+    if (stream != NULL) {
+        if (stream->confidence < STRIDE_CONFIDENCE)
+            stream->confidence++;
+    }
+    else if (repeated != NULL) {
+        /* A repeated access to the stream's last block, which doesn't
+         * continue any other stream.
+         */
+        repeated->last_used = state->clock;
+        return;
+    }
+    else if (nearest != NULL) {
+        stream = nearest;
+        stream->stride = (int32_t) (block - stream->last_block);
+        stream->confidence = 0;
+    }
+    else {
+        stream = oldest;
+        stream->stride = 0;
+        stream->confidence = 0;
+    }
+
+    stream->last_block = block;
+    stream->last_used = state->clock;
+
+    if (stream->confidence >= STRIDE_CONFIDENCE) {
+        for (i = 1; i <= p_cache->prefetch_degree; i++) {
+            int64_t next = (int64_t) block - 1 + (int64_t) i * stream->stride;
+            if (next < 0)
+                break;
+            prefetch_block(p_cache,
+                           (addr_t) next << p_cache->block_offset_bits);
+        }
+    }
+}
+
+
+const prefetcher_t stride_prefetcher = {
+    "stride", "stride", 2, stride_init, free_prefetch_state,
+    stride_access, NULL, NULL
+};
+
+
+/*---------------------------------------------------------------------------
+ * Stream buffers (Jouppi, 1990):  a miss that no buffer can supply starts a
+ * new stream in the least recently used buffer, which fetches the next
+ * degree blocks after the missing one.  Later misses are looked up in every
+ * buffer entry; a block found there moves into the cache, the entries ahead
+ * of it are dropped, and the buffer fetches more blocks to stay full.  Since
+ * the buffers sit beside the cache, they never evict anything from it.
+ */
+
+
+typedef struct stream_buffer {
+    /* The start address of each buffered block, and the block data. */
+    addr_t *block_starts;
+    unsigned char *data;
+
+    /* The buffer is a circular queue of prefetch_degree entries. */
+    uint32_t head;
+    uint32_t count;
+
+    /* The start address of the next block to fetch. */
+    addr_t next_start;
+
+    /* When the buffer was last allocated or hit; 0 if never used. */
+    uint64_t last_used;
+} stream_buffer;
+
+
+typedef struct stream_state {
+    stream_buffer buffers[STREAM_BUFFERS];
+    uint64_t clock;
+} stream_state;
+
+
+void stream_init(cache_t *p_cache) {
+    stream_state *state = calloc(1, sizeof(stream_state));
+    uint32_t depth = p_cache->prefetch_degree;
+    int i;
+
+    if (state == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    for (i = 0; i < STREAM_BUFFERS; i++) {
+        stream_buffer *buf = state->buffers + i;
+        buf->block_starts = malloc(depth * sizeof(addr_t));
+        buf->data = malloc(depth * p_cache->block_size);
+        if (buf->block_starts == NULL || buf->data == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+
+    p_cache->prefetch_state = state;
+}
+
+
+void stream_free(cache_t *p_cache) {
+    stream_state *state = p_cache->prefetch_state;
+    int i;
+
+    if (state != NULL) {
+        for (i = 0; i < STREAM_BUFFERS; i++) {
+            free(state->buffers[i].block_starts);
+            free(state->buffers[i].data);
+        }
+        free(state);
+    }
+    p_cache->prefetch_state = NULL;
+}
+
+
+/* Fetches blocks into a stream buffer until it is full, or the stream
+ * reaches the end of the memory.
+ */
+void stream_fill(cache_t *p_cache, stream_buffer *buf) {
+    uint32_t depth = p_cache->prefetch_degree;
+
+    while (buf->count < depth && buf->next_start < p_cache->prefetch_limit &&
+           p_cache->prefetch_limit - buf->next_start >= p_cache->block_size) {
+        uint32_t i = (buf->head + buf->count) % depth;
+
+        buf->block_starts[i] = buf->next_start;
+        read_block(p_cache->next_memory, buf->next_start,
+                   buf->data + i * p_cache->block_size, p_cache->block_size);
+
+        buf->next_start += p_cache->block_size;
+        buf->count++;
+        p_cache->num_prefetches++;
+    }
+}
+
+
+int stream_take_block(cache_t *p_cache, addr_t block_start,
+                      unsigned char *dest) {
+    stream_state *state = p_cache->prefetch_state;
+    uint32_t depth = p_cache->prefetch_degree;
+    int i;
+    uint32_t j;
+
+    for (i = 0; i < STREAM_BUFFERS; i++) {
+        stream_buffer *buf = state->buffers + i;
+
+        for (j = 0; j < buf->count; j++) {
+            uint32_t k = (buf->head + j) % depth;
+            if (buf->block_starts[k] != block_start)
+                continue;
+
+            memcpy(dest, buf->data + k * p_cache->block_size,
+                   p_cache->block_size);
+
+            /* Drop the entries skipped over, along with this one. */
+            p_cache->num_unused_prefetches += j;
+            buf->head = (k + 1) % depth;
+            buf->count -= j + 1;
+            buf->last_used = ++state->clock;
+
+            stream_fill(p_cache, buf);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+void stream_access(cache_t *p_cache, addr_t address, int trigger) {
+    stream_state *state = p_cache->prefetch_state;
+    stream_buffer *buf = state->buffers;
+    int i;
+
+    /* Only misses that no buffer could supply start a new stream. */
+    if (!trigger)
+        return;
+
+    for (i = 1; i < STREAM_BUFFERS; i++) {
+        if (state->buffers[i].last_used < buf->last_used)
+            buf = state->buffers + i;
+    }
+
+    p_cache->num_unused_prefetches += buf->count;
+    buf->head = 0;
+    buf->count = 0;
+    buf->next_start = (address & ~(p_cache->block_size - 1)) +
+                      p_cache->block_size;
+    buf->last_used = ++state->clock;
+
+    stream_fill(p_cache, buf);
+}
+
+
+void stream_block_written(cache_t *p_cache, addr_t block_start) {
+    stream_state *state = p_cache->prefetch_state;
+    uint32_t depth = p_cache->prefetch_degree;
+    int i;
+    uint32_t j;
+
+    /* A buffered copy of the block is now stale; drop it and the entries
+     * after it, and fetch them again when the buffer is next refilled.
+     */
+    for (i = 0; i < STREAM_BUFFERS; i++) {
+        stream_buffer *buf = state->buffers + i;
+
+        for (j = 0; j < buf->count; j++) {
+            if (buf->block_starts[(buf->head + j) % depth] == block_start) {
+                p_cache->num_unused_prefetches += buf->count - j;
+                buf->count = j;
+                buf->next_start = block_start;
+                break;
+            }
+        }
+    }
+}
+
+
+const prefetcher_t stream_prefetcher = {
+    "stream", "stream-buffer", 4, stream_init, stream_free,
+    stream_access, stream_take_block, stream_block_written
+};
+
+
+/*---------------------------------------------------------------------------
+ * PREFETCHER LOOKUP
+ */
+
+
+const prefetcher_t *prefetchers[] = {
+    &nextline_prefetcher, &stride_prefetcher, &stream_prefetcher, NULL
+};
+
+
+/* Returns the prefetcher with the specified spec_name, or NULL if there
+ * isn't one.
+ */
+const prefetcher_t * find_prefetcher(const char *spec_name) {
+    int i;
+
+    for (i = 0; prefetchers[i] != NULL; i++) {
+        if (strcmp(prefetchers[i]->spec_name, spec_name) == 0)
+            return prefetchers[i];
+    }
+    return NULL;
+}
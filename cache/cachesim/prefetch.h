@@ -0,0 +1,60 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+
+#include "cache.h"
+
+
+/* This struct defines a hardware prefetcher.  Like replacement_policy_t, it
+ * is a set of function pointers that a cache calls through; the prefetcher
+ * keeps its state in the cache's prefetch_state member.  Prefetchers that
+ * fetch into the cache itself use prefetch_block(), and are charged for the
+ * lines their prefetches evict; prefetchers with their own buffers, such as
+ * stream buffers, supply blocks to the cache through take_block() instead.
+ */
+typedef struct prefetcher_t {
+    /* The name used to select the prefetcher in a cache specification. */
+    const char *spec_name;
+
+    /* The name printed in the cache statistics. */
+    const char *name;
+
+    /* The degree used if the cache specification doesn't give one. */
+    uint32_t default_degree;
+
+    /* Sets up and releases the prefetcher's state.  Either may be NULL. */
+    void (*init)(cache_t *p_cache);
+    void (*free)(cache_t *p_cache);
+
+    /* Called after each access to the cache, once the accessed line has
+     * been used.  trigger is nonzero if the access missed, or was the first
+     * access to a prefetched line.
+     */
+    void (*access)(cache_t *p_cache, addr_t address, int trigger);
+
+    /* Called on a miss.  If the prefetcher holds the block starting at
+     * block_start, it copies the block into dest and returns nonzero, and
+     * the access counts as a hit.  May be NULL.
+     */
+    int (*take_block)(cache_t *p_cache, addr_t block_start,
+                      unsigned char *dest);
+
+    /* Called after the cache writes back the block starting at
+     * block_start, so that the prefetcher can drop any stale copy of it.
+     * May be NULL.
+     */
+    void (*block_written)(cache_t *p_cache, addr_t block_start);
+} prefetcher_t;
+
+
+/* All of the available prefetchers, ending with NULL. */
+extern const prefetcher_t *prefetchers[];
+
+
+/* Returns the prefetcher with the specified spec_name, or NULL if there
+ * isn't one.
+ */
+const prefetcher_t * find_prefetcher(const char *spec_name);
+
+
+#endif /* PREFETCH_H */
@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "memory.h"
 #include "cache.h"
 #include "cmdline.h"
+#include "timing.h"
 
 
 #define NUM_ELEMS 1000000
@@ -17,39 +21,178 @@
 #define SEED 54321098
 
 
-/* This helper handles the task of swapping two integers in the simulated
- * memory.
+/* Ranges of at most this many values are finished with an insertion sort
+ * by the introsort kernels.
  */
-void swap_values(membase_t *p_mem, int i, int j) {
-    int i_val = read_int(p_mem, i);
-    int j_val = read_int(p_mem, j);
+#define INSERTION_CUTOFF 16
 
-    write_int(p_mem, i, j_val);
-    write_int(p_mem, j, i_val);
+/* The block partition scans this many values from each end at a time,
+ * recording the offsets of the values that belong on the other side.
+ */
+#define PARTITION_BLOCK 64
+
+/* The default number of bits in each digit of the radix sort.  The digit
+ * counts of one pass take 4 << bits bytes, so they fit in a small cache.
+ */
+#define DEFAULT_RADIX_BITS 8
+#define MAX_RADIX_BITS 16
+
+/* The sample sort picks its splitters from a sample of this many values
+ * per thread.
+ */
+#define SAMPLE_OVERSAMPLING 32
+
+/* The values to sort, either in the simulated memory or in a native array.
+ * The radix sort also uses a scratch buffer of num_values values after the
+ * values, and then the digit counts.
+ */
+typedef struct {
+    int num_values;
+
+    /* The simulated memory, or NULL if native is used instead. */
+    membase_t *p_mem;
+    int *native;
+
+    /* The number of bits in each digit of the radix sort. */
+    int radix_bits;
+
+    /* The number of threads the sample sort uses. */
+    int num_threads;
+} sort_data;
+
+
+/* A sorting kernel.  Kernels that are native_only can't run in the
+ * simulated memory.
+ */
+typedef struct {
+    const char *name;
+    void (*sort)(sort_data *d);
+    int native_only;
+} sort_kernel;
+
+
+/* One thread's share of the sample sort. */
+typedef struct {
+    sort_data *d;
+    int thread;
+
+    /* The num_threads - 1 values that divide the buckets. */
+    const int *splitters;
+
+    /* For each thread t and bucket b, at [t * num_threads + b], the number
+     * of the thread's values that fall in the bucket, and then where in the
+     * scratch buffer the thread puts them.
+     */
+    int *counts;
+
+    /* Where each bucket starts in the scratch buffer, and then the number
+     * of values, which ends the last bucket.
+     */
+    const int *bucket_starts;
+} sample_sort_task;
+
+
+/* Local functions used by the sorting test. */
+
+void swap_values(sort_data *d, int i, int j);
+int partition(sort_data *d, int start, int end);
+void quicksort(sort_data *d, int start, int end);
+void sort_quicksort(sort_data *d);
+
+void median_of_three(sort_data *d, int start, int end);
+int lomuto_partition(sort_data *d, int start, int end);
+int block_partition(sort_data *d, int start, int end);
+void insertion_sort(sort_data *d, int start, int end);
+void sift_down_max(sort_data *d, int start, int root, int last);
+void heapsort(sort_data *d, int start, int end);
+void introsort(sort_data *d, int start, int end, int depth_limit,
+               int (*partition_range)(sort_data *, int, int));
+int introsort_depth_limit(int num_values);
+void sort_introsort(sort_data *d);
+void sort_block_quicksort(sort_data *d);
+
+void sort_radix(sort_data *d);
+
+int find_bucket(const int *splitters, int num_splitters, int value);
+void run_sample_sort_phase(sample_sort_task *tasks, int num_threads,
+                           void * (*phase)(void *));
+void * sample_sort_count(void *arg);
+void * sample_sort_scatter(void *arg);
+void * sample_sort_bucket(void *arg);
+void sort_sample(sort_data *d);
+
+int compare_int_ptrs(const void *v1, const void *v2);
+uint32_t sort_memory_size(const sort_kernel *kernel, int num_values,
+                          int radix_bits);
+void generate_inputs(int *inputs, int num_values);
+int check_results(sort_data *d, const int *sorted);
+void time_native_runs(int num_values, int radix_bits, int num_threads);
+void qsorttest_usage(const char *progname);
+
+
+/* The kernels, in the order the native runs time them. */
+const sort_kernel kernels[] = {
+    { "quicksort", sort_quicksort, 0 },
+    { "introsort", sort_introsort, 0 },
+    { "blockqs", sort_block_quicksort, 0 },
+    { "radix", sort_radix, 0 },
+    { "samplesort", sort_sample, 1 },
+};
+
+#define NUM_KERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+
+static inline int get_int(sort_data *d, int index) {
+    if (d->p_mem == NULL)
+        return d->native[index];
+    return read_int(d->p_mem, index);
+}
+
+
+static inline void set_int(sort_data *d, int index, int value) {
+    if (d->p_mem == NULL)
+        d->native[index] = value;
+    else
+        write_int(d->p_mem, index, value);
+}
+
+
+/*---------------------------------------------------------------------------
+ * QUICKSORT
+ */
+
+
+/* This helper handles the task of swapping two integers in the array. */
+void swap_values(sort_data *d, int i, int j) {
+    int i_val = get_int(d, i);
+    int j_val = get_int(d, j);
+
+    set_int(d, i, j_val);
+    set_int(d, j, i_val);
 }
 
 
 /* This function partitions a range of values between the start and end
  * indexes, inclusive, and then returns the index of the pivot value.
  */
-int partition(membase_t *p_mem, int start, int end) {
+int partition(sort_data *d, int start, int end) {
     int pivot_idx, pivot, swap_idx, i;
 
     assert(end > start);
 
     pivot_idx = (start + end) / 2;
-    pivot = read_int(p_mem, pivot_idx);
-    swap_values(p_mem, pivot_idx, end);
+    pivot = get_int(d, pivot_idx);
+    swap_values(d, pivot_idx, end);
 
     swap_idx = start;
     for (i = start; i < end; i++) {
-        if (read_int(p_mem, i) < pivot) {
-            swap_values(p_mem, i, swap_idx);
+        if (get_int(d, i) < pivot) {
+            swap_values(d, i, swap_idx);
             swap_idx++;
         }
     }
 
-    swap_values(p_mem, swap_idx, end);
+    swap_values(d, swap_idx, end);
 
     return swap_idx;
 }
@@ -60,20 +203,513 @@ int partition(membase_t *p_mem, int start, int end) {
  * operation, and the array is sorted in-place.  The start and end indexes
  * are inclusive.
  */
-void quicksort(membase_t *p_mem, int start, int end) {
+void quicksort(sort_data *d, int start, int end) {
     int pivot_idx;
 
     if (end <= start)
         return;
 
-    pivot_idx = partition(p_mem, start, end);
-    quicksort(p_mem, start, pivot_idx - 1);
-    quicksort(p_mem, pivot_idx + 1, end);
+    pivot_idx = partition(d, start, end);
+    quicksort(d, start, pivot_idx - 1);
+    quicksort(d, pivot_idx + 1, end);
+}
+
+
+void sort_quicksort(sort_data *d) {
+    quicksort(d, 0, d->num_values - 1);
+}
+
+
+/*---------------------------------------------------------------------------
+ * INTROSORT
+ */
+
+
+/* Moves the median of the first, middle and last values of a range to its
+ * end, to serve as the pivot, and puts the other two in order.
+ */
+void median_of_three(sort_data *d, int start, int end) {
+    int mid = start + (end - start) / 2;
+
+    if (get_int(d, mid) < get_int(d, start))
+        swap_values(d, mid, start);
+    if (get_int(d, end) < get_int(d, start))
+        swap_values(d, end, start);
+    if (get_int(d, mid) < get_int(d, end))
+        swap_values(d, mid, end);
+}
+
+
+/* The same partition as partition(), but with a median-of-3 pivot, and
+ * without swapping values that are already in place.
+ */
+int lomuto_partition(sort_data *d, int start, int end) {
+    int pivot, swap_idx, i;
+
+    median_of_three(d, start, end);
+    pivot = get_int(d, end);
+
+    swap_idx = start;
+    for (i = start; i < end; i++) {
+        if (get_int(d, i) < pivot) {
+            if (i != swap_idx)
+                swap_values(d, i, swap_idx);
+            swap_idx++;
+        }
+    }
+
+    swap_values(d, swap_idx, end);
+
+    return swap_idx;
+}
+
+
+/* The BlockQuicksort partition (Edelkamp and Weiss, 2016).  It scans a
+ * block of PARTITION_BLOCK values from each end of the range, recording the
+ * offsets of the values that belong on the other side without branching on
+ * the comparisons, and then swaps pairs of recorded values.  The offset
+ * buffers are local variables, which a real implementation keeps in the L1
+ * cache, so they aren't simulated.  The last few blocks are partitioned
+ * like lomuto_partition().
+ */
+int block_partition(sort_data *d, int start, int end) {
+    int offsets_l[PARTITION_BLOCK], offsets_r[PARTITION_BLOCK];
+    int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+    int pivot, left, right, num, swap_idx, i;
+
+    median_of_three(d, start, end);
+    pivot = get_int(d, end);
+
+    /* Everything before left is at most the pivot, and everything after
+     * right is at least the pivot.
+     */
+    left = start;
+    right = end - 1;
+    while (right - left + 1 > 2 * PARTITION_BLOCK) {
+        if (num_l == 0) {
+            start_l = 0;
+            for (i = 0; i < PARTITION_BLOCK; i++) {
+                offsets_l[num_l] = i;
+                num_l += (get_int(d, left + i) >= pivot);
+            }
+        }
+        if (num_r == 0) {
+            start_r = 0;
+            for (i = 0; i < PARTITION_BLOCK; i++) {
+                offsets_r[num_r] = i;
+                num_r += (pivot >= get_int(d, right - i));
+            }
+        }
+
+        num = num_l < num_r ? num_l : num_r;
+        for (i = 0; i < num; i++) {
+            swap_values(d, left + offsets_l[start_l + i],
+                        right - offsets_r[start_r + i]);
+        }
+        num_l -= num;
+        num_r -= num;
+        start_l += num;
+        start_r += num;
+
+        /* Move past a block once all of its misplaced values are swapped.
+         * The other block keeps the offsets it has left.
+         */
+        if (num_l == 0)
+            left += PARTITION_BLOCK;
+        if (num_r == 0)
+            right -= PARTITION_BLOCK;
+    }
+
+    /* Partition what is left, including any block with offsets left over,
+     * whose swapped values are already in place.
+     */
+    swap_idx = left;
+    for (i = left; i <= right; i++) {
+        if (get_int(d, i) < pivot) {
+            if (i != swap_idx)
+                swap_values(d, i, swap_idx);
+            swap_idx++;
+        }
+    }
+
+    swap_values(d, swap_idx, end);
+
+    return swap_idx;
+}
+
+
+/* Sorts a range of values, inclusive, by inserting each value into the
+ * sorted values before it.
+ */
+void insertion_sort(sort_data *d, int start, int end) {
+    int i, j;
+
+    for (i = start + 1; i <= end; i++) {
+        int value = get_int(d, i);
+
+        for (j = i; j > start; j--) {
+            int prev = get_int(d, j - 1);
+            if (prev <= value)
+                break;
+            set_int(d, j, prev);
+        }
+        set_int(d, j, value);
+    }
+}
+
+
+/* Sifts the value at root down the max-heap that starts at start and ends
+ * at last, inclusive, with the children of i at 2i+1 and 2i+2 relative to
+ * start.
+ */
+void sift_down_max(sort_data *d, int start, int root, int last) {
+    int value = get_int(d, start + root);
+
+    while (2 * root + 1 <= last) {
+        int child = 2 * root + 1;
+        int child_val = get_int(d, start + child);
+
+        if (child < last) {
+            int right_val = get_int(d, start + child + 1);
+            if (right_val > child_val) {
+                child++;
+                child_val = right_val;
+            }
+        }
+        if (child_val <= value)
+            break;
+
+        set_int(d, start + root, child_val);
+        root = child;
+    }
+    set_int(d, start + root, value);
+}
+
+
+/* Sorts a range of values, inclusive, with a heapsort, which introsort
+ * falls back on when the partitions are too unbalanced.
+ */
+void heapsort(sort_data *d, int start, int end) {
+    int last = end - start;
+    int i;
+
+    for (i = (last - 1) / 2; i >= 0; i--)
+        sift_down_max(d, start, i, last);
+
+    /* Move the largest value to the end, and restore the rest of the heap. */
+    while (last > 0) {
+        swap_values(d, start, start + last);
+        last--;
+        sift_down_max(d, start, 0, last);
+    }
+}
+
+
+/* Sorts a range of values, inclusive, with the specified partition.  It
+ * recurses on the smaller side of each partition and loops on the larger,
+ * leaves small ranges to an insertion sort, and switches to a heapsort
+ * after depth_limit partitions, which bounds the worst case.
+ */
+void introsort(sort_data *d, int start, int end, int depth_limit,
+               int (*partition_range)(sort_data *, int, int)) {
+    int pivot_idx;
+
+    while (end - start + 1 > INSERTION_CUTOFF) {
+        if (depth_limit == 0) {
+            heapsort(d, start, end);
+            return;
+        }
+        depth_limit--;
+
+        pivot_idx = partition_range(d, start, end);
+        if (pivot_idx - start < end - pivot_idx) {
+            introsort(d, start, pivot_idx - 1, depth_limit, partition_range);
+            start = pivot_idx + 1;
+        }
+        else {
+            introsort(d, pivot_idx + 1, end, depth_limit, partition_range);
+            end = pivot_idx - 1;
+        }
+    }
+
+    insertion_sort(d, start, end);
+}
+
+
+/* Returns the introsort depth limit for a number of values, twice its
+ * log.
+ */
+int introsort_depth_limit(int num_values) {
+    int limit = 0;
+
+    while (num_values > 1) {
+        num_values /= 2;
+        limit += 2;
+    }
+    return limit;
+}
+
+
+void sort_introsort(sort_data *d) {
+    introsort(d, 0, d->num_values - 1, introsort_depth_limit(d->num_values),
+              lomuto_partition);
+}
+
+
+void sort_block_quicksort(sort_data *d) {
+    introsort(d, 0, d->num_values - 1, introsort_depth_limit(d->num_values),
+              block_partition);
+}
+
+
+/*---------------------------------------------------------------------------
+ * RADIX SORT
+ */
+
+
+/* A least-significant-digit radix sort.  Each pass counts the values with
+ * each digit, turns the counts into the positions where each digit's
+ * values start, and then copies the values to those positions in the
+ * other buffer, which keeps the values in order within each digit.  The
+ * sign bit is flipped, so that negative values sort first.
+ */
+void sort_radix(sort_data *d) {
+    int num_values = d->num_values;
+    int bits = d->radix_bits;
+    int num_digits = 1 << bits;
+    int counts = 2 * num_values;
+    int src = 0, dst = num_values;
+    int shift, digit, i;
+
+    for (shift = 0; shift < 32; shift += bits) {
+        int total = 0;
+
+        for (digit = 0; digit < num_digits; digit++)
+            set_int(d, counts + digit, 0);
+
+        for (i = 0; i < num_values; i++) {
+            uint32_t key = (uint32_t) get_int(d, src + i) ^ 0x80000000U;
+            digit = (key >> shift) & (num_digits - 1);
+            set_int(d, counts + digit, get_int(d, counts + digit) + 1);
+        }
+
+        for (digit = 0; digit < num_digits; digit++) {
+            int count = get_int(d, counts + digit);
+            set_int(d, counts + digit, total);
+            total += count;
+        }
+
+        for (i = 0; i < num_values; i++) {
+            int value = get_int(d, src + i);
+            uint32_t key = (uint32_t) value ^ 0x80000000U;
+            int pos;
+
+            digit = (key >> shift) & (num_digits - 1);
+            pos = get_int(d, counts + digit);
+            set_int(d, dst + pos, value);
+            set_int(d, counts + digit, pos + 1);
+        }
+
+        src = num_values - src;
+        dst = num_values - dst;
+    }
+
+    /* An odd number of passes leaves the values in the scratch buffer. */
+    if (src != 0) {
+        for (i = 0; i < num_values; i++)
+            set_int(d, i, get_int(d, src + i));
+    }
+}
+
+
+/*---------------------------------------------------------------------------
+ * PARALLEL SAMPLE SORT
+ */
+
+
+/* Returns the bucket of a value:  the number of splitters that are at most
+ * the value.
+ */
+int find_bucket(const int *splitters, int num_splitters, int value) {
+    int low = 0, high = num_splitters;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (splitters[mid] <= value)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+
+/* Runs one phase of the sample sort on every thread, and waits for them to
+ * finish.
+ */
+void run_sample_sort_phase(sample_sort_task *tasks, int num_threads,
+                           void * (*phase)(void *)) {
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    int t;
+
+    if (threads == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    for (t = 0; t < num_threads; t++) {
+        if (pthread_create(&threads[t], NULL, phase, &tasks[t]) != 0) {
+            printf("ERROR:  couldn't create a sample sort thread.\n");
+            exit(1);
+        }
+    }
+    for (t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+
+    free(threads);
+}
+
+
+/* Counts the values of the thread's slice of the array in each bucket. */
+void * sample_sort_count(void *arg) {
+    sample_sort_task *task = arg;
+    int num_threads = task->d->num_threads;
+    int num_values = task->d->num_values;
+    int *counts = task->counts + task->thread * num_threads;
+    int first = (long) num_values * task->thread / num_threads;
+    int last = (long) num_values * (task->thread + 1) / num_threads;
+    int i;
+
+    for (i = first; i < last; i++) {
+        counts[find_bucket(task->splitters, num_threads - 1,
+                           task->d->native[i])]++;
+    }
+    return NULL;
+}
+
+
+/* Copies the values of the thread's slice of the array into their buckets
+ * in the scratch buffer.
+ */
+void * sample_sort_scatter(void *arg) {
+    sample_sort_task *task = arg;
+    int num_threads = task->d->num_threads;
+    int num_values = task->d->num_values;
+    int *positions = task->counts + task->thread * num_threads;
+    int *scratch = task->d->native + num_values;
+    int first = (long) num_values * task->thread / num_threads;
+    int last = (long) num_values * (task->thread + 1) / num_threads;
+    int i;
+
+    for (i = first; i < last; i++) {
+        int value = task->d->native[i];
+        scratch[positions[find_bucket(task->splitters, num_threads - 1,
+                                      value)]++] = value;
+    }
+    return NULL;
+}
+
+
+/* Sorts the bucket with the thread's number, and copies it back into the
+ * array.
+ */
+void * sample_sort_bucket(void *arg) {
+    sample_sort_task *task = arg;
+    int first = task->bucket_starts[task->thread];
+    int last = task->bucket_starts[task->thread + 1];
+    sort_data bucket = *task->d;
+
+    bucket.native = task->d->native + task->d->num_values + first;
+    bucket.num_values = last - first;
+    if (bucket.num_values > 0)
+        sort_block_quicksort(&bucket);
+
+    memcpy(task->d->native + first, bucket.native,
+           (last - first) * sizeof(int));
+    return NULL;
+}
+
+
+/* A parallel sample sort, which only runs natively.  It sorts a sample of
+ * the values to pick splitters that divide them into one bucket per
+ * thread; each thread counts the values of its slice of the array in each
+ * bucket and then copies them to their buckets in the scratch buffer; and
+ * finally each thread sorts one bucket with the block quicksort and copies
+ * it back.  The threads only share the counts, which they write between
+ * phases.
+ */
+void sort_sample(sort_data *d) {
+    int num_threads = d->num_threads;
+    int num_samples = num_threads * SAMPLE_OVERSAMPLING;
+    int *samples, *splitters, *counts, *bucket_starts;
+    sample_sort_task *tasks;
+    int t, b, total;
+
+    if (num_threads == 1 || d->num_values < num_samples) {
+        sort_block_quicksort(d);
+        return;
+    }
+
+    samples = malloc(num_samples * sizeof(int));
+    splitters = malloc((num_threads - 1) * sizeof(int));
+    counts = calloc(num_threads * num_threads, sizeof(int));
+    bucket_starts = malloc((num_threads + 1) * sizeof(int));
+    tasks = malloc(num_threads * sizeof(sample_sort_task));
+    if (samples == NULL || splitters == NULL || counts == NULL ||
+        bucket_starts == NULL || tasks == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    /* Take evenly spaced samples, since the values are in random order. */
+    for (t = 0; t < num_samples; t++)
+        samples[t] = d->native[(long) d->num_values * t / num_samples];
+    qsort(samples, num_samples, sizeof(int), compare_int_ptrs);
+    for (t = 0; t < num_threads - 1; t++)
+        splitters[t] = samples[(t + 1) * SAMPLE_OVERSAMPLING];
+
+    for (t = 0; t < num_threads; t++) {
+        tasks[t].d = d;
+        tasks[t].thread = t;
+        tasks[t].splitters = splitters;
+        tasks[t].counts = counts;
+        tasks[t].bucket_starts = bucket_starts;
+    }
+
+    run_sample_sort_phase(tasks, num_threads, sample_sort_count);
+
+    /* Turn the counts into positions:  bucket by bucket, and within each
+     * bucket, thread by thread.
+     */
+    total = 0;
+    for (b = 0; b < num_threads; b++) {
+        bucket_starts[b] = total;
+        for (t = 0; t < num_threads; t++) {
+            int count = counts[t * num_threads + b];
+            counts[t * num_threads + b] = total;
+            total += count;
+        }
+    }
+    bucket_starts[num_threads] = total;
+
+    run_sample_sort_phase(tasks, num_threads, sample_sort_scatter);
+    run_sample_sort_phase(tasks, num_threads, sample_sort_bucket);
+
+    free(samples);
+    free(splitters);
+    free(counts);
+    free(bucket_starts);
+    free(tasks);
 }
 
 
+/*---------------------------------------------------------------------------
+ * TESTING
+ */
+
+
 /* This function is used by the C standard-library function qsort(), so that
- * we can check the output of our quicksort algorithm.
+ * we can check the output of our sorting kernels.
  */
 int compare_int_ptrs(const void *v1, const void *v2) {
     int i1 = *(int *) v1;
@@ -83,59 +719,247 @@ int compare_int_ptrs(const void *v1, const void *v2) {
 }
 
 
+/* Returns the number of bytes of memory a kernel uses:  just the values,
+ * or also the scratch buffer and digit counts for the radix sort.
+ */
+uint32_t sort_memory_size(const sort_kernel *kernel, int num_values,
+                          int radix_bits) {
+    if (kernel->sort == sort_radix)
+        return (2 * num_values + (1 << radix_bits)) * sizeof(int);
+    return num_values * sizeof(int);
+}
+
+
+/* Generates the same random ints every time for the same SEED. */
+void generate_inputs(int *inputs, int num_values) {
+    int i;
+
+    srand(SEED);
+    for (i = 0; i < num_values; i++)
+        inputs[i] = rand();
+}
+
+
+/* Checks the sorted values against the inputs sorted by qsort().  Returns
+ * nonzero if any don't match.
+ */
+int check_results(sort_data *d, const int *sorted) {
+    int i, error = 0;
+
+    for (i = 0; i < d->num_values; i++) {
+        int val = get_int(d, i);
+        if (val != sorted[i]) {
+            printf("ERROR:  sorted arrays don't match at index %d!  "
+                   "data[i] = %d, verify[i] = %d\n", i, val, sorted[i]);
+            error = 1;
+        }
+    }
+
+    return error;
+}
+
+
+/* Runs every kernel on native arrays, without simulating any caches, and
+ * reports the best of NATIVE_TRIALS times for each, and its speedup over
+ * the quicksort kernel.
+ */
+void time_native_runs(int num_values, int radix_bits, int num_threads) {
+    int *inputs, *sorted;
+    double times[NUM_KERNELS];
+    sort_data d;
+    int k, trial;
+
+    inputs = malloc(num_values * sizeof(int));
+    sorted = malloc(num_values * sizeof(int));
+    d.native = malloc((2 * num_values + (1 << radix_bits)) * sizeof(int));
+    if (inputs == NULL || sorted == NULL || d.native == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    d.num_values = num_values;
+    d.p_mem = NULL;
+    d.radix_bits = radix_bits;
+    d.num_threads = num_threads;
+
+    generate_inputs(inputs, num_values);
+    memcpy(sorted, inputs, num_values * sizeof(int));
+    qsort(sorted, num_values, sizeof(int), compare_int_ptrs);
+
+    printf("Timing each kernel natively on %d random ints, best of %d "
+           "trials.\n", num_values, NATIVE_TRIALS);
+    printf("The radix sort uses %d-bit digits, and the sample sort %d "
+           "thread%s.\n\n", radix_bits, num_threads,
+           num_threads == 1 ? "" : "s");
+
+    for (k = 0; k < NUM_KERNELS; k++) {
+        times[k] = 0;
+
+        for (trial = 0; trial < NATIVE_TRIALS; trial++) {
+            double start, elapsed;
+
+            memcpy(d.native, inputs, num_values * sizeof(int));
+            start = now_seconds();
+            kernels[k].sort(&d);
+            elapsed = now_seconds() - start;
+
+            if (check_results(&d, sorted)) {
+                printf("The %s kernel's results are wrong, aborting.\n",
+                       kernels[k].name);
+                abort();
+            }
+
+            if (times[k] == 0 || elapsed < times[k])
+                times[k] = elapsed;
+        }
+
+        printf("    %-10s  %8.3f s  %6.2fx\n", kernels[k].name, times[k],
+               times[0] / times[k]);
+    }
+
+    free(d.native);
+    free(inputs);
+    free(sorted);
+}
+
+
+/* Prints the program usage. */
+void qsorttest_usage(const char *progname) {
+    int k;
+
+    printf("usage: %s [-k kernel] [-b bits] [-j threads] [-n count] "
+           "[-native]\n\t\t[cache-spec ...]\n\n", progname);
+    printf("\tSorts random ints (default %d) through the specified caches\n",
+           NUM_ELEMS);
+    printf("\twith one of these kernels (default %s):\n\n", kernels[0].name);
+    for (k = 0; k < NUM_KERNELS; k++) {
+        printf("\t    %s%s\n", kernels[k].name,
+               kernels[k].native_only ? " (native only)" : "");
+    }
+    printf("\n\tThe radix sort uses digits of -b bits (default %d), and the\n",
+           DEFAULT_RADIX_BITS);
+    printf("\tsample sort -j threads (default:  one per processor).\n");
+    printf("\t-native times every kernel on native arrays instead, without\n");
+    printf("\tsimulating any caches.\n\n");
+    usage(progname);
+}
+
+
 int main(int argc, const char **argv) {
+    const char *progname = argv[0];
+    const sort_kernel *kernel = &kernels[0];
+    int num_values = NUM_ELEMS, radix_bits = DEFAULT_RADIX_BITS;
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN), native = 0;
     int *inputs;
-    int i, error;
+    int i, k;
+    uint32_t mem_size;
     membase_t *p_mem;
+    sort_data d;
+
+    i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-native") == 0) {
+            native = 1;
+            i++;
+            continue;
+        }
 
-    /* Set up the simulated memory. */
-    p_mem = make_cached_memory(argc, argv, NUM_ELEMS * sizeof(int));
+        if (i + 1 >= argc) {
+            qsorttest_usage(progname);
+            exit(1);
+        }
 
-    /* Generate random floats to sort. */
+        if (strcmp(argv[i], "-k") == 0) {
+            for (k = 0; k < NUM_KERNELS; k++) {
+                if (strcmp(argv[i + 1], kernels[k].name) == 0)
+                    break;
+            }
+            kernel = k < NUM_KERNELS ? &kernels[k] : NULL;
+        }
+        else if (strcmp(argv[i], "-b") == 0) {
+            radix_bits = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-j") == 0) {
+            num_threads = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-n") == 0) {
+            num_values = atoi(argv[i + 1]);
+        }
+        else {
+            kernel = NULL;
+        }
 
-    printf("Generating %d random ints to sort.\n", NUM_ELEMS);
+        if (kernel == NULL || radix_bits < 1 || radix_bits > MAX_RADIX_BITS ||
+            num_threads < 1 || num_values <= 0) {
+            qsorttest_usage(progname);
+            exit(1);
+        }
+        i += 2;
+    }
 
-    inputs = malloc(NUM_ELEMS * sizeof(float));
+    if (num_threads < 1)
+        num_threads = 1;
 
-    srand(SEED);
+    if (native) {
+        time_native_runs(num_values, radix_bits, num_threads);
+        return 0;
+    }
+
+    if (kernel->native_only) {
+        printf("ERROR:  the %s kernel only runs natively; use -native.\n",
+               kernel->name);
+        exit(1);
+    }
+
+    /* Set up the simulated memory.  make_cached_memory() expects the
+     * program name followed by the cache specifications.
+     */
+    mem_size = sort_memory_size(kernel, num_values, radix_bits);
+    mem_size = (mem_size + MEM_SIZE_ALIGN - 1) & ~(MEM_SIZE_ALIGN - 1);
+    argv[i - 1] = progname;
+    p_mem = make_cached_memory(argc - i + 1, argv + i - 1, mem_size);
+
+    d.num_values = num_values;
+    d.p_mem = p_mem;
+    d.native = NULL;
+    d.radix_bits = radix_bits;
+    d.num_threads = 1;
+
+    /* Generate random ints to sort. */
+
+    printf("Generating %d random ints to sort.\n", num_values);
+
+    inputs = malloc(num_values * sizeof(int));
+    if (inputs == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
 
     /* Generate the inputs, then store them into the memory simulator in a
      * separate loop, so that the inputs we use don't change if the random
      * replacement policy is currently in effect.
      */
-    for (i = 0; i < NUM_ELEMS; i++)
-        inputs[i] = rand();
-    
-    for (i = 0; i < NUM_ELEMS; i++)
+    generate_inputs(inputs, num_values);
+
+    for (i = 0; i < num_values; i++)
         write_int(p_mem, i, inputs[i]);
 
-    /* Quicksort the array of integers. */
+    /* Sort the array of integers. */
 
-    printf("Quicksorting the array of integers.\n");
-    quicksort(p_mem, 0, NUM_ELEMS - 1);
+    printf("Sorting the array of integers (%s).\n", kernel->name);
+    kernel->sort(&d);
 
-    /* Sort the inputs so that we can check the heap's results. */
+    /* Sort the inputs so that we can check the kernel's results. */
 
     printf("Checking the results against the sorted inputs.\n");
 
-    qsort(inputs, NUM_ELEMS, sizeof(float), compare_int_ptrs);
-
-    error = 0;
-    for (i = 0; i < NUM_ELEMS; i++) {
-        int val = read_int(p_mem, i);
-        if (val != inputs[i]) {
-            printf("ERROR:  sorted arrays don't match at index %d!  "
-                   "data[i] = %d, verify[i] = %d\n", i, val, inputs[i]);
-            error = 1;
-        }
-    }
+    qsort(inputs, num_values, sizeof(int), compare_int_ptrs);
 
-    if (error) {
+    if (check_results(&d, inputs)) {
         printf("Some values didn't match, aborting.\n");
         abort();
     }
 
-    /* Print out the results of the quicksort. */
+    /* Print out the results of the sort. */
 
     printf("\nMemory-Access Statistics:\n\n");
     p_mem->print_stats(p_mem);
@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "stackdist.h"
+
+
+/* The initial number of entries in each level's histogram of stack
+ * distances; histograms double in size as larger distances show up.
+ */
+#define INITIAL_HISTOGRAM_SIZE 64
+
+
+/* Local functions used by the stack-distance implementation. */
+
+unsigned char stackdist_read_byte(membase_t *mb, addr_t address);
+void stackdist_write_byte(membase_t *mb, addr_t address, unsigned char value);
+void stackdist_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                          uint32_t size);
+void stackdist_write_block(membase_t *mb, addr_t address,
+                           const unsigned char *buf, uint32_t size);
+void stackdist_print_stats(membase_t *mb);
+void stackdist_reset_stats(membase_t *mb);
+void stackdist_free(membase_t *mb);
+membase_t * stackdist_next_level(membase_t *mb);
+uint64_t stackdist_cycles(membase_t *mb);
+
+void record_access(stackdist_t *p_sd, addr_t address, uint32_t size);
+void access_block(stackdist_t *p_sd, uint32_t block_no);
+uint32_t new_block_id(stackdist_t *p_sd);
+void add_to_histogram(stackdist_t *p_sd, uint32_t level, uint32_t distance);
+
+void tree_split(sd_node *nodes, uint32_t root, uint64_t time,
+                uint32_t *left, uint32_t *right);
+uint32_t tree_merge(sd_node *nodes, uint32_t left, uint32_t right);
+
+
+/* Initializes a stack-distance analyzer for the specified block size, for
+ * every power-of-2 number of cache sets up to max_sets.
+ */
+void init_stackdist(stackdist_t *p_sd, uint32_t block_size, uint32_t max_sets,
+                    uint32_t mem_size, membase_t *next_mem) {
+    uint32_t level;
+
+    assert(p_sd != NULL);
+    assert(next_mem != NULL);
+
+    assert(is_power_of_2(block_size));
+    assert(is_power_of_2(max_sets));
+
+    bzero(p_sd, sizeof(stackdist_t));
+
+    p_sd->next_memory = next_mem;
+
+    p_sd->read_byte = stackdist_read_byte;
+    p_sd->write_byte = stackdist_write_byte;
+    p_sd->read_block = stackdist_read_block;
+    p_sd->write_block = stackdist_write_block;
+    p_sd->print_stats = stackdist_print_stats;
+    p_sd->reset_stats = stackdist_reset_stats;
+    p_sd->free = stackdist_free;
+    p_sd->next_level = stackdist_next_level;
+    p_sd->cycles = stackdist_cycles;
+
+    p_sd->block_size = block_size;
+    p_sd->block_offset_bits = log_2(block_size);
+    p_sd->max_sets = max_sets;
+    p_sd->num_levels = log_2(max_sets) + 1;
+
+    p_sd->num_blocks = (mem_size + block_size - 1) >> p_sd->block_offset_bits;
+    p_sd->block_ids = calloc(p_sd->num_blocks, sizeof(uint32_t));
+    p_sd->roots = calloc(2 * max_sets - 1, sizeof(uint32_t));
+    p_sd->histograms = malloc(p_sd->num_levels * sizeof(uint64_t *));
+    p_sd->histogram_sizes = malloc(p_sd->num_levels * sizeof(uint32_t));
+    p_sd->cold_misses = calloc(p_sd->num_levels, sizeof(uint64_t));
+    if (p_sd->block_ids == NULL || p_sd->roots == NULL ||
+        p_sd->histograms == NULL || p_sd->histogram_sizes == NULL ||
+        p_sd->cold_misses == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    for (level = 0; level < p_sd->num_levels; level++) {
+        p_sd->histogram_sizes[level] = INITIAL_HISTOGRAM_SIZE;
+        p_sd->histograms[level] =
+            calloc(INITIAL_HISTOGRAM_SIZE, sizeof(uint64_t));
+        if (p_sd->histograms[level] == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+
+    p_sd->rand_state = 2463534242U;
+}
+
+
+/* The access functions record each access, and then pass it on to the next
+ * level of the memory unchanged.
+ */
+
+unsigned char stackdist_read_byte(membase_t *mb, addr_t address) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+
+    p_sd->num_reads++;
+    record_access(p_sd, address, 1);
+    return read_byte(p_sd->next_memory, address);
+}
+
+
+void stackdist_write_byte(membase_t *mb, addr_t address, unsigned char value) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+
+    p_sd->num_writes++;
+    record_access(p_sd, address, 1);
+    write_byte(p_sd->next_memory, address, value);
+}
+
+
+void stackdist_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                          uint32_t size) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+
+    p_sd->num_reads += size;
+    record_access(p_sd, address, size);
+    read_block(p_sd->next_memory, address, buf, size);
+}
+
+
+void stackdist_write_block(membase_t *mb, addr_t address,
+                           const unsigned char *buf, uint32_t size) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+
+    p_sd->num_writes += size;
+    record_access(p_sd, address, size);
+    write_block(p_sd->next_memory, address, buf, size);
+}
+
+
+/* This function prints the miss counts and miss rates of every cache the
+ * analysis covers, and then calls the next level of the memory to print its
+ * statistics.  For each number of sets, the number of lines per set doubles
+ * until no more misses would be avoided.
+ */
+void stackdist_print_stats(membase_t *mb) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+    uint32_t level, lines;
+
+    printf(" * Stack-distance analysis reads=%ld writes=%ld block-size=%u\n",
+           p_sd->num_reads, p_sd->num_writes, p_sd->block_size);
+    printf("   LRU replacement policy\n");
+    printf("        sets    lines   cache-size       misses  miss-rate\n");
+
+    for (level = 0; level < p_sd->num_levels; level++) {
+        uint32_t num_sets = 1U << level;
+
+        for (lines = 1; ; lines *= 2) {
+            uint64_t misses = stackdist_misses(p_sd, num_sets, lines);
+            double miss_rate = 0;
+
+            if (p_sd->num_bytes > 0)
+                miss_rate = 100.0 * misses / p_sd->num_bytes;
+
+            printf("   %9u %8u %12lu %12lu %9.2f%%\n", num_sets, lines,
+                   (uint64_t) p_sd->block_size * num_sets * lines, misses,
+                   miss_rate);
+
+            if (misses == p_sd->cold_misses[level])
+                break;
+        }
+    }
+
+    p_sd->next_memory->print_stats(p_sd->next_memory);
+}
+
+
+/* This function resets the analysis results, and passes the operation on to
+ * the next level of the memory as well.  The contents of the simulated
+ * caches are kept, just as cache_reset_stats() keeps the cache lines.
+ */
+void stackdist_reset_stats(membase_t *mb) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+    uint32_t level;
+
+    p_sd->num_reads = 0;
+    p_sd->num_writes = 0;
+    p_sd->num_bytes = 0;
+
+    for (level = 0; level < p_sd->num_levels; level++) {
+        bzero(p_sd->histograms[level],
+              p_sd->histogram_sizes[level] * sizeof(uint64_t));
+        p_sd->cold_misses[level] = 0;
+    }
+
+    p_sd->next_memory->reset_stats(p_sd->next_memory);
+}
+
+
+/* This function frees all heap-allocated memory used by the analyzer.  Like
+ * cache_free(), it does *not* pass the call on to the next level.
+ */
+void stackdist_free(membase_t *mb) {
+    stackdist_t *p_sd = (stackdist_t *) mb;
+    uint32_t level;
+
+    for (level = 0; level < p_sd->num_levels; level++)
+        free(p_sd->histograms[level]);
+
+    free(p_sd->histograms);
+    free(p_sd->histogram_sizes);
+    free(p_sd->cold_misses);
+    free(p_sd->roots);
+    free(p_sd->nodes);
+    free(p_sd->block_ids);
+}
+
+
+/* Returns the level behind the analyzer. */
+membase_t * stackdist_next_level(membase_t *mb) {
+    return ((stackdist_t *) mb)->next_memory;
+}
+
+
+/* The analyzer takes no time of its own, so this returns the cycles of the
+ * level behind it.
+ */
+uint64_t stackdist_cycles(membase_t *mb) {
+    return level_cycles(((stackdist_t *) mb)->next_memory);
+}
+
+
+/* Returns the number of misses that an LRU cache with the specified number
+ * of sets and lines per set would have had:  every first access to a block,
+ * and every access whose stack distance is at least the number of lines.
+ */
+uint64_t stackdist_misses(stackdist_t *p_sd, uint32_t num_sets,
+                          uint32_t lines_per_set) {
+    uint32_t level = log_2(num_sets);
+    uint64_t misses;
+    uint32_t d;
+
+    assert(num_sets <= p_sd->max_sets);
+
+    misses = p_sd->cold_misses[level];
+    for (d = lines_per_set; d < p_sd->histogram_sizes[level]; d++)
+        misses += p_sd->histograms[level][d];
+
+    return misses;
+}
+
+
+/*---------------------------------------------------------------------------
+ * STACK-DISTANCE HELPER FUNCTIONS
+ */
+
+
+/* Records an access of size bytes.  Like an access through a cache, it is
+ * split at block boundaries, and each piece counts as a single access to its
+ * block; a cache would count one hit or miss and then hits for the rest of
+ * the piece's bytes.
+ */
+void record_access(stackdist_t *p_sd, addr_t address, uint32_t size) {
+    p_sd->num_bytes += size;
+
+    while (size > 0) {
+        uint32_t offset = address & (p_sd->block_size - 1);
+        uint32_t num_bytes = p_sd->block_size - offset;
+
+        if (num_bytes > size)
+            num_bytes = size;
+
+        access_block(p_sd, address >> p_sd->block_offset_bits);
+
+        address += num_bytes;
+        size -= num_bytes;
+    }
+}
+
+
+/* Computes the stack distance of an access to the specified block for every
+ * number of sets, and moves the block to the top of its stack in each.
+ *
+ * The stack distance of an access is the number of other blocks in the same
+ * set that were accessed since the last access to this block.  Each set's
+ * tree is keyed by last-access time, so that is just the number of nodes
+ * with a later time than the block's own node.
+ *
+ * Levels are visited in order of increasing number of sets.  A set at one
+ * level only holds blocks from one set at the level before, so distances
+ * never grow from one level to the next, and once a distance is 0 it is 0
+ * for the remaining levels too.
+ */
+void access_block(stackdist_t *p_sd, uint32_t block_no) {
+    uint32_t num_levels = p_sd->num_levels;
+    uint32_t id, level;
+    uint64_t now;
+
+    assert(block_no < p_sd->num_blocks);
+
+    now = ++p_sd->clock;
+    id = p_sd->block_ids[block_no];
+
+    if (id != 0 && p_sd->last_block == (uint64_t) block_no + 1) {
+        /* Another access to the same block as the last access.  Its node
+         * is already the latest one in every tree, so only the time needs
+         * to change, and the distance is 0 everywhere.
+         */
+        for (level = 0; level < num_levels; level++) {
+            p_sd->nodes[id * num_levels + level].time = now;
+            p_sd->histograms[level][0]++;
+        }
+        return;
+    }
+    p_sd->last_block = (uint64_t) block_no + 1;
+
+    if (id == 0) {
+        id = new_block_id(p_sd);
+        p_sd->block_ids[block_no] = id;
+    }
+
+    for (level = 0; level < num_levels; level++) {
+        uint32_t *root = p_sd->roots + (1U << level) - 1 +
+                         (block_no & ((1U << level) - 1));
+        uint32_t node = id * num_levels + level;
+        sd_node *nodes = p_sd->nodes;
+
+        if (nodes[node].time == 0) {
+            /* The first access to the block. */
+            p_sd->cold_misses[level]++;
+        }
+        else {
+            uint32_t earlier, rest, self, later;
+
+            /* Split the tree into the nodes before, at and after the
+             * block's last access.
+             */
+            tree_split(nodes, *root, nodes[node].time, &earlier, &rest);
+            tree_split(nodes, rest, nodes[node].time + 1, &self, &later);
+            assert(self == node);
+
+            if (later == 0) {
+                /* The block is already the latest in its set, here and at
+                 * every remaining level.
+                 */
+                *root = tree_merge(nodes, earlier, node);
+                for (; level < num_levels; level++) {
+                    nodes[id * num_levels + level].time = now;
+                    p_sd->histograms[level][0]++;
+                }
+                return;
+            }
+
+            add_to_histogram(p_sd, level, nodes[later].size);
+            *root = tree_merge(nodes, earlier, later);
+        }
+
+        /* The block is now the most recently accessed one in its set. */
+        nodes[node].time = now;
+        nodes[node].left = 0;
+        nodes[node].right = 0;
+        nodes[node].size = 1;
+        *root = tree_merge(nodes, *root, node);
+    }
+}
+
+
+/* Assigns the next block id, and sets up the block's tree nodes. */
+uint32_t new_block_id(stackdist_t *p_sd) {
+    uint32_t id = ++p_sd->num_ids;
+    uint32_t first = id * p_sd->num_levels;
+    uint32_t level;
+
+    if (first + p_sd->num_levels > p_sd->nodes_size) {
+        uint32_t old_size = p_sd->nodes_size;
+
+        p_sd->nodes_size = old_size ? 2 * old_size : 1024 * p_sd->num_levels;
+        p_sd->nodes = realloc(p_sd->nodes, p_sd->nodes_size * sizeof(sd_node));
+        if (p_sd->nodes == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+        bzero(p_sd->nodes + old_size,
+              (p_sd->nodes_size - old_size) * sizeof(sd_node));
+    }
+
+    for (level = 0; level < p_sd->num_levels; level++) {
+        /* xorshift32; rand() isn't used, so that the analysis doesn't change
+         * the random numbers the test programs generate.
+         */
+        p_sd->rand_state ^= p_sd->rand_state << 13;
+        p_sd->rand_state ^= p_sd->rand_state >> 17;
+        p_sd->rand_state ^= p_sd->rand_state << 5;
+        p_sd->nodes[first + level].priority = p_sd->rand_state;
+    }
+
+    return id;
+}
+
+
+/* Counts an access with the specified stack distance, growing the level's
+ * histogram if needed.
+ */
+void add_to_histogram(stackdist_t *p_sd, uint32_t level, uint32_t distance) {
+    uint32_t size = p_sd->histogram_sizes[level];
+
+    if (distance >= size) {
+        uint32_t new_size = size;
+        while (distance >= new_size)
+            new_size *= 2;
+
+        p_sd->histograms[level] = realloc(p_sd->histograms[level],
+                                          new_size * sizeof(uint64_t));
+        if (p_sd->histograms[level] == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+        bzero(p_sd->histograms[level] + size,
+              (new_size - size) * sizeof(uint64_t));
+        p_sd->histogram_sizes[level] = new_size;
+    }
+
+    p_sd->histograms[level][distance]++;
+}
+
+
+/* Splits the tree rooted at root into the nodes with a time before the
+ * specified time, and the nodes with a time at or after it.
+ */
+void tree_split(sd_node *nodes, uint32_t root, uint64_t time,
+                uint32_t *left, uint32_t *right) {
+    if (root == 0) {
+        *left = 0;
+        *right = 0;
+        return;
+    }
+
+    if (nodes[root].time < time) {
+        tree_split(nodes, nodes[root].right, time, &nodes[root].right, right);
+        *left = root;
+    }
+    else {
+        tree_split(nodes, nodes[root].left, time, left, &nodes[root].left);
+        *right = root;
+    }
+
+    nodes[root].size =
+        1 + nodes[nodes[root].left].size + nodes[nodes[root].right].size;
+}
+
+
+/* Joins two trees, where every time in the left tree is before every time
+ * in the right tree, and returns the root of the result.
+ */
+uint32_t tree_merge(sd_node *nodes, uint32_t left, uint32_t right) {
+    if (left == 0)
+        return right;
+    if (right == 0)
+        return left;
+
+    if (nodes[left].priority > nodes[right].priority) {
+        nodes[left].right = tree_merge(nodes, nodes[left].right, right);
+        nodes[left].size = 1 + nodes[nodes[left].left].size +
+                           nodes[nodes[left].right].size;
+        return left;
+    }
+    else {
+        nodes[right].left = tree_merge(nodes, left, nodes[right].left);
+        nodes[right].size = 1 + nodes[nodes[right].left].size +
+                            nodes[nodes[right].right].size;
+        return right;
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+
+#include "membase.h"
+
+
+/* A node of one of the trees used by the stack-distance analysis.  Each tree
+ * holds the blocks that map to one cache set, keyed by the time each block
+ * was last accessed; the trees are treaps, balanced by random priorities.
+ */
+typedef struct sd_node {
+    /* The time of the last access to the block. */
+    uint64_t time;
+
+    /* The indexes of the children in the node array, or 0 for none. */
+    uint32_t left;
+    uint32_t right;
+
+    /* The number of nodes in the subtree rooted at this node. */
+    uint32_t size;
+
+    uint32_t priority;
+} sd_node;
+
+
+/* This struct holds the state for a stack-distance analyzer.  It sits in the
+ * memory hierarchy like a cache, but it keeps no data:  every access is
+ * passed straight through to the next memory.  Along the way, it computes
+ * the LRU stack distance of each access (Mattson et al., 1970) for every
+ * power-of-2 number of cache sets up to max_sets, at one block size.  An
+ * access with stack distance d hits in an LRU cache with that many sets and
+ * more than d lines per set, and misses otherwise, so one pass produces the
+ * miss rate of every one of those caches.  The results are exactly those of
+ * the LRU policy in cache.c, since both count the same per-line accesses.
+ */
+typedef struct stackdist_t {
+    /* The number of reads that occurred at this level of the memory. */
+    uint64_t num_reads;
+
+    /* The number of writes that occurred at this level of the memory. */
+    uint64_t num_writes;
+
+    /* The function to read a byte from the memory. */
+    unsigned char (*read_byte)(membase_t *mb, addr_t address);
+
+    /* The function to write a byte to the memory. */
+    void (*write_byte)(membase_t *mb, addr_t address, unsigned char value);
+
+    /* The function to read size bytes starting at address into buf. */
+    void (*read_block)(membase_t *mb, addr_t address,
+                       unsigned char *buf, uint32_t size);
+
+    /* The function to write size bytes from buf starting at address. */
+    void (*write_block)(membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size);
+
+    /* The function to print the analysis results. */
+    void (*print_stats)(struct membase_t *mb);
+
+    /* The function to reset the analysis results. */
+    void (*reset_stats)(struct membase_t *mb);
+
+    /* The function to release any internally allocated data used by
+     * the analyzer.
+     */
+    void (*free)(membase_t *mb);
+
+    /* The function to return the level behind this one, or NULL for the
+     * memory at the bottom of the hierarchy.
+     */
+    membase_t * (*next_level)(membase_t *mb);
+
+    /* The function to return the cycles that the accesses to this level
+     * have taken so far, counting the levels behind it.
+     */
+    uint64_t (*cycles)(membase_t *mb);
+
+
+    /* The block size being analyzed, which must be a power of 2. */
+    uint32_t block_size;
+    uint32_t block_offset_bits;
+
+    /* The number of set counts analyzed:  1, 2, 4, ..., up to max_sets. */
+    uint32_t num_levels;
+    uint32_t max_sets;
+
+    /* The number of blocks in the memory, and for each one, its number in
+     * the order blocks were first accessed (1-based), or 0 if it hasn't
+     * been accessed yet.
+     */
+    uint32_t num_blocks;
+    uint32_t *block_ids;
+    uint32_t num_ids;
+
+    /* The block accessed most recently, plus 1, or 0 if there isn't one. */
+    uint64_t last_block;
+
+    /* The tree nodes; block id b has node b * num_levels + level in each
+     * level's tree.  Node 0 is unused, so that 0 can mean "no node".
+     */
+    sd_node *nodes;
+    uint32_t nodes_size;
+
+    /* The roots of the trees.  The trees of level l, which has 2^l sets,
+     * start at index 2^l - 1.
+     */
+    uint32_t *roots;
+
+    /* The access clock, and the state of the priority generator. */
+    uint64_t clock;
+    uint32_t rand_state;
+
+    /* For each level, a histogram of the stack distances of accesses that
+     * weren't the first access to their block, and the number that were.
+     */
+    uint64_t **histograms;
+    uint32_t *histogram_sizes;
+    uint64_t *cold_misses;
+
+    /* The number of bytes accessed; every byte counts as one access, so
+     * that the miss rates are computed as they are for a cache.
+     */
+    uint64_t num_bytes;
+
+    /* The memory that this analyzer passes accesses on to. */
+    membase_t *next_memory;
+
+} stackdist_t;
+
+
+/* Initializes a stack-distance analyzer for the specified block size, for
+ * every power-of-2 number of cache sets up to max_sets.  mem_size is the
+ * size of the memory being accessed.
+ */
+void init_stackdist(stackdist_t *p_sd, uint32_t block_size, uint32_t max_sets,
+                    uint32_t mem_size, membase_t *next_mem);
+
+/* Returns the number of misses that an LRU cache with the analyzed block
+ * size, the specified number of sets (a power of 2, at most max_sets) and
+ * the specified number of lines per set would have had.
+ */
+uint64_t stackdist_misses(stackdist_t *p_sd, uint32_t num_sets,
+                          uint32_t lines_per_set);
+
+
+#endif /* STACKDIST_H */
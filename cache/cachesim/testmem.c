@@ -5,14 +5,86 @@
 #include "membase.h"
 #include "memory.h"
 #include "cache.h"
+#include "coherence.h"
+#include "classify.h"
+#include "policy.h"
+#include "prefetch.h"
+#include "stackdist.h"
+#include "tlb.h"
 
 
 #define TESTMEM_SIZE 65536
 #define NUM_WRITES 50000
 
+/* Runs written and read with the block operations are up to this many bytes
+ * long, so that many of them span several cache lines.
+ */
+#define MAX_RUN 200
+
 // #define TESTMEM_SIZE 65536
 // #define NUM_WRITES 100
 
+/* The stack-distance analysis is checked against caches with this block
+ * size, 1 to STACK_MAX_SETS sets, and 1 to STACK_MAX_LINES lines per set.
+ */
+#define STACK_BLOCK_SIZE 32
+#define STACK_MAX_SETS 16
+#define STACK_MAX_LINES 32
+#define STACK_ACCESSES 20000
+
+/* Each replacement policy is checked with a small cache of this geometry,
+ * so that it has to choose victims often.
+ */
+#define POLICY_BLOCK_SIZE 16
+#define POLICY_NUM_SETS 4
+#define POLICY_LINES 8
+#define POLICY_WRITES 20000
+
+/* The coherence check gives each core two levels of private caches in front
+ * of a shared cache.  The private caches are small, and every access falls
+ * in a region a few times their size, so blocks move between the levels and
+ * between the cores often.
+ */
+#define COHERENCE_CORES 4
+#define COHERENCE_BLOCK_SIZE 16
+#define COHERENCE_REGION 2048
+#define COHERENCE_ACCESSES 50000
+
+/* The miss classification is checked with a direct-mapped cache and a fully
+ * associative one, each with this many lines of this block size, and with a
+ * cache of one line.
+ */
+#define CLASSIFY_BLOCK_SIZE 32
+#define CLASSIFY_LINES 64
+#define CLASSIFY_ACCESSES 50000
+
+/* The TLB check uses small pages and two small levels, so that the accesses
+ * miss both levels often.
+ */
+#define TLB_PAGE_SIZE 256
+#define TLB_L1_ENTRIES 8
+#define TLB_L1_WAYS 2
+#define TLB_L2_ENTRIES 32
+#define TLB_L2_WAYS 4
+#define TLB_ACCESSES 50000
+
+/* The latency check uses two levels of caches with these hit latencies,
+ * and a memory with this latency.
+ */
+#define LATENCY_L1 4
+#define LATENCY_L2 12
+#define LATENCY_MEMORY 100
+#define LATENCY_MLP 4
+#define LATENCY_ACCESSES 50000
+
+/* The hierarchy check puts a small cache with a write buffer in front of a
+ * larger one, with victim caches of this many blocks or none, and works
+ * over a region a few times the size of the larger cache.
+ */
+#define HIERARCHY_VICTIMS 4
+#define HIERARCHY_REGION 8192
+#define HIERARCHY_ACCESSES 50000
+
 
 /* Setting this to 1 will cause the program to output the details of
  * each write performed against the cached memory.
@@ -20,17 +92,668 @@
 #define DEBUG_TESTMEM 0
 
 
+/* Replays the same pseudo-random accesses through a stack-distance analysis
+ * and through a separate cache for each geometry it covers, and checks that
+ * the analysis predicts each cache's misses exactly.  Returns the number of
+ * geometries that don't match.
+ */
+int check_stackdist() {
+    stackdist_t sd;
+    memory_t sd_memory;
+    cache_t caches[STACK_MAX_SETS * 2][STACK_MAX_LINES + 1];
+    memory_t memories[STACK_MAX_SETS * 2][STACK_MAX_LINES + 1];
+    unsigned char buf[MAX_RUN];
+    uint32_t num_sets, lines;
+    int i, count;
+
+    init_memory(&sd_memory, TESTMEM_SIZE);
+    init_stackdist(&sd, STACK_BLOCK_SIZE, STACK_MAX_SETS, TESTMEM_SIZE,
+                   (membase_t *) &sd_memory);
+
+    for (num_sets = 1; num_sets <= STACK_MAX_SETS; num_sets *= 2) {
+        for (lines = 1; lines <= STACK_MAX_LINES; lines++) {
+            init_memory(&memories[num_sets][lines], TESTMEM_SIZE);
+            init_cache(&caches[num_sets][lines], STACK_BLOCK_SIZE, num_sets,
+                       lines, (membase_t *) &memories[num_sets][lines]);
+        }
+    }
+
+    /* Accesses mostly stay within a small region, so that the caches get a
+     * mix of hits and misses, but sometimes jump anywhere.
+     */
+    srand(4321);
+    for (i = 0; i < STACK_ACCESSES; i++) {
+        static addr_t region = 0;
+        addr_t addr;
+        uint32_t size = 1 + rand() % 8;
+        int is_write = rand() % 3 == 0;
+
+        if (rand() % 50 == 0)
+            region = rand() % (TESTMEM_SIZE - 4096);
+        addr = region + rand() % 4096;
+
+        if (is_write)
+            write_block((membase_t *) &sd, addr, buf, size);
+        else
+            read_block((membase_t *) &sd, addr, buf, size);
+
+        for (num_sets = 1; num_sets <= STACK_MAX_SETS; num_sets *= 2) {
+            for (lines = 1; lines <= STACK_MAX_LINES; lines++) {
+                membase_t *mb = (membase_t *) &caches[num_sets][lines];
+                if (is_write)
+                    write_block(mb, addr, buf, size);
+                else
+                    read_block(mb, addr, buf, size);
+            }
+        }
+    }
+
+    count = 0;
+    for (num_sets = 1; num_sets <= STACK_MAX_SETS; num_sets *= 2) {
+        for (lines = 1; lines <= STACK_MAX_LINES; lines++) {
+            cache_t *p_cache = &caches[num_sets][lines];
+            uint64_t predicted = stackdist_misses(&sd, num_sets, lines);
+
+            if (predicted != p_cache->num_misses) {
+                count++;
+                printf("Stack distances predict %lu misses for %u sets of "
+                       "%u lines, but the cache had %lu\n", predicted,
+                       num_sets, lines, p_cache->num_misses);
+            }
+
+            p_cache->free((membase_t *) p_cache);
+            memories[num_sets][lines].free(
+                (membase_t *) &memories[num_sets][lines]);
+        }
+    }
+
+    sd.free((membase_t *) &sd);
+    sd_memory.free((membase_t *) &sd_memory);
+
+    return count;
+}
+
+
+/* Performs pseudo-random writes and reads through a small cache with the
+ * specified replacement policy, prefetcher (which may be NULL) and write
+ * policy, and checks the values read, and the memory after the cache is
+ * flushed.  The accesses mostly walk through the memory with a fixed
+ * stride, so that the prefetchers have something to find.  Returns 1 if
+ * anything is wrong, or 0 if everything matches.
+ */
+int check_cache_config(const char *name, const replacement_policy_t *policy,
+                       const prefetcher_t *prefetcher, int write_through,
+                       int write_allocate, uint32_t write_buffer_size) {
+    unsigned char *p_raw = malloc(TESTMEM_SIZE);
+    unsigned char run[MAX_RUN];
+    addr_t write_addr = 0, read_addr = 0;
+    int i, j, stride = 0, result = 0;
+    cache_t cache;
+    memory_t memory;
+
+    init_memory(&memory, TESTMEM_SIZE);
+    init_cache(&cache, POLICY_BLOCK_SIZE, POLICY_NUM_SETS, POLICY_LINES,
+               (membase_t *) &memory);
+    set_replacement_policy(&cache, policy);
+    set_write_policy(&cache, write_through, write_allocate,
+                     write_buffer_size);
+    if (prefetcher != NULL) {
+        set_prefetcher(&cache, prefetcher, prefetcher->default_degree,
+                       TESTMEM_SIZE);
+    }
+    bzero(p_raw, TESTMEM_SIZE);
+
+    srand(1234);
+    for (i = 0; i < POLICY_WRITES; i++) {
+        int size = 1 + rand() % (MAX_RUN / 4);
+
+        if (rand() % 16 == 0) {
+            write_addr = rand() % (TESTMEM_SIZE - MAX_RUN);
+            read_addr = rand() % (TESTMEM_SIZE - MAX_RUN);
+            stride = MAX_RUN / 4 + rand() % MAX_RUN;
+        }
+        write_addr = (write_addr + stride) % (TESTMEM_SIZE - MAX_RUN);
+        read_addr = (read_addr + stride) % (TESTMEM_SIZE - MAX_RUN);
+
+        for (j = 0; j < size; j++)
+            run[j] = rand() % 256;
+
+        memcpy(p_raw + write_addr, run, size);
+        write_block((membase_t *) &cache, write_addr, run, size);
+
+        /* Read some other block back, so that lines also get hit. */
+        read_block((membase_t *) &cache, read_addr, run, size);
+        if (memcmp(run, p_raw + read_addr, size) != 0) {
+            result = 1;
+            printf("The %s cache read the wrong values at address %u.\n",
+                   name, read_addr);
+            break;
+        }
+    }
+
+    flush_cache(&cache);
+    if (memcmp(p_raw, memory.mem, TESTMEM_SIZE) != 0) {
+        result = 1;
+        printf("The %s cache left the wrong values in memory.\n", name);
+    }
+
+    cache.free((membase_t *) &cache);
+    memory.free((membase_t *) &memory);
+    free(p_raw);
+
+    return result;
+}
+
+
+/* Checks a cache with each replacement policy, an LRU cache with each
+ * prefetcher, and LRU caches with each combination of write policies.
+ * Returns the number of configurations that go wrong.
+ */
+int check_policies() {
+    int i, count = 0;
+
+    for (i = 0; replacement_policies[i] != NULL; i++) {
+        count += check_cache_config(replacement_policies[i]->name,
+                                    replacement_policies[i], NULL, 0, 1, 0);
+    }
+
+    for (i = 0; prefetchers[i] != NULL; i++) {
+        count += check_cache_config(prefetchers[i]->name, &lru_policy,
+                                    prefetchers[i], 0, 1, 0);
+    }
+
+    /* Bit 0 selects write-through, bit 1 no-write-allocate, and bit 2 a
+     * write buffer.  The stream buffers are used too, since their copies
+     * of blocks must not go stale as writes reach the next level.
+     */
+    for (i = 1; i < 8; i++) {
+        const prefetcher_t *stream = find_prefetcher("stream");
+        char name[64];
+        sprintf(name, "%s, %s%s", i & 1 ? "write-through" : "write-back",
+                i & 2 ? "no-write-allocate" : "write-allocate",
+                i & 4 ? ", write-buffered" : "");
+        count += check_cache_config(name, &lru_policy, NULL,
+                                    i & 1, !(i & 2), i & 4 ? 4 : 0);
+        count += check_cache_config(name, &lru_policy, stream,
+                                    i & 1, !(i & 2), i & 4 ? 4 : 0);
+    }
+
+    return count;
+}
+
+
+/* Performs pseudo-random writes and reads from several cores, whose private
+ * caches are kept coherent with the specified protocol, and checks that
+ * every core reads the values last written by any core.  Then it flushes
+ * all of the caches, and checks the memory.  Returns 1 if anything is
+ * wrong, or 0 if everything matches.
+ */
+int check_coherence(int protocol) {
+    unsigned char *p_raw = malloc(TESTMEM_SIZE);
+    unsigned char run[MAX_RUN];
+    cache_t l1[COHERENCE_CORES], l2[COHERENCE_CORES], llc;
+    memory_t memory;
+    coherence_bus_t bus;
+    uint64_t invalidations = 0;
+    int i, j, result = 0;
+
+    init_memory(&memory, TESTMEM_SIZE);
+    init_cache(&llc, COHERENCE_BLOCK_SIZE, 32, 4, (membase_t *) &memory);
+    init_coherence_bus(&bus, protocol, COHERENCE_CORES, (membase_t *) &llc);
+    for (i = 0; i < COHERENCE_CORES; i++) {
+        cache_t *levels[2] = { &l1[i], &l2[i] };
+
+        init_cache(&l2[i], COHERENCE_BLOCK_SIZE, 16, 4, (membase_t *) &llc);
+        init_cache(&l1[i], COHERENCE_BLOCK_SIZE, 4, 2, (membase_t *) &l2[i]);
+        attach_core(&bus, i, levels, 2);
+    }
+    bzero(p_raw, TESTMEM_SIZE);
+
+    srand(2468);
+    for (i = 0; i < COHERENCE_ACCESSES; i++) {
+        membase_t *p_core = (membase_t *) &l1[rand() % COHERENCE_CORES];
+        addr_t addr = rand() % COHERENCE_REGION;
+        int size = 1 + rand() % 8;
+
+        if (rand() % 3 == 0) {
+            for (j = 0; j < size; j++)
+                run[j] = rand() % 256;
+
+            memcpy(p_raw + addr, run, size);
+            write_block(p_core, addr, run, size);
+        }
+        else {
+            read_block(p_core, addr, run, size);
+            if (memcmp(run, p_raw + addr, size) != 0) {
+                result = 1;
+                printf("The %s caches read the wrong values at address %u.\n",
+                       protocol_name(protocol), addr);
+                break;
+            }
+        }
+    }
+
+    /* Within a core, the newest copy is nearest the core, so flush that
+     * level first.
+     */
+    for (i = 0; i < COHERENCE_CORES; i++) {
+        flush_cache(&l1[i]);
+        flush_cache(&l2[i]);
+        invalidations += bus.cores[i].num_invalidations;
+    }
+    flush_cache(&llc);
+
+    if (memcmp(p_raw, memory.mem, TESTMEM_SIZE) != 0) {
+        result = 1;
+        printf("The %s caches left the wrong values in memory.\n",
+               protocol_name(protocol));
+    }
+
+    if (invalidations == 0) {
+        result = 1;
+        printf("The %s caches never invalidated a block.\n",
+               protocol_name(protocol));
+    }
+
+    for (i = 0; i < COHERENCE_CORES; i++) {
+        l1[i].free((membase_t *) &l1[i]);
+        l2[i].free((membase_t *) &l2[i]);
+    }
+    llc.free((membase_t *) &llc);
+    memory.free((membase_t *) &memory);
+    free_coherence_bus(&bus);
+    free(p_raw);
+
+    return result;
+}
+
+
+/* Replays the same pseudo-random accesses through a direct-mapped cache and
+ * a fully associative LRU cache with the same number of lines, classifying
+ * the misses of both, with two regions named.  The fully associative cache
+ * behaves exactly like the shadow of both, so it has no conflict misses,
+ * and the direct-mapped cache can only have a capacity miss where it does.
+ * A cache of one line is both, so it has no conflict misses either.
+ * Returns the number of checks that fail.
+ */
+int check_miss_classes() {
+    cache_t caches[3];
+    memory_t memory;
+    unsigned char buf[8];
+    miss_classifier_t *dm, *fa;
+    uint64_t total;
+    int i, c, count = 0;
+
+    init_memory(&memory, TESTMEM_SIZE);
+    init_cache(&caches[0], CLASSIFY_BLOCK_SIZE, CLASSIFY_LINES, 1,
+               (membase_t *) &memory);
+    init_cache(&caches[1], CLASSIFY_BLOCK_SIZE, 1, CLASSIFY_LINES,
+               (membase_t *) &memory);
+    init_cache(&caches[2], CLASSIFY_BLOCK_SIZE, 1, 1, (membase_t *) &memory);
+    for (c = 0; c < 3; c++) {
+        set_miss_classification(&caches[c]);
+        add_miss_region((membase_t *) &caches[c], "low", 0,
+                        TESTMEM_SIZE / 2);
+        add_miss_region((membase_t *) &caches[c], "high", TESTMEM_SIZE / 2,
+                        TESTMEM_SIZE / 2);
+    }
+
+    srand(8642);
+    for (i = 0; i < CLASSIFY_ACCESSES; i++) {
+        static addr_t region = 0;
+        addr_t addr;
+        uint32_t size = 1 + rand() % 8;
+        int is_write = rand() % 3 == 0;
+
+        if (rand() % 100 == 0)
+            region = rand() % (TESTMEM_SIZE - 4096);
+        addr = region + rand() % 4096;
+
+        for (c = 0; c < 3; c++) {
+            if (is_write)
+                write_block((membase_t *) &caches[c], addr, buf, size);
+            else
+                read_block((membase_t *) &caches[c], addr, buf, size);
+        }
+    }
+
+    for (c = 0; c < 3; c++) {
+        miss_classifier_t *mc = caches[c].classifier;
+
+        total = mc->num_misses[MISS_COMPULSORY] +
+                mc->num_misses[MISS_CAPACITY] + mc->num_misses[MISS_CONFLICT];
+        if (total != caches[c].num_misses) {
+            count++;
+            printf("The classes of cache %d's misses add up to %lu, not "
+                   "%lu.\n", c, total, caches[c].num_misses);
+        }
+
+        total = mc->regions[0].num_accesses + mc->regions[1].num_accesses;
+        if (total != caches[c].num_hits + caches[c].num_misses ||
+            mc->other.num_accesses != 0) {
+            count++;
+            printf("The regions of cache %d don't cover its accesses.\n", c);
+        }
+    }
+
+    dm = caches[0].classifier;
+    fa = caches[1].classifier;
+    if (fa->num_misses[MISS_CONFLICT] != 0) {
+        count++;
+        printf("The fully associative cache had %lu conflict misses.\n",
+               fa->num_misses[MISS_CONFLICT]);
+    }
+    if (caches[2].classifier->num_misses[MISS_CONFLICT] != 0) {
+        count++;
+        printf("The one-line cache had %lu conflict misses.\n",
+               caches[2].classifier->num_misses[MISS_CONFLICT]);
+    }
+    if (dm->num_misses[MISS_COMPULSORY] != fa->num_misses[MISS_COMPULSORY] ||
+        dm->num_misses[MISS_CAPACITY] > fa->num_misses[MISS_CAPACITY] ||
+        dm->num_misses[MISS_CONFLICT] == 0) {
+        count++;
+        printf("The direct-mapped cache's misses are misclassified.\n");
+    }
+
+    for (c = 0; c < 3; c++)
+        caches[c].free((membase_t *) &caches[c]);
+    memory.free((membase_t *) &memory);
+
+    return count;
+}
+
+
+/* Replays the same pseudo-random int reads through a two-level TLB and
+ * through two levels of caches with the TLB's geometry, whose blocks are
+ * pages.  A TLB level is an LRU cache of pages, and the second level only
+ * sees the first level's misses, just as the second cache does (with no
+ * writes, no write-backs reach it), so their misses must match.  Then it
+ * checks that values written through the TLB read back unchanged.  Returns
+ * the number of checks that fail.
+ */
+int check_tlb() {
+    tlb_t tlb;
+    cache_t caches[2];
+    memory_t memory, cache_memory;
+    uint32_t i;
+    int count = 0;
+
+    init_memory(&memory, TESTMEM_SIZE);
+    init_tlb(&tlb, TLB_PAGE_SIZE, (membase_t *) &memory);
+    add_tlb_level(&tlb, TLB_L1_ENTRIES, TLB_L1_WAYS);
+    add_tlb_level(&tlb, TLB_L2_ENTRIES, TLB_L2_WAYS);
+
+    init_memory(&cache_memory, TESTMEM_SIZE);
+    init_cache(&caches[1], TLB_PAGE_SIZE, TLB_L2_ENTRIES / TLB_L2_WAYS,
+               TLB_L2_WAYS, (membase_t *) &cache_memory);
+    init_cache(&caches[0], TLB_PAGE_SIZE, TLB_L1_ENTRIES / TLB_L1_WAYS,
+               TLB_L1_WAYS, (membase_t *) &caches[1]);
+
+    srand(9753);
+    for (i = 0; i < TLB_ACCESSES; i++) {
+        static addr_t region = 0;
+        uint32_t index;
+
+        if (rand() % 100 == 0)
+            region = rand() % (TESTMEM_SIZE - 4096);
+        index = (region + rand() % 4096) / 4;
+
+        if (read_int((membase_t *) &tlb, index) != 0)
+            count++;
+        read_int((membase_t *) &caches[0], index);
+    }
+
+    if (count > 0)
+        printf("%d reads through the TLB returned the wrong value.\n", count);
+
+    if (tlb.levels[0].num_lookups != TLB_ACCESSES ||
+        tlb.levels[0].num_misses != caches[0].num_misses ||
+        tlb.levels[1].num_lookups != caches[0].num_misses ||
+        tlb.levels[1].num_misses != caches[1].num_misses ||
+        tlb.num_walks != caches[1].num_misses) {
+        count++;
+        printf("The TLB missed %lu and %lu times, but the caches missed "
+               "%lu and %lu times.\n", tlb.levels[0].num_misses,
+               tlb.levels[1].num_misses, caches[0].num_misses,
+               caches[1].num_misses);
+    }
+
+    for (i = 0; i < TESTMEM_SIZE / 4; i++)
+        write_int((membase_t *) &tlb, i, i * 7919);
+    for (i = 0; i < TESTMEM_SIZE / 4; i++) {
+        if (read_int((membase_t *) &tlb, i) != (int32_t) (i * 7919)) {
+            count++;
+            printf("The TLB changed the value at index %u.\n", i);
+            break;
+        }
+    }
+
+    tlb.free((membase_t *) &tlb);
+    for (i = 0; i < 2; i++)
+        caches[i].free((membase_t *) &caches[i]);
+    memory.free((membase_t *) &memory);
+    cache_memory.free((membase_t *) &cache_memory);
+
+    return count;
+}
+
+
+/* Replays the same pseudo-random int reads through two hierarchies of two
+ * caches and a memory, with latencies, one of them letting the misses of
+ * its first cache overlap.  With only reads, each level's accesses are
+ * exactly the misses of the level above, so each level's cycles must be its
+ * accesses times its hit latency plus the cycles of the level below, and
+ * the overlapping misses can only save cycles.  Returns the number of
+ * checks that fail.
+ */
+int check_latency() {
+    cache_t caches[2][2];
+    memory_t memory[2];
+    uint32_t i;
+    int h, count = 0;
+
+    for (h = 0; h < 2; h++) {
+        init_memory(&memory[h], TESTMEM_SIZE);
+        init_cache(&caches[h][1], 32, 16, 4, (membase_t *) &memory[h]);
+        init_cache(&caches[h][0], 32, 4, 2, (membase_t *) &caches[h][1]);
+        set_cache_latency(&caches[h][1], LATENCY_L2, 0);
+        set_cache_latency(&caches[h][0], LATENCY_L1, h == 0 ? 0 : LATENCY_MLP);
+        set_memory_latency((membase_t *) &caches[h][0], LATENCY_MEMORY);
+    }
+
+    srand(4242);
+    for (i = 0; i < LATENCY_ACCESSES; i++) {
+        uint32_t index = rand() % 4 != 0 ? i % 2048 : rand() % 4096;
+
+        for (h = 0; h < 2; h++)
+            read_int((membase_t *) &caches[h][0], index);
+    }
+
+    for (h = 0; h < 2; h++) {
+        cache_t *l1 = &caches[h][0], *l2 = &caches[h][1];
+
+        if (memory[h].latency != LATENCY_MEMORY ||
+            l2->num_cycles != l2->num_accesses * LATENCY_L2 +
+                              memory[h].num_accesses * LATENCY_MEMORY ||
+            (h == 0 && l1->num_cycles != l1->num_accesses * LATENCY_L1 +
+                                         l2->num_cycles)) {
+            count++;
+            printf("The cycles of hierarchy %d don't add up:  %lu and %lu "
+                   "cycles.\n", h, l1->num_cycles, l2->num_cycles);
+        }
+    }
+
+    if (caches[1][0].num_overlapped_misses == 0 ||
+        caches[1][0].num_cycles >= caches[0][0].num_cycles) {
+        count++;
+        printf("Overlapping misses took %lu cycles, and %lu cycles without "
+               "overlap.\n", caches[1][0].num_cycles,
+               caches[0][0].num_cycles);
+    }
+
+    for (h = 0; h < 2; h++) {
+        caches[h][0].free((membase_t *) &caches[h][0]);
+        caches[h][1].free((membase_t *) &caches[h][1]);
+        memory[h].free((membase_t *) &memory[h]);
+    }
+
+    return count;
+}
+
+
+/* Returns 1 if the blocks held by the first cache of a hierarchy, in its
+ * lines and its victim cache, obey the second cache's inclusion policy:
+ * for an inclusive cache, it must hold all of them, and for an exclusive
+ * one, none of them.  Returns 0 if not.
+ */
+int check_inclusion_invariant(cache_t *l1, cache_t *l2) {
+    addr_t set_no, block_start;
+    uint32_t i;
+    int line_no, held;
+
+    if (l2->inclusion == INCLUSION_NINE)
+        return 1;
+
+    for (set_no = 0; set_no < l1->num_sets; set_no++) {
+        cacheset_t *p_set = l1->cache_sets + set_no;
+
+        for (line_no = 0; line_no < p_set->num_lines; line_no++) {
+            if (!line_is_valid(p_set, p_set->cache_lines + line_no))
+                continue;
+
+            block_start = ((line_tag(p_set, p_set->cache_lines + line_no) <<
+                            l1->sets_addr_bits) + set_no) <<
+                          l1->block_offset_bits;
+            held = holds_block(l2, block_start);
+            if (held != (l2->inclusion == INCLUSION_INCLUSIVE))
+                return 0;
+        }
+    }
+
+    for (i = 0; i < l1->victim_cache_size; i++) {
+        if (!l1->victim_cache[i].valid)
+            continue;
+
+        held = holds_block(l2, l1->victim_cache[i].block_start);
+        if (held != (l2->inclusion == INCLUSION_INCLUSIVE))
+            return 0;
+    }
+
+    return 1;
+}
+
+
+/* Performs pseudo-random writes and reads through two levels of caches,
+ * where the second has the specified inclusion policy, and both have
+ * victim caches if victims is nonzero.  If with_tlb is nonzero, a TLB sits
+ * between the caches, and the policy must still apply through it.  Checks
+ * the values read, that the first cache's blocks obey the policy after
+ * every access, and the memory after both caches are flushed.  The second
+ * cache has larger blocks than the first unless it is exclusive, so that
+ * back-invalidation covers several of the first cache's lines.  Returns 1
+ * if anything is wrong, or 0 if everything matches.
+ */
+int check_hierarchy(int inclusion, int victims, int with_tlb) {
+    unsigned char *p_raw = malloc(TESTMEM_SIZE);
+    unsigned char run[MAX_RUN];
+    cache_t l1, l2;
+    tlb_t tlb;
+    memory_t memory;
+    int i, j, result = 0;
+
+    init_memory(&memory, TESTMEM_SIZE);
+    init_cache(&l2, inclusion == INCLUSION_EXCLUSIVE ? 16 : 32, 16, 4,
+               (membase_t *) &memory);
+    set_inclusion_policy(&l2, inclusion);
+    if (with_tlb) {
+        init_tlb(&tlb, TLB_PAGE_SIZE, (membase_t *) &l2);
+        add_tlb_level(&tlb, TLB_L1_ENTRIES, TLB_L1_WAYS);
+        init_cache(&l1, 16, 4, 2, (membase_t *) &tlb);
+    }
+    else {
+        init_cache(&l1, 16, 4, 2, (membase_t *) &l2);
+    }
+    set_write_policy(&l1, 0, 1, 2);
+    if (victims) {
+        set_victim_cache(&l1, HIERARCHY_VICTIMS);
+        set_victim_cache(&l2, HIERARCHY_VICTIMS);
+    }
+    bzero(p_raw, TESTMEM_SIZE);
+
+    srand(8642);
+    for (i = 0; i < HIERARCHY_ACCESSES && result == 0; i++) {
+        addr_t addr = rand() % (HIERARCHY_REGION - MAX_RUN);
+        int size = 1 + rand() % (MAX_RUN / 4);
+
+        if (rand() % 2 == 0) {
+            for (j = 0; j < size; j++)
+                run[j] = rand() % 256;
+
+            memcpy(p_raw + addr, run, size);
+            write_block((membase_t *) &l1, addr, run, size);
+        }
+        else {
+            read_block((membase_t *) &l1, addr, run, size);
+            if (memcmp(run, p_raw + addr, size) != 0) {
+                result = 1;
+                printf("The %s hierarchy read the wrong values at address "
+                       "%u.\n", inclusion_names[inclusion], addr);
+            }
+        }
+
+        if (!check_inclusion_invariant(&l1, &l2)) {
+            result = 1;
+            printf("The %s hierarchy broke its inclusion policy after "
+                   "%d accesses.\n", inclusion_names[inclusion], i + 1);
+        }
+    }
+
+    if ((inclusion == INCLUSION_INCLUSIVE && l2.num_back_invalidations == 0) ||
+        (inclusion == INCLUSION_EXCLUSIVE && l2.num_victim_fills == 0) ||
+        (victims && l1.num_victim_hits == 0)) {
+        result = 1;
+        printf("The %s hierarchy never used its policy or victim caches.\n",
+               inclusion_names[inclusion]);
+    }
+
+    flush_cache(&l1);
+    flush_cache(&l2);
+    if (memcmp(p_raw, memory.mem, TESTMEM_SIZE) != 0) {
+        result = 1;
+        printf("The %s hierarchy left the wrong values in memory.\n",
+               inclusion_names[inclusion]);
+    }
+
+    l1.free((membase_t *) &l1);
+    if (with_tlb)
+        tlb.free((membase_t *) &tlb);
+    l2.free((membase_t *) &l2);
+    memory.free((membase_t *) &memory);
+    free(p_raw);
+
+    return result;
+}
+
+
 /* This program exercises the memory and the cache implementation by
  * performing a series of writes against a cached memory, then flushing
  * the cache, and then reading the contents of the memory directly to see
- * if the values properly reflect what they ought to be.
+ * if the values properly reflect what they ought to be.  Most writes are
+ * followed by a run of bytes written with write_block(), and the contents
+ * are read back through the cache with read_block() before the flush.
+ * Finally, it checks the stack-distance analysis against real caches, and
+ * checks the cache with each replacement policy, prefetcher and write
+ * policy, checks caches kept coherent with each protocol, checks the
+ * classification of misses, checks the TLB, checks the latency model,
+ * and checks the inclusion policies and victim caches.
  */
 int main() {
     cache_t cache;
     memory_t memory;
     unsigned char *p_raw;
+    unsigned char run[MAX_RUN];
 
-    int i, count;
+    int i, j, count;
 
     p_raw = malloc(TESTMEM_SIZE);
     bzero(p_raw, TESTMEM_SIZE);
@@ -51,11 +774,28 @@ int main() {
 
         p_raw[addr] = value;
         write_byte((membase_t *) &cache, addr, value);
+
+        if (addr + MAX_RUN <= TESTMEM_SIZE) {
+            int size = 1 + rand() % MAX_RUN;
+            for (j = 0; j < size; j++)
+                run[j] = rand() % 256;
+
+            memcpy(p_raw + addr, run, size);
+            write_block((membase_t *) &cache, addr, run, size);
+        }
+    }
+
+    count = 0;
+    for (i = 0; i + MAX_RUN <= TESTMEM_SIZE; i += MAX_RUN) {
+        read_block((membase_t *) &cache, i, run, MAX_RUN);
+        if (memcmp(run, p_raw + i, MAX_RUN) != 0) {
+            count++;
+            printf("Block read at address %d doesn't match.\n", i);
+        }
     }
 
     flush_cache(&cache);
 
-    count = 0;
     for (i = 0; i < TESTMEM_SIZE; i++) {
         if (p_raw[i] != memory.mem[i]) {
             count++;
@@ -71,6 +811,39 @@ int main() {
     memory.free((membase_t *) &memory);
     free(p_raw);
 
+    printf("Checking stack distances.\n");
+    if (check_stackdist() == 0)
+        printf("Stack distances match the caches.\n");
+
+    printf("Checking replacement policies, prefetchers and write policies.\n");
+    if (check_policies() == 0)
+        printf("All cache configurations match the memory.\n");
+
+    printf("Checking coherent caches.\n");
+    if (check_coherence(PROTOCOL_MESI) + check_coherence(PROTOCOL_MOESI) == 0)
+        printf("Coherent caches match the memory.\n");
+
+    printf("Checking miss classification.\n");
+    if (check_miss_classes() == 0)
+        printf("Miss classes match the fully associative cache.\n");
+
+    printf("Checking the TLB.\n");
+    if (check_tlb() == 0)
+        printf("TLB misses match the caches of pages.\n");
+
+    printf("Checking the latency model.\n");
+    if (check_latency() == 0)
+        printf("Cycles add up through the hierarchy.\n");
+
+    printf("Checking inclusion policies and victim caches.\n");
+    count = 0;
+    for (i = INCLUSION_NINE; i <= INCLUSION_EXCLUSIVE; i++) {
+        count += check_hierarchy(i, 0, 0) + check_hierarchy(i, 1, 0) +
+                 check_hierarchy(i, 0, 1);
+    }
+    if (count == 0)
+        printf("Hierarchies match the memory and their policies.\n");
+
     return 0;
 }
 
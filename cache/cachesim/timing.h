@@ -0,0 +1,26 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+
+#include <time.h>
+
+
+/* The number of times the test programs time each native run; the best time
+ * is reported.
+ */
+#define NATIVE_TRIALS 3
+
+
+/* Returns the wall-clock time in seconds.  This is defined here rather than
+ * in a library, so each program that times itself includes this header from
+ * exactly one source file.
+ */
+double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+#endif /* TIMING_H */
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tlb.h"
+
+
+/* Local functions used by the TLB implementation. */
+
+unsigned char tlb_read_byte(membase_t *mb, addr_t address);
+void tlb_write_byte(membase_t *mb, addr_t address, unsigned char value);
+void tlb_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                    uint32_t size);
+void tlb_write_block(membase_t *mb, addr_t address,
+                     const unsigned char *buf, uint32_t size);
+void tlb_print_stats(membase_t *mb);
+void tlb_reset_stats(membase_t *mb);
+void tlb_free(membase_t *mb);
+membase_t * tlb_next_level(membase_t *mb);
+uint64_t tlb_cycles(membase_t *mb);
+
+void translate(tlb_t *p_tlb, addr_t address, uint32_t size);
+int lookup_level(tlb_level_t *p_level, uint32_t page, uint64_t now);
+
+
+/* Initializes a TLB for the specified page size, with no levels. */
+void init_tlb(tlb_t *p_tlb, uint32_t page_size, membase_t *next_mem) {
+    uint32_t offset_bits;
+
+    assert(p_tlb != NULL);
+    assert(next_mem != NULL);
+    assert(is_power_of_2(page_size));
+
+    bzero(p_tlb, sizeof(tlb_t));
+
+    p_tlb->next_memory = next_mem;
+
+    p_tlb->read_byte = tlb_read_byte;
+    p_tlb->write_byte = tlb_write_byte;
+    p_tlb->read_block = tlb_read_block;
+    p_tlb->write_block = tlb_write_block;
+    p_tlb->print_stats = tlb_print_stats;
+    p_tlb->reset_stats = tlb_reset_stats;
+    p_tlb->free = tlb_free;
+    p_tlb->next_level = tlb_next_level;
+    p_tlb->cycles = tlb_cycles;
+
+    p_tlb->page_size = page_size;
+    p_tlb->page_offset_bits = offset_bits = log_2(page_size);
+
+    /* Each table resolves TLB_TABLE_BITS of the page number; the last one
+     * may resolve fewer.
+     */
+    p_tlb->walk_levels = 1;
+    if (offset_bits < TLB_VIRTUAL_ADDRESS_BITS) {
+        p_tlb->walk_levels = (TLB_VIRTUAL_ADDRESS_BITS - offset_bits +
+                              TLB_TABLE_BITS - 1) / TLB_TABLE_BITS;
+    }
+    p_tlb->walk_level_cycles = DEFAULT_PAGE_WALK_CYCLES;
+}
+
+
+void add_tlb_level(tlb_t *p_tlb, uint32_t num_entries, uint32_t ways) {
+    tlb_level_t *p_level;
+
+    assert(p_tlb->num_levels < MAX_TLB_LEVELS);
+    assert(ways > 0 && num_entries % ways == 0);
+    assert(is_power_of_2(num_entries / ways));
+
+    p_level = p_tlb->levels + p_tlb->num_levels;
+    bzero(p_level, sizeof(tlb_level_t));
+
+    p_level->num_entries = num_entries;
+    p_level->ways = ways;
+    p_level->num_sets = num_entries / ways;
+    p_level->pages = calloc(num_entries, sizeof(uint32_t));
+    p_level->last_used = calloc(num_entries, sizeof(uint64_t));
+    if (p_level->pages == NULL || p_level->last_used == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    p_tlb->num_levels++;
+}
+
+
+void set_page_walk_cost(tlb_t *p_tlb, uint32_t walk_level_cycles) {
+    p_tlb->walk_level_cycles = walk_level_cycles;
+}
+
+
+/* The access functions translate each access, and then pass it on to the
+ * next level of the memory unchanged.
+ */
+
+unsigned char tlb_read_byte(membase_t *mb, addr_t address) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+
+    p_tlb->num_reads++;
+    translate(p_tlb, address, 1);
+    return read_byte(p_tlb->next_memory, address);
+}
+
+
+void tlb_write_byte(membase_t *mb, addr_t address, unsigned char value) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+
+    p_tlb->num_writes++;
+    translate(p_tlb, address, 1);
+    write_byte(p_tlb->next_memory, address, value);
+}
+
+
+void tlb_read_block(membase_t *mb, addr_t address, unsigned char *buf,
+                    uint32_t size) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+
+    p_tlb->num_reads += size;
+    translate(p_tlb, address, size);
+    read_block(p_tlb->next_memory, address, buf, size);
+}
+
+
+void tlb_write_block(membase_t *mb, addr_t address,
+                     const unsigned char *buf, uint32_t size) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+
+    p_tlb->num_writes += size;
+    translate(p_tlb, address, size);
+    write_block(p_tlb->next_memory, address, buf, size);
+}
+
+
+/* This function prints the lookups and misses of each level of the TLB,
+ * the page walks and the cycles the cost model charges for them, and then
+ * calls the next level of the memory to print its statistics.
+ */
+void tlb_print_stats(membase_t *mb) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+    uint64_t num_lookups = p_tlb->levels[0].num_lookups;
+    int i;
+
+    printf(" * TLB reads=%ld writes=%ld page-size=%u\n", p_tlb->num_reads,
+           p_tlb->num_writes, p_tlb->page_size);
+
+    for (i = 0; i < p_tlb->num_levels; i++) {
+        tlb_level_t *p_level = p_tlb->levels + i;
+        double miss_rate = 0;
+
+        if (p_level->num_lookups > 0)
+            miss_rate = 100.0 * p_level->num_misses / p_level->num_lookups;
+
+        printf("   L%d TLB entries=%u ways=%u:  lookups=%lu misses=%lu "
+               "miss-rate=%.2f%%\n", i + 1, p_level->num_entries,
+               p_level->ways, p_level->num_lookups, p_level->num_misses,
+               miss_rate);
+    }
+
+    printf("   page walks=%lu of %u levels at %u cycles each;  translation "
+           "cycles=%lu", p_tlb->num_walks, p_tlb->walk_levels,
+           p_tlb->walk_level_cycles, p_tlb->translation_cycles);
+    if (num_lookups > 0) {
+        printf(" (%.2f per lookup)",
+               (double) p_tlb->translation_cycles / num_lookups);
+    }
+    printf("\n");
+
+    p_tlb->next_memory->print_stats(p_tlb->next_memory);
+}
+
+
+/* This function resets the TLB's statistics, and passes the operation on
+ * to the next level of the memory as well.  The TLB keeps its entries, just
+ * as cache_reset_stats() keeps the cache lines.
+ */
+void tlb_reset_stats(membase_t *mb) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+    int i;
+
+    p_tlb->num_reads = 0;
+    p_tlb->num_writes = 0;
+    p_tlb->num_walks = 0;
+    p_tlb->translation_cycles = 0;
+
+    for (i = 0; i < p_tlb->num_levels; i++) {
+        p_tlb->levels[i].num_lookups = 0;
+        p_tlb->levels[i].num_misses = 0;
+    }
+
+    p_tlb->next_memory->reset_stats(p_tlb->next_memory);
+}
+
+
+/* This function frees all heap-allocated memory used by the TLB.  Like
+ * cache_free(), it does *not* pass the call on to the next level.
+ */
+void tlb_free(membase_t *mb) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+    int i;
+
+    for (i = 0; i < p_tlb->num_levels; i++) {
+        free(p_tlb->levels[i].pages);
+        free(p_tlb->levels[i].last_used);
+    }
+}
+
+
+/* Returns the level behind the TLB. */
+membase_t * tlb_next_level(membase_t *mb) {
+    return ((tlb_t *) mb)->next_memory;
+}
+
+
+/* Returns the cycles taken so far by the TLB's translations, plus those of
+ * the accesses it passed on to the level below.
+ */
+uint64_t tlb_cycles(membase_t *mb) {
+    tlb_t *p_tlb = (tlb_t *) mb;
+
+    return p_tlb->translation_cycles + level_cycles(p_tlb->next_memory);
+}
+
+
+/*---------------------------------------------------------------------------
+ * TLB HELPER FUNCTIONS
+ */
+
+
+/* Translates an access of size bytes.  Each page the access touches is
+ * looked up once, like a cache access is split at block boundaries.  A
+ * lookup goes down the levels until one hits, and each level that missed
+ * is filled on the way back.
+ */
+void translate(tlb_t *p_tlb, addr_t address, uint32_t size) {
+    uint32_t page = address >> p_tlb->page_offset_bits;
+    uint32_t num_pages;
+    int i;
+
+    if (size == 0)
+        return;
+
+    num_pages = ((address + size - 1) >> p_tlb->page_offset_bits) - page + 1;
+    for (; num_pages > 0; num_pages--, page++) {
+        uint64_t now = ++p_tlb->clock;
+
+        for (i = 0; i < p_tlb->num_levels; i++) {
+            if (lookup_level(p_tlb->levels + i, page, now))
+                break;
+        }
+
+        if (i == p_tlb->num_levels) {
+            p_tlb->num_walks++;
+            p_tlb->translation_cycles +=
+                p_tlb->walk_levels * p_tlb->walk_level_cycles;
+        }
+        else if (i > 0) {
+            p_tlb->translation_cycles += TLB_L2_HIT_CYCLES;
+        }
+    }
+}
+
+
+/* Looks up a page in one level of the TLB, making its entry the most
+ * recently used.  On a miss, the page replaces the set's least recently
+ * used entry, or an empty one.  Returns nonzero on a hit.
+ */
+int lookup_level(tlb_level_t *p_level, uint32_t page, uint64_t now) {
+    uint32_t first = (page & (p_level->num_sets - 1)) * p_level->ways;
+    uint32_t victim = first;
+    uint32_t i;
+
+    p_level->num_lookups++;
+
+    for (i = first; i < first + p_level->ways; i++) {
+        if (p_level->pages[i] == page + 1) {
+            p_level->last_used[i] = now;
+            return 1;
+        }
+        if (p_level->last_used[i] < p_level->last_used[victim])
+            victim = i;
+    }
+
+    p_level->num_misses++;
+    p_level->pages[victim] = page + 1;
+    p_level->last_used[victim] = now;
+    return 0;
+}
@@ -0,0 +1,143 @@
+#ifndef TLB_H
+#define TLB_H
+
+
+#include "membase.h"
+
+
+/* The most levels a TLB can have. */
+#define MAX_TLB_LEVELS 2
+
+/* The page-walk cost model assumes a radix page table like x86-64's:  a
+ * virtual address of this many bits, translated by tables that each
+ * resolve this many bits.  A page size with more offset bits skips tables,
+ * so 4 KiB pages take 4 levels and 2 MiB pages take 3.
+ */
+#define TLB_VIRTUAL_ADDRESS_BITS 48
+#define TLB_TABLE_BITS 9
+
+/* The cycles a lookup costs when it misses the first level of the TLB and
+ * hits the second.
+ */
+#define TLB_L2_HIT_CYCLES 7
+
+/* The cycles each level of a page walk costs, if the specification doesn't
+ * say.
+ */
+#define DEFAULT_PAGE_WALK_CYCLES 20
+
+
+/* One level of a TLB:  a set-associative cache of page translations, with
+ * LRU replacement.
+ */
+typedef struct tlb_level_t {
+    uint32_t num_entries;
+    uint32_t ways;
+    uint32_t num_sets;
+
+    /* For each entry, the page it translates plus 1 (or 0 if the entry is
+     * empty), and the time it was last used.  The entries of set s are at
+     * s * ways to s * ways + ways - 1.
+     */
+    uint32_t *pages;
+    uint64_t *last_used;
+
+    uint64_t num_lookups;
+    uint64_t num_misses;
+} tlb_level_t;
+
+
+/* This struct holds the state for a TLB.  Like the stack-distance analysis,
+ * it sits in the memory hierarchy in front of the caches, and passes every
+ * access straight through to the next memory:  the simulated addresses are
+ * used as both virtual and physical addresses.  Along the way, it looks up
+ * the page of each access in its levels, in order, filling every level that
+ * missed, and charges the lookups that miss them all a page walk.  The page
+ * tables aren't simulated; a walk just costs a fixed number of cycles per
+ * table.
+ */
+typedef struct tlb_t {
+    /* The number of reads that occurred at this level of the memory. */
+    uint64_t num_reads;
+
+    /* The number of writes that occurred at this level of the memory. */
+    uint64_t num_writes;
+
+    /* The function to read a byte from the memory. */
+    unsigned char (*read_byte)(membase_t *mb, addr_t address);
+
+    /* The function to write a byte to the memory. */
+    void (*write_byte)(membase_t *mb, addr_t address, unsigned char value);
+
+    /* The function to read size bytes starting at address into buf. */
+    void (*read_block)(membase_t *mb, addr_t address,
+                       unsigned char *buf, uint32_t size);
+
+    /* The function to write size bytes from buf starting at address. */
+    void (*write_block)(membase_t *mb, addr_t address,
+                        const unsigned char *buf, uint32_t size);
+
+    /* The function to print the TLB's statistics. */
+    void (*print_stats)(struct membase_t *mb);
+
+    /* The function to reset the TLB's statistics. */
+    void (*reset_stats)(struct membase_t *mb);
+
+    /* The function to release any internally allocated data used by
+     * the TLB.
+     */
+    void (*free)(membase_t *mb);
+
+    /* The function to return the level behind this one, or NULL for the
+     * memory at the bottom of the hierarchy.
+     */
+    membase_t * (*next_level)(membase_t *mb);
+
+    /* The function to return the cycles that the accesses to this level
+     * have taken so far, counting the levels behind it.
+     */
+    uint64_t (*cycles)(membase_t *mb);
+
+
+    /* The page size, which must be a power of 2. */
+    uint32_t page_size;
+    uint32_t page_offset_bits;
+
+    tlb_level_t levels[MAX_TLB_LEVELS];
+    int num_levels;
+
+    /* The access clock, for the LRU replacement. */
+    uint64_t clock;
+
+    /* The page-walk cost model:  the number of tables a walk reads, and
+     * the cycles each one costs.
+     */
+    uint32_t walk_levels;
+    uint32_t walk_level_cycles;
+
+    /* The number of page walks, and the cycles spent on the lookups that
+     * missed the first level.
+     */
+    uint64_t num_walks;
+    uint64_t translation_cycles;
+
+    /* The memory that this TLB passes accesses on to. */
+    membase_t *next_memory;
+
+} tlb_t;
+
+
+/* Initializes a TLB for the specified page size, with no levels. */
+void init_tlb(tlb_t *p_tlb, uint32_t page_size, membase_t *next_mem);
+
+/* Adds a level with the specified number of entries and ways, which must
+ * divide the entries into a power-of-2 number of sets, after the levels
+ * the TLB already has.
+ */
+void add_tlb_level(tlb_t *p_tlb, uint32_t num_entries, uint32_t ways);
+
+/* Sets the cycles each level of a page walk costs. */
+void set_page_walk_cost(tlb_t *p_tlb, uint32_t walk_level_cycles);
+
+
+#endif /* TLB_H */
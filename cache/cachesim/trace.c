@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "trace.h"
+
+
+/* Local functions used by the trace implementation. */
+
+int write_varint(FILE *fp, uint64_t value);
+int read_varint(FILE *fp, uint64_t *value);
+
+
+/* Writes an unsigned LEB128 varint:  seven bits per byte, least significant
+ * group first, with the high bit set on every byte but the last.
+ */
+int write_varint(FILE *fp, uint64_t value) {
+    while (value >= 0x80) {
+        if (putc((value & 0x7F) | 0x80, fp) == EOF)
+            return -1;
+        value >>= 7;
+    }
+    return putc(value, fp) == EOF ? -1 : 0;
+}
+
+
+/* Reads an unsigned LEB128 varint.  Returns 1 if a value was read, 0 if the
+ * stream was already at its end, or -1 if it ended in the middle of the
+ * varint or the varint is too long.
+ */
+int read_varint(FILE *fp, uint64_t *value) {
+    uint64_t result = 0;
+    int shift = 0;
+    int c;
+
+    c = getc(fp);
+    if (c == EOF)
+        return 0;
+
+    while (c & 0x80) {
+        result |= (uint64_t) (c & 0x7F) << shift;
+        shift += 7;
+        if (shift > 63)
+            return -1;
+
+        c = getc(fp);
+        if (c == EOF)
+            return -1;
+    }
+
+    *value = result | (uint64_t) c << shift;
+    return 1;
+}
+
+
+/* Opens a trace for reading, and reads its header. */
+int trace_open(trace_file *tf, const char *path) {
+    bzero(tf, sizeof(trace_file));
+
+    if (strcmp(path, "-") == 0) {
+        tf->fp = stdin;
+    }
+    else {
+        tf->fp = fopen(path, "rb");
+        if (tf->fp == NULL) {
+            perror(path);
+            return -1;
+        }
+    }
+
+    if (fread(&tf->header, sizeof(trace_header), 1, tf->fp) != 1 ||
+        tf->header.magic != TRACE_MAGIC ||
+        tf->header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a memory-access trace\n", path);
+        if (tf->fp != stdin)
+            fclose(tf->fp);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Creates a trace for writing, and writes a provisional header. */
+int trace_create(trace_file *tf, const char *path) {
+    bzero(tf, sizeof(trace_file));
+    tf->writing = 1;
+
+    if (strcmp(path, "-") == 0) {
+        tf->fp = stdout;
+    }
+    else {
+        tf->fp = fopen(path, "wb");
+        if (tf->fp == NULL) {
+            perror(path);
+            return -1;
+        }
+    }
+
+    tf->header.magic = TRACE_MAGIC;
+    tf->header.version = TRACE_VERSION;
+
+    if (fwrite(&tf->header, sizeof(trace_header), 1, tf->fp) != 1) {
+        perror(path);
+        if (tf->fp != stdout)
+            fclose(tf->fp);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Reads the next access from a trace. */
+int trace_read(trace_file *tf, trace_access *access) {
+    uint64_t v, size;
+    int64_t delta;
+    int result;
+
+    assert(!tf->writing);
+
+    result = read_varint(tf->fp, &v);
+    if (result <= 0)
+        return result;
+
+    /* Undo the zigzag encoding of the delta. */
+    delta = (int64_t) (v >> 5) ^ -(int64_t) ((v >> 4) & 1);
+
+    if (((v >> 1) & 7) == TRACE_SIZE_EXPLICIT) {
+        if (read_varint(tf->fp, &size) != 1 || size > UINT32_MAX)
+            return -1;
+    }
+    else {
+        size = 1 << ((v >> 1) & 7);
+    }
+
+    access->address = tf->next_address + delta;
+    access->size = size;
+    access->is_write = v & 1;
+
+    tf->next_address = access->address + access->size;
+    tf->num_records++;
+    return 1;
+}
+
+
+/* Appends an access to a trace. */
+int trace_write(trace_file *tf, const trace_access *access) {
+    int64_t delta = (int64_t) access->address - (int64_t) tf->next_address;
+    uint64_t zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+    uint32_t size_code;
+
+    assert(tf->writing);
+
+    /* Sizes 1, 2, 4, ..., 64 are encoded in the record itself. */
+    if (access->size > 0 && access->size <= 64 &&
+        is_power_of_2(access->size))
+        size_code = log_2(access->size);
+    else
+        size_code = TRACE_SIZE_EXPLICIT;
+
+    if (write_varint(tf->fp, zigzag << 4 | size_code << 1 |
+                             (access->is_write != 0)) != 0)
+        return -1;
+
+    if (size_code == TRACE_SIZE_EXPLICIT &&
+        write_varint(tf->fp, access->size) != 0)
+        return -1;
+
+    tf->next_address = access->address + access->size;
+    tf->num_records++;
+    return 0;
+}
+
+
+/* Closes a trace.  A trace being written to a regular file gets its header
+ * rewritten with the final record count and memory size.
+ */
+int trace_close(trace_file *tf) {
+    int result = 0;
+
+    if (tf->writing) {
+        tf->header.num_records = tf->num_records;
+
+        if (fflush(tf->fp) != 0)
+            result = -1;
+        else if (fseek(tf->fp, 0, SEEK_SET) == 0 &&
+                 (fwrite(&tf->header, sizeof(trace_header), 1, tf->fp) != 1 ||
+                  fflush(tf->fp) != 0))
+            result = -1;
+    }
+
+    if (tf->fp != stdin && tf->fp != stdout && fclose(tf->fp) != 0)
+        result = -1;
+
+    tf->fp = NULL;
+    return result;
+}
@@ -0,0 +1,110 @@
+/* This file declares a compact binary format for memory-access traces, which
+ * the cachesim program replays through a simulated cache hierarchy.
+ *
+ * A trace is a header (trace_header) followed by one variable-length record
+ * per access.  Each record starts with an unsigned LEB128 varint holding
+ *
+ *     (zigzag(delta) << 4) | (size_code << 1) | is_write
+ *
+ * where delta is the difference between the access's address and the end of
+ * the previous access (so a sequential scan encodes as delta 0), and
+ * size_code is log2 of the access size for sizes 1 through 64.  A size_code
+ * of 7 means the size is not one of those, and follows as a second varint.
+ * Most records are therefore one or two bytes long.
+ *
+ * Traces are read and written strictly in order through stdio, so they can
+ * be arbitrarily long and can be piped between programs; the path "-" means
+ * standard input or standard output.  All header fields are in the host's
+ * byte order.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+
+#include <stdio.h>
+
+#include "membase.h"
+
+
+/* "CTR1" in little-endian order; identifies a trace file. */
+#define TRACE_MAGIC 0x31525443
+
+#define TRACE_VERSION 1
+
+/* The size_code that means the size follows as a separate varint. */
+#define TRACE_SIZE_EXPLICIT 7
+
+
+/* The header at the start of a trace. */
+typedef struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+
+    /* The number of bytes of memory the traced addresses fall within, or 0
+     * if the recorder didn't know.  cachesim uses it as the memory size.
+     */
+    uint32_t mem_size;
+    uint32_t reserved;
+
+    /* The number of records, or 0 if the recorder didn't know. */
+    uint64_t num_records;
+} trace_header;
+
+
+/* One memory access in a trace. */
+typedef struct trace_access {
+    addr_t address;
+    uint32_t size;
+    int is_write;
+} trace_access;
+
+
+/* An open trace, being either read or written. */
+typedef struct trace_file {
+    FILE *fp;
+
+    /* Nonzero if the trace was opened with trace_create(). */
+    int writing;
+
+    /* The header read from the trace, or to be written to it.  A recorder
+     * may set header.mem_size any time before trace_close().
+     */
+    trace_header header;
+
+    /* The address just past the end of the previous access, which is what
+     * each record's delta is relative to.
+     */
+    addr_t next_address;
+
+    /* The number of records read or written so far. */
+    uint64_t num_records;
+} trace_file;
+
+
+/* Opens a trace for reading, and reads its header.  Returns 0 on success, or
+ * -1 if the trace can't be opened or doesn't start with a valid header.
+ */
+int trace_open(trace_file *tf, const char *path);
+
+/* Creates a trace for writing, and writes a provisional header.  Returns 0
+ * on success, or -1 if the file can't be created.
+ */
+int trace_create(trace_file *tf, const char *path);
+
+/* Reads the next access from a trace.  Returns 1 if an access was read, 0 at
+ * the end of the trace, or -1 if the trace is truncated or corrupt.
+ */
+int trace_read(trace_file *tf, trace_access *access);
+
+/* Appends an access to a trace.  Returns 0 on success, or -1 on error. */
+int trace_write(trace_file *tf, const trace_access *access);
+
+/* Closes a trace.  When writing to a regular file, the header is rewritten
+ * with the final record count and memory size; on a pipe, the provisional
+ * header stays.  Returns 0 on success, or -1 on error.
+ */
+int trace_close(trace_file *tf);
+
+
+#endif /* TRACE_H */
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+
+#define TRACE_PATH "tracetest.trace"
+
+#define NUM_ACCESSES 1000000
+
+/* The memory size recorded in the trace's header. */
+#define TRACE_MEM_SIZE (1 << 24)
+
+
+/* Setting this to 1 will cause the program to output every access that is
+ * read back from the trace.
+ */
+#define DEBUG_TRACETEST 0
+
+
+/* Generates the access after prev in the test trace.  Most accesses are
+ * small and near the previous one, like real traces, but some jump across the whole
+ * address space, and some have sizes that need the explicit size encoding.
+ */
+void make_access(trace_access *access, const trace_access *prev) {
+    int r = rand() % 100;
+
+    if (r < 60)
+        access->address = prev->address + prev->size;
+    else if (r < 90)
+        access->address = prev->address + rand() % 1024 - 512;
+    else
+        access->address = (addr_t) rand() * 2654435761U;
+
+    r = rand() % 100;
+    if (r < 70)
+        access->size = 1 << rand() % 4;
+    else if (r < 95)
+        access->size = 1 << rand() % 7;
+    else
+        access->size = 1 + rand() % 100000;
+
+    access->is_write = (rand() % 4 == 0);
+}
+
+
+/* The last access of the test trace.  Its size needs the explicit encoding,
+ * so the trace ends with a varint that follows another one; chopping off the
+ * final byte leaves the last record incomplete.
+ */
+trace_access last_access = { 0, 3, 1 };
+
+
+/* This program writes a trace of pseudo-random accesses, reads it back to
+ * check that every access survives the round trip, and then checks that a
+ * truncated copy of the trace is reported as corrupt rather than read as
+ * valid.
+ */
+int main() {
+    trace_access expected, actual, prev;
+    trace_file tf;
+    long file_size;
+    int i, result, count;
+
+    printf("Writing a trace of %d accesses.\n", NUM_ACCESSES);
+
+    if (trace_create(&tf, TRACE_PATH) != 0)
+        exit(1);
+
+    srand(12345);
+    bzero(&prev, sizeof(prev));
+    for (i = 0; i < NUM_ACCESSES; i++) {
+        make_access(&expected, &prev);
+        if (trace_write(&tf, &expected) != 0) {
+            printf("Couldn't write the trace.\n");
+            exit(1);
+        }
+        prev = expected;
+    }
+
+    if (trace_write(&tf, &last_access) != 0) {
+        printf("Couldn't write the trace.\n");
+        exit(1);
+    }
+
+    tf.header.mem_size = TRACE_MEM_SIZE;
+    if (trace_close(&tf) != 0) {
+        printf("Couldn't write the trace.\n");
+        exit(1);
+    }
+
+    printf("Reading the trace back.\n");
+
+    if (trace_open(&tf, TRACE_PATH) != 0)
+        exit(1);
+
+    count = 0;
+    if (tf.header.num_records != NUM_ACCESSES + 1 ||
+        tf.header.mem_size != TRACE_MEM_SIZE) {
+        count++;
+        printf("Header has %lu records and memory size %u, not %d and %d.\n",
+               tf.header.num_records, tf.header.mem_size, NUM_ACCESSES + 1,
+               TRACE_MEM_SIZE);
+    }
+
+    srand(12345);
+    bzero(&prev, sizeof(prev));
+    for (i = 0; i < NUM_ACCESSES; i++) {
+        make_access(&expected, &prev);
+        prev = expected;
+
+        if (trace_read(&tf, &actual) != 1) {
+            count++;
+            printf("Trace ended early, after %d accesses.\n", i);
+            break;
+        }
+
+#if DEBUG_TRACETEST
+        printf("%c %u,%u\n", actual.is_write ? 'W' : 'R', actual.address,
+               actual.size);
+#endif
+
+        if (actual.address != expected.address ||
+            actual.size != expected.size ||
+            actual.is_write != expected.is_write) {
+            count++;
+            printf("Access %d doesn't match:  read %c %u,%u, expected "
+                   "%c %u,%u\n", i, actual.is_write ? 'W' : 'R',
+                   actual.address, actual.size, expected.is_write ? 'W' : 'R',
+                   expected.address, expected.size);
+        }
+    }
+
+    if (i == NUM_ACCESSES &&
+        (trace_read(&tf, &actual) != 1 ||
+         memcmp(&actual, &last_access, sizeof(trace_access)) != 0)) {
+        count++;
+        printf("Last access doesn't match.\n");
+    }
+
+    if (i == NUM_ACCESSES && trace_read(&tf, &actual) != 0) {
+        count++;
+        printf("Trace has extra data at the end.\n");
+    }
+
+    file_size = ftell(tf.fp);
+    trace_close(&tf);
+    printf("Trace is %ld bytes, %.2f bytes per access.\n", file_size,
+           (double) (file_size - sizeof(trace_header)) / NUM_ACCESSES);
+
+    /* Chop off the last byte, in the middle of the last record; that must
+     * be reported as an error, not as the end of the trace.
+     */
+    if (truncate(TRACE_PATH, file_size - 1) != 0) {
+        perror(TRACE_PATH);
+        exit(1);
+    }
+
+    if (trace_open(&tf, TRACE_PATH) != 0)
+        exit(1);
+
+    while ((result = trace_read(&tf, &actual)) == 1);
+    trace_close(&tf);
+
+    if (result != -1) {
+        count++;
+        printf("Truncated trace wasn't reported as corrupt.\n");
+    }
+
+    if (count == 0)
+        printf("Traces are identical.\n");
+
+    remove(TRACE_PATH);
+
+    return 0;
+}
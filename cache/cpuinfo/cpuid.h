@@ -16,6 +16,7 @@ unsigned int cpuid_0(char *vendor_string, unsigned int *max_ext_value);
 
 void cpuid_4(unsigned int ecx, regs_t *regs);
 void cpuid_n(unsigned int eax, regs_t *regs);
+void cpuid_nc(unsigned int eax, unsigned int ecx, regs_t *regs);
 
 unsigned int num_cores_in_package(void);
 
@@ -54,6 +55,49 @@ typedef struct cpuid_1_info {
 
 void cpuid_1(cpuid_1_info *info);
 
+/* The types of caches that CPUID reports. */
+#define CACHE_TYPE_NONE 0
+#define CACHE_TYPE_DATA 1
+#define CACHE_TYPE_INSTRUCTION 2
+#define CACHE_TYPE_UNIFIED 3
+
+/* The most caches that get_caches() reports. */
+#define MAX_CACHES 16
+
+typedef struct cache_info {
+
+    unsigned int type;
+
+    unsigned int level;
+
+    unsigned int line_size;
+
+    unsigned int partitions;
+
+    unsigned int ways;
+
+    unsigned int sets;
+
+    unsigned int size;
+
+    /* The number of logical processors that share the cache. */
+    unsigned int sharing_ids;
+
+    /* The number of logical processor IDs in the package. */
+    unsigned int package_ids;
+
+} cache_info;
+
+
+const char * get_cache_type_name(unsigned int type);
+
+/* Stores a description of each of the CPU's caches in caches, in the order
+ * that CPUID reports them (by level, with the L1 data cache before the L1
+ * instruction cache), up to max_caches of them.  Returns the number of
+ * caches, or 0 if the CPU can't report them.
+ */
+int get_caches(cache_info *caches, int max_caches);
+
 void enumerate_caches(void);
 
 #endif /* CPUID_H */
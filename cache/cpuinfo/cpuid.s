@@ -110,3 +110,34 @@ cpuid_n:
     popq %rbx
     ret
 
+
+#=============================================================================
+# void cpuid_nc(unsigned int eax, unsigned int ecx, regs_t *regs)
+#
+#     Invokes the CPUID instruction with the specified values of %eax and
+#     %ecx, for the leaves that take a subleaf, and stores the results into
+#     regs.
+#
+.globl _cpuid_nc
+.globl cpuid_nc
+_cpuid_nc:
+cpuid_nc:
+    pushq %rbx
+
+    # CPUID overwrites %rdx, so keep the target location in %r8
+    movq  %rdx, %r8
+
+    # Invoke CPUID with the specified values for %eax and %ecx
+    movl  %edi, %eax
+    movl  %esi, %ecx
+    cpuid
+
+    # Store the results into the target location
+    movl %eax,   (%r8)
+    movl %ebx,  4(%r8)
+    movl %ecx,  8(%r8)
+    movl %edx, 12(%r8)
+
+    popq %rbx
+    ret
+
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "cpuid.h"
 
@@ -85,40 +86,80 @@ static const char * CACHE_TYPES[] = {
 };
 
 
-void enumerate_caches(void) {
-    unsigned int index;
+const char * get_cache_type_name(unsigned int type) {
+    if (type > CACHE_TYPE_UNIFIED)
+        return "unknown";
+
+    return CACHE_TYPES[type];
+}
+
+
+/* Intel CPUs describe their caches with CPUID leaf 4.  AMD CPUs with the
+ * topology extensions describe them with leaf 0x8000001D instead, in the
+ * same format.
+ */
+int get_caches(cache_info *caches, int max_caches) {
+    unsigned int max_cpuid, max_ext_cpuid, leaf, index;
+    char vendor_string[13];
     regs_t regs;
 
-    unsigned int cache_type, cache_level;
-    unsigned int cache_proc_ids, package_proc_ids;
-    unsigned int line_size, partitions, ways_assoc, n_sets;
+    max_cpuid = cpuid_0(vendor_string, &max_ext_cpuid);
+    if (strcmp(vendor_string, "AuthenticAMD") == 0) {
+        if (max_ext_cpuid < 0x8000001D)
+            return 0;
+        leaf = 0x8000001D;
+    }
+    else {
+        if (max_cpuid < 4)
+            return 0;
+        leaf = 4;
+    }
 
     index = 0;
-    while (1) {
-        cpuid_4(index, &regs);
+    while (index < max_caches) {
+        cache_info *p_info = caches + index;
+
+        cpuid_nc(leaf, index, &regs);
 
-        cache_type = regs.eax & 0x1F;
-        if (cache_type == 0)
+        p_info->type = regs.eax & 0x1F;
+        if (p_info->type == CACHE_TYPE_NONE)
             break;
 
-        cache_level = (regs.eax >> 5) & 0x07;
+        p_info->level = (regs.eax >> 5) & 0x07;
 
-        cache_proc_ids = 1 + ((regs.eax >> 14) & 0x0FFF);
-        package_proc_ids = 1 + ((regs.eax >> 26) & 0x3F);
+        p_info->sharing_ids = 1 + ((regs.eax >> 14) & 0x0FFF);
+        p_info->package_ids = 1 + ((regs.eax >> 26) & 0x3F);
 
-        line_size = 1 + (regs.ebx & 0x0FFF);
-        partitions = 1 + ((regs.ebx >> 12) & 0x3FF);
-        ways_assoc = 1 + ((regs.ebx >> 22) & 0x3FF);
-        n_sets = 1 + regs.ecx;
+        p_info->line_size = 1 + (regs.ebx & 0x0FFF);
+        p_info->partitions = 1 + ((regs.ebx >> 12) & 0x3FF);
+        p_info->ways = 1 + ((regs.ebx >> 22) & 0x3FF);
+        p_info->sets = 1 + regs.ecx;
+        p_info->size = p_info->line_size * p_info->partitions *
+                       p_info->ways * p_info->sets;
+
+        index++;
+    }
+
+    return index;
+}
+
+
+void enumerate_caches(void) {
+    cache_info caches[MAX_CACHES];
+    int num_caches, i;
+
+    num_caches = get_caches(caches, MAX_CACHES);
+    for (i = 0; i < num_caches; i++) {
+        cache_info *p_info = caches + i;
 
         printf("Cache index %u:  type %u (%s), level %u, procIDs %u, "
-            "totIDs %u\n", index, cache_type, CACHE_TYPES[cache_type],
-            cache_level, cache_proc_ids, package_proc_ids);
+            "totIDs %u\n", i, p_info->type,
+            get_cache_type_name(p_info->type), p_info->level,
+            p_info->sharing_ids, p_info->package_ids);
         printf("    Block size %uB, partitions %u, associativity %u, sets %u\n",
-            line_size, partitions, ways_assoc, n_sets);
-        printf("    Cache size:  %u bytes\n", line_size * ways_assoc * n_sets);
-
-        index++;
+            p_info->line_size, p_info->partitions, p_info->ways,
+            p_info->sets);
+        printf("    Cache size:  %u bytes\n", p_info->size);
     }
 }
 
@@ -0,0 +1,399 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mm_file.h"
+
+
+/*============================================================================
+ * HELPER FUNCTION DECLARATIONS
+ *============================================================================*/
+
+int compare_file_values(const void *v1, const void *v2);
+void file_iter_push_path(mm_file_iter *it, int index);
+int check_file_nodes(const mm_file_header *header,
+                     const mm_file_node *nodes);
+
+
+/*============================================================================
+ * FUNCTION IMPLEMENTATIONS
+ *============================================================================*/
+
+/* Comparison function for sorting each key's values with qsort(). */
+int compare_file_values(const void *v1, const void *v2) {
+    int i1 = *(const int *) v1;
+    int i2 = *(const int *) v2;
+
+    return (i1 > i2) - (i1 < i2);
+}
+
+
+/* Writes a multimap to a file.  The node array is written first, in one pass
+ * over the nodes, and then the values in a second pass, so nothing but one
+ * key's values ever has to be copied.
+ */
+int mm_file_save(const char *path, int num_nodes, mm_file_node_fn node_fn,
+                 void *ctx) {
+    mm_file_header header;
+    mm_file_node fnode;
+    const int *values;
+    int *sorted = NULL;
+    int sorted_size = 0;
+    int i, key, left, right, num_values;
+    FILE *fp;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    bzero(&header, sizeof(header));
+    header.magic = MM_FILE_MAGIC;
+    header.version = MM_FILE_VERSION;
+    header.num_nodes = num_nodes;
+    header.nodes_offset = sizeof(mm_file_header);
+    header.values_offset =
+        header.nodes_offset + (uint64_t) num_nodes * sizeof(mm_file_node);
+
+    /* The header is rewritten once the number of values is known. */
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+        goto write_error;
+
+    bzero(&fnode, sizeof(fnode));
+    for (i = 0; i < num_nodes; i++) {
+        node_fn(ctx, i, &key, &left, &right, &values, &num_values);
+
+        fnode.key = key;
+        fnode.left_child = left;
+        fnode.right_child = right;
+        fnode.num_values = num_values;
+        fnode.first_value = header.num_values;
+        header.num_values += num_values;
+
+        if (fwrite(&fnode, sizeof(fnode), 1, fp) != 1)
+            goto write_error;
+    }
+
+    for (i = 0; i < num_nodes; i++) {
+        node_fn(ctx, i, &key, &left, &right, &values, &num_values);
+        if (num_values == 0)
+            continue;
+
+        if (num_values > sorted_size) {
+            sorted_size = num_values;
+            sorted = realloc(sorted, sorted_size * sizeof(int));
+            if (sorted == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+        memcpy(sorted, values, num_values * sizeof(int));
+        qsort(sorted, num_values, sizeof(int), compare_file_values);
+
+        if (fwrite(sorted, sizeof(int), num_values, fp) != num_values)
+            goto write_error;
+    }
+    free(sorted);
+    sorted = NULL;
+
+    if (fseek(fp, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, fp) != 1)
+        goto write_error;
+
+    if (fclose(fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+
+write_error:
+    perror(path);
+    free(sorted);
+    fclose(fp);
+    return -1;
+}
+
+
+/* Returns nonzero if every node's children are valid node indexes (or 0 for
+ * no child), and every node's values lie within the value array.  Probes
+ * trust both, so a corrupt file must be rejected before it is searched.
+ */
+int check_file_nodes(const mm_file_header *header,
+                     const mm_file_node *nodes) {
+    uint32_t i;
+
+    for (i = 0; i < header->num_nodes; i++) {
+        const mm_file_node *node = nodes + i;
+
+        if (node->left_child < 0 ||
+            (uint32_t) node->left_child >= header->num_nodes ||
+            node->right_child < 0 ||
+            (uint32_t) node->right_child >= header->num_nodes ||
+            node->num_values < 0 ||
+            node->first_value > header->num_values ||
+            node->num_values > header->num_values - node->first_value)
+            return 0;
+    }
+
+    return 1;
+}
+
+
+/* Maps a saved multimap into memory.  Besides checking that the header is
+ * consistent with the size of the file, this reads every node once to
+ * check its child indexes and value range; the values are paged in by the
+ * kernel as probes touch them.
+ */
+int mm_file_open(const char *path, mm_mapped *mapped) {
+    const mm_file_header *header;
+    struct stat st;
+    uint64_t end;
+    void *base;
+    int fd;
+
+    bzero(mapped, sizeof(mm_mapped));
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size < (off_t) sizeof(mm_file_header)) {
+        fprintf(stderr, "%s: not a saved multimap\n", path);
+        close(fd);
+        return -1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+
+    /* The header is checked against the size of the file before the nodes
+     * are read, so that they are known to lie within the mapping.
+     */
+    header = (const mm_file_header *) base;
+    end = header->values_offset + header->num_values * sizeof(int32_t);
+    if (header->magic != MM_FILE_MAGIC ||
+        header->version != MM_FILE_VERSION ||
+        header->nodes_offset != sizeof(mm_file_header) ||
+        header->values_offset != header->nodes_offset +
+            (uint64_t) header->num_nodes * sizeof(mm_file_node) ||
+        header->num_values > (uint64_t) st.st_size / sizeof(int32_t) ||
+        end != (uint64_t) st.st_size ||
+        !check_file_nodes(header, (const mm_file_node *)
+                          ((const char *) base + header->nodes_offset))) {
+        fprintf(stderr, "%s: not a saved multimap\n", path);
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    mapped->base = base;
+    mapped->size = st.st_size;
+    mapped->header = header;
+    mapped->nodes = (const mm_file_node *)
+        ((const char *) base + header->nodes_offset);
+    mapped->values = (const int32_t *)
+        ((const char *) base + header->values_offset);
+
+    return 0;
+}
+
+
+/* Unmaps a saved multimap. */
+void mm_file_close(mm_mapped *mapped) {
+    if (mapped->base != NULL)
+        munmap((void *) mapped->base, mapped->size);
+    bzero(mapped, sizeof(mm_mapped));
+}
+
+
+/* Returns the node with the specified key, or NULL if there isn't one.  As
+ * in opt_mm_impl.c, following a child index of 0 means we fell off the tree.
+ * Removed nodes are reused, so a child's index can be less than its
+ * parent's, and check_file_nodes() can't rule out a corrupt file whose
+ * children form a cycle.  No search visits more nodes than there are, so
+ * the descent stops there.
+ */
+const mm_file_node * mm_file_find(const mm_mapped *mapped, int key) {
+    const mm_file_node *nodes = mapped->nodes;
+    uint32_t num_visits;
+    int index = 0;
+
+    for (num_visits = 0; num_visits < mapped->header->num_nodes;
+         num_visits++) {
+        const mm_file_node *node = nodes + index;
+
+        if (node->key == key)
+            return node;
+
+        index = (node->key > key) ? node->left_child : node->right_child;
+        if (index == 0)
+            return NULL;
+    }
+
+    return NULL;
+}
+
+
+/* Returns nonzero if the mapped multimap contains the (key, value) pair.
+ * Each key's values are sorted in the file, so this is a binary search.
+ */
+int mm_file_contains_pair(const mm_mapped *mapped, int key, int value) {
+    const mm_file_node *node = mm_file_find(mapped, key);
+    const int32_t *values;
+    int lo, hi;
+
+    if (node == NULL)
+        return 0;
+
+    values = mapped->values + node->first_value;
+    lo = 0;
+    hi = node->num_values;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (values[mid] == value)
+            return 1;
+
+        if (values[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return 0;
+}
+
+
+/* Pushes the nodes on the path from the specified node down to the smallest
+ * key that is >= it->lo, just like iter_push_path() in the implementations.
+ * An iteration visits each node of a tree at most once, so if it visits
+ * more nodes than there are, the file's children form a cycle, and the
+ * iteration ends.
+ */
+void file_iter_push_path(mm_file_iter *it, int index) {
+    const mm_file_node *nodes = it->mapped->nodes;
+
+    while (1) {
+        const mm_file_node *node = nodes + index;
+
+        if (it->num_visits++ == it->mapped->header->num_nodes) {
+            it->depth = 0;
+            break;
+        }
+
+        if (node->key < it->lo) {
+            if (node->right_child == 0)
+                break;
+            index = node->right_child;
+        }
+        else {
+            if (it->depth == it->max_depth) {
+                it->max_depth = it->max_depth ? 2 * it->max_depth : 32;
+                it->stack = realloc(it->stack, it->max_depth * sizeof(int));
+                if (it->stack == NULL) {
+                    printf("Not enough memory.\n");
+                    exit(0);
+                }
+            }
+            it->stack[it->depth++] = index;
+
+            if (node->key == it->lo || node->left_child == 0)
+                break;
+            index = node->left_child;
+        }
+    }
+}
+
+
+/* Initializes an iterator over the keys in the range [lo, hi]. */
+void mm_file_iter_init(mm_file_iter *it, const mm_mapped *mapped,
+                       int lo, int hi) {
+    bzero(it, sizeof(mm_file_iter));
+    it->mapped = mapped;
+    it->lo = lo;
+    it->hi = hi;
+
+    if (mapped->header->num_nodes != 0 && lo <= hi)
+        file_iter_push_path(it, 0);
+}
+
+
+/* Retrieves the next key in the range, and an array of all of its values.
+ * Returns nonzero if a key was retrieved, or zero at the end of the range.
+ */
+int mm_file_iter_next(mm_file_iter *it, int *key, const int **values,
+                      int *num_values) {
+    const mm_file_node *node;
+
+    if (it->depth == 0)
+        return 0;
+
+    node = it->mapped->nodes + it->stack[--it->depth];
+    if (node->key > it->hi) {
+        it->depth = 0;
+        return 0;
+    }
+
+    *key = node->key;
+    *values = it->mapped->values + node->first_value;
+    *num_values = node->num_values;
+
+    if (node->right_child != 0)
+        file_iter_push_path(it, node->right_child);
+
+    return 1;
+}
+
+
+/* Releases the memory held by an iterator, but not the iterator itself. */
+void mm_file_iter_release(mm_file_iter *it) {
+    free(it->stack);
+}
+
+
+/* Performs an in-order traversal of a mapped multimap. */
+void mm_file_traverse(const mm_mapped *mapped, void (*f)(int key, int value)) {
+    mm_file_iter it;
+    const int *values;
+    int key, num_values, i;
+
+    mm_file_iter_init(&it, mapped, INT32_MIN, INT32_MAX);
+    while (mm_file_iter_next(&it, &key, &values, &num_values)) {
+        for (i = 0; i < num_values; i++)
+            f(key, values[i]);
+    }
+    mm_file_iter_release(&it);
+}
+
+
+/* A node callback for mm_file_save() that reads the nodes of a mapped
+ * multimap, so that a mapped multimap can be saved again.  ctx is the
+ * mm_mapped.
+ */
+void mm_file_mapped_node(void *ctx, int index, int *key, int *left_child,
+                         int *right_child, const int **values,
+                         int *num_values) {
+    const mm_mapped *mapped = (const mm_mapped *) ctx;
+    const mm_file_node *node = mapped->nodes + index;
+
+    *key = node->key;
+    *left_child = node->left_child;
+    *right_child = node->right_child;
+    *values = mapped->values + node->first_value;
+    *num_values = node->num_values;
+}
@@ -0,0 +1,149 @@
+/* This file declares the on-disk format for saved multimaps, along with the
+ * functions for writing it and for probing a saved multimap that has been
+ * memory-mapped.
+ *
+ * The file is position-independent:  it refers to other parts of itself only
+ * by index, never by pointer, so it can be mmap()ed read-only at any address
+ * and probed immediately, with no deserialization.  It consists of:
+ *
+ *   - A header (mm_file_header).
+ *   - An array of tree nodes (mm_file_node).  Node 0 is the root, and a child
+ *     index of 0 means "no child", just like the node pool in opt_mm_impl.c.
+ *   - One array holding every value.  Each node's values are contiguous and
+ *     sorted, so probes can binary-search them.
+ *
+ * All fields are in the host's byte order.
+ */
+
+#ifndef MM_FILE_H
+#define MM_FILE_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* "MMF1" in little-endian order; identifies a saved multimap. */
+#define MM_FILE_MAGIC 0x31464D4D
+
+#define MM_FILE_VERSION 1
+
+
+/* The header at the start of a saved multimap. */
+typedef struct mm_file_header {
+    uint32_t magic;
+    uint32_t version;
+
+    /* The number of nodes.  Nodes left over from removals are saved with
+     * no values, and can't be reached from the root.
+     */
+    uint32_t num_nodes;
+    uint32_t reserved;
+
+    /* The total number of (key, value) pairs. */
+    uint64_t num_values;
+
+    /* Byte offsets of the node array and the value array in the file. */
+    uint64_t nodes_offset;
+    uint64_t values_offset;
+} mm_file_header;
+
+
+/* One tree node of a saved multimap. */
+typedef struct mm_file_node {
+    int32_t key;
+
+    /* Indexes of the child nodes, or 0 if there is no child. */
+    int32_t left_child;
+    int32_t right_child;
+
+    /* The number of values this key has, and the index of the first one in
+     * the value array.
+     */
+    int32_t num_values;
+    uint64_t first_value;
+} mm_file_node;
+
+
+/* A saved multimap that has been memory-mapped. */
+typedef struct mm_mapped {
+    /* The start of the mapping, and its size in bytes. */
+    const void *base;
+    size_t size;
+
+    const mm_file_header *header;
+    const mm_file_node *nodes;
+    const int32_t *values;
+} mm_mapped;
+
+
+/* An iterator over a range of keys in a mapped multimap.  Like the
+ * in-memory iterators, it keeps an explicit stack of node indexes.
+ */
+typedef struct mm_file_iter {
+    const mm_mapped *mapped;
+    int lo;
+    int hi;
+
+    int *stack;
+    int depth;
+    int max_depth;
+
+    /* The number of nodes visited so far. */
+    uint32_t num_visits;
+} mm_file_iter;
+
+
+/* Describes node number index to mm_file_save():  its key, the indexes of its
+ * children (0 for none), and its values in any order.  The values array only
+ * needs to remain valid until the next call.
+ */
+typedef void (*mm_file_node_fn)(void *ctx, int index, int *key,
+                                int *left_child, int *right_child,
+                                const int **values, int *num_values);
+
+
+/* Writes a multimap with the specified number of nodes to a file, using the
+ * callback to retrieve each node.  Node 0 must be the root.  Returns 0 on
+ * success, or -1 if the file couldn't be written.
+ */
+int mm_file_save(const char *path, int num_nodes, mm_file_node_fn node_fn,
+                 void *ctx);
+
+/* A node callback for mm_file_save() that reads the nodes of a mapped
+ * multimap; ctx is the mm_mapped.
+ */
+void mm_file_mapped_node(void *ctx, int index, int *key, int *left_child,
+                         int *right_child, const int **values,
+                         int *num_values);
+
+/* Maps a saved multimap into memory, read-only.  Returns 0 on success, or -1
+ * if the file can't be opened or isn't a valid saved multimap.
+ */
+int mm_file_open(const char *path, mm_mapped *mapped);
+
+/* Unmaps a saved multimap. */
+void mm_file_close(mm_mapped *mapped);
+
+/* Returns the node with the specified key, or NULL if there isn't one. */
+const mm_file_node * mm_file_find(const mm_mapped *mapped, int key);
+
+/* Returns nonzero if the mapped multimap contains the (key, value) pair. */
+int mm_file_contains_pair(const mm_mapped *mapped, int key, int value);
+
+/* Iterates over the keys in [lo, hi] of a mapped multimap.  Values are
+ * handed out directly from the mapping, in sorted order.
+ */
+void mm_file_iter_init(mm_file_iter *it, const mm_mapped *mapped,
+                       int lo, int hi);
+int mm_file_iter_next(mm_file_iter *it, int *key, const int **values,
+                      int *num_values);
+void mm_file_iter_release(mm_file_iter *it);
+
+/* Performs an in-order traversal of a mapped multimap, passing each
+ * (key, value) pair to the specified function.
+ */
+void mm_file_traverse(const mm_mapped *mapped, void (*f)(int key, int value));
+
+
+#endif /* MM_FILE_H */
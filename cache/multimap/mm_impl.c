@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "mm_file.h"
 #include "multimap.h"
 
 
@@ -51,9 +52,63 @@ typedef struct multimap_node {
 /* The entry-point of the multimap data structure. */
 struct multimap {
     multimap_node *root;
+
+    /* If the multimap was opened with mm_open_mapped(), this is the saved
+     * file it was mapped from, and root is NULL.
+     */
+    mm_mapped *mapped;
+
+    /* Nonzero once mm_freeze() has been called.  This implementation doesn't
+     * reorganize anything; it only refuses further additions.
+     */
+    int frozen;
+};
+
+
+/* The state of an iteration over a range of keys.  Instead of recursing like
+ * mm_traverse() does, the iterator keeps an explicit stack of the nodes whose
+ * keys are still to be visited, with the next key on top.  Only nodes on the
+ * path to keys in the range are ever pushed.
+ */
+struct mm_iter {
+    multimap *mm;
+
+    /* The range of keys being iterated over. */
+    int lo;
+    int hi;
+
+    /* The stack of nodes still to be visited. */
+    multimap_node **stack;
+    int depth;
+    int max_depth;
+
+    /* A key's value-list is copied into this buffer to hand it out. */
+    int *buffer;
+    int buffer_size;
+
+    /* Iterations over a mapped multimap are handed off to this iterator. */
+    mm_file_iter file_iter;
 };
 
 
+/* The state passed to save_node() while the multimap is being saved.  Nodes
+ * are numbered in breadth-first order, so the root is node 0.
+ */
+typedef struct save_state {
+    /* The nodes in the order they are saved, and the numbers of their
+     * children (0 for none).
+     */
+    multimap_node **nodes;
+    int *left_index;
+    int *right_index;
+    int num_nodes;
+
+    /* A node's value-list is copied into this buffer to save it. */
+    int *buffer;
+    int buffer_size;
+} save_state;
+
+
 /*============================================================================
  * HELPER FUNCTION DECLARATIONS
  *
@@ -69,6 +124,18 @@ multimap_node * find_mm_node(multimap_node *root, int key,
 void free_multimap_values(multimap_value *values);
 void free_multimap_node(multimap_node *node);
 
+multimap_node ** find_mm_link(multimap_node **link, int key);
+void remove_mm_node(multimap_node **link);
+void check_modifiable(multimap *mm);
+
+void iter_init(mm_iter *it, multimap *mm, int lo, int hi);
+void iter_push_path(mm_iter *it, multimap_node *node);
+void iter_release(mm_iter *it);
+
+void number_nodes(save_state *state, multimap_node *root);
+void save_node(void *ctx, int index, int *key, int *left_child,
+               int *right_child, const int **values, int *num_values);
+
 
 /*============================================================================
  * FUNCTION IMPLEMENTATIONS
@@ -179,6 +246,8 @@ void free_multimap_node(multimap_node *node) {
 multimap * init_multimap() {
     multimap *mm = malloc(sizeof(multimap));
     mm->root = NULL;
+    mm->mapped = NULL;
+    mm->frozen = 0;
     return mm;
 }
 
@@ -190,6 +259,29 @@ void clear_multimap(multimap *mm) {
     assert(mm != NULL);
     free_multimap_node(mm->root);
     mm->root = NULL;
+    mm->frozen = 0;
+
+    if (mm->mapped != NULL) {
+        mm_file_close(mm->mapped);
+        free(mm->mapped);
+        mm->mapped = NULL;
+    }
+}
+
+
+/* Exits with an error if the multimap is mapped from a file or frozen, since
+ * neither kind can be modified.
+ */
+void check_modifiable(multimap *mm) {
+    if (mm->mapped != NULL) {
+        printf("Cannot modify a memory-mapped multimap.\n");
+        exit(1);
+    }
+
+    if (mm->frozen) {
+        printf("Cannot modify a frozen multimap.\n");
+        exit(1);
+    }
 }
 
 
@@ -199,6 +291,7 @@ void mm_add_value(multimap *mm, int key, int value) {
     multimap_value *new_value;
 
     assert(mm != NULL);
+    check_modifiable(mm);
 
     /* Look up the node with the specified key.  Create if not found. */
     node = find_mm_node(mm->root, key, /* create */ 1);
@@ -225,10 +318,127 @@ void mm_add_value(multimap *mm, int key, int value) {
 }
 
 
+/* Returns the link (the root pointer, or a child pointer in the parent) that
+ * refers to the node with the specified key.  If there is no such node, the
+ * link where it would go is returned, which refers to NULL.
+ */
+multimap_node ** find_mm_link(multimap_node **link, int key) {
+    while (*link != NULL && (*link)->key != key) {
+        if ((*link)->key > key)
+            link = &(*link)->left_child;
+        else
+            link = &(*link)->right_child;
+    }
+
+    return link;
+}
+
+
+/* Removes the node that the link refers to from the tree, and frees it along
+ * with its values.  A node with two children is replaced by its in-order
+ * successor, the leftmost node of its right subtree, which has no left child
+ * and so is easy to unlink.
+ */
+void remove_mm_node(multimap_node **link) {
+    multimap_node *node = *link;
+
+    if (node->left_child != NULL && node->right_child != NULL) {
+        multimap_node **succ_link = &node->right_child;
+        multimap_node *succ;
+
+        while ((*succ_link)->left_child != NULL)
+            succ_link = &(*succ_link)->left_child;
+
+        succ = *succ_link;
+        *succ_link = succ->right_child;
+
+        succ->left_child = node->left_child;
+        succ->right_child = node->right_child;
+        *link = succ;
+    }
+    else if (node->left_child != NULL) {
+        *link = node->left_child;
+    }
+    else {
+        *link = node->right_child;
+    }
+
+    free_multimap_values(node->values);
+
+#ifdef DEBUG_ZERO
+    /* Clear out what we are about to free, to expose issues quickly. */
+    bzero(node, sizeof(multimap_node));
+#endif
+    free(node);
+}
+
+
+/* Removes one occurrence of the (key, value) pair from the multimap, and
+ * the key itself if that was its last value.
+ */
+int mm_remove_pair(multimap *mm, int key, int value) {
+    multimap_node **link, *node;
+    multimap_value *curr, *prev;
+
+    assert(mm != NULL);
+    check_modifiable(mm);
+
+    link = find_mm_link(&mm->root, key);
+    node = *link;
+    if (node == NULL)
+        return 0;
+
+    /* Find the value, and unlink it from the value-list. */
+    prev = NULL;
+    curr = node->values;
+    while (curr != NULL && curr->value != value) {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    if (curr == NULL)
+        return 0;
+
+    if (prev != NULL)
+        prev->next = curr->next;
+    else
+        node->values = curr->next;
+
+    if (node->values_tail == curr)
+        node->values_tail = prev;
+
+    free(curr);
+
+    if (node->values == NULL)
+        remove_mm_node(link);
+
+    return 1;
+}
+
+
+/* Removes the key and all of its values from the multimap. */
+int mm_remove_key(multimap *mm, int key) {
+    multimap_node **link;
+
+    assert(mm != NULL);
+    check_modifiable(mm);
+
+    link = find_mm_link(&mm->root, key);
+    if (*link == NULL)
+        return 0;
+
+    remove_mm_node(link);
+    return 1;
+}
+
+
 /* Returns nonzero if the multimap contains the specified key-value, zero
  * otherwise.
  */
 int mm_contains_key(multimap *mm, int key) {
+    if (mm->mapped != NULL)
+        return mm_file_find(mm->mapped, key) != NULL;
+
     return find_mm_node(mm->root, key, /* create */ 0) != NULL;
 }
 
@@ -240,6 +450,9 @@ int mm_contains_pair(multimap *mm, int key, int value) {
     multimap_node *node;
     multimap_value *curr;
 
+    if (mm->mapped != NULL)
+        return mm_file_contains_pair(mm->mapped, key, value);
+
     node = find_mm_node(mm->root, key, /* create */ 0);
     if (node == NULL)
         return 0;
@@ -282,6 +495,273 @@ void mm_traverse_helper(multimap_node *node, void (*f)(int key, int value)) {
  * pair to the specified function.
  */
 void mm_traverse(multimap *mm, void (*f)(int key, int value)) {
+    if (mm->mapped != NULL) {
+        mm_file_traverse(mm->mapped, f);
+        return;
+    }
+
     mm_traverse_helper(mm->root, f);
 }
 
+
+/* Pushes the nodes on the path from the specified node down to the smallest
+ * key that is >= it->lo.  Nodes with smaller keys are passed over, since
+ * neither they nor their left subtrees can hold keys in the range.
+ */
+void iter_push_path(mm_iter *it, multimap_node *node) {
+    while (node != NULL) {
+        if (node->key < it->lo) {
+            /* Everything we want is to the right. */
+            node = node->right_child;
+            continue;
+        }
+
+        if (it->depth == it->max_depth) {
+            it->max_depth = it->max_depth ? 2 * it->max_depth : 32;
+            it->stack = realloc(it->stack,
+                                it->max_depth * sizeof(multimap_node *));
+            if (it->stack == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+        it->stack[it->depth++] = node;
+
+        if (node->key == it->lo)
+            break;
+        node = node->left_child;
+    }
+}
+
+
+/* Initializes an iterator over the keys in the range [lo, hi]. */
+void iter_init(mm_iter *it, multimap *mm, int lo, int hi) {
+    bzero(it, sizeof(mm_iter));
+    it->mm = mm;
+    it->lo = lo;
+    it->hi = hi;
+
+    if (mm->mapped != NULL)
+        mm_file_iter_init(&it->file_iter, mm->mapped, lo, hi);
+    else if (lo <= hi)
+        iter_push_path(it, mm->root);
+}
+
+
+/* Releases the memory held by an iterator, but not the iterator itself. */
+void iter_release(mm_iter *it) {
+    free(it->stack);
+    free(it->buffer);
+    mm_file_iter_release(&it->file_iter);
+}
+
+
+/* Starts iterating over the keys in the range [lo, hi]. */
+mm_iter * mm_iter_begin(multimap *mm, int lo, int hi) {
+    mm_iter *it = malloc(sizeof(mm_iter));
+    assert(mm != NULL);
+    iter_init(it, mm, lo, hi);
+    return it;
+}
+
+
+/* Retrieves the next key in the range, and an array of all of its values.
+ * Returns nonzero if a key was retrieved, or zero at the end of the range.
+ */
+int mm_iter_next(mm_iter *it, int *key, const int **values, int *num_values) {
+    multimap_node *node;
+    multimap_value *curr;
+    int count;
+
+    if (it->mm->mapped != NULL)
+        return mm_file_iter_next(&it->file_iter, key, values, num_values);
+
+    if (it->depth == 0)
+        return 0;
+
+    node = it->stack[--it->depth];
+    if (node->key > it->hi) {
+        /* Every remaining key is even larger. */
+        it->depth = 0;
+        return 0;
+    }
+
+    /* Copy the value-list into the buffer, growing it if necessary. */
+    count = 0;
+    for (curr = node->values; curr != NULL; curr = curr->next) {
+        if (count == it->buffer_size) {
+            it->buffer_size = it->buffer_size ? 2 * it->buffer_size : 16;
+            it->buffer = realloc(it->buffer, it->buffer_size * sizeof(int));
+            if (it->buffer == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+        it->buffer[count++] = curr->value;
+    }
+
+    *key = node->key;
+    *values = it->buffer;
+    *num_values = count;
+
+    /* The right subtree holds the keys that come next. */
+    iter_push_path(it, node->right_child);
+
+    return 1;
+}
+
+
+/* Releases the iterator. */
+void mm_iter_end(mm_iter *it) {
+    iter_release(it);
+    free(it);
+}
+
+
+/* Passes every key in the range [lo, hi] to the specified function, in
+ * increasing order, along with an array of all of that key's values.
+ */
+void mm_range(multimap *mm, int lo, int hi,
+              void (*f)(int key, const int *values, int num_values)) {
+    mm_iter it;
+    const int *values;
+    int key, num_values;
+
+    iter_init(&it, mm, lo, hi);
+    while (mm_iter_next(&it, &key, &values, &num_values))
+        f(key, values, num_values);
+    iter_release(&it);
+}
+
+
+/* Numbers the nodes of the tree in breadth-first order, recording each node
+ * and the numbers of its children in the save state.  The array of nodes
+ * doubles as the queue of nodes whose children still need numbers.
+ */
+void number_nodes(save_state *state, multimap_node *root) {
+    int max_nodes = 0;
+    int i;
+
+    if (root == NULL)
+        return;
+
+    state->num_nodes = 1;
+    for (i = 0; i < state->num_nodes; i++) {
+        multimap_node *node;
+
+        /* Make room for this node and both of its children. */
+        if (state->num_nodes + 2 > max_nodes) {
+            max_nodes = max_nodes ? 2 * max_nodes : 64;
+            state->nodes = realloc(state->nodes,
+                                   max_nodes * sizeof(multimap_node *));
+            state->left_index = realloc(state->left_index,
+                                        max_nodes * sizeof(int));
+            state->right_index = realloc(state->right_index,
+                                         max_nodes * sizeof(int));
+            if (state->nodes == NULL || state->left_index == NULL ||
+                state->right_index == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+
+        if (i == 0)
+            state->nodes[0] = root;
+        node = state->nodes[i];
+
+        state->left_index[i] = 0;
+        if (node->left_child != NULL) {
+            state->left_index[i] = state->num_nodes;
+            state->nodes[state->num_nodes++] = node->left_child;
+        }
+
+        state->right_index[i] = 0;
+        if (node->right_child != NULL) {
+            state->right_index[i] = state->num_nodes;
+            state->nodes[state->num_nodes++] = node->right_child;
+        }
+    }
+}
+
+
+/* Describes node number index to mm_file_save(), copying its value-list into
+ * the save state's buffer.
+ */
+void save_node(void *ctx, int index, int *key, int *left_child,
+               int *right_child, const int **values, int *num_values) {
+    save_state *state = (save_state *) ctx;
+    multimap_node *node = state->nodes[index];
+    multimap_value *curr;
+    int count = 0;
+
+    for (curr = node->values; curr != NULL; curr = curr->next) {
+        if (count == state->buffer_size) {
+            state->buffer_size = state->buffer_size ?
+                2 * state->buffer_size : 16;
+            state->buffer = realloc(state->buffer,
+                                    state->buffer_size * sizeof(int));
+            if (state->buffer == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
+        }
+        state->buffer[count++] = curr->value;
+    }
+
+    *key = node->key;
+    *left_child = state->left_index[index];
+    *right_child = state->right_index[index];
+    *values = state->buffer;
+    *num_values = count;
+}
+
+
+/* Writes the multimap to a file that mm_open_mapped() can map back in. */
+int mm_save(multimap *mm, const char *path) {
+    save_state state;
+    int result;
+
+    assert(mm != NULL);
+
+    if (mm->mapped != NULL) {
+        return mm_file_save(path, mm->mapped->header->num_nodes,
+                            mm_file_mapped_node, mm->mapped);
+    }
+
+    bzero(&state, sizeof(save_state));
+    number_nodes(&state, mm->root);
+    result = mm_file_save(path, state.num_nodes, save_node, &state);
+
+    free(state.nodes);
+    free(state.left_index);
+    free(state.right_index);
+    free(state.buffer);
+    return result;
+}
+
+
+/* Maps a multimap saved by mm_save() into memory, read-only. */
+multimap * mm_open_mapped(const char *path) {
+    multimap *mm = init_multimap();
+
+    mm->mapped = malloc(sizeof(mm_mapped));
+    if (mm->mapped == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    if (mm_file_open(path, mm->mapped) != 0) {
+        free(mm->mapped);
+        free(mm);
+        return NULL;
+    }
+
+    return mm;
+}
+
+
+/* Declares that the multimap is fully populated. */
+void mm_freeze(multimap *mm) {
+    assert(mm != NULL);
+    mm->frozen = 1;
+}
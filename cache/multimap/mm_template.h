@@ -0,0 +1,462 @@
+/* This file provides a header-only generator for multimaps with any key and
+ * value types.  DEFINE_MULTIMAP(name, key_t, val_t, key_cmp, val_eq) expands
+ * to a complete multimap type called name, with the same design as
+ * opt_mm_impl.c:  the tree nodes live in one pool and refer to each other by
+ * index, with the root always at index 0, and each key's values are kept in a
+ * contiguous array that grows geometrically.  Removed nodes are recycled
+ * through a free list in the pool.
+ *
+ * key_cmp(a, b) must return a negative number, zero or a positive number as
+ * key a is less than, equal to or greater than key b, and val_eq(a, b) must
+ * return nonzero if two values are equal.  Both are used as macros or
+ * inline functions, and are expanded directly into the search loops, so
+ * there is no function-pointer dispatch when probing.  MM_CMP_SCALAR and
+ * MM_EQ_SCALAR work for any arithmetic type; strcmp works for string keys.
+ * Keys and values are copied by assignment, so a multimap with string keys
+ * stores the pointers, and the caller must keep the strings alive.
+ *
+ * The generated functions are all static inline, so a specialization costs
+ * nothing where it isn't used.  For a multimap called name, they are:
+ *
+ *   void name_init(name *mm);
+ *   void name_clear(name *mm);
+ *   void name_add(name *mm, key_t key, val_t value);
+ *   int name_contains_key(name *mm, key_t key);
+ *   int name_contains_pair(name *mm, key_t key, val_t value);
+ *   int name_remove_pair(name *mm, key_t key, val_t value);
+ *   int name_remove_key(name *mm, key_t key);
+ *   void name_traverse(name *mm, void (*f)(key_t key, val_t value));
+ *
+ *   void name_iter_init(name_iter *it, name *mm, key_t lo, key_t hi);
+ *   int name_iter_next(name_iter *it, key_t *key, const val_t **values,
+ *                      int *num_values);
+ *   void name_iter_release(name_iter *it);
+ *
+ * These behave like the functions in multimap.h.  The int-valued
+ * opt_mm_impl.c additionally has a size-class pool for small value arrays
+ * and bit-packed value-lists, which depend on the values being ints, so they
+ * aren't part of the template.
+ */
+
+#ifndef MM_TEMPLATE_H
+#define MM_TEMPLATE_H
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* The number of nodes the pool starts with; it doubles when it fills up. */
+#define MMT_TREE_SIZE 16
+
+/* Value arrays start with room for MMT_MIN_VALUES values and double until
+ * they hold MMT_DOUBLING_VALUES values; after that they grow by
+ * MMT_LIST_GROWTH_PERCENT percent at a time, like in opt_mm_impl.c.
+ */
+#define MMT_MIN_VALUES 4
+#define MMT_DOUBLING_VALUES 32
+#define MMT_LIST_GROWTH_PERCENT 25
+
+/* Comparators for arithmetic key and value types. */
+#define MM_CMP_SCALAR(a, b) (((a) > (b)) - ((a) < (b)))
+#define MM_EQ_SCALAR(a, b) ((a) == (b))
+
+
+/* Returns the new capacity for a value array that has filled up. */
+static inline int mmt_grow_values(int size) {
+    if (size == 0)
+        return MMT_MIN_VALUES;
+
+    if (size < MMT_DOUBLING_VALUES)
+        return 2 * size;
+
+    return size + size * MMT_LIST_GROWTH_PERCENT / 100;
+}
+
+
+/* realloc() that exits if there isn't enough memory. */
+static inline void * mmt_realloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    return ptr;
+}
+
+
+/* Defines a multimap type called name, mapping keys of type key_t to values
+ * of type val_t, along with its functions.  See the top of this file.
+ */
+#define DEFINE_MULTIMAP(name, key_t, val_t, key_cmp, val_eq)                  \
+/* A key and its values, and the pool indexes of the child nodes (0 for       \
+ * none).  Removed nodes are on the free list, linked through left_child.     \
+ * The values pointer comes first so that, with 4-byte keys, the node packs   \
+ * into 32 bytes like opt_mm_impl.c's does.                                   \
+ */                                                                           \
+typedef struct name##_node {                                                  \
+    val_t *values;                                                            \
+    key_t key;                                                                \
+    int value_length;                                                         \
+    int value_size;                                                           \
+    int left_child;                                                           \
+    int right_child;                                                          \
+    int is_free;                                                              \
+} name##_node;                                                                \
+                                                                              \
+/* The multimap:  the node pool, and the head of its free list (0 if the      \
+ * list is empty).  The multimap is empty when length is 0.                   \
+ */                                                                           \
+typedef struct name {                                                         \
+    name##_node *nodes;                                                       \
+    int length;                                                               \
+    int size;                                                                 \
+    int free_nodes;                                                           \
+} name;                                                                       \
+                                                                              \
+/* An iteration over the keys in [lo, hi], with an explicit stack of the      \
+ * nodes whose keys are still to be visited.                                  \
+ */                                                                           \
+typedef struct name##_iter {                                                  \
+    name *mm;                                                                 \
+    key_t lo;                                                                 \
+    key_t hi;                                                                 \
+    int *stack;                                                               \
+    int depth;                                                                \
+    int max_depth;                                                            \
+} name##_iter;                                                                \
+                                                                              \
+                                                                              \
+static inline void name##_init(name *mm) {                                    \
+    memset(mm, 0, sizeof(name));                                              \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_clear(name *mm) {                                   \
+    int i;                                                                    \
+    for (i = 0; i < mm->length; i++)                                          \
+        free(mm->nodes[i].values);                                            \
+    free(mm->nodes);                                                          \
+    memset(mm, 0, sizeof(name));                                              \
+}                                                                             \
+                                                                              \
+                                                                              \
+/* Takes a node from the free list, or from the end of the pool. */           \
+static inline int name##_alloc_node(name *mm, key_t key) {                    \
+    name##_node *node;                                                        \
+    int index;                                                                \
+                                                                              \
+    if (mm->free_nodes != 0) {                                                \
+        index = mm->free_nodes;                                               \
+        mm->free_nodes = mm->nodes[index].left_child;                         \
+    }                                                                         \
+    else {                                                                    \
+        if (mm->length == mm->size) {                                         \
+            mm->size = mm->size ? 2 * mm->size : MMT_TREE_SIZE;               \
+            mm->nodes = (name##_node *)                                       \
+                mmt_realloc(mm->nodes, mm->size * sizeof(name##_node));       \
+        }                                                                     \
+        index = mm->length++;                                                 \
+    }                                                                         \
+                                                                              \
+    node = mm->nodes + index;                                                 \
+    memset(node, 0, sizeof(name##_node));                                     \
+    node->key = key;                                                          \
+    return index;                                                             \
+}                                                                             \
+                                                                              \
+                                                                              \
+/* Returns the index of the node with the key, or -1 if there isn't one.      \
+ * The index of its parent is stored in *parent, or -1 for the root.          \
+ */                                                                           \
+static inline int name##_find(name *mm, key_t key, int *parent) {             \
+    int index = 0;                                                            \
+                                                                              \
+    *parent = -1;                                                             \
+    if (mm->length == 0)                                                      \
+        return -1;                                                            \
+                                                                              \
+    while (1) {                                                               \
+        name##_node *node = mm->nodes + index;                                \
+        int c = key_cmp(key, node->key);                                      \
+        int child;                                                            \
+                                                                              \
+        if (c == 0)                                                           \
+            return index;                                                     \
+                                                                              \
+        child = (c < 0) ? node->left_child : node->right_child;               \
+        if (child == 0)                                                       \
+            return -1;                                                        \
+                                                                              \
+        *parent = index;                                                      \
+        index = child;                                                        \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+                                                                              \
+/* Like name_find(), but adds a node for the key if there isn't one. */       \
+static inline int name##_find_or_add(name *mm, key_t key) {                   \
+    int index = 0;                                                            \
+                                                                              \
+    if (mm->length == 0)                                                      \
+        return name##_alloc_node(mm, key);                                    \
+                                                                              \
+    while (1) {                                                               \
+        name##_node *node = mm->nodes + index;                                \
+        int c = key_cmp(key, node->key);                                      \
+        int child;                                                            \
+                                                                              \
+        if (c == 0)                                                           \
+            return index;                                                     \
+                                                                              \
+        child = (c < 0) ? node->left_child : node->right_child;               \
+        if (child == 0) {                                                     \
+            /* The pool may move, so link the new node in by index. */        \
+            child = name##_alloc_node(mm, key);                               \
+            if (c < 0)                                                        \
+                mm->nodes[index].left_child = child;                          \
+            else                                                              \
+                mm->nodes[index].right_child = child;                         \
+            return child;                                                     \
+        }                                                                     \
+        index = child;                                                        \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_add(name *mm, key_t key, val_t value) {             \
+    /* Adding a node may move the pool, so find the node first. */            \
+    int index = name##_find_or_add(mm, key);                                  \
+    name##_node *node = mm->nodes + index;                                    \
+                                                                              \
+    if (node->value_length == node->value_size) {                             \
+        node->value_size = mmt_grow_values(node->value_size);                 \
+        node->values = (val_t *)                                              \
+            mmt_realloc(node->values, node->value_size * sizeof(val_t));      \
+    }                                                                         \
+    node->values[node->value_length++] = value;                               \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline int name##_contains_key(name *mm, key_t key) {                  \
+    int parent;                                                               \
+    return name##_find(mm, key, &parent) != -1;                               \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline int name##_contains_pair(name *mm, key_t key, val_t value) {    \
+    name##_node *node;                                                        \
+    int parent, index, i;                                                     \
+                                                                              \
+    index = name##_find(mm, key, &parent);                                    \
+    if (index == -1)                                                          \
+        return 0;                                                             \
+                                                                              \
+    node = mm->nodes + index;                                                 \
+    for (i = 0; i < node->value_length; i++) {                                \
+        if (val_eq(node->values[i], value))                                   \
+            return 1;                                                         \
+    }                                                                         \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+                                                                              \
+/* Puts an unlinked node on the free list. */                                 \
+static inline void name##_free_node(name *mm, int index) {                    \
+    name##_node *node = mm->nodes + index;                                    \
+                                                                              \
+    memset(node, 0, sizeof(name##_node));                                     \
+    node->is_free = 1;                                                        \
+    node->left_child = mm->free_nodes;                                        \
+    mm->free_nodes = index;                                                   \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_replace_child(name *mm, int parent, int old_child,  \
+                                        int new_child) {                      \
+    if (mm->nodes[parent].left_child == old_child)                            \
+        mm->nodes[parent].left_child = new_child;                             \
+    else                                                                      \
+        mm->nodes[parent].right_child = new_child;                            \
+}                                                                             \
+                                                                              \
+                                                                              \
+/* Removes a node and its values, the same way as opt_mm_impl.c does:  a node \
+ * with two children takes over its successor's key and values, and the root  \
+ * stays at index 0.                                                          \
+ */                                                                           \
+static inline void name##_remove_node(name *mm, int index, int parent) {      \
+    name##_node *node = mm->nodes + index;                                    \
+    int child;                                                                \
+                                                                              \
+    free(node->values);                                                       \
+    node->values = NULL;                                                      \
+                                                                              \
+    if (node->left_child != 0 && node->right_child != 0) {                    \
+        int succ_parent = index;                                              \
+        int succ = node->right_child;                                         \
+        name##_node *succ_node;                                               \
+                                                                              \
+        while (mm->nodes[succ].left_child != 0) {                             \
+            succ_parent = succ;                                               \
+            succ = mm->nodes[succ].left_child;                                \
+        }                                                                     \
+        succ_node = mm->nodes + succ;                                         \
+                                                                              \
+        node->key = succ_node->key;                                           \
+        node->values = succ_node->values;                                     \
+        node->value_length = succ_node->value_length;                         \
+        node->value_size = succ_node->value_size;                             \
+                                                                              \
+        name##_replace_child(mm, succ_parent, succ, succ_node->right_child);  \
+        name##_free_node(mm, succ);                                           \
+        return;                                                               \
+    }                                                                         \
+                                                                              \
+    child = (node->left_child != 0) ? node->left_child : node->right_child;   \
+                                                                              \
+    if (parent != -1) {                                                       \
+        name##_replace_child(mm, parent, index, child);                       \
+        name##_free_node(mm, index);                                          \
+    }                                                                         \
+    else if (child != 0) {                                                    \
+        *node = mm->nodes[child];                                             \
+        name##_free_node(mm, child);                                          \
+    }                                                                         \
+    else {                                                                    \
+        mm->length = 0;                                                       \
+        mm->free_nodes = 0;                                                   \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline int name##_remove_pair(name *mm, key_t key, val_t value) {      \
+    name##_node *node;                                                        \
+    int parent, index, i;                                                     \
+                                                                              \
+    index = name##_find(mm, key, &parent);                                    \
+    if (index == -1)                                                          \
+        return 0;                                                             \
+                                                                              \
+    node = mm->nodes + index;                                                 \
+    for (i = 0; i < node->value_length; i++) {                                \
+        if (val_eq(node->values[i], value))                                   \
+            break;                                                            \
+    }                                                                         \
+    if (i == node->value_length)                                              \
+        return 0;                                                             \
+                                                                              \
+    node->values[i] = node->values[--node->value_length];                     \
+    if (node->value_length == 0)                                              \
+        name##_remove_node(mm, index, parent);                                \
+    return 1;                                                                 \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline int name##_remove_key(name *mm, key_t key) {                    \
+    int parent, index;                                                        \
+                                                                              \
+    index = name##_find(mm, key, &parent);                                    \
+    if (index == -1)                                                          \
+        return 0;                                                             \
+                                                                              \
+    name##_remove_node(mm, index, parent);                                    \
+    return 1;                                                                 \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_traverse_helper(name *mm, int index,                \
+        void (*f)(key_t key, val_t value)) {                                  \
+    name##_node *node = mm->nodes + index;                                    \
+    int i;                                                                    \
+                                                                              \
+    if (node->left_child != 0)                                                \
+        name##_traverse_helper(mm, node->left_child, f);                      \
+                                                                              \
+    for (i = 0; i < node->value_length; i++)                                  \
+        f(node->key, node->values[i]);                                        \
+                                                                              \
+    if (node->right_child != 0)                                               \
+        name##_traverse_helper(mm, node->right_child, f);                     \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_traverse(name *mm,                                  \
+                                   void (*f)(key_t key, val_t value)) {       \
+    if (mm->length != 0)                                                      \
+        name##_traverse_helper(mm, 0, f);                                     \
+}                                                                             \
+                                                                              \
+                                                                              \
+/* Pushes the path from the node down to the smallest key >= it->lo. */       \
+static inline void name##_iter_push_path(name##_iter *it, int index) {        \
+    name##_node *nodes = it->mm->nodes;                                       \
+                                                                              \
+    while (1) {                                                               \
+        name##_node *node = nodes + index;                                    \
+        int c = key_cmp(node->key, it->lo);                                   \
+                                                                              \
+        if (c < 0) {                                                          \
+            if (node->right_child == 0)                                       \
+                break;                                                        \
+            index = node->right_child;                                        \
+        }                                                                     \
+        else {                                                                \
+            if (it->depth == it->max_depth) {                                 \
+                it->max_depth = it->max_depth ? 2 * it->max_depth : 32;       \
+                it->stack = (int *)                                           \
+                    mmt_realloc(it->stack, it->max_depth * sizeof(int));      \
+            }                                                                 \
+            it->stack[it->depth++] = index;                                   \
+                                                                              \
+            if (c == 0 || node->left_child == 0)                              \
+                break;                                                        \
+            index = node->left_child;                                         \
+        }                                                                     \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_iter_init(name##_iter *it, name *mm,                \
+                                    key_t lo, key_t hi) {                     \
+    memset(it, 0, sizeof(name##_iter));                                       \
+    it->mm = mm;                                                              \
+    it->lo = lo;                                                              \
+    it->hi = hi;                                                              \
+                                                                              \
+    if (mm->length != 0 && key_cmp(lo, hi) <= 0)                              \
+        name##_iter_push_path(it, 0);                                         \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline int name##_iter_next(name##_iter *it, key_t *key,               \
+                                   const val_t **values, int *num_values) {   \
+    name##_node *node;                                                        \
+                                                                              \
+    if (it->depth == 0)                                                       \
+        return 0;                                                             \
+                                                                              \
+    node = it->mm->nodes + it->stack[--it->depth];                            \
+    if (key_cmp(node->key, it->hi) > 0) {                                     \
+        it->depth = 0;                                                        \
+        return 0;                                                             \
+    }                                                                         \
+                                                                              \
+    *key = node->key;                                                         \
+    *values = node->values;                                                   \
+    *num_values = node->value_length;                                         \
+                                                                              \
+    if (node->right_child != 0)                                               \
+        name##_iter_push_path(it, node->right_child);                         \
+    return 1;                                                                 \
+}                                                                             \
+                                                                              \
+                                                                              \
+static inline void name##_iter_release(name##_iter *it) {                     \
+    free(it->stack);                                                          \
+}
+
+
+#endif /* MM_TEMPLATE_H */
@@ -0,0 +1,746 @@
+/* This program is a more careful version of mmperf, meant for comparing
+ * multimap implementations against each other.  It runs the same tests as
+ * mmperf, but:
+ *
+ *  - Probe keys and values are generated before timing starts, so the cost
+ *    of rand() is not included in the measurement.
+ *  - The process is pinned to one CPU, so it isn't migrated mid-trial.
+ *  - Each test does some warmup runs, and then a number of timed trials;
+ *    the median, mean and standard deviation of the trials are reported.
+ *  - Time is measured with a raw monotonic clock, in nanoseconds.
+ *  - Where the kernel allows it, hardware counters (L1 data-cache misses,
+ *    last-level cache misses and branch misses) are collected per trial.
+ *
+ * Results are printed as CSV on stdout, one row per test, so that the output
+ * of several implementations can simply be concatenated and charted.
+ * Progress messages go to stderr.
+ *
+ * With -f, each map is frozen with mm_freeze() after it is populated, so the
+ * probes measure the read-optimized layout; the implementation name gets a
+ * "-frozen" suffix unless -n is given.
+ *
+ * With -r, the program instead measures range scans of various widths over
+ * the 15M-pair map, comparing mm_range(), the mm_iter iterator, and a full
+ * mm_traverse() that filters out keys outside the range.
+ *
+ * With -p file or -m file, the program measures how long it takes a process
+ * to start answering probes against the 15M-pair map.  -p builds the map from
+ * scratch, as mmperf does, and then saves it to the file with mm_save(); -m
+ * maps the saved file back in with mm_open_mapped().  Both report the time to
+ * get the map ready, the latency of the very first probe, the probe rate
+ * afterwards, and the resident set size after the first probe and after all
+ * probes.  Run -p first, and -m in a separate process.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "multimap.h"
+#include "realtime.h"
+
+
+/* Various populate-mode values used by populate_multimap() to generate keys.
+ * These are the same as in mmperf.
+ */
+#define MODE_RAND 0
+#define MODE_INCR 1
+#define MODE_DECR 2
+
+/* The number of probes in each trial is scaled like mmperf's tests. */
+#define SCALE 10
+
+/* The default number of warmup runs and timed trials per test. */
+#define DEFAULT_WARMUPS 2
+#define DEFAULT_TRIALS 7
+
+/* The hardware counters collected, if the kernel allows it. */
+#define NUM_COUNTERS 3
+
+/* The ways the startup benchmark can get the map ready. */
+#define START_REBUILD 0
+#define START_MAPPED 1
+
+const char *start_str[] = { "rebuild", "mapped" };
+
+
+/* One of the tests to run.  These mirror the tests in mmperf. */
+typedef struct bench_test {
+    int num_pairs;
+    int num_probes;
+    int keygen_mode;
+    int max_key;
+    int max_val;
+
+    /* Nonzero for the tests that take minutes with the unoptimized map. */
+    int slow;
+} bench_test;
+
+
+bench_test tests[] = {
+    {   300000, SCALE * 100000, MODE_RAND,     50, 1000, 0 },
+    {   300000, SCALE * 100000, MODE_INCR,     50, 1000, 0 },
+    {   300000, SCALE * 100000, MODE_DECR,     50, 1000, 0 },
+    { 15000000, SCALE * 100000, MODE_RAND, 100000,   50, 0 },
+    {   100000, SCALE *   5000, MODE_INCR, 100000,   50, 1 },
+    {   100000, SCALE *   5000, MODE_DECR, 100000,   50, 1 },
+    { 0 }
+};
+
+
+const char *mode_str[] = { "random", "incrementing", "decrementing" };
+
+
+/* The widths of the key ranges scanned by the range-scan benchmark. */
+int range_widths[] = { 1, 10, 100, 1000, 10000, 100000, 0 };
+
+/* The number of scans per timed trial, for widths up to 1000 keys and for
+ * wider ranges.  A full traversal is always timed one scan at a time.
+ */
+#define NARROW_SCANS 10000
+#define WIDE_SCANS 20
+
+/* The ways a range can be scanned. */
+#define SCAN_RANGE 0
+#define SCAN_ITER 1
+#define SCAN_TRAVERSE 2
+
+const char *scan_str[] = { "range", "iter", "traverse" };
+
+
+/* State used by the range-scan callbacks, which can't take a context. */
+long long scan_pairs;
+int scan_lo, scan_hi;
+
+
+/* The hardware counters, as file descriptors from perf_event_open().  The
+ * first counter is the group leader.  If counters are unavailable, the
+ * leader is -1.
+ */
+int counter_fds[NUM_COUNTERS] = { -1, -1, -1 };
+
+
+/*============================================================================
+ * HELPER FUNCTIONS
+ *============================================================================*/
+
+/* Returns the current time in nanoseconds. */
+int64_t now_ns() {
+    struct timespec ts;
+    clock_get_monotonic(&ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* Pins the process to the specified CPU.  Returns nonzero on success. */
+int pin_to_cpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return 0;
+#endif
+}
+
+
+#ifdef __linux__
+/* Opens one hardware counter for this process, in the specified group. */
+int open_counter(uint32_t type, uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+
+/* Sets up the hardware counters.  Returns nonzero if they are available; many
+ * containers and VMs don't allow perf_event_open(), in which case the counter
+ * columns are left empty.
+ */
+int open_counters() {
+#ifdef __linux__
+    int i;
+
+    counter_fds[0] = open_counter(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1);
+    if (counter_fds[0] == -1)
+        return 0;
+
+    counter_fds[1] = open_counter(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_CACHE_MISSES, counter_fds[0]);
+    counter_fds[2] = open_counter(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_BRANCH_MISSES, counter_fds[0]);
+
+    for (i = 1; i < NUM_COUNTERS; i++) {
+        if (counter_fds[i] == -1) {
+            for (i = 0; i < NUM_COUNTERS; i++) {
+                if (counter_fds[i] != -1)
+                    close(counter_fds[i]);
+                counter_fds[i] = -1;
+            }
+            return 0;
+        }
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+/* Resets and starts the counters. */
+void start_counters() {
+#ifdef __linux__
+    if (counter_fds[0] == -1)
+        return;
+
+    ioctl(counter_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counter_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+
+/* Stops the counters and adds their values into totals. */
+void stop_counters(uint64_t *totals) {
+#ifdef __linux__
+    uint64_t buf[1 + NUM_COUNTERS];
+    int i;
+
+    if (counter_fds[0] == -1)
+        return;
+
+    ioctl(counter_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (read(counter_fds[0], buf, sizeof(buf)) != sizeof(buf))
+        return;
+
+    /* With PERF_FORMAT_GROUP, buf[0] is the number of counters. */
+    for (i = 0; i < NUM_COUNTERS; i++)
+        totals[i] += buf[1 + i];
+#endif
+}
+
+
+/* Comparison function for sorting trial times with qsort(). */
+int compare_doubles(const void *v1, const void *v2) {
+    double d1 = *(const double *) v1;
+    double d2 = *(const double *) v2;
+
+    return (d1 > d2) - (d1 < d2);
+}
+
+
+/* Computes the median, mean and sample standard deviation of the trials.
+ * The samples are sorted as a side effect.
+ */
+void summarize_trials(double *samples, int n, double *median, double *mean,
+                      double *stddev) {
+    int i;
+
+    *mean = 0;
+    for (i = 0; i < n; i++)
+        *mean += samples[i];
+    *mean /= n;
+
+    *stddev = 0;
+    for (i = 0; i < n; i++)
+        *stddev += (samples[i] - *mean) * (samples[i] - *mean);
+    *stddev = n > 1 ? sqrt(*stddev / (n - 1)) : 0;
+
+    qsort(samples, n, sizeof(double), compare_doubles);
+    if (n % 2 == 1)
+        *median = samples[n / 2];
+    else
+        *median = (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+
+/* Populate the multimap with a specific number of key/value pairs, exactly as
+ * mmperf does, so that both programs build identical maps.
+ */
+void populate_multimap(multimap *mm, int num_pairs, int keygen_mode,
+                       int max_key, int max_val) {
+    int i, key = 0, value;
+
+    for (i = 0; i < num_pairs; i++) {
+        if (keygen_mode == MODE_RAND)
+            key = rand() % max_key;
+        else if (keygen_mode == MODE_INCR)
+            key = (i == 0) ? 0 : (key + 1) % (max_key + 1);
+        else
+            key = (i == 0) ? max_key : (key + max_key) % (max_key + 1);
+
+        value = rand() % max_val;
+        mm_add_value(mm, key, value);
+    }
+}
+
+
+/* Runs one test, printing a CSV row with the results. */
+void run_test(const char *impl_name, bench_test *t, int warmups, int trials,
+              int have_counters, int freeze) {
+    multimap *mm;
+    int *probe_keys, *probe_vals;
+    double *ns_per_probe, median, mean, stddev;
+    uint64_t counters[NUM_COUNTERS] = { 0 };
+    int64_t start, end;
+    int i, run, hits = 0;
+
+    fprintf(stderr, "Testing %d pairs, %d probes, %s keys.\n",
+            t->num_pairs, t->num_probes, mode_str[t->keygen_mode]);
+
+    mm = init_multimap();
+    populate_multimap(mm, t->num_pairs, t->keygen_mode, t->max_key,
+                      t->max_val);
+
+    if (freeze) {
+        start = now_ns();
+        mm_freeze(mm);
+        fprintf(stderr, "Froze in %.1f ms.\n",
+                (double) (now_ns() - start) / 1e6);
+    }
+
+    /* Generate all probes up front, so rand() isn't part of the timing. */
+    probe_keys = malloc(t->num_probes * sizeof(int));
+    probe_vals = malloc(t->num_probes * sizeof(int));
+    ns_per_probe = malloc(trials * sizeof(double));
+    for (i = 0; i < t->num_probes; i++) {
+        probe_keys[i] = rand() % t->max_key;
+        probe_vals[i] = rand() % t->max_val;
+    }
+
+    for (run = 0; run < warmups + trials; run++) {
+        int total = 0;
+
+        if (run >= warmups)
+            start_counters();
+        start = now_ns();
+
+        for (i = 0; i < t->num_probes; i++)
+            total += mm_contains_pair(mm, probe_keys[i], probe_vals[i]);
+
+        end = now_ns();
+        if (run >= warmups) {
+            stop_counters(counters);
+            ns_per_probe[run - warmups] =
+                (double) (end - start) / (double) t->num_probes;
+        }
+
+        /* Every run must see the same answers. */
+        if (run != 0 && total != hits) {
+            fprintf(stderr, "ERROR:  run %d found %d pairs, not %d.\n",
+                    run, total, hits);
+            exit(1);
+        }
+        hits = total;
+    }
+
+    summarize_trials(ns_per_probe, trials, &median, &mean, &stddev);
+
+    printf("%s,%d,%d,%s,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f",
+           impl_name, t->num_pairs, t->num_probes, mode_str[t->keygen_mode],
+           t->max_key, t->max_val, trials, hits, median, mean, stddev,
+           ns_per_probe[0], ns_per_probe[trials - 1]);
+
+    for (i = 0; i < NUM_COUNTERS; i++) {
+        if (have_counters) {
+            printf(",%.4f", (double) counters[i] /
+                   ((double) trials * t->num_probes));
+        }
+        else {
+            printf(",");
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+
+    free(probe_keys);
+    free(probe_vals);
+    free(ns_per_probe);
+    clear_multimap(mm);
+    free(mm);
+}
+
+
+/* Range-scan callback for mm_range(). */
+void count_range(int key, const int *values, int num_values) {
+    scan_pairs += num_values;
+}
+
+
+/* Traversal callback that only counts pairs within the scanned range. */
+void count_filtered(int key, int value) {
+    if (key >= scan_lo && key <= scan_hi)
+        scan_pairs++;
+}
+
+
+/* Performs one scan of the keys in [lo, hi] with the specified method. */
+void scan_once(multimap *mm, int method, int lo, int hi) {
+    mm_iter *it;
+    const int *values;
+    int key, num_values;
+
+    switch (method) {
+    case SCAN_RANGE:
+        mm_range(mm, lo, hi, count_range);
+        break;
+
+    case SCAN_ITER:
+        it = mm_iter_begin(mm, lo, hi);
+        while (mm_iter_next(it, &key, &values, &num_values))
+            scan_pairs += num_values;
+        mm_iter_end(it);
+        break;
+
+    default:
+        scan_lo = lo;
+        scan_hi = hi;
+        mm_traverse(mm, count_filtered);
+        break;
+    }
+}
+
+
+/* Runs the range-scan benchmark against the 15M-pair map, printing one CSV
+ * row per range width and scan method.
+ */
+void run_range_tests(const char *impl_name, int warmups, int trials) {
+    bench_test *t = &tests[3];
+    multimap *mm;
+    double *ns_per_scan, median, mean, stddev;
+    int *starts;
+    int w, method, i, run;
+
+    fprintf(stderr, "Populating %d pairs, %s keys, for range scans.\n",
+            t->num_pairs, mode_str[t->keygen_mode]);
+
+    mm = init_multimap();
+    populate_multimap(mm, t->num_pairs, t->keygen_mode, t->max_key,
+                      t->max_val);
+
+    starts = malloc(NARROW_SCANS * sizeof(int));
+    ns_per_scan = malloc(trials * sizeof(double));
+
+    for (w = 0; range_widths[w] != 0; w++) {
+        int width = range_widths[w];
+        int num_scans = (width <= 1000) ? NARROW_SCANS : WIDE_SCANS;
+
+        /* Generate the range starts up front. */
+        for (i = 0; i < num_scans; i++)
+            starts[i] = rand() % (t->max_key - width + 1);
+
+        for (method = SCAN_RANGE; method <= SCAN_TRAVERSE; method++) {
+            int scans = (method == SCAN_TRAVERSE) ? 1 : num_scans;
+            long long pairs = 0;
+
+            fprintf(stderr, "Scanning width %d with %s.\n", width,
+                    scan_str[method]);
+
+            for (run = 0; run < warmups + trials; run++) {
+                int64_t start, end;
+
+                scan_pairs = 0;
+                start = now_ns();
+                for (i = 0; i < scans; i++)
+                    scan_once(mm, method, starts[i], starts[i] + width - 1);
+                end = now_ns();
+
+                if (run >= warmups) {
+                    ns_per_scan[run - warmups] =
+                        (double) (end - start) / (double) scans;
+                }
+                pairs = scan_pairs;
+            }
+
+            summarize_trials(ns_per_scan, trials, &median, &mean, &stddev);
+            printf("%s,%d,%d,%d,%s,%d,%d,%.1f,%.1f,%.1f,%.1f\n",
+                   impl_name, t->num_pairs, t->max_key, width,
+                   scan_str[method], scans, trials,
+                   (double) pairs / (double) scans, median, mean, stddev);
+            fflush(stdout);
+        }
+    }
+
+    free(starts);
+    free(ns_per_scan);
+    clear_multimap(mm);
+    free(mm);
+}
+
+
+/* Returns the resident set size of the process in KiB, including pages of
+ * mapped files, or -1 if it is unknown.
+ */
+long rss_kb() {
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/statm", "r");
+    long size, resident;
+    int n;
+
+    if (fp == NULL)
+        return -1;
+
+    n = fscanf(fp, "%ld %ld", &size, &resident);
+    fclose(fp);
+    if (n != 2)
+        return -1;
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+
+/* Flushes a file to disk and drops it from the page cache, so that mapping
+ * it measures a cold start rather than one served from memory.
+ */
+void drop_from_page_cache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+
+    fsync(fd);
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    close(fd);
+}
+
+
+/* Runs the startup benchmark against the 15M-pair map, printing a CSV row.
+ * The map is either built from scratch and then saved to the file, or mapped
+ * in from the file.
+ */
+void run_startup_test(const char *impl_name, const char *path, int start_mode,
+                      int warmups, int trials) {
+    bench_test *t = &tests[3];
+    multimap *mm;
+    int *probe_keys, *probe_vals;
+    double *ns_per_probe, median, mean, stddev;
+    int64_t start, ready, first;
+    long rss_first, rss_all;
+    int i, run, hits = 0;
+
+    /* Generate the probes first; when rebuilding, rand() is also used to
+     * generate the map, so the probes then differ from the ones run_test()
+     * makes, but match between the two modes.
+     */
+    probe_keys = malloc(t->num_probes * sizeof(int));
+    probe_vals = malloc(t->num_probes * sizeof(int));
+    ns_per_probe = malloc(trials * sizeof(double));
+    for (i = 0; i < t->num_probes; i++) {
+        probe_keys[i] = rand() % t->max_key;
+        probe_vals[i] = rand() % t->max_val;
+    }
+
+    if (start_mode == START_MAPPED) {
+        fprintf(stderr, "Mapping %s.\n", path);
+        drop_from_page_cache(path);
+
+        start = now_ns();
+        mm = mm_open_mapped(path);
+        ready = now_ns();
+        if (mm == NULL)
+            exit(1);
+    }
+    else {
+        fprintf(stderr, "Populating %d pairs, %s keys.\n",
+                t->num_pairs, mode_str[t->keygen_mode]);
+
+        start = now_ns();
+        mm = init_multimap();
+        populate_multimap(mm, t->num_pairs, t->keygen_mode, t->max_key,
+                          t->max_val);
+        ready = now_ns();
+    }
+
+    mm_contains_pair(mm, probe_keys[0], probe_vals[0]);
+    first = now_ns();
+    rss_first = rss_kb();
+
+    for (run = 0; run < warmups + trials; run++) {
+        int64_t trial_start, trial_end;
+        int total = 0;
+
+        trial_start = now_ns();
+        for (i = 0; i < t->num_probes; i++)
+            total += mm_contains_pair(mm, probe_keys[i], probe_vals[i]);
+        trial_end = now_ns();
+
+        if (run >= warmups) {
+            ns_per_probe[run - warmups] =
+                (double) (trial_end - trial_start) / (double) t->num_probes;
+        }
+
+        if (run != 0 && total != hits) {
+            fprintf(stderr, "ERROR:  run %d found %d pairs, not %d.\n",
+                    run, total, hits);
+            exit(1);
+        }
+        hits = total;
+    }
+    rss_all = rss_kb();
+
+    summarize_trials(ns_per_probe, trials, &median, &mean, &stddev);
+    printf("%s,%s,%d,%d,%.3f,%.3f,%.3f,%d,%.3f,%.3f,%ld,%ld\n",
+           impl_name, start_str[start_mode], t->num_pairs, t->num_probes,
+           (double) (ready - start) / 1e6, (double) (first - ready) / 1e3,
+           (double) (first - start) / 1e6, hits, median, stddev,
+           rss_first, rss_all);
+    fflush(stdout);
+
+    if (start_mode == START_REBUILD) {
+        fprintf(stderr, "Saving to %s.\n", path);
+        start = now_ns();
+        if (mm_save(mm, path) != 0)
+            exit(1);
+        fprintf(stderr, "Saved in %.1f ms.\n",
+                (double) (now_ns() - start) / 1e6);
+    }
+
+    free(probe_keys);
+    free(probe_vals);
+    free(ns_per_probe);
+    clear_multimap(mm);
+    free(mm);
+}
+
+
+/* Prints the program usage. */
+void usage(const char *progname) {
+    fprintf(stderr, "usage: %s [-n name] [-c cpu] [-w warmups] [-t trials] "
+            "[-s] [-f] [-r] [-p file | -m file] [-H]\n\n", progname);
+    fprintf(stderr, "\t-n name     implementation name for the CSV "
+            "(default: program name)\n");
+    fprintf(stderr, "\t-c cpu      CPU to pin the process to (default: 0; "
+            "-1 to not pin)\n");
+    fprintf(stderr, "\t-w warmups  untimed runs per test (default: %d)\n",
+            DEFAULT_WARMUPS);
+    fprintf(stderr, "\t-t trials   timed runs per test (default: %d)\n",
+            DEFAULT_TRIALS);
+    fprintf(stderr, "\t-s          skip the slow tests\n");
+    fprintf(stderr, "\t-f          freeze each map before probing it\n");
+    fprintf(stderr, "\t-r          benchmark range scans instead of "
+            "probes\n");
+    fprintf(stderr, "\t-p file     benchmark startup by rebuilding the map, "
+            "then save it to file\n");
+    fprintf(stderr, "\t-m file     benchmark startup by mapping the map "
+            "saved in file\n");
+    fprintf(stderr, "\t-H          don't print the CSV header row\n");
+}
+
+
+int main(int argc, char **argv) {
+    const char *impl_name;
+    int opt, cpu = 0, warmups = DEFAULT_WARMUPS, trials = DEFAULT_TRIALS;
+    int skip_slow = 0, ranges = 0, header = 1, have_counters, freeze = 0;
+    int named = 0;
+    char *frozen_name;
+    int start_mode = -1;
+    const char *path = NULL;
+    bench_test *t;
+
+    impl_name = strrchr(argv[0], '/');
+    impl_name = (impl_name != NULL) ? impl_name + 1 : argv[0];
+
+    while ((opt = getopt(argc, argv, "n:c:w:t:sfrp:m:H")) != -1) {
+        switch (opt) {
+        case 'n':  impl_name = optarg;  named = 1;  break;
+        case 'c':  cpu = atoi(optarg);        break;
+        case 'w':  warmups = atoi(optarg);    break;
+        case 't':  trials = atoi(optarg);     break;
+        case 's':  skip_slow = 1;             break;
+        case 'f':  freeze = 1;                break;
+        case 'r':  ranges = 1;                break;
+        case 'p':  start_mode = START_REBUILD;  path = optarg;  break;
+        case 'm':  start_mode = START_MAPPED;   path = optarg;  break;
+        case 'H':  header = 0;                break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (warmups < 0 || trials < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Label frozen runs, unless the caller named them. */
+    if (freeze && !named) {
+        frozen_name = malloc(strlen(impl_name) + strlen("-frozen") + 1);
+        sprintf(frozen_name, "%s-frozen", impl_name);
+        impl_name = frozen_name;
+    }
+
+    if (cpu >= 0 && !pin_to_cpu(cpu))
+        fprintf(stderr, "WARNING:  couldn't pin to CPU %d.\n", cpu);
+
+    /* Same seed as mmperf, so the maps and hit counts match. */
+    srand(11);
+
+    if (start_mode != -1) {
+        if (header) {
+            printf("impl,start,pairs,probes,ready_ms,first_probe_us,"
+                   "time_to_first_probe_ms,hits,median_ns,stddev_ns,"
+                   "rss_first_kb,rss_all_kb\n");
+        }
+        run_startup_test(impl_name, path, start_mode, warmups, trials);
+        return 0;
+    }
+
+    if (ranges) {
+        if (header) {
+            printf("impl,pairs,max_key,width,method,scans,trials,"
+                   "pairs_per_scan,median_ns,mean_ns,stddev_ns\n");
+        }
+        run_range_tests(impl_name, warmups, trials);
+        return 0;
+    }
+
+    have_counters = open_counters();
+    if (!have_counters)
+        fprintf(stderr, "WARNING:  hardware counters are unavailable.\n");
+
+    if (header) {
+        printf("impl,pairs,probes,keys,max_key,max_val,trials,hits,"
+               "median_ns,mean_ns,stddev_ns,min_ns,max_ns,"
+               "l1d_misses_per_probe,llc_misses_per_probe,"
+               "branch_misses_per_probe\n");
+    }
+
+    for (t = tests; t->num_pairs != 0; t++) {
+        if (t->slow && skip_slow)
+            continue;
+
+        run_test(impl_name, t, warmups, trials, have_counters, freeze);
+    }
+
+    return 0;
+}
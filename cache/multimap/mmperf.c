@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 
 #include "multimap.h"
 #include "realtime.h"
@@ -24,6 +25,25 @@
  */
 #define EXCLUDE_SLOW_TESTS 0
 
+/* During the churn tests, a random key is removed outright once every this
+ * many rounds.
+ */
+#define KEY_REMOVAL_INTERVAL 10000
+
+
+/* Returns the number of heap bytes currently allocated by the program, so that
+ * the memory footprint of the multimap can be reported.  Large allocations
+ * are served by mmap() rather than the heap, so those are included too.
+ */
+size_t heap_bytes_in_use() {
+#ifdef __GLIBC__
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
 
 /* Populate the multimap with a specific number of key/value pairs.  The keys
  * can be generated in one of three ways, either randomly, incrementing, or
@@ -130,6 +150,7 @@ void test_multimap_perf(int num_pairs, int num_probes, int keygen_mode,
     multimap *mm;
     struct timespec ts;
     int total_hits;
+    size_t heap_before, heap_after;
     long long int start_us, end_us;
     double total_seconds, us_per_probe;
     const char *mode_str[] = { "random", "incrementing", "decrementing" };
@@ -139,11 +160,28 @@ void test_multimap_perf(int num_pairs, int num_probes, int keygen_mode,
     printf("Testing multimap performance:  %d pairs, %d probes, %s keys.\n",
            num_pairs, num_probes, mode_str[keygen_mode]);
 
+    heap_before = heap_bytes_in_use();
+
     /* Initialize the multimap data structure. */
     mm = init_multimap();
 
+    clock_get_realtime(&ts);
+    start_us = (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+
     populate_multimap(mm, num_pairs, keygen_mode, max_key, max_val);
 
+    clock_get_realtime(&ts);
+    end_us = (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+    printf("Populate wall-clock time:  %.2f seconds\n",
+           (double) (end_us - start_us) / 1000000.0);
+
+    heap_after = heap_bytes_in_use();
+    if (heap_after > heap_before) {
+        printf("Multimap memory usage:  %zu bytes (%.2f bytes per pair)\n",
+               heap_after - heap_before,
+               (double) (heap_after - heap_before) / (double) num_pairs);
+    }
+
     clock_get_realtime(&ts);
     start_us = (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
 
@@ -166,6 +204,94 @@ void test_multimap_perf(int num_pairs, int num_probes, int keygen_mode,
 }
 
 
+/* Performs a churn test against the multimap, the way a long-running service
+ * would use it:  after the multimap is populated, each round removes the
+ * oldest pair that was added, adds a new random pair, and performs two random
+ * probes.  The added pairs are remembered in a FIFO, so the size of the
+ * multimap stays about the same.  Every KEY_REMOVAL_INTERVAL rounds a random
+ * key is removed as well, which leaves some pairs in the FIFO that are no
+ * longer in the map; removing those later finds nothing.
+ */
+void test_multimap_churn(int num_pairs, int num_rounds, int max_key,
+                         int max_val) {
+    multimap *mm;
+    struct timespec ts;
+    int *fifo_keys, *fifo_vals;
+    int i, oldest, key, value, total_hits, total_removed;
+    size_t heap_before, heap_after;
+    long long int start_us, end_us;
+
+    printf("Testing multimap churn:  %d pairs, %d rounds of remove, add and "
+           "2 probes.\n", num_pairs, num_rounds);
+    printf("Keys in range [0, %d), values in range [0, %d).\n",
+           max_key, max_val);
+
+    fifo_keys = malloc(num_pairs * sizeof(int));
+    fifo_vals = malloc(num_pairs * sizeof(int));
+    if (fifo_keys == NULL || fifo_vals == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    heap_before = heap_bytes_in_use();
+
+    mm = init_multimap();
+    for (i = 0; i < num_pairs; i++) {
+        fifo_keys[i] = rand() % max_key;
+        fifo_vals[i] = rand() % max_val;
+        mm_add_value(mm, fifo_keys[i], fifo_vals[i]);
+    }
+
+    clock_get_realtime(&ts);
+    start_us = (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+
+    total_hits = 0;
+    total_removed = 0;
+    oldest = 0;
+    for (i = 0; i < num_rounds; i++) {
+        total_removed += mm_remove_pair(mm, fifo_keys[oldest],
+                                        fifo_vals[oldest]);
+
+        fifo_keys[oldest] = rand() % max_key;
+        fifo_vals[oldest] = rand() % max_val;
+        mm_add_value(mm, fifo_keys[oldest], fifo_vals[oldest]);
+        oldest = (oldest + 1) % num_pairs;
+
+        key = rand() % max_key;
+        value = rand() % max_val;
+        total_hits += mm_contains_pair(mm, key, value);
+
+        key = rand() % max_key;
+        value = rand() % max_val;
+        total_hits += mm_contains_pair(mm, key, value);
+
+        if (i % KEY_REMOVAL_INTERVAL == KEY_REMOVAL_INTERVAL - 1)
+            mm_remove_key(mm, rand() % max_key);
+    }
+
+    clock_get_realtime(&ts);
+    end_us = (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+
+    printf("%d out of %d removals found their pair; %d out of %d probes hit\n",
+           total_removed, num_rounds, total_hits, 2 * num_rounds);
+
+    heap_after = heap_bytes_in_use();
+    if (heap_after > heap_before) {
+        printf("Multimap memory usage after churn:  %zu bytes\n",
+               heap_after - heap_before);
+    }
+
+    printf("Total wall-clock time:  %.2f seconds\t\t\u03BCs per round:"
+           "  %.3f \u03BCs\n\n", (double) (end_us - start_us) / 1000000.0,
+           (double) (end_us - start_us) / (double) num_rounds);
+
+    clear_multimap(mm);
+    free(mm);
+    free(fifo_keys);
+    free(fifo_vals);
+}
+
+
 int main() {
     srand(11);
 
@@ -204,6 +330,11 @@ int main() {
     test_multimap_perf(100000, SCALE * 5000, MODE_DECR, 100000, 50);
 #endif
 
+    /* Arguments:  num_pairs, num_rounds, max_key, max_value */
+
+    test_multimap_churn(300000, SCALE * 10000, 50, 1000);
+    test_multimap_churn(1000000, SCALE * 10000, 100000, 50);
+
     return 0;
 }
 
@@ -1,7 +1,9 @@
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "multimap.h"
+#include "mm_file.h"
 
 
 int failures = 0;
@@ -44,6 +46,43 @@ int probe_keys[] = {
 };
 
 
+int range_tests[] = {
+    2, 3, 2, 3,  /* lo, hi, number of keys, number of values */
+    0, 100, 4, 6,
+    3, 3, 1, 1,
+    5, 9, 0, 0,
+    4, 1, 0, 0,
+    -1
+};
+
+
+/* The bulk test adds many values to a few keys, so that implementations which
+ * store values in fixed-size blocks spill across many blocks.  The values are
+ * the even numbers in [-BULK_RANGE, BULK_RANGE), each added more than once.
+ */
+#define BULK_KEYS 4
+#define BULK_VALUES 2000
+#define BULK_RANGE 1500
+
+/* The many-keys test adds this many keys, the multiples of 3 in
+ * [0, 3 * MANY_KEYS), in scrambled order, so that the tree has some depth.
+ */
+#define MANY_KEYS 1000
+
+/* Where the bulk multimap is saved to test mm_save() and mm_open_mapped(). */
+#define SAVE_PATH "mmtest.saved"
+
+
+int bulk_value(int key, int i) {
+    return ((i * 7919 + key * 13) % BULK_RANGE) * 2 - BULK_RANGE;
+}
+
+
+int many_key(int i) {
+    return (i * 7919 % MANY_KEYS) * 3;
+}
+
+
 int prev_key;
 
 void check_order(int key, int value) {
@@ -59,11 +98,287 @@ void check_order(int key, int value) {
 }
 
 
+int range_lo, range_hi, range_keys, range_values, range_failures;
 
-int main() {
+void check_range(int key, const int *values, int num_values) {
+    if (key < range_lo || key > range_hi ||
+        (range_keys > 0 && key <= prev_key)) {
+        printf(" - key %d OUT OF RANGE OR ORDER!", key);
+        range_failures++;
+    }
+
+    prev_key = key;
+    range_keys++;
+    range_values += num_values;
+}
+
+
+int pair_count;
+
+void count_pair(int key, int value) {
+    pair_count++;
+}
+
+
+/* Probes, traverses and range-queries the bulk multimap, returning the
+ * number of failures.
+ */
+int check_bulk(multimap *mm) {
+    int bulk_failures = 0;
+    int key, i;
+
+    for (key = -1; key <= BULK_KEYS; key++) {
+        int answer = (key >= 0 && key < BULK_KEYS);
+        if (mm_contains_key(mm, key) != answer)
+            bulk_failures++;
+    }
+
+    for (key = 0; key < BULK_KEYS; key++) {
+        for (i = -BULK_RANGE - 100; i < BULK_RANGE + 100; i++) {
+            int answer = (i % 2 == 0 && i >= -BULK_RANGE && i < BULK_RANGE);
+            int probe = mm_contains_pair(mm, key, i);
+
+            if ((probe && !answer) || (!probe && answer))
+                bulk_failures++;
+        }
+    }
+
+    pair_count = 0;
+    mm_traverse(mm, count_pair);
+    if (pair_count != BULK_KEYS * BULK_VALUES)
+        bulk_failures++;
+
+    range_lo = 1;
+    range_hi = BULK_KEYS - 2;
+    range_keys = range_values = range_failures = 0;
+    mm_range(mm, range_lo, range_hi, check_range);
+    if (range_failures != 0 || range_values != (BULK_KEYS - 2) * BULK_VALUES)
+        bulk_failures++;
+
+    return bulk_failures;
+}
+
+
+/* Probes every key around the many-keys multimap, as well as the pair
+ * (key, key), returning the number of failures.
+ */
+int check_many_keys(multimap *mm) {
+    int key_failures = 0;
+    int key;
+
+    for (key = -1; key <= 3 * MANY_KEYS; key++) {
+        int answer = (key >= 0 && key < 3 * MANY_KEYS && key % 3 == 0);
+        if (mm_contains_key(mm, key) != answer)
+            key_failures++;
+        if (mm_contains_pair(mm, key, key) != answer)
+            key_failures++;
+    }
+
+    return key_failures;
+}
+
+
+/* Checks the many-keys multimap against the expected state of each key:  bit
+ * 0 is set if it should hold (key, key), and bit 1 if it should hold
+ * (key, key + 1).  Returns the number of failures.
+ */
+int check_removed(multimap *mm, const int *state) {
+    int removal_failures = 0;
+    int i, num_keys = 0, num_pairs = 0;
+
+    for (i = 0; i < MANY_KEYS; i++) {
+        int key = many_key(i);
+
+        if (mm_contains_key(mm, key) != (state[i] != 0) ||
+            mm_contains_pair(mm, key, key) != (state[i] & 1) ||
+            mm_contains_pair(mm, key, key + 1) != (state[i] >> 1))
+            removal_failures++;
+
+        num_keys += (state[i] != 0);
+        num_pairs += (state[i] & 1) + (state[i] >> 1);
+    }
+
+    /* The remaining keys must still come out in order. */
+    range_lo = 0;
+    range_hi = 3 * MANY_KEYS;
+    range_keys = range_values = range_failures = 0;
+    mm_range(mm, range_lo, range_hi, check_range);
+    if (range_failures != 0 || range_keys != num_keys ||
+        range_values != num_pairs)
+        removal_failures++;
+
+    return removal_failures;
+}
+
+
+/* Removes pairs and keys from a multimap of MANY_KEYS keys in several
+ * patterns, then adds some back, checking the contents after each step.
+ * Returns the number of failures.
+ */
+int check_removals() {
     multimap *mm;
+    int state[MANY_KEYS];
+    int removal_failures = 0;
     int i;
 
+    mm = init_multimap();
+    for (i = 0; i < MANY_KEYS; i++) {
+        mm_add_value(mm, many_key(i), many_key(i));
+        mm_add_value(mm, many_key(i), many_key(i) + 1);
+        state[i] = 3;
+    }
+
+    /* Remove the second pair of every other key. */
+    for (i = 0; i < MANY_KEYS; i += 2) {
+        if (!mm_remove_pair(mm, many_key(i), many_key(i) + 1) ||
+            mm_remove_pair(mm, many_key(i), many_key(i) + 1))
+            removal_failures++;
+        state[i] &= 1;
+    }
+
+    /* Remove every third key outright. */
+    for (i = 0; i < MANY_KEYS; i += 3) {
+        if (!mm_remove_key(mm, many_key(i)) ||
+            mm_remove_key(mm, many_key(i)))
+            removal_failures++;
+        state[i] = 0;
+    }
+
+    /* Remove the first pair of every fifth key, which removes the key too
+     * if it has no pairs left.
+     */
+    for (i = 0; i < MANY_KEYS; i += 5) {
+        if (mm_remove_pair(mm, many_key(i), many_key(i)) != (state[i] & 1))
+            removal_failures++;
+        state[i] &= 2;
+    }
+    removal_failures += check_removed(mm, state);
+
+    /* Adding keys back reuses the removed nodes. */
+    for (i = 0; i < MANY_KEYS; i += 3) {
+        mm_add_value(mm, many_key(i), many_key(i));
+        state[i] |= 1;
+    }
+    removal_failures += check_removed(mm, state);
+
+    /* Empty the multimap completely, and then use it again. */
+    for (i = 0; i < MANY_KEYS; i++) {
+        if (mm_remove_key(mm, many_key(i)) != (state[i] != 0))
+            removal_failures++;
+        state[i] = 0;
+    }
+    removal_failures += check_removed(mm, state);
+
+    mm_add_value(mm, many_key(1), many_key(1));
+    state[1] = 1;
+    removal_failures += check_removed(mm, state);
+
+    clear_multimap(mm);
+    free(mm);
+
+    return removal_failures;
+}
+
+
+/* Overwrites one field of the saved root node with a bad value, and checks
+ * that mm_open_mapped() refuses the file.  The field is restored afterward.
+ * Returns 1 if the corrupt file was mapped, 0 if it was refused.
+ */
+int check_corrupt_field(const char *path, long field, const void *bad,
+                        size_t size) {
+    char saved[sizeof(uint64_t)];
+    long offset = (long) sizeof(mm_file_header) + field;
+    multimap *mm;
+    FILE *fp;
+
+    fp = fopen(path, "r+b");
+    if (fp == NULL || fseek(fp, offset, SEEK_SET) != 0 ||
+        fread(saved, size, 1, fp) != 1 || fseek(fp, offset, SEEK_SET) != 0 ||
+        fwrite(bad, size, 1, fp) != 1 || fflush(fp) != 0) {
+        perror(path);
+        if (fp != NULL)
+            fclose(fp);
+        return 1;
+    }
+
+    mm = mm_open_mapped(path);
+    if (mm != NULL) {
+        clear_multimap(mm);
+        free(mm);
+    }
+
+    fseek(fp, offset, SEEK_SET);
+    fwrite(saved, size, 1, fp);
+    fclose(fp);
+
+    return mm != NULL;
+}
+
+
+/* Corrupts the root node of a saved multimap in each way mm_file_open()
+ * checks for, returning the number of corrupt files that were mapped.
+ */
+int check_corrupt_files(const char *path) {
+    int32_t bad_child = -1;
+    int32_t far_child = INT32_MAX;
+    int32_t bad_count = -1;
+    uint64_t bad_first = UINT64_MAX;
+    int corrupt_failures = 0;
+
+    corrupt_failures += check_corrupt_field(path,
+        offsetof(mm_file_node, left_child), &bad_child, sizeof(int32_t));
+    corrupt_failures += check_corrupt_field(path,
+        offsetof(mm_file_node, right_child), &far_child, sizeof(int32_t));
+    corrupt_failures += check_corrupt_field(path,
+        offsetof(mm_file_node, num_values), &bad_count, sizeof(int32_t));
+    corrupt_failures += check_corrupt_field(path,
+        offsetof(mm_file_node, first_value), &bad_first, sizeof(uint64_t));
+
+    return corrupt_failures;
+}
+
+
+/* Points both children of node 1 of a saved multimap back at node 1, which
+ * mm_open_mapped() can't tell from a reused node, and checks that probes
+ * and a traversal of the mapped file still end.  The file is left corrupt.
+ * Returns 1 if the file wasn't mapped, 0 otherwise.
+ */
+int check_cyclic_file(const char *path) {
+    int32_t children[2] = { 1, 1 };
+    long offset = (long) (sizeof(mm_file_header) + sizeof(mm_file_node) +
+                          offsetof(mm_file_node, left_child));
+    multimap *mm;
+    FILE *fp;
+    int key;
+
+    fp = fopen(path, "r+b");
+    if (fp == NULL || fseek(fp, offset, SEEK_SET) != 0 ||
+        fwrite(children, sizeof(children), 1, fp) != 1) {
+        perror(path);
+        if (fp != NULL)
+            fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+
+    mm = mm_open_mapped(path);
+    if (mm == NULL)
+        return 1;
+
+    for (key = -1; key <= BULK_KEYS; key++)
+        mm_contains_key(mm, key);
+    mm_traverse(mm, count_pair);
+
+    clear_multimap(mm);
+    free(mm);
+    return 0;
+}
+
+
+int main() {
+    multimap *mm, *saved;
+    int i, key, bulk_failures;
+
     failures = 0;
 
     /* Initialize the multimap data structure. */
@@ -118,10 +433,155 @@ int main() {
     prev_key = -1;
     mm_traverse(mm, check_order);
 
+    printf("\nChecking range queries.\n");
+    for (i = 0; range_tests[i] != -1; i += 4) {
+        mm_iter *it;
+        const int *values;
+        int key, num_values, iter_keys, iter_values;
+
+        range_lo = range_tests[i];
+        range_hi = range_tests[i + 1];
+
+        /* First with the callback... */
+        range_keys = range_values = range_failures = 0;
+        mm_range(mm, range_lo, range_hi, check_range);
+        iter_keys = range_keys;
+        iter_values = range_values;
+
+        /* ...and then with an iterator. */
+        range_keys = range_values = 0;
+        it = mm_iter_begin(mm, range_lo, range_hi);
+        while (mm_iter_next(it, &key, &values, &num_values))
+            check_range(key, values, num_values);
+        mm_iter_end(it);
+
+        printf(" * [%d, %d] should have %d keys and %d values:  ",
+               range_lo, range_hi, range_tests[i + 2], range_tests[i + 3]);
+
+        if (range_failures == 0 &&
+            iter_keys == range_tests[i + 2] && range_keys == iter_keys &&
+            iter_values == range_tests[i + 3] && range_values == iter_values) {
+            printf("PASS");
+        }
+        else {
+            printf("FAIL");
+            failures++;
+        }
+
+        printf("\n");
+    }
+
     printf("\nTesting finished, freeing multimap.\n");
     clear_multimap(mm);
     free(mm);
 
+    printf("\nAdding %d values to each of %d keys.\n", BULK_VALUES, BULK_KEYS);
+    mm = init_multimap();
+    for (i = 0; i < BULK_KEYS; i++) {
+        /* Start with key 1, so that the tree has a left child as well. */
+        int j;
+        key = (i + 1) % BULK_KEYS;
+        for (j = 0; j < BULK_VALUES; j++)
+            mm_add_value(mm, key, bulk_value(key, j));
+    }
+
+    bulk_failures = check_bulk(mm);
+    printf(" * %d probes and traversal of %d pairs:  %s\n",
+           BULK_KEYS * (2 * BULK_RANGE + 200), pair_count,
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    printf("\nFreezing the multimap.\n");
+    mm_freeze(mm);
+    bulk_failures = check_bulk(mm);
+    printf(" * the same probes of the frozen multimap:  %s\n",
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    printf("\nSaving the multimap to %s and mapping it back in.\n",
+           SAVE_PATH);
+    saved = NULL;
+    if (mm_save(mm, SAVE_PATH) == 0)
+        saved = mm_open_mapped(SAVE_PATH);
+
+    clear_multimap(mm);
+    free(mm);
+
+    if (saved != NULL) {
+        bulk_failures = check_bulk(saved);
+        clear_multimap(saved);
+        free(saved);
+    }
+    else {
+        bulk_failures = 1;
+    }
+
+    printf(" * the same probes of the mapped multimap:  %s\n",
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    bulk_failures = check_corrupt_files(SAVE_PATH);
+    printf(" * refusing to map the file with a corrupt root node:  %s\n",
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    bulk_failures = check_cyclic_file(SAVE_PATH);
+    remove(SAVE_PATH);
+    printf(" * probing the file with a node that is its own child:  %s\n",
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    printf("\nAdding %d keys in scrambled order, and freezing.\n", MANY_KEYS);
+    mm = init_multimap();
+    for (i = 0; i < MANY_KEYS; i++)
+        mm_add_value(mm, many_key(i), many_key(i));
+
+    bulk_failures = check_many_keys(mm);
+    mm_freeze(mm);
+    bulk_failures += check_many_keys(mm);
+    printf(" * %d key probes before and after freezing:  %s\n",
+           4 * (3 * MANY_KEYS + 2), bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    clear_multimap(mm);
+    free(mm);
+
+    printf("\nRemoving pairs and keys from %d keys.\n", MANY_KEYS);
+    bulk_failures = check_removals();
+    printf(" * removals, re-additions and probes:  %s\n",
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    printf("\nRemoving most of the values of a bulk key.\n");
+    mm = init_multimap();
+    for (key = 0; key < 2; key++) {
+        for (i = 0; i < BULK_VALUES; i++)
+            mm_add_value(mm, key, bulk_value(key, i));
+    }
+
+    /* Keep only the values in [BULK_RANGE - 100, BULK_RANGE) for key 0. */
+    for (i = -BULK_RANGE; i < BULK_RANGE - 100; i++) {
+        while (mm_remove_pair(mm, 0, i))
+            continue;
+    }
+
+    bulk_failures = 0;
+    for (key = 0; key < 2; key++) {
+        for (i = -BULK_RANGE - 100; i < BULK_RANGE + 100; i++) {
+            int lo = (key == 0) ? BULK_RANGE - 100 : -BULK_RANGE;
+            int answer = (i % 2 == 0 && i >= lo && i < BULK_RANGE);
+
+            if (mm_contains_pair(mm, key, i) != answer)
+                bulk_failures++;
+        }
+    }
+    printf(" * probes of the remaining values:  %s\n",
+           bulk_failures == 0 ? "PASS" : "FAIL");
+    failures += bulk_failures;
+
+    clear_multimap(mm);
+    free(mm);
+
     printf("\nFinal results:  %d failures\n", failures);
 
     return 0;
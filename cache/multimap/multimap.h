@@ -24,6 +24,17 @@ void clear_multimap(multimap *mm);
 /* Adds the specified (key, value) pair to the multimap. */
 void mm_add_value(multimap *mm, int key, int value);
 
+/* Removes one occurrence of the specified (key, value) pair from the
+ * multimap.  If it was the key's last value, the key is removed as well.
+ * Returns nonzero if the pair was found, zero otherwise.
+ */
+int mm_remove_pair(multimap *mm, int key, int value);
+
+/* Removes the specified key and all of its values from the multimap.
+ * Returns nonzero if the key was found, zero otherwise.
+ */
+int mm_remove_key(multimap *mm, int key);
+
 /* Returns nonzero if the multimap contains the specified key-value, zero
  * otherwise.
  */
@@ -39,5 +50,54 @@ int mm_contains_pair(multimap *mm, int key, int value);
  */
 void mm_traverse(multimap *mm, void (*f)(int key, int value));
 
+/* Passes every key in the range [lo, hi] to the specified function, in
+ * increasing order, along with an array of all of that key's values.  Only
+ * the part of the multimap that can hold keys in the range is visited.  The
+ * values array is only valid for the duration of the call.
+ */
+void mm_range(multimap *mm, int lo, int hi,
+              void (*f)(int key, const int *values, int num_values));
+
+
+/* An iterator over the keys in a range of the multimap, for callers that
+ * would rather pull keys out one at a time than receive callbacks.  The
+ * multimap must not be modified while an iterator is in use.
+ */
+typedef struct mm_iter mm_iter;
+
+/* Starts iterating over the keys in the range [lo, hi]. */
+mm_iter * mm_iter_begin(multimap *mm, int lo, int hi);
+
+/* Retrieves the next key in the range, and an array of all of its values.
+ * The values array is only valid until the next call on the iterator.
+ * Returns nonzero if a key was retrieved, or zero at the end of the range.
+ */
+int mm_iter_next(mm_iter *it, int *key, const int **values, int *num_values);
+
+/* Releases the iterator. */
+void mm_iter_end(mm_iter *it);
+
+
+/* Writes the multimap to a file in the format described in mm_file.h, which
+ * mm_open_mapped() can map straight back into memory.  Returns 0 on success,
+ * or -1 if the file couldn't be written.
+ */
+int mm_save(multimap *mm, const char *path);
+
+/* Maps a multimap saved by mm_save() into memory, read-only.  The multimap
+ * can be probed, traversed and iterated over immediately, since nothing is
+ * rebuilt; pages are only read in as probes touch them.  Adding values to it
+ * is an error.  clear_multimap() unmaps the file.  Returns NULL if the file
+ * can't be mapped.
+ */
+multimap * mm_open_mapped(const char *path);
+
+
+/* Declares that the multimap is fully populated.  Implementations may then
+ * reorganize it for faster probes; adding values to a frozen multimap is an
+ * error.  Probes, traversals and range queries work as before.
+ */
+void mm_freeze(multimap *mm);
+
 #endif
 
@@ -1,9 +1,12 @@
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "mm_file.h"
 #include "multimap.h"
+#include "packed_values.h"
 
 /* The block_size of cache. */
 #define BLOCK_SIZE 64
@@ -22,6 +25,76 @@
  */
 #define TREE_SIZE 16
 
+/* Value arrays bigger than this many values are shrunk by half when removals
+ * leave them less than a quarter full.  This is well above the largest value
+ * pool class, so shrunk arrays always stay with malloc().
+ */
+#define LIST_SHRINK_SIZE 64
+
+/* How the tree-node pool and large value arrays grow when they fill up, as a
+ * percentage of their current size.  With a percentage of 0 they grow by a
+ * constant TREE_SIZE nodes or LIST_SIZE values, which costs O(n^2) realloc
+ * copying for large maps; otherwise they grow geometrically, so each element
+ * is copied O(1) times on average.  Value arrays grow more slowly than the
+ * node pool, since there are many of them and the slack adds up.
+ */
+#ifndef TREE_GROWTH_PERCENT
+#define TREE_GROWTH_PERCENT 100
+#endif
+
+#ifndef LIST_GROWTH_PERCENT
+#define LIST_GROWTH_PERCENT 25
+#endif
+
+/* Set this to 1 to carve small value arrays out of shared slabs, instead of
+ * giving each array its own malloc() block.  Small arrays come in a few size
+ * classes of VALUE_POOL_MIN_CLASS, 2 * VALUE_POOL_MIN_CLASS, ... ints, up to
+ * VALUE_POOL_NUM_CLASSES classes; since the slabs are cache-line aligned and
+ * there is no per-allocation header, several small arrays share one cache
+ * line.  Arrays that outgrow the largest class are moved to malloc().
+ */
+#ifndef VALUE_POOL
+#define VALUE_POOL 1
+#endif
+
+#define VALUE_POOL_MIN_CLASS 4
+#define VALUE_POOL_NUM_CLASSES 3
+#define VALUE_POOL_MAX_CLASS \
+    (VALUE_POOL_MIN_CLASS << (VALUE_POOL_NUM_CLASSES - 1))
+
+/* The number of bytes in each slab of the value pool. */
+#define VALUE_SLAB_SIZE 65536
+
+/* Set this to 1 to store each key's values as a sorted, bit-packed list (see
+ * packed_values.h) instead of a plain int array.  This shrinks keys with many
+ * values considerably, and lets mm_contains_pair() binary-search the values
+ * instead of scanning them.  The "packed" targets in the Makefile build this
+ * implementation with the option turned on.
+ */
+#ifndef PACKED_VALUES
+#define PACKED_VALUES 0
+#endif
+
+/* mm_freeze() copies the keys into an implicit tree stored in Eytzinger
+ * (breadth-first) order:  the children of slot k are slots 2k and 2k + 1, so
+ * a probe needs no child indexes and can be written without branches.  Since
+ * 16 keys fit in a cache block, the 16 possible descendants of slot k four
+ * levels down are the contiguous slots 16k to 16k + 15; with FREEZE_PREFETCH
+ * turned on, each step of a probe prefetches that block, so the cache misses
+ * of consecutive levels overlap.
+ */
+#ifndef FREEZE_PREFETCH
+#define FREEZE_PREFETCH 1
+#endif
+
+/* Set this to 1 to have mm_freeze() also sort each key's value array, so that
+ * probes of a frozen multimap can binary-search the values instead of scanning
+ * them.  (Packed value-lists are always sorted.)
+ */
+#ifndef FREEZE_SORTS_VALUES
+#define FREEZE_SORTS_VALUES 1
+#endif
+
 
 /*============================================================================
  * TYPES
@@ -42,8 +115,13 @@ typedef struct multimap_node {
     /* Optimized version: in order to get a contiguous memory to hold all
      * the values, we change the data structure of linked list into int
      * array. In this way, we would improve the locality for cache.
+     * With PACKED_VALUES, this is a sorted, bit-packed list instead.
      */
+#if PACKED_VALUES
+    packed_values *values;
+#else
     int *values;
+#endif
 
     /* The current number of elements the value array */
     int value_length;
@@ -53,10 +131,11 @@ typedef struct multimap_node {
      */
     int value_size;
 
-    /* This variable is used to make the multimap_node to be 32 bytes, so that
-     * a block size can fit in two multimap_nodes.
+    /* Nonzero if the node has been removed, and is on the pool's free list.
+     * This variable is also used to make the multimap_node to be 32 bytes, so
+     * that a block size can fit in two multimap_nodes.
      */
-    int useless;
+    int is_free;
 
     /* The tree_index represents the relative position of a tree node in the
      * whole object pool. In this way, we can access the node by calling
@@ -78,24 +157,101 @@ typedef struct multimap_node {
 } multimap_node;
 
 
+/* The size-class pool that small value arrays are allocated from.  Each
+ * class has its own current slab, so that arrays are aligned to their size.
+ * Freed arrays are kept on a per-class free list, linked through their first
+ * bytes.
+ */
+typedef struct value_pool {
+    /* The freed arrays of each size class. */
+    void *free_lists[VALUE_POOL_NUM_CLASSES];
+
+    /* The next unused array in each class's current slab, and how many bytes
+     * remain in that slab.
+     */
+    char *slab_pos[VALUE_POOL_NUM_CLASSES];
+    int slab_left[VALUE_POOL_NUM_CLASSES];
+
+    /* Every slab allocated so far, so they can be released. */
+    void **slabs;
+    int num_slabs;
+    int max_slabs;
+} value_pool;
+
+
 /* The entry-point of the multimap data structure. */
 struct multimap {
     multimap_node *root;
+
+    /* We change the tree structure into multimap_node arrays. Before that,
+     * every tree node is independently allocated, so the memory address of
+     * these node are very far from each other. Here, we managed an object
+     * pool with contiguous memory, in order to hold all the tree nodes. Each
+     * time we add a new tree node, we get some space from the object pool to
+     * put it in.  The tree_head is simply the start of memory pool.
+     * Tree_length means currently how many nodes are in the pool, and
+     * tree_size means how many nodes in total the current pool can hold. If
+     * tree_length exceeds tree_size, we reallocate a bigger pool and move
+     * everything to the new pool.  The pool lives in the multimap itself, so
+     * that several multimaps can be used at once.
+     */
+    multimap_node *tree_head;
+    int tree_length;
+    int tree_size;
+
+    /* Removed nodes are kept on a free list, linked through their
+     * left_child, and reused before the pool grows.  free_nodes is the
+     * tree_index of the first one, or 0 if the list is empty; the root never
+     * moves from index 0, so it can't be on the list.
+     */
+    int free_nodes;
+
+    /* The pool that small value arrays are allocated from. */
+    value_pool pool;
+
+    /* If the multimap was opened with mm_open_mapped(), this is the saved
+     * file it was mapped from, and the node pool above stays empty.
+     */
+    mm_mapped *mapped;
+
+    /* Once mm_freeze() has been called, frozen_keys holds every key in
+     * Eytzinger order, starting at slot 1, and frozen_nodes holds the
+     * tree_index of each key's node.  frozen_length is the number of keys.
+     * The tree itself is left as it is, for traversals.
+     */
+    int *frozen_keys;
+    int *frozen_nodes;
+    int frozen_length;
+    int frozen;
 };
 
-/* We change the tree structure into multimap_node arrays. Before that, every
- * tree node is independently allocated, so the memory address of these node
- * are very far from each other. Here, we managed an object pool with
- * contiguous memory, in order to hold all the tree nodes. Each time we add
- * a new tree node, we get some space from the object pool to put it in.
- * The tree_head is simply the start of memory pool. Tree_length means
- * currently how many nodes are in the pool, and tree_size means how many nodes
- * in total the current pool can hold. If tree_length exceeds tree_size,
- * we reallocate a bigger pool and move everything to the new pool.
+
+/* The state of an iteration over a range of keys.  Instead of recursing like
+ * mm_traverse() does, the iterator keeps an explicit stack of the tree_index
+ * of each node whose key is still to be visited, with the next key on top.
+ * Only nodes on the path to keys in the range are ever pushed.
  */
-multimap_node *tree_head;
-int tree_length;
-int tree_size;
+struct mm_iter {
+    multimap *mm;
+
+    /* The range of keys being iterated over. */
+    int lo;
+    int hi;
+
+    /* The stack of nodes still to be visited. */
+    int *stack;
+    int depth;
+    int max_depth;
+
+    /* Iterations over a mapped multimap are handed off to this iterator. */
+    mm_file_iter file_iter;
+
+#if PACKED_VALUES
+    /* Packed values are unpacked into this buffer to hand them out. */
+    int *buffer;
+    int buffer_size;
+#endif
+};
 
 
 /*============================================================================
@@ -114,7 +270,32 @@ void free_multimap_values(int *values);
 void free_multimap_node(multimap_node *node);
 
 /* Optimized version: helper functions */
-void node_add_value(multimap_node *node, int value);
+int * alloc_value_array(multimap *mm, int size);
+void free_value_array(multimap *mm, int *values, int size);
+int grow_size(int size, int percent, int increment);
+
+void node_add_value(multimap *mm, multimap_node *node, int value);
+int node_contains_value(multimap_node *node, int value);
+int node_remove_value(multimap *mm, multimap_node *node, int value);
+void node_release_values(multimap *mm, multimap_node *node);
+
+int find_node_index(multimap *mm, int key, int *parent);
+void free_mm_node(multimap *mm, int index);
+void replace_child(multimap *mm, int parent, int old_child, int new_child);
+void remove_mm_node(multimap *mm, int index, int parent);
+void check_modifiable(multimap *mm);
+
+void iter_init(mm_iter *it, multimap *mm, int lo, int hi);
+void iter_push_path(mm_iter *it, int index);
+void iter_release(mm_iter *it);
+
+int compare_values(const void *v1, const void *v2);
+int fill_eytzinger(multimap *mm, const int *sorted, int next, int slot);
+multimap_node * find_frozen_node(multimap *mm, int key);
+int sorted_contains_value(multimap_node *node, int value);
+
+void save_node(void *ctx, int index, int *key, int *left_child,
+               int *right_child, const int **values, int *num_values);
 
 
 /*============================================================================
@@ -125,40 +306,139 @@ void node_add_value(multimap_node *node, int value);
  * the initial value of everything will be.
  */
 multimap_node * alloc_mm_node(multimap *mm) {
-    if (tree_head == NULL) {
+    if (mm->free_nodes != 0) {
+        /* reuse a removed node */
+        multimap_node *node = mm->tree_head + mm->free_nodes;
+        mm->free_nodes = node->left_child;
+
+        bzero(node, sizeof(multimap_node));
+        node->tree_index = node - mm->tree_head;
+        return node;
+    }
+
+    if (mm->tree_head == NULL) {
         /* if there is currently no node, allocate one block */
         multimap_node *new_head = 
             (multimap_node *) malloc(TREE_SIZE * sizeof(multimap_node));
 
-        tree_head = new_head;
-        tree_size += TREE_SIZE;
+        mm->tree_head = new_head;
+        mm->tree_size = TREE_SIZE;
     }
-    else if (tree_length == tree_size) {
+    else if (mm->tree_length == mm->tree_size) {
         /* if the current memory is full, allocate a bigger one */
-        int new_size = (tree_size + TREE_SIZE) * sizeof(multimap_node);
+        int new_count = grow_size(mm->tree_size, TREE_GROWTH_PERCENT,
+                                  TREE_SIZE);
+        size_t new_size = (size_t) new_count * sizeof(multimap_node);
 
         multimap_node *new_head = 
-            (multimap_node *) realloc(tree_head, new_size);
+            (multimap_node *) realloc(mm->tree_head, new_size);
         /* handles allocation error */
         if (new_head == NULL) {
             printf("Not enough memory.\n");
             exit(0);
         }
 
-        tree_head = new_head;
-        mm->root = tree_head;
-        tree_size += TREE_SIZE;
+        mm->tree_head = new_head;
+        mm->root = mm->tree_head;
+        mm->tree_size = new_count;
     }
     /* nothing special */
-    tree_length += 1;
-    multimap_node *node = tree_head + tree_length - 1;
+    mm->tree_length += 1;
+    multimap_node *node = mm->tree_head + mm->tree_length - 1;
     /* clear the allocated node */
     bzero(node, sizeof(multimap_node));
-    node->tree_index = tree_length - 1;
+    node->tree_index = mm->tree_length - 1;
     return node;   
 }    
 
 
+/* Computes the new capacity of a pool or array that has filled up, according
+ * to the growth percentage.  It always grows by at least the specified
+ * increment, so a percentage of 0 means linear growth.
+ */
+int grow_size(int size, int percent, int increment) {
+    int growth = (int) ((long long) size * percent / 100);
+
+    return size + (growth > increment ? growth : increment);
+}
+
+
+/* Allocates an array with room for size ints.  Sizes up to
+ * VALUE_POOL_MAX_CLASS must be one of the pool's size classes, and come from
+ * the pool; anything larger comes from malloc().
+ */
+int * alloc_value_array(multimap *mm, int size) {
+    value_pool *pool = &mm->pool;
+    int c, bytes;
+    void *array;
+
+    if (!VALUE_POOL || size > VALUE_POOL_MAX_CLASS) {
+        array = malloc(size * sizeof(int));
+        if (array == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+        return (int *) array;
+    }
+
+    /* Figure out the size class. */
+    for (c = 0; (VALUE_POOL_MIN_CLASS << c) < size; c++);
+    assert((VALUE_POOL_MIN_CLASS << c) == size);
+    bytes = size * sizeof(int);
+
+    /* Reuse a freed array if there is one. */
+    if (pool->free_lists[c] != NULL) {
+        array = pool->free_lists[c];
+        pool->free_lists[c] = *(void **) array;
+        return (int *) array;
+    }
+
+    /* Otherwise, carve the array out of the class's slab, starting a new
+     * cache-line aligned slab if the current one is used up.
+     */
+    if (pool->slab_left[c] < bytes) {
+        void *slab;
+
+        if (pool->num_slabs == pool->max_slabs) {
+            pool->max_slabs = pool->max_slabs ? 2 * pool->max_slabs : 16;
+            pool->slabs = realloc(pool->slabs,
+                                  pool->max_slabs * sizeof(void *));
+        }
+
+        if (posix_memalign(&slab, BLOCK_SIZE, VALUE_SLAB_SIZE) != 0 ||
+            pool->slabs == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+
+        pool->slabs[pool->num_slabs++] = slab;
+        pool->slab_pos[c] = (char *) slab;
+        pool->slab_left[c] = VALUE_SLAB_SIZE;
+    }
+
+    array = pool->slab_pos[c];
+    pool->slab_pos[c] += bytes;
+    pool->slab_left[c] -= bytes;
+    return (int *) array;
+}
+
+
+/* Releases an array allocated by alloc_value_array(). */
+void free_value_array(multimap *mm, int *values, int size) {
+    value_pool *pool = &mm->pool;
+    int c;
+
+    if (!VALUE_POOL || size > VALUE_POOL_MAX_CLASS) {
+        free(values);
+        return;
+    }
+
+    for (c = 0; (VALUE_POOL_MIN_CLASS << c) < size; c++);
+    *(void **) values = pool->free_lists[c];
+    pool->free_lists[c] = values;
+}
+
+
 /* This helper function searches for the multimap node that contains the
  * specified key.  If such a node doesn't exist, the function can initialize
  * a new node and add this into the structure, or it will simply return NULL.
@@ -194,13 +474,13 @@ multimap_node * find_mm_node(multimap *mm, multimap_node *root, int key,
                 /* here, note that the reallocation might move the whole block
                  * to somewhere else, thus the node pointer may be erased or
                  * modified. So we record the tree_index and access the node
-                 * through tree_head.
+                 * through mm->tree_head.
                  */
-                node = tree_head + index;
+                node = mm->tree_head + index;
                 node->left_child = new->tree_index;
             }
-            node = tree_head + node->left_child;
-            if (node == tree_head)
+            node = mm->tree_head + node->left_child;
+            if (node == mm->tree_head)
                 return NULL;
         }
         else {                   /* Follow right child */
@@ -211,11 +491,11 @@ multimap_node * find_mm_node(multimap *mm, multimap_node *root, int key,
                 new->key = key;
 
                 /* same for right child part */
-                node = tree_head + index;
+                node = mm->tree_head + index;
                 node->right_child = new->tree_index;
             }
-            node = tree_head + node->right_child;
-            if (node == tree_head)
+            node = mm->tree_head + node->right_child;
+            if (node == mm->tree_head)
                 return NULL;
         }
 
@@ -230,12 +510,7 @@ multimap_node * find_mm_node(multimap *mm, multimap_node *root, int key,
 /* Initialize a multimap data structure. */
 multimap * init_multimap() {
     multimap *mm = malloc(sizeof(multimap));
-    mm->root = NULL;
-
-    /* initialize global variables */
-    tree_head = NULL;
-    tree_length = 0;
-    tree_head = 0;
+    bzero(mm, sizeof(multimap));
     return mm;
 }
 
@@ -246,17 +521,46 @@ multimap * init_multimap() {
 void clear_multimap(multimap *mm) {
 
     int i = 0;
+
+    /* unmap the saved file, if the multimap was mapped from one */
+    if (mm->mapped != NULL) {
+        mm_file_close(mm->mapped);
+        free(mm->mapped);
+        mm->mapped = NULL;
+    }
+
+    /* free the frozen key array */
+    free(mm->frozen_keys);
+    free(mm->frozen_nodes);
+    mm->frozen_keys = NULL;
+    mm->frozen_nodes = NULL;
+    mm->frozen_length = 0;
+    mm->frozen = 0;
+
     /* free all the values in each node */
-    while (i < tree_length) {
-        free(tree_head[i].values);
+    while (i < mm->tree_length) {
+#if PACKED_VALUES
+        pv_free(mm->tree_head[i].values);
+#else
+        /* pooled arrays are released with their slabs, below */
+        if (!VALUE_POOL || mm->tree_head[i].value_size > VALUE_POOL_MAX_CLASS)
+            free(mm->tree_head[i].values);
+#endif
         i++;
     }
 
     /* free the whole tree */
-    free(tree_head);
-    tree_head = NULL;
-    tree_length = 0;
-    tree_size = 0;
+    free(mm->tree_head);
+    mm->tree_head = NULL;
+    mm->tree_length = 0;
+    mm->tree_size = 0;
+    mm->free_nodes = 0;
+
+    /* free the value pool */
+    for (i = 0; i < mm->pool.num_slabs; i++)
+        free(mm->pool.slabs[i]);
+    free(mm->pool.slabs);
+    bzero(&mm->pool, sizeof(value_pool));
 
     /* free the multimap */
     mm->root = NULL;
@@ -267,39 +571,106 @@ void clear_multimap(multimap *mm) {
  * This function ensures that the elements in the value array have adjacent
  * memory addresses, and thus improving the locality of access.
  * We change the data structure from linked list to int array.
- * Initially we allocate a big memory block to hold multimap_value types,
- * and when the block is filled, we expand it into a even bigger coherent
- * memory block using realloc(). So, when the program is traversing value-
- * array, it goes down the contiguous memory.
+ * Initially we take a small array from the size-class pool, and when the
+ * array is filled, we move it into the next size class.  Once it outgrows
+ * the pool, we expand it into a even bigger coherent memory block using
+ * realloc(). So, when the program is traversing value-array, it goes down
+ * the contiguous memory.
  */
-void node_add_value(multimap_node *node, int value) {
-    
+void node_add_value(multimap *mm, multimap_node *node, int value) {
+#if PACKED_VALUES
+    /* The packed list manages its own memory. */
+    if (node->values == NULL)
+        node->values = pv_alloc();
+
+    pv_add(node->values, value);
+    node->value_length += 1;
+#else
     if (node->values == NULL) {
         assert(node->value_size == 0);
         assert(node->value_length == 0);
 
-        /* if the node has no values inside, allocate one big block */
-        int *new_value_head = (int *) malloc(LIST_SIZE * sizeof(int));
+        /* if the node has no values inside, allocate the first block */
+        int size = VALUE_POOL ? VALUE_POOL_MIN_CLASS : LIST_SIZE;
 
         /* update node attributes */
-        node->values = new_value_head;
-        node->value_size += LIST_SIZE;
+        node->values = alloc_value_array(mm, size);
+        node->value_size = size;
     }
     else if (node->value_size == node->value_length) {
         assert(node->value_length != 0);
 
-        /* if the allocated memory is filled, allocate a larger one */     
-        int new_size = (node->value_size + LIST_SIZE) * sizeof(int);
+        int *new_value_head;
+
+        if (VALUE_POOL && node->value_size <= VALUE_POOL_MAX_CLASS) {
+            /* move up to the next size class (or out of the pool) */
+            int new_size = node->value_size * 2;
 
-        /* use realloc to get a bigger dynamic allocation */
-        int *new_value_head = (int *) realloc(node->values, new_size);
+            new_value_head = alloc_value_array(mm, new_size);
+            memcpy(new_value_head, node->values,
+                   node->value_length * sizeof(int));
+            free_value_array(mm, node->values, node->value_size);
+
+            node->values = new_value_head;
+            node->value_size = new_size;
+        }
+        else {
+            /* if the allocated memory is filled, allocate a larger one */
+            int new_size = grow_size(node->value_size, LIST_GROWTH_PERCENT,
+                                     LIST_SIZE);
+
+            /* use realloc to get a bigger dynamic allocation */
+            new_value_head = (int *) realloc(node->values,
+                                             new_size * sizeof(int));
+            if (new_value_head == NULL) {
+                printf("Not enough memory.\n");
+                exit(0);
+            }
 
-        node->values = new_value_head;
-        node->value_size += LIST_SIZE;
+            node->values = new_value_head;
+            node->value_size = new_size;
+        }
     }
     /* no dynamic allocation needed, simply add the value */
     node->value_length += 1;
     node->values[node->value_length - 1] = value;
+#endif
+}
+
+
+/* Returns nonzero if the node's value-list contains the specified value. */
+int node_contains_value(multimap_node *node, int value) {
+#if PACKED_VALUES
+    return node->values != NULL && pv_contains(node->values, value);
+#else
+    /* (modified to array traversal) */
+    int *curr = node->values;
+    int i = 0;
+    int length = node->value_length;
+    while (i < length) {
+        if (curr[i] == value)
+            return 1;
+        i++;
+    }
+
+    return 0;
+#endif
+}
+
+
+/* Exits with an error if the multimap is mapped from a file or frozen, since
+ * neither kind can be modified.
+ */
+void check_modifiable(multimap *mm) {
+    if (mm->mapped != NULL) {
+        printf("Cannot modify a memory-mapped multimap.\n");
+        exit(1);
+    }
+
+    if (mm->frozen) {
+        printf("Cannot modify a frozen multimap.\n");
+        exit(1);
+    }
 }
 
 
@@ -308,6 +679,7 @@ void mm_add_value(multimap *mm, int key, int value) {
     multimap_node *node;
 
     assert(mm != NULL);
+    check_modifiable(mm);
 
     /* Look up the node with the specified key.  Create if not found. */
     node = find_mm_node(mm, mm->root, key, /* create */ 1);
@@ -320,7 +692,213 @@ void mm_add_value(multimap *mm, int key, int value) {
     assert(node->key == key);
 
     /* Add the new value to the multimap node. */
-    node_add_value(node, value);
+    node_add_value(mm, node, value);
+}
+
+
+/* Removes one occurrence of the value from the node's value-list.  Returns
+ * nonzero if the value was found.  Since values aren't kept in any particular
+ * order, the array is compacted by moving the last value into the hole.
+ */
+int node_remove_value(multimap *mm, multimap_node *node, int value) {
+#if PACKED_VALUES
+    if (node->values == NULL || !pv_remove(node->values, value))
+        return 0;
+
+    node->value_length -= 1;
+    return 1;
+#else
+    int i = 0;
+
+    while (i < node->value_length && node->values[i] != value)
+        i++;
+
+    if (i == node->value_length)
+        return 0;
+
+    node->value_length -= 1;
+    node->values[i] = node->values[node->value_length];
+
+    /* give memory back if a big array is mostly empty */
+    if (node->value_size > LIST_SHRINK_SIZE &&
+        node->value_length < node->value_size / 4) {
+        int new_size = node->value_size / 2;
+        int *new_value_head = (int *) realloc(node->values,
+                                              new_size * sizeof(int));
+        if (new_value_head != NULL) {
+            node->values = new_value_head;
+            node->value_size = new_size;
+        }
+    }
+
+    return 1;
+#endif
+}
+
+
+/* Releases the node's value-list, leaving it empty. */
+void node_release_values(multimap *mm, multimap_node *node) {
+#if PACKED_VALUES
+    pv_free(node->values);
+#else
+    if (node->values != NULL)
+        free_value_array(mm, node->values, node->value_size);
+#endif
+    node->values = NULL;
+    node->value_length = 0;
+    node->value_size = 0;
+}
+
+
+/* Returns the tree_index of the node with the specified key, or -1 if there
+ * isn't one.  The tree_index of its parent is stored in *parent, or -1 if the
+ * node is the root.
+ */
+int find_node_index(multimap *mm, int key, int *parent) {
+    int index = 0;
+
+    *parent = -1;
+    if (mm->root == NULL)
+        return -1;
+
+    while (1) {
+        multimap_node *node = mm->tree_head + index;
+        int child;
+
+        if (node->key == key)
+            return index;
+
+        child = (node->key > key) ? node->left_child : node->right_child;
+        if (child == 0)
+            return -1;
+
+        *parent = index;
+        index = child;
+    }
+}
+
+
+/* Puts an unlinked node, whose values have been released or moved to another
+ * node, on the free list.
+ */
+void free_mm_node(multimap *mm, int index) {
+    multimap_node *node = mm->tree_head + index;
+
+    assert(index != 0);
+    assert(node->values == NULL);
+
+    bzero(node, sizeof(multimap_node));
+    node->tree_index = index;
+    node->is_free = 1;
+    node->left_child = mm->free_nodes;
+    mm->free_nodes = index;
+}
+
+
+/* Makes new_child take old_child's place under the parent node. */
+void replace_child(multimap *mm, int parent, int old_child, int new_child) {
+    multimap_node *node = mm->tree_head + parent;
+
+    if (node->left_child == old_child)
+        node->left_child = new_child;
+    else
+        node->right_child = new_child;
+}
+
+
+/* Removes a node and its values from the tree.  A node with two children
+ * takes over the key and values of its in-order successor, which is removed
+ * in its place; that's the leftmost node of the right subtree, so it has no
+ * left child.  Since the root must stay at index 0, removing a root with one
+ * child moves the child into the root's slot.
+ */
+void remove_mm_node(multimap *mm, int index, int parent) {
+    multimap_node *node = mm->tree_head + index;
+    int child;
+
+    node_release_values(mm, node);
+
+    if (node->left_child != 0 && node->right_child != 0) {
+        int succ_parent = index;
+        int succ = node->right_child;
+        multimap_node *succ_node;
+
+        while (mm->tree_head[succ].left_child != 0) {
+            succ_parent = succ;
+            succ = mm->tree_head[succ].left_child;
+        }
+        succ_node = mm->tree_head + succ;
+
+        /* move the successor's key and values up into this node */
+        node->key = succ_node->key;
+        node->values = succ_node->values;
+        node->value_length = succ_node->value_length;
+        node->value_size = succ_node->value_size;
+        succ_node->values = NULL;
+
+        replace_child(mm, succ_parent, succ, succ_node->right_child);
+        free_mm_node(mm, succ);
+        return;
+    }
+
+    child = (node->left_child != 0) ? node->left_child : node->right_child;
+
+    if (parent != -1) {
+        replace_child(mm, parent, index, child);
+        free_mm_node(mm, index);
+    }
+    else if (child != 0) {
+        /* pull the root's only child up into slot 0 */
+        *node = mm->tree_head[child];
+        node->tree_index = 0;
+        mm->tree_head[child].values = NULL;
+        free_mm_node(mm, child);
+    }
+    else {
+        /* the tree is now empty, so start the pool over */
+        mm->tree_length = 0;
+        mm->free_nodes = 0;
+        mm->root = NULL;
+    }
+}
+
+
+/* Removes one occurrence of the (key, value) pair from the multimap, and
+ * the key itself if that was its last value.
+ */
+int mm_remove_pair(multimap *mm, int key, int value) {
+    int index, parent;
+
+    assert(mm != NULL);
+    check_modifiable(mm);
+
+    index = find_node_index(mm, key, &parent);
+    if (index == -1)
+        return 0;
+
+    if (!node_remove_value(mm, mm->tree_head + index, value))
+        return 0;
+
+    if (mm->tree_head[index].value_length == 0)
+        remove_mm_node(mm, index, parent);
+
+    return 1;
+}
+
+
+/* Removes the key and all of its values from the multimap. */
+int mm_remove_key(multimap *mm, int key) {
+    int index, parent;
+
+    assert(mm != NULL);
+    check_modifiable(mm);
+
+    index = find_node_index(mm, key, &parent);
+    if (index == -1)
+        return 0;
+
+    remove_mm_node(mm, index, parent);
+    return 1;
 }
 
 
@@ -328,6 +906,12 @@ void mm_add_value(multimap *mm, int key, int value) {
  * otherwise.
  */
 int mm_contains_key(multimap *mm, int key) {
+    if (mm->mapped != NULL)
+        return mm_file_find(mm->mapped, key) != NULL;
+
+    if (mm->frozen)
+        return find_frozen_node(mm, key) != NULL;
+
     return find_mm_node(mm, mm->root, key, /* create */ 0) != NULL;
 }
 
@@ -337,49 +921,57 @@ int mm_contains_key(multimap *mm, int key) {
  */
 int mm_contains_pair(multimap *mm, int key, int value) {
     multimap_node *node;
-    int *curr;
+
+    if (mm->mapped != NULL)
+        return mm_file_contains_pair(mm->mapped, key, value);
+
+    if (mm->frozen) {
+        node = find_frozen_node(mm, key);
+        if (node == NULL)
+            return 0;
+
+#if FREEZE_SORTS_VALUES
+        return sorted_contains_value(node, value);
+#else
+        return node_contains_value(node, value);
+#endif
+    }
 
     node = find_mm_node(mm, mm->root, key, /* create */ 0);
     if (node == NULL)
         return 0;
 
-    /* (modified to array traversal) */
-    curr = node->values;
-    int i = 0;
-    int length = node->value_length;
-    while (i < length) {
-        if (curr[i] == value)
-            return 1;
-        i++;
-    }
-
-    return 0;
+    return node_contains_value(node, value);
 }
 
 
 /* This helper function is used by mm_traverse() to traverse every pair within
  * the multimap.
  */
-void mm_traverse_helper(multimap_node *node, void (*f)(int key, int value)) {
-    int *curr;
-
+void mm_traverse_helper(multimap *mm, multimap_node *node,
+                        void (*f)(int key, int value)) {
     if (node == NULL)
         return;
 
     if (node->left_child != 0)
-        mm_traverse_helper(tree_head + node->left_child, f);
+        mm_traverse_helper(mm, mm->tree_head + node->left_child, f);
 
+#if PACKED_VALUES
+    if (node->values != NULL)
+        pv_traverse(node->values, node->key, f);
+#else
     /* (modified to array traversal) */
-    curr = node->values;
+    int *curr = node->values;
     int i = 0;
     int length = node->value_length;
     while (i < length) {
         f(node->key, curr[i]);
         i++;
     }
+#endif
 
     if (node->right_child != 0)
-        mm_traverse_helper(tree_head + node->right_child, f);
+        mm_traverse_helper(mm, mm->tree_head + node->right_child, f);
 }
 
 
@@ -387,6 +979,389 @@ void mm_traverse_helper(multimap_node *node, void (*f)(int key, int value)) {
  * pair to the specified function.
  */
 void mm_traverse(multimap *mm, void (*f)(int key, int value)) {
-    mm_traverse_helper(mm->root, f);
+    if (mm->mapped != NULL) {
+        mm_file_traverse(mm->mapped, f);
+        return;
+    }
+
+    mm_traverse_helper(mm, mm->root, f);
+}
+
+
+/* Pushes the nodes on the path from the specified node down to the smallest
+ * key that is >= it->lo.  Nodes with smaller keys are passed over, since
+ * neither they nor their left subtrees can hold keys in the range.
+ */
+void iter_push_path(mm_iter *it, int index) {
+    multimap_node *tree_head = it->mm->tree_head;
+
+    while (1) {
+        multimap_node *node = tree_head + index;
+
+        if (node->key < it->lo) {
+            /* Everything we want is to the right. */
+            if (node->right_child == 0)
+                break;
+            index = node->right_child;
+        }
+        else {
+            if (it->depth == it->max_depth) {
+                it->max_depth = it->max_depth ? 2 * it->max_depth : 32;
+                it->stack = realloc(it->stack, it->max_depth * sizeof(int));
+                if (it->stack == NULL) {
+                    printf("Not enough memory.\n");
+                    exit(0);
+                }
+            }
+            it->stack[it->depth++] = index;
+
+            if (node->key == it->lo || node->left_child == 0)
+                break;
+            index = node->left_child;
+        }
+    }
+}
+
+
+/* Initializes an iterator over the keys in the range [lo, hi]. */
+void iter_init(mm_iter *it, multimap *mm, int lo, int hi) {
+    bzero(it, sizeof(mm_iter));
+    it->mm = mm;
+    it->lo = lo;
+    it->hi = hi;
+
+    if (mm->mapped != NULL)
+        mm_file_iter_init(&it->file_iter, mm->mapped, lo, hi);
+    else if (mm->root != NULL && lo <= hi)
+        iter_push_path(it, 0);
+}
+
+
+/* Releases the memory held by an iterator, but not the iterator itself. */
+void iter_release(mm_iter *it) {
+    free(it->stack);
+    mm_file_iter_release(&it->file_iter);
+#if PACKED_VALUES
+    free(it->buffer);
+#endif
+}
+
+
+/* Starts iterating over the keys in the range [lo, hi]. */
+mm_iter * mm_iter_begin(multimap *mm, int lo, int hi) {
+    mm_iter *it = malloc(sizeof(mm_iter));
+    assert(mm != NULL);
+    iter_init(it, mm, lo, hi);
+    return it;
+}
+
+
+/* Retrieves the next key in the range, and an array of all of its values.
+ * Returns nonzero if a key was retrieved, or zero at the end of the range.
+ */
+int mm_iter_next(mm_iter *it, int *key, const int **values, int *num_values) {
+    multimap_node *node;
+
+    if (it->mm->mapped != NULL)
+        return mm_file_iter_next(&it->file_iter, key, values, num_values);
+
+    if (it->depth == 0)
+        return 0;
+
+    node = it->mm->tree_head + it->stack[--it->depth];
+    if (node->key > it->hi) {
+        /* Every remaining key is even larger. */
+        it->depth = 0;
+        return 0;
+    }
+
+    *key = node->key;
+    *num_values = node->value_length;
+
+#if PACKED_VALUES
+    if (node->value_length > it->buffer_size) {
+        it->buffer_size = node->value_length;
+        it->buffer = realloc(it->buffer, it->buffer_size * sizeof(int));
+        if (it->buffer == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+    if (node->values != NULL)
+        pv_decode(node->values, it->buffer);
+    *values = it->buffer;
+#else
+    *values = node->values;
+#endif
+
+    /* The right subtree holds the keys that come next. */
+    if (node->right_child != 0)
+        iter_push_path(it, node->right_child);
+
+    return 1;
+}
+
+
+/* Releases the iterator. */
+void mm_iter_end(mm_iter *it) {
+    iter_release(it);
+    free(it);
+}
+
+
+/* Passes every key in the range [lo, hi] to the specified function, in
+ * increasing order, along with an array of all of that key's values.
+ */
+void mm_range(multimap *mm, int lo, int hi,
+              void (*f)(int key, const int *values, int num_values)) {
+    mm_iter it;
+    const int *values;
+    int key, num_values;
+
+    iter_init(&it, mm, lo, hi);
+    while (mm_iter_next(&it, &key, &values, &num_values))
+        f(key, values, num_values);
+    iter_release(&it);
+}
+
+
+/* The state passed to save_node() while the multimap is being saved. */
+typedef struct save_state {
+    multimap *mm;
+
+#if PACKED_VALUES
+    /* Packed values are unpacked into this buffer to save them. */
+    int *buffer;
+    int buffer_size;
+#endif
+} save_state;
+
+
+/* Describes node number index to mm_file_save().  The node pool is written
+ * out exactly as it is, since nodes already refer to each other by their
+ * index in the pool, and the root is always node 0.
+ */
+void save_node(void *ctx, int index, int *key, int *left_child,
+               int *right_child, const int **values, int *num_values) {
+    save_state *state = (save_state *) ctx;
+    multimap_node *node = state->mm->tree_head + index;
+
+    /* Removed nodes are saved as empty, unreachable nodes. */
+    if (node->is_free) {
+        *key = 0;
+        *left_child = 0;
+        *right_child = 0;
+        *values = NULL;
+        *num_values = 0;
+        return;
+    }
+
+    *key = node->key;
+    *left_child = node->left_child;
+    *right_child = node->right_child;
+    *num_values = node->value_length;
+
+#if PACKED_VALUES
+    if (node->value_length > state->buffer_size) {
+        state->buffer_size = node->value_length;
+        state->buffer = realloc(state->buffer,
+                                state->buffer_size * sizeof(int));
+        if (state->buffer == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+    if (node->values != NULL)
+        pv_decode(node->values, state->buffer);
+    *values = state->buffer;
+#else
+    *values = node->values;
+#endif
+}
+
+
+/* Writes the multimap to a file that mm_open_mapped() can map back in. */
+int mm_save(multimap *mm, const char *path) {
+    save_state state;
+    int result;
+
+    assert(mm != NULL);
+
+    if (mm->mapped != NULL) {
+        return mm_file_save(path, mm->mapped->header->num_nodes,
+                            mm_file_mapped_node, mm->mapped);
+    }
+
+    bzero(&state, sizeof(save_state));
+    state.mm = mm;
+    result = mm_file_save(path, mm->tree_length, save_node, &state);
+#if PACKED_VALUES
+    free(state.buffer);
+#endif
+    return result;
+}
+
+
+/* Maps a multimap saved by mm_save() into memory, read-only. */
+multimap * mm_open_mapped(const char *path) {
+    multimap *mm = init_multimap();
+
+    mm->mapped = malloc(sizeof(mm_mapped));
+    if (mm->mapped == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    if (mm_file_open(path, mm->mapped) != 0) {
+        free(mm->mapped);
+        free(mm);
+        return NULL;
+    }
+
+    return mm;
+}
+
+
+/* Comparison function for sorting value arrays with qsort(). */
+int compare_values(const void *v1, const void *v2) {
+    int i1 = *(const int *) v1;
+    int i2 = *(const int *) v2;
+
+    return (i1 > i2) - (i1 < i2);
+}
+
+
+/* Fills the Eytzinger subtree rooted at the specified slot with the sorted
+ * node indexes, starting at sorted[next].  An in-order walk of the implicit
+ * tree visits its slots in increasing key order, so each slot simply takes
+ * the next node.  Returns the index of the first node not used.
+ */
+int fill_eytzinger(multimap *mm, const int *sorted, int next, int slot) {
+    if (slot > mm->frozen_length)
+        return next;
+
+    next = fill_eytzinger(mm, sorted, next, 2 * slot);
+    mm->frozen_nodes[slot] = sorted[next];
+    mm->frozen_keys[slot] = mm->tree_head[sorted[next]].key;
+    next++;
+    return fill_eytzinger(mm, sorted, next, 2 * slot + 1);
+}
+
+
+/* Finds the node with the specified key in a frozen multimap, or returns
+ * NULL if there isn't one.  The loop descends to the bottom of the implicit
+ * tree without branching on the comparisons, recording each turn in the
+ * bits of k.  Afterwards the last left turn marks the smallest key that is
+ * >= the probe key; shifting out the trailing right turns (the trailing 1
+ * bits) and that left turn leaves its slot.
+ */
+multimap_node * find_frozen_node(multimap *mm, int key) {
+    const int *keys = mm->frozen_keys;
+    unsigned int n = mm->frozen_length;
+    unsigned int k = 1;
+
+    while (k <= n) {
+#if FREEZE_PREFETCH
+        __builtin_prefetch(keys + 16 * k);
+#endif
+        k = 2 * k + (keys[k] < key);
+    }
+    k >>= __builtin_ffs(~k);
+
+    if (k == 0 || keys[k] != key)
+        return NULL;
+
+    return mm->tree_head + mm->frozen_nodes[k];
+}
+
+
+/* Returns nonzero if the node's value array, which has been sorted by
+ * mm_freeze(), contains the specified value.
+ */
+int sorted_contains_value(multimap_node *node, int value) {
+#if PACKED_VALUES
+    /* Packed value-lists are searched the same way either way. */
+    return node_contains_value(node, value);
+#else
+    const int *values = node->values;
+    int lo = 0, hi = node->value_length;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (values[mid] == value)
+            return 1;
+
+        if (values[mid] < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return 0;
+#endif
 }
 
+
+/* Declares that the multimap is fully populated, and builds the Eytzinger
+ * key array that probes of the frozen multimap use.  The key array is
+ * cache-block aligned, so that each prefetch covers a whole group of
+ * descendants.
+ */
+void mm_freeze(multimap *mm) {
+    mm_iter it;
+    int *sorted;
+    void *keys;
+    int n, i;
+
+    assert(mm != NULL);
+
+    /* Mapped multimaps are read-only already. */
+    if (mm->mapped != NULL || mm->frozen)
+        return;
+
+    /* Collect the node indexes in key order, the way mm_iter_next() walks
+     * the tree.  Removed nodes in the pool aren't reached.
+     */
+    sorted = malloc((mm->tree_length + 1) * sizeof(int));
+    if (sorted == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    i = 0;
+    iter_init(&it, mm, INT_MIN, INT_MAX);
+    while (it.depth > 0) {
+        int index = it.stack[--it.depth];
+        sorted[i++] = index;
+        if (mm->tree_head[index].right_child != 0)
+            iter_push_path(&it, mm->tree_head[index].right_child);
+    }
+    iter_release(&it);
+    n = i;
+
+    if (posix_memalign(&keys, BLOCK_SIZE, (n + 1) * sizeof(int)) != 0) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    mm->frozen_keys = (int *) keys;
+    mm->frozen_nodes = malloc((n + 1) * sizeof(int));
+    if (mm->frozen_nodes == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    mm->frozen_length = n;
+    mm->frozen_keys[0] = 0;
+    mm->frozen_nodes[0] = 0;
+    fill_eytzinger(mm, sorted, 0, 1);
+    free(sorted);
+
+#if FREEZE_SORTS_VALUES && !PACKED_VALUES
+    for (i = 0; i < mm->tree_length; i++) {
+        multimap_node *node = mm->tree_head + i;
+        qsort(node->values, node->value_length, sizeof(int), compare_values);
+    }
+#endif
+
+    mm->frozen = 1;
+}
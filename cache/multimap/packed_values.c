@@ -0,0 +1,367 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packed_values.h"
+
+
+/*============================================================================
+ * HELPER FUNCTION DECLARATIONS
+ *============================================================================*/
+
+int compare_ints(const void *v1, const void *v2);
+int bits_needed(uint32_t n);
+uint32_t extract_offset(const uint32_t *words, uint32_t bit, int width);
+void unpack_block(const pv_block *blk, int *out);
+void pack_block(pv_block *blk, const int *sorted, int count);
+int find_block(const packed_values *pv, int value);
+void replace_block(packed_values *pv, int b, const int *sorted, int count,
+                   int fill);
+void pv_flush_tail(packed_values *pv);
+
+
+/*============================================================================
+ * FUNCTION IMPLEMENTATIONS
+ *============================================================================*/
+
+/* Comparison function for sorting the tail with qsort(). */
+int compare_ints(const void *v1, const void *v2) {
+    int i1 = *(const int *) v1;
+    int i2 = *(const int *) v2;
+
+    return (i1 > i2) - (i1 < i2);
+}
+
+
+/* Returns the number of bits required to represent n. */
+int bits_needed(uint32_t n) {
+    return n == 0 ? 0 : 32 - __builtin_clz(n);
+}
+
+
+/* Extracts the width-bit offset that starts at the specified bit position.
+ * The offset may straddle two words, so both are loaded together; this is
+ * why the packed data always has one word of padding at the end.  Blocks of
+ * identical values have a width of 0 and no packed data at all.
+ */
+uint32_t extract_offset(const uint32_t *words, uint32_t bit, int width) {
+    uint32_t index, mask;
+    uint64_t pair;
+
+    if (width == 0)
+        return 0;
+
+    index = bit >> 5;
+    pair = words[index] | ((uint64_t) words[index + 1] << 32);
+    mask = (width == 32) ? 0xFFFFFFFF : (1U << width) - 1;
+
+    return (uint32_t) (pair >> (bit & 31)) & mask;
+}
+
+
+/* Unpacks every value in the specified block into out. */
+void unpack_block(const pv_block *blk, int *out) {
+    const uint32_t *words = blk->words;
+    uint32_t bit = 0;
+    int i;
+
+    for (i = 0; i < blk->count; i++, bit += blk->width) {
+        out[i] = (int) ((uint32_t) blk->base +
+                        extract_offset(words, bit, blk->width));
+    }
+}
+
+
+/* Allocate and initialize an empty packed value-list. */
+packed_values * pv_alloc(void) {
+    packed_values *pv = malloc(sizeof(packed_values));
+    if (pv == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+    bzero(pv, sizeof(packed_values));
+    return pv;
+}
+
+
+/* Release a packed value-list and everything it references. */
+void pv_free(packed_values *pv) {
+    int b;
+
+    if (pv == NULL)
+        return;
+
+    for (b = 0; b < pv->num_blocks; b++)
+        free(pv->blocks[b].words);
+    free(pv->blocks);
+    free(pv);
+}
+
+
+/* Packs count sorted values, 1 to PV_BLOCK_SIZE of them, into the specified
+ * block, allocating its packed data.
+ */
+void pack_block(pv_block *blk, const int *sorted, int count) {
+    uint32_t bit = 0;
+    int i;
+
+    assert(count > 0 && count <= PV_BLOCK_SIZE);
+
+    blk->base = sorted[0];
+    blk->last = sorted[count - 1];
+    blk->count = count;
+    blk->width = bits_needed((uint32_t) blk->last - (uint32_t) blk->base);
+    blk->unused = 0;
+
+    /* The extra word is padding for extract_offset(). */
+    blk->words = calloc((count * blk->width + 31) / 32 + 1, sizeof(uint32_t));
+    if (blk->words == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    if (blk->width == 0)
+        return;
+
+    for (i = 0; i < count; i++, bit += blk->width) {
+        uint32_t offset = (uint32_t) sorted[i] - (uint32_t) blk->base;
+        uint32_t shift = bit & 31;
+
+        blk->words[bit >> 5] |= offset << shift;
+        if (shift + blk->width > 32)
+            blk->words[(bit >> 5) + 1] |= offset >> (32 - shift);
+    }
+}
+
+
+/* Returns the index of the first block whose largest value is >= value, or
+ * num_blocks if there is none.  Since blocks are globally sorted, this is
+ * the only block that can hold the value.
+ */
+int find_block(const packed_values *pv, int value) {
+    int lo = 0, hi = pv->num_blocks;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (pv->blocks[mid].last < value)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+
+/* Replaces block b with blocks holding count sorted values, up to
+ * PV_BLOCK_SIZE + PV_TAIL_SIZE of them:  none, if count is 0, one block, or
+ * two if they don't fit in one.  Two blocks split the values evenly, so
+ * that values added later in the same range have room, unless fill is
+ * nonzero; then the first block is filled, which suits values appended at
+ * the end of the list.  If b is num_blocks, the blocks are added at the
+ * end instead.
+ */
+void replace_block(packed_values *pv, int b, const int *sorted, int count,
+                   int fill) {
+    int old_blocks = b < pv->num_blocks ? 1 : 0;
+    int new_blocks = (count + PV_BLOCK_SIZE - 1) / PV_BLOCK_SIZE;
+    int first;
+
+    assert(new_blocks <= 2);
+
+    if (old_blocks > 0)
+        free(pv->blocks[b].words);
+
+    if (pv->num_blocks - old_blocks + new_blocks > pv->max_blocks) {
+        pv->max_blocks = pv->max_blocks > 0 ? 2 * pv->max_blocks : 4;
+        pv->blocks = realloc(pv->blocks, pv->max_blocks * sizeof(pv_block));
+        if (pv->blocks == NULL) {
+            printf("Not enough memory.\n");
+            exit(0);
+        }
+    }
+
+    /* Shift the following headers; only the headers move, not the data. */
+    memmove(pv->blocks + b + new_blocks, pv->blocks + b + old_blocks,
+            (pv->num_blocks - b - old_blocks) * sizeof(pv_block));
+    pv->num_blocks += new_blocks - old_blocks;
+
+    if (new_blocks == 1) {
+        pack_block(pv->blocks + b, sorted, count);
+    }
+    else if (new_blocks == 2) {
+        first = fill ? PV_BLOCK_SIZE : count / 2;
+        pack_block(pv->blocks + b, sorted, first);
+        pack_block(pv->blocks + b + 1, sorted + first, count - first);
+    }
+}
+
+
+/* Merges the tail buffer into the packed blocks.  The sorted tail is split
+ * into the runs that fall in each block, and each of those blocks is
+ * unpacked, merged with its run, and repacked, so that a flush costs time
+ * in proportion to the tail, not to the whole list.  Values past the end
+ * of the last block go into the last block.
+ */
+void pv_flush_tail(packed_values *pv) {
+    int old_values[PV_BLOCK_SIZE];
+    int merged[PV_BLOCK_SIZE + PV_TAIL_SIZE];
+    int i = 0, j, k, n, num_old, b, last;
+
+    qsort(pv->tail, pv->tail_length, sizeof(int), compare_ints);
+
+    while (i < pv->tail_length) {
+        b = find_block(pv, pv->tail[i]);
+        if (b == pv->num_blocks && b > 0)
+            b--;
+        last = b >= pv->num_blocks - 1;
+
+        /* The run of tail values that falls in this block. */
+        for (j = i; j < pv->tail_length &&
+                    (last || pv->tail[j] <= pv->blocks[b].last); j++);
+
+        num_old = 0;
+        if (b < pv->num_blocks) {
+            unpack_block(pv->blocks + b, old_values);
+            num_old = pv->blocks[b].count;
+        }
+
+        /* Standard two-way merge of the block's values and the run. */
+        for (k = 0, n = 0; k < num_old || i < j; n++) {
+            if (i == j || (k < num_old && old_values[k] <= pv->tail[i]))
+                merged[n] = old_values[k++];
+            else
+                merged[n] = pv->tail[i++];
+        }
+
+        replace_block(pv, b, merged, n, last);
+    }
+
+    pv->tail_length = 0;
+}
+
+
+/* Add a value to the list.  The value goes into the tail, which is packed
+ * when it fills up.
+ */
+void pv_add(packed_values *pv, int value) {
+    assert(pv != NULL);
+
+    pv->tail[pv->tail_length++] = value;
+    pv->num_values++;
+
+    if (pv->tail_length == PV_TAIL_SIZE)
+        pv_flush_tail(pv);
+}
+
+
+/* Removes one occurrence of the value from the list.  Returns nonzero if the
+ * value was found.  A value in the tail is simply replaced by the last tail
+ * entry; a packed value means unpacking its block, removing the value and
+ * repacking the block, or dropping it if it becomes empty.
+ */
+int pv_remove(packed_values *pv, int value) {
+    int values[PV_BLOCK_SIZE];
+    int i, b, count;
+
+    for (i = 0; i < pv->tail_length; i++) {
+        if (pv->tail[i] == value) {
+            pv->tail[i] = pv->tail[--pv->tail_length];
+            pv->num_values--;
+            return 1;
+        }
+    }
+
+    b = find_block(pv, value);
+    if (b == pv->num_blocks || value < pv->blocks[b].base)
+        return 0;
+
+    unpack_block(pv->blocks + b, values);
+    count = pv->blocks[b].count;
+    for (i = 0; i < count && values[i] != value; i++);
+    if (i == count)
+        return 0;
+
+    memmove(values + i, values + i + 1, (count - i - 1) * sizeof(int));
+    replace_block(pv, b, values, count - 1, 0);
+    pv->num_values--;
+    return 1;
+}
+
+
+/* Returns nonzero if the list contains the value, zero otherwise.  The tail
+ * is scanned linearly; the packed blocks are searched without unpacking.
+ */
+int pv_contains(const packed_values *pv, int value) {
+    const pv_block *blk;
+    const uint32_t *words;
+    uint32_t target;
+    int i, lo, hi;
+
+    for (i = 0; i < pv->tail_length; i++) {
+        if (pv->tail[i] == value)
+            return 1;
+    }
+
+    lo = find_block(pv, value);
+    if (lo == pv->num_blocks)
+        return 0;
+
+    blk = pv->blocks + lo;
+    if (value < blk->base)
+        return 0;
+
+    /* Binary search of the packed offsets, which are sorted as well. */
+    target = (uint32_t) value - (uint32_t) blk->base;
+    words = blk->words;
+    lo = 0;
+    hi = blk->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        uint32_t offset = extract_offset(words, mid * blk->width, blk->width);
+        if (offset == target)
+            return 1;
+
+        if (offset < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return 0;
+}
+
+
+/* Copies every value into out, which must have room for pv->num_values
+ * ints.
+ */
+void pv_decode(const packed_values *pv, int *out) {
+    int b;
+
+    for (b = 0; b < pv->num_blocks; b++) {
+        unpack_block(pv->blocks + b, out);
+        out += pv->blocks[b].count;
+    }
+
+    memcpy(out, pv->tail, pv->tail_length * sizeof(int));
+}
+
+
+/* Passes each value in the list, along with the specified key, to f.  Blocks
+ * are unpacked one at a time into a local buffer.
+ */
+void pv_traverse(const packed_values *pv, int key,
+                 void (*f)(int key, int value)) {
+    int buf[PV_BLOCK_SIZE];
+    int b, i;
+
+    for (b = 0; b < pv->num_blocks; b++) {
+        unpack_block(pv->blocks + b, buf);
+        for (i = 0; i < pv->blocks[b].count; i++)
+            f(key, buf[i]);
+    }
+
+    for (i = 0; i < pv->tail_length; i++)
+        f(key, pv->tail[i]);
+}
@@ -0,0 +1,109 @@
+/* This file declares a compact representation for the list of values that
+ * belongs to a single multimap key.  Values are kept sorted and stored in
+ * frame-of-reference (FOR) packed blocks:  each block of up to
+ * PV_BLOCK_SIZE values records its smallest value (the "frame"), and every
+ * value in the block is stored as a fixed-width bit-packed offset from that
+ * frame.  Since the width is fixed within a block, any value can be extracted
+ * without unpacking the rest of the block, so membership tests are a binary
+ * search over the block headers followed by a binary search inside one block.
+ *
+ * New values are first appended to a small unsorted tail buffer, and are only
+ * merged into the packed blocks when the tail fills up.  Each block's data
+ * is allocated separately, so a merge only repacks the blocks that the new
+ * values fall in, splitting any block that overflows.  Duplicate values are
+ * retained, since the multimap may hold the same (key, value) pair more than
+ * once.
+ */
+
+#ifndef PACKED_VALUES_H
+#define PACKED_VALUES_H
+
+
+#include <stdint.h>
+
+
+/* The maximum number of values packed into one block. */
+#define PV_BLOCK_SIZE 128
+
+/* The number of unsorted values buffered before they are merged into the
+ * packed blocks.  32 ints are two 64-byte cache lines, so a probe never scans
+ * more than that before it reaches the packed blocks.
+ */
+#define PV_TAIL_SIZE 32
+
+
+/* The header of one packed block. */
+typedef struct pv_block {
+    /* The smallest value in the block; all values are stored relative to
+     * this frame.
+     */
+    int base;
+
+    /* The largest value in the block, so that probes can skip the block
+     * without touching its packed data.
+     */
+    int last;
+
+    /* The block's packed data.  One extra word of padding is always
+     * allocated at the end, so that an extraction can read two words at
+     * once.
+     */
+    uint32_t *words;
+
+    /* The number of values in the block. */
+    uint16_t count;
+
+    /* The number of bits used for each packed offset (0 to 32). */
+    uint8_t width;
+
+    uint8_t unused;
+} pv_block;
+
+
+/* A sorted, bit-packed list of values, plus an unsorted tail buffer. */
+typedef struct packed_values {
+    /* The total number of values, including those still in the tail. */
+    int num_values;
+
+    /* The headers of the packed blocks, in increasing order of value, and
+     * the number of headers allocated.
+     */
+    pv_block *blocks;
+    int num_blocks;
+    int max_blocks;
+
+    /* Recently added values that have not been packed yet. */
+    int tail_length;
+    int tail[PV_TAIL_SIZE];
+} packed_values;
+
+
+/* Allocate and initialize an empty packed value-list. */
+packed_values * pv_alloc(void);
+
+/* Release a packed value-list and everything it references. */
+void pv_free(packed_values *pv);
+
+/* Add a value to the list. */
+void pv_add(packed_values *pv, int value);
+
+/* Removes one occurrence of the value from the list.  Returns nonzero if the
+ * value was found, zero otherwise.
+ */
+int pv_remove(packed_values *pv, int value);
+
+/* Returns nonzero if the list contains the value, zero otherwise. */
+int pv_contains(const packed_values *pv, int value);
+
+/* Copies every value into out, which must have room for pv->num_values
+ * ints.  Packed values come out in sorted order, followed by the unsorted
+ * tail.
+ */
+void pv_decode(const packed_values *pv, int *out);
+
+/* Passes each value in the list, along with the specified key, to f. */
+void pv_traverse(const packed_values *pv, int key,
+                 void (*f)(int key, int value));
+
+
+#endif /* PACKED_VALUES_H */
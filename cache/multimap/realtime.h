@@ -27,3 +27,22 @@ void clock_get_realtime(struct timespec *ts) {
 #endif
 }
 
+
+/* Reads a monotonic clock that is not subject to NTP slewing, for measuring
+ * short intervals.  On Linux this is CLOCK_MONOTONIC_RAW.
+ */
+void clock_get_monotonic(struct timespec *ts) {
+#ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
+  clock_serv_t cclock;
+  mach_timespec_t mts;
+  host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &cclock);
+  clock_get_time(cclock, &mts);
+  mach_port_deallocate(mach_task_self(), cclock);
+  ts->tv_sec = mts.tv_sec;
+  ts->tv_nsec = mts.tv_nsec;
+#elif defined(CLOCK_MONOTONIC_RAW)
+  clock_gettime(CLOCK_MONOTONIC_RAW, ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, ts);
+#endif
+}
@@ -0,0 +1,272 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm_file.h"
+#include "mm_template.h"
+#include "multimap.h"
+
+
+/* This implementation of multimap.h is the int specialization of the
+ * template in mm_template.h, so that the template can be tested and
+ * benchmarked with the same programs as the other implementations.  The
+ * "tmpl" targets in the Makefile build it.
+ */
+DEFINE_MULTIMAP(int_mm, int, int, MM_CMP_SCALAR, MM_EQ_SCALAR)
+
+
+/*============================================================================
+ * TYPES
+ *============================================================================*/
+
+/* The entry-point of the multimap data structure. */
+struct multimap {
+    int_mm map;
+
+    /* If the multimap was opened with mm_open_mapped(), this is the saved
+     * file it was mapped from, and the map above stays empty.
+     */
+    mm_mapped *mapped;
+
+    /* Nonzero once mm_freeze() has been called.  The template doesn't
+     * reorganize anything; the multimap only refuses further changes.
+     */
+    int frozen;
+};
+
+
+/* The state of an iteration over a range of keys. */
+struct mm_iter {
+    int mapped;
+    int_mm_iter it;
+    mm_file_iter file_iter;
+};
+
+
+/*============================================================================
+ * HELPER FUNCTION DECLARATIONS
+ *============================================================================*/
+
+void check_modifiable(multimap *mm);
+
+void save_node(void *ctx, int index, int *key, int *left_child,
+               int *right_child, const int **values, int *num_values);
+
+
+/*============================================================================
+ * FUNCTION IMPLEMENTATIONS
+ *============================================================================*/
+
+/* Initialize a multimap data structure. */
+multimap * init_multimap() {
+    multimap *mm = malloc(sizeof(multimap));
+    bzero(mm, sizeof(multimap));
+    int_mm_init(&mm->map);
+    return mm;
+}
+
+
+/* Release all dynamically allocated memory associated with the multimap
+ * data structure.
+ */
+void clear_multimap(multimap *mm) {
+    int_mm_clear(&mm->map);
+    mm->frozen = 0;
+
+    if (mm->mapped != NULL) {
+        mm_file_close(mm->mapped);
+        free(mm->mapped);
+        mm->mapped = NULL;
+    }
+}
+
+
+/* Exits with an error if the multimap is mapped from a file or frozen, since
+ * neither kind can be modified.
+ */
+void check_modifiable(multimap *mm) {
+    if (mm->mapped != NULL) {
+        printf("Cannot modify a memory-mapped multimap.\n");
+        exit(1);
+    }
+
+    if (mm->frozen) {
+        printf("Cannot modify a frozen multimap.\n");
+        exit(1);
+    }
+}
+
+
+/* Adds the specified (key, value) pair to the multimap. */
+void mm_add_value(multimap *mm, int key, int value) {
+    assert(mm != NULL);
+    check_modifiable(mm);
+    int_mm_add(&mm->map, key, value);
+}
+
+
+/* Removes one occurrence of the (key, value) pair from the multimap. */
+int mm_remove_pair(multimap *mm, int key, int value) {
+    assert(mm != NULL);
+    check_modifiable(mm);
+    return int_mm_remove_pair(&mm->map, key, value);
+}
+
+
+/* Removes the key and all of its values from the multimap. */
+int mm_remove_key(multimap *mm, int key) {
+    assert(mm != NULL);
+    check_modifiable(mm);
+    return int_mm_remove_key(&mm->map, key);
+}
+
+
+/* Returns nonzero if the multimap contains the specified key-value, zero
+ * otherwise.
+ */
+int mm_contains_key(multimap *mm, int key) {
+    if (mm->mapped != NULL)
+        return mm_file_find(mm->mapped, key) != NULL;
+
+    return int_mm_contains_key(&mm->map, key);
+}
+
+
+/* Returns nonzero if the multimap contains the specified (key, value) pair,
+ * zero otherwise.
+ */
+int mm_contains_pair(multimap *mm, int key, int value) {
+    if (mm->mapped != NULL)
+        return mm_file_contains_pair(mm->mapped, key, value);
+
+    return int_mm_contains_pair(&mm->map, key, value);
+}
+
+
+/* Performs an in-order traversal of the multimap, passing each (key, value)
+ * pair to the specified function.
+ */
+void mm_traverse(multimap *mm, void (*f)(int key, int value)) {
+    if (mm->mapped != NULL)
+        mm_file_traverse(mm->mapped, f);
+    else
+        int_mm_traverse(&mm->map, f);
+}
+
+
+/* Starts iterating over the keys in the range [lo, hi]. */
+mm_iter * mm_iter_begin(multimap *mm, int lo, int hi) {
+    mm_iter *it = malloc(sizeof(mm_iter));
+    assert(mm != NULL);
+    bzero(it, sizeof(mm_iter));
+
+    it->mapped = (mm->mapped != NULL);
+    if (it->mapped)
+        mm_file_iter_init(&it->file_iter, mm->mapped, lo, hi);
+    else
+        int_mm_iter_init(&it->it, &mm->map, lo, hi);
+
+    return it;
+}
+
+
+/* Retrieves the next key in the range, and an array of all of its values.
+ * Returns nonzero if a key was retrieved, or zero at the end of the range.
+ */
+int mm_iter_next(mm_iter *it, int *key, const int **values, int *num_values) {
+    if (it->mapped)
+        return mm_file_iter_next(&it->file_iter, key, values, num_values);
+
+    return int_mm_iter_next(&it->it, key, values, num_values);
+}
+
+
+/* Releases the iterator. */
+void mm_iter_end(mm_iter *it) {
+    if (it->mapped)
+        mm_file_iter_release(&it->file_iter);
+    else
+        int_mm_iter_release(&it->it);
+    free(it);
+}
+
+
+/* Passes every key in the range [lo, hi] to the specified function, in
+ * increasing order, along with an array of all of that key's values.
+ */
+void mm_range(multimap *mm, int lo, int hi,
+              void (*f)(int key, const int *values, int num_values)) {
+    mm_iter *it = mm_iter_begin(mm, lo, hi);
+    const int *values;
+    int key, num_values;
+
+    while (mm_iter_next(it, &key, &values, &num_values))
+        f(key, values, num_values);
+    mm_iter_end(it);
+}
+
+
+/* Declares that the multimap is fully populated. */
+void mm_freeze(multimap *mm) {
+    assert(mm != NULL);
+    mm->frozen = 1;
+}
+
+
+/* Describes node number index to mm_file_save().  The template's node pool
+ * is laid out like the one in opt_mm_impl.c, so it is written as it is.
+ */
+void save_node(void *ctx, int index, int *key, int *left_child,
+               int *right_child, const int **values, int *num_values) {
+    int_mm_node *node = ((int_mm *) ctx)->nodes + index;
+
+    /* Removed nodes are saved as empty, unreachable nodes. */
+    if (node->is_free) {
+        *key = 0;
+        *left_child = 0;
+        *right_child = 0;
+        *values = NULL;
+        *num_values = 0;
+        return;
+    }
+
+    *key = node->key;
+    *left_child = node->left_child;
+    *right_child = node->right_child;
+    *values = node->values;
+    *num_values = node->value_length;
+}
+
+
+/* Writes the multimap to a file that mm_open_mapped() can map back in. */
+int mm_save(multimap *mm, const char *path) {
+    assert(mm != NULL);
+
+    if (mm->mapped != NULL) {
+        return mm_file_save(path, mm->mapped->header->num_nodes,
+                            mm_file_mapped_node, mm->mapped);
+    }
+
+    return mm_file_save(path, mm->map.length, save_node, &mm->map);
+}
+
+
+/* Maps a multimap saved by mm_save() into memory, read-only. */
+multimap * mm_open_mapped(const char *path) {
+    multimap *mm = init_multimap();
+
+    mm->mapped = malloc(sizeof(mm_mapped));
+    if (mm->mapped == NULL) {
+        printf("Not enough memory.\n");
+        exit(0);
+    }
+
+    if (mm_file_open(path, mm->mapped) != 0) {
+        free(mm->mapped);
+        free(mm);
+        return NULL;
+    }
+
+    return mm;
+}
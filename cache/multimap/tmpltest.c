@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm_template.h"
+
+
+/* This program tests specializations of the multimap template that can't be
+ * tested through multimap.h:  one with 64-bit keys and double values, and
+ * one with string keys.
+ */
+DEFINE_MULTIMAP(wide_mm, int64_t, double, MM_CMP_SCALAR, MM_EQ_SCALAR)
+DEFINE_MULTIMAP(str_mm, const char *, int, strcmp, MM_EQ_SCALAR)
+
+
+/* The number of keys added to each multimap.  Keys are added in scrambled
+ * order, so that the tree has some depth.
+ */
+#define NUM_KEYS 1000
+
+
+int failures = 0;
+
+
+/* Prints the outcome of a check, and counts it if it failed. */
+void report(const char *what, int check_failures) {
+    printf(" * %s:  %s\n", what, check_failures == 0 ? "PASS" : "FAIL");
+    failures += check_failures;
+}
+
+
+/* The i-th key of the 64-bit multimap; all of them need more than 32 bits.
+ * Keys are spaced 3 apart, so the keys in between can be probed.
+ */
+int64_t wide_key(int i) {
+    return ((int64_t) 1 << 40) + (int64_t) (i * 7919 % NUM_KEYS) * 3;
+}
+
+
+void test_wide_keys() {
+    wide_mm mm;
+    wide_mm_iter it;
+    const double *values;
+    int64_t key, prev;
+    int i, num_values, check_failures, num_keys;
+
+    printf("\nTesting 64-bit keys with double values.\n");
+    wide_mm_init(&mm);
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        wide_mm_add(&mm, wide_key(i), i + 0.5);
+        wide_mm_add(&mm, wide_key(i), -(i + 0.5));
+    }
+
+    check_failures = 0;
+    for (i = 0; i < NUM_KEYS; i++) {
+        if (!wide_mm_contains_key(&mm, wide_key(i)) ||
+            wide_mm_contains_key(&mm, wide_key(i) + 1) ||
+            wide_mm_contains_key(&mm, wide_key(i) - (1LL << 40)) ||
+            !wide_mm_contains_pair(&mm, wide_key(i), i + 0.5) ||
+            wide_mm_contains_pair(&mm, wide_key(i), i + 0.75))
+            check_failures++;
+    }
+    report("probes of keys and pairs", check_failures);
+
+    /* Remove the keys with odd i, and one value of the rest. */
+    check_failures = 0;
+    for (i = 0; i < NUM_KEYS; i++) {
+        if (i % 2 == 1) {
+            if (!wide_mm_remove_key(&mm, wide_key(i)))
+                check_failures++;
+        }
+        else if (!wide_mm_remove_pair(&mm, wide_key(i), -(i + 0.5))) {
+            check_failures++;
+        }
+    }
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        if (wide_mm_contains_key(&mm, wide_key(i)) != (i % 2 == 0) ||
+            wide_mm_contains_pair(&mm, wide_key(i), -(i + 0.5)))
+            check_failures++;
+    }
+    report("removals", check_failures);
+
+    /* Every remaining key, in order, with one value each. */
+    check_failures = 0;
+    num_keys = 0;
+    prev = 0;
+    wide_mm_iter_init(&it, &mm, (int64_t) 1 << 40, INT64_MAX);
+    while (wide_mm_iter_next(&it, &key, &values, &num_values)) {
+        if ((num_keys > 0 && key <= prev) || num_values != 1)
+            check_failures++;
+        prev = key;
+        num_keys++;
+    }
+    wide_mm_iter_release(&it);
+
+    if (num_keys != NUM_KEYS / 2)
+        check_failures++;
+    report("iteration order", check_failures);
+
+    wide_mm_clear(&mm);
+}
+
+
+/* The string keys, generated by init_str_keys(). */
+char str_keys[NUM_KEYS][16];
+
+
+void init_str_keys() {
+    int i;
+    for (i = 0; i < NUM_KEYS; i++)
+        sprintf(str_keys[i], "key%05d", i * 7919 % NUM_KEYS);
+}
+
+
+int str_pairs;
+
+void count_str_pair(const char *key, int value) {
+    str_pairs++;
+}
+
+
+void test_string_keys() {
+    str_mm mm;
+    str_mm_iter it;
+    const int *values;
+    const char *key;
+    char probe[16];
+    int i, num_values, check_failures, num_keys;
+
+    printf("\nTesting string keys.\n");
+    init_str_keys();
+    str_mm_init(&mm);
+
+    for (i = 0; i < NUM_KEYS; i++)
+        str_mm_add(&mm, str_keys[i], i);
+
+    /* Probe with copies of the keys, so that only the contents match. */
+    check_failures = 0;
+    for (i = 0; i < NUM_KEYS; i++) {
+        strcpy(probe, str_keys[i]);
+        if (!str_mm_contains_key(&mm, probe) ||
+            !str_mm_contains_pair(&mm, probe, i) ||
+            str_mm_contains_pair(&mm, probe, i + 1))
+            check_failures++;
+
+        strcat(probe, "x");
+        if (str_mm_contains_key(&mm, probe))
+            check_failures++;
+    }
+    report("probes of keys and pairs", check_failures);
+
+    /* The keys from "key00100" to "key00199", in order. */
+    check_failures = 0;
+    num_keys = 0;
+    str_mm_iter_init(&it, &mm, "key00100", "key00199");
+    while (str_mm_iter_next(&it, &key, &values, &num_values)) {
+        sprintf(probe, "key%05d", 100 + num_keys);
+        if (strcmp(key, probe) != 0 || num_values != 1)
+            check_failures++;
+        num_keys++;
+    }
+    str_mm_iter_release(&it);
+
+    if (num_keys != 100)
+        check_failures++;
+    report("range iteration", check_failures);
+
+    str_pairs = 0;
+    for (i = 0; i < NUM_KEYS; i += 2)
+        str_mm_remove_pair(&mm, str_keys[i], i);
+    str_mm_traverse(&mm, count_str_pair);
+    report("removals and traversal", str_pairs != NUM_KEYS / 2);
+
+    str_mm_clear(&mm);
+}
+
+
+int main() {
+    test_wide_keys();
+    test_string_keys();
+
+    printf("\nFinal results:  %d failures\n", failures);
+    return 0;
+}